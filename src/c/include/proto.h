@@ -39,6 +39,8 @@ extern "C" {
 #define ZOO_CLOSE_OP -11
 #define ZOO_SETAUTH_OP 100
 #define ZOO_SETWATCHES_OP 101
+#define ZOO_SETWATCHES2_OP 105
+#define ZOO_ADDWATCH_OP 106
 
 #ifdef __cplusplus
 }
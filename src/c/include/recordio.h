@@ -68,8 +68,34 @@ struct oarchive {
 
 struct oarchive *create_buffer_oarchive(void);
 void close_buffer_oarchive(struct oarchive **oa, int free_buffer);
+/* for callers that manage the memory of the archive themselves: storage
+ * must hold buffer_oarchive_size() bytes, and release_buffer_oarchive()
+ * frees everything but the storage */
+size_t buffer_oarchive_size(void);
+struct oarchive *init_buffer_oarchive(void *storage);
+/* like init_buffer_oarchive(), with a buffer of len bytes to start with that
+ * is preceded by reserve bytes left to the caller: get_buffer() points right
+ * after them, so they are at get_buffer() - reserve */
+struct oarchive *init_reserved_buffer_oarchive(void *storage, int32_t reserve,
+        int32_t len);
+/* an archive that stores nothing and only adds the number of bytes that
+ * serializing into a buffer archive would take to *size */
+void init_size_oarchive(struct oarchive *oa, int32_t *size);
+void release_buffer_oarchive(struct oarchive *oa, int free_buffer);
 struct iarchive *create_buffer_iarchive(char *buffer, int len);
+/* like create_buffer_iarchive(), but deserialized buffers and strings point
+ * into buffer instead of being copied: buffer gets modified in place and
+ * must outlive them, and they must not be deallocated (vector arrays are
+ * still allocated and need freeing) */
+struct iarchive *create_borrowed_buffer_iarchive(char *buffer, int len);
 void close_buffer_iarchive(struct iarchive **ia);
+struct String_vector;
+/* deserializes a string vector from a buffer iarchive into one block: the
+ * array of pointers followed by the names it points at. Release it with
+ * deallocate_String_vector_arena() */
+int deserialize_String_vector_arena(struct iarchive *ia, const char *tag,
+        struct String_vector *v);
+void deallocate_String_vector_arena(struct String_vector *v);
 char *get_buffer(struct oarchive *);
 int get_buffer_len(struct oarchive *);
 
@@ -173,6 +173,25 @@ extern ZOOAPI const int ZOO_EPHEMERAL;
 extern ZOOAPI const int ZOO_SEQUENCE;
 // @}
 
+/**
+ * @name Add Watch Modes
+ *
+ * These modes are used by \ref zoo_add_watch to choose the kind of
+ * persistent watch. Unlike the watches set by the read calls, persistent
+ * watches are not removed when they fire; they stay until the session ends.
+ */
+// @{
+/**
+ * \brief all events of the node, including changes of its children list.
+ */
+extern ZOOAPI const int ZOO_ADD_WATCH_PERSISTENT;
+/**
+ * \brief the created, changed and deleted events of the node and of every
+ * node below it.
+ */
+extern ZOOAPI const int ZOO_ADD_WATCH_PERSISTENT_RECURSIVE;
+// @}
+
 /**
  * @name State Consts
  * These constants represent the states of a zookeeper connection. They are
@@ -257,6 +276,26 @@ typedef struct {
     char passwd[16];
 } clientid_t;
 
+/**
+ * \brief allocation counters of one of the object pools of a handle.
+ */
+typedef struct {
+    int64_t hits; /* allocations served by recycling a released object */
+    int64_t misses; /* allocations that went to the system allocator */
+} zoo_pool_counters_t;
+
+/**
+ * \brief allocation counters of the object pools of a handle.
+ *
+ * \see zoo_get_pool_stats
+ */
+typedef struct {
+    zoo_pool_counters_t completions; /* pending request completions */
+    zoo_pool_counters_t buffers; /* queued packets */
+    zoo_pool_counters_t archives; /* request serialization archives */
+    zoo_pool_counters_t watchers; /* watcher registrations */
+} zoo_pool_stats_t;
+
 /**
  * \brief zoo_op structure.
  *
@@ -449,6 +488,81 @@ typedef void (*watcher_fn)(zhandle_t *zh, int type,
 ZOOAPI zhandle_t *zookeeper_init(const char *host, watcher_fn fn,
   int recv_timeout, const clientid_t *clientid, void *context, int flags);
 
+#ifdef THREADED
+/**
+ * \brief a shared event loop that runs the IO of many handles.
+ *
+ * Every handle of the multithreaded library normally starts two threads of
+ * its own, one for the IO and one for the completions. An application that
+ * keeps many sessions open can instead create a reactor with a small, fixed
+ * number of threads and create its handles with \ref zookeeper_init_reactor.
+ * One of the reactor threads serves each such handle, and it also calls the
+ * completions and the watchers of the handle. These callbacks must not block;
+ * in particular they must not call the synchronous API.
+ *
+ * The reactor is built on epoll and is only available on Linux.
+ */
+typedef struct _zoo_reactor zoo_reactor_t;
+
+/**
+ * \brief create a reactor.
+ *
+ * \param threads the number of threads, from 1 to 64
+ * \return the reactor, or NULL if it could not be created, in which case
+ * errno indicates the reason.
+ */
+ZOOAPI zoo_reactor_t *zoo_reactor_create(int threads);
+
+/**
+ * \brief stop the threads of a reactor and free it.
+ *
+ * All the handles served by the reactor must have been closed before.
+ * This function must not be called from a callback.
+ *
+ * \param reactor the reactor obtained by a call to \ref zoo_reactor_create
+ * \return ZOK, or ZINVALIDSTATE if the reactor still serves some handles
+ */
+ZOOAPI int zoo_reactor_destroy(zoo_reactor_t *reactor);
+
+/**
+ * \brief create a handle served by a reactor.
+ *
+ * The same as \ref zookeeper_init, except that the handle does not start
+ * threads of its own; its IO and callbacks run on one of the threads of
+ * the reactor instead. \ref zookeeper_close takes the handle off the
+ * reactor again.
+ *
+ * \param reactor the reactor obtained by a call to \ref zoo_reactor_create
+ */
+ZOOAPI zhandle_t *zookeeper_init_reactor(zoo_reactor_t *reactor,
+  const char *host, watcher_fn fn, int recv_timeout,
+  const clientid_t *clientid, void *context, int flags);
+
+/**
+ * \brief call the completions and the watchers on several threads.
+ *
+ * By default a single thread calls all the completions and watchers of a
+ * handle, one after the other, so one slow callback holds up the others.
+ * With more than one thread the callbacks are spread over that many worker
+ * threads by the path of the request or of the event. The callbacks for the
+ * same path are still called one at a time and in order, and so are the
+ * session events together with the completions of the requests that have
+ * no path. Callbacks for different paths run concurrently, in no particular
+ * order. Since the callbacks no longer run on a reactor thread, they may
+ * block, even on handles served by a reactor.
+ *
+ * Call this right after the handle is created, before issuing any request.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param threads the number of threads, from 1 (the default) to 64
+ * \return ZOK on success, or one of the following errcodes on failure:
+ * ZBADARGUMENTS - invalid input parameters
+ * ZINVALIDSTATE - the threads were already set, or the handle is closing
+ * ZSYSTEMERROR - the threads could not be started
+ */
+ZOOAPI int zoo_set_completion_threads(zhandle_t *zh, int threads);
+#endif
+
 /**
  * \brief close the zookeeper handle and free up any resources.
  * 
@@ -486,6 +600,51 @@ ZOOAPI const clientid_t *zoo_client_id(zhandle_t *zh);
  */
 ZOOAPI int zoo_recv_timeout(zhandle_t *zh);
 
+/**
+ * \brief set the deadline for the requests issued through this handle.
+ *
+ * A request that has not been answered within the given time completes
+ * with ZOPERATIONTIMEOUT, and its response is discarded should it arrive
+ * later. Unlike a session timeout this does not drop the connection. The
+ * deadline applies to the requests issued after the call.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param timeout the deadline in milliseconds, 0 (the default) for none
+ */
+ZOOAPI void zoo_set_request_timeout(zhandle_t *zh, int timeout);
+
+/**
+ * \brief return the request deadline set by \ref zoo_set_request_timeout.
+ */
+ZOOAPI int zoo_get_request_timeout(zhandle_t *zh);
+
+/**
+ * \brief allow persistent watches to be set through this handle.
+ *
+ * Persistent watches need servers of version 3.6 or later, which the client
+ * cannot tell from the handshake: an older server drops the request without
+ * an answer. Until they are enabled \ref zoo_aadd_watch and \ref zoo_add_watch
+ * fail with ZUNIMPLEMENTED.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param enable non zero if every server of the ensemble supports persistent
+ * watches, 0 (the default) otherwise
+ */
+ZOOAPI void zoo_set_persistent_watches(zhandle_t *zh, int enable);
+
+/**
+ * \brief return the allocation counters of the object pools of this handle.
+ *
+ * The handle recycles the small objects it allocates for every request
+ * through per-handle free lists. The counters accumulate over the lifetime
+ * of the handle; a low hit rate under steady load means the pools are not
+ * doing their job.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param stats the structure to fill in
+ */
+ZOOAPI void zoo_get_pool_stats(zhandle_t *zh, zoo_pool_stats_t *stats);
+
 /**
  * \brief return the context for this handle.
  */
@@ -820,6 +979,37 @@ ZOOAPI int zoo_adelete(zhandle_t *zh, const char *path, int version,
 ZOOAPI int zoo_aexists(zhandle_t *zh, const char *path, int watch, 
         stat_completion_t completion, const void *data);
 
+/**
+ * \brief sets a persistent watch on a node.
+ * 
+ * The watcher is called for every matching event until the session ends;
+ * the watch is set again by the client after it reconnects. Servers older
+ * than 3.6 do not support persistent watches, so they have to be enabled
+ * with \ref zoo_set_persistent_watches first.
+ * 
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param path the name of the node. Expressed as a file name with slashes 
+ * separating ancestors of the node. The node need not exist.
+ * \param mode ZOO_ADD_WATCH_PERSISTENT to watch the node, or
+ * ZOO_ADD_WATCH_PERSISTENT_RECURSIVE to watch it and all the nodes below it.
+ * \param watcher the function to call when the watch fires.
+ * \param watcherCtx user specific data, will be passed to the watcher callback.
+ * \param completion the routine to invoke when the request completes. The completion
+ * will be triggered with one of the following codes passed in as the rc argument:
+ * ZOK operation completed successfully
+ * ZNOAUTH the client does not have permission.
+ * \param data the data that will be passed to the completion routine when the 
+ * function completes.
+ * \return ZOK on success or one of the following errcodes on failure:
+ * ZBADARGUMENTS - invalid input parameters
+ * ZUNIMPLEMENTED - persistent watches are not enabled on this handle
+ * ZINVALIDSTATE - zhandle state is either ZOO_SESSION_EXPIRED_STATE or ZOO_AUTH_FAILED_STATE
+ * ZMARSHALLINGERROR - failed to marshall a request; possibly, out of memory
+ */
+ZOOAPI int zoo_aadd_watch(zhandle_t *zh, const char *path, int mode,
+        watcher_fn watcher, void* watcherCtx,
+        void_completion_t completion, const void *data);
+
 /**
  * \brief checks the existence of a node in zookeeper.
  * 
@@ -1181,6 +1371,95 @@ ZOOAPI int zoo_add_auth(zhandle_t *zh,const char* scheme,const char* cert,
  */
 ZOOAPI int is_unrecoverable(zhandle_t *zh);
 
+/**
+ * \brief the number of buckets of a latency histogram.
+ *
+ * Bucket i < 16 counts the latencies of i microseconds. Above that each
+ * power of 2 is split in 16 buckets, so a latency is known to within 1/16.
+ * \ref zoo_latency_bucket_floor gives the lowest latency of a bucket.
+ */
+#define ZOO_LATENCY_BUCKETS 464
+
+/**
+ * \brief the latencies of the requests of one type.
+ *
+ * A latency is the time from the queueing of the request to the reading of
+ * its response; requests that get no response are not counted.
+ */
+struct zoo_op_latency {
+    int op; /* the ZOO_*_OP of the requests, see proto.h */
+    int64_t count;
+    int64_t total_us;
+    int64_t max_us;
+    int64_t buckets[ZOO_LATENCY_BUCKETS];
+};
+
+#define ZOO_METRICS_MAX_OPS 16
+
+/**
+ * \brief the request latencies of a handle, see \ref zoo_get_metrics.
+ */
+struct zoo_metrics {
+    int count; /* of the request types that were sent */
+    struct zoo_op_latency ops[ZOO_METRICS_MAX_OPS];
+};
+
+/**
+ * \brief gets the request latencies of a handle.
+ *
+ * The histograms are copied while the IO goes on, so the counts of a copy
+ * may be a few requests apart from each other.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param metrics the latencies, per type of request.
+ * \return ZOK or ZBADARGUMENTS
+ */
+ZOOAPI int zoo_get_metrics(zhandle_t *zh, struct zoo_metrics *metrics);
+
+/**
+ * \brief the lowest latency, in microseconds, of a histogram bucket.
+ */
+ZOOAPI int64_t zoo_latency_bucket_floor(int bucket);
+
+/**
+ * \brief the latency, in microseconds, below which the given percentage of
+ * the requests completed; 0 if there were none.
+ *
+ * \param latency the latencies, see \ref zoo_get_metrics
+ * \param percentile from 0 to 100, e.g. 99.9
+ */
+ZOOAPI int64_t zoo_latency_percentile(const struct zoo_op_latency *latency,
+        double percentile);
+
+/**
+ * \brief a snapshot of the queues and counters of a handle, see
+ * \ref zoo_get_stats.
+ */
+struct zoo_stats {
+    int32_t to_send; /* requests queued and not yet written */
+    int32_t sent_requests; /* requests written and awaiting their response */
+    int32_t to_process; /* responses read and not yet processed */
+    int32_t completions; /* completions waiting to be called */
+    int64_t bytes_sent;
+    int64_t bytes_received;
+    int32_t connects; /* sessions established or re-established */
+    int32_t disconnects; /* connections lost or closed */
+    int32_t watched_paths; /* paths with data, exists or child watches */
+    int32_t persistent_watched_paths; /* paths with persistent watches */
+};
+
+/**
+ * \brief gets the queue depths and the traffic counters of a handle.
+ *
+ * Reading them takes no lock, so a snapshot taken while requests are in
+ * flight may be a request apart from one queue to the next.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param stats the snapshot
+ * \return ZOK or ZBADARGUMENTS
+ */
+ZOOAPI int zoo_get_stats(zhandle_t *zh, struct zoo_stats *stats);
+
 /**
  * \brief sets the debugging level for the library 
  */
@@ -1195,6 +1474,25 @@ ZOOAPI void zoo_set_debug_level(ZooLogLevel logLevel);
  */
 ZOOAPI void zoo_set_log_stream(FILE* logStream);
 
+#ifdef THREADED
+/**
+ * \brief turns the asynchronous logging on or off.
+ * 
+ * By default each message is written and flushed by the thread that logs
+ * it, the IO thread included. With asynchronous logging the message is
+ * queued and a background thread writes the queued messages out in batches.
+ * Messages are truncated to 479 characters; if the queue is full they are
+ * dropped, and the number dropped is logged in their place. Turning it off
+ * waits until the queued messages are written, which is also done at exit.
+ * Turn it off before closing the log stream. Not available on Windows.
+ * 
+ * \param enable nonzero to turn it on, 0 to turn it off.
+ * \return ZOK, ZSYSTEMERROR if the thread could not be started or
+ * ZUNIMPLEMENTED if the platform does not support it.
+ */
+ZOOAPI int zoo_set_log_async(int enable);
+#endif
+
 /**
  * \brief enable/disable quorum endpoint order randomization
  * 
@@ -1291,6 +1589,28 @@ ZOOAPI int zoo_delete(zhandle_t *zh, const char *path, int version);
  */
 ZOOAPI int zoo_exists(zhandle_t *zh, const char *path, int watch, struct Stat *stat);
 
+/**
+ * \brief sets a persistent watch on a node synchronously.
+ * 
+ * See \ref zoo_aadd_watch.
+ * 
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param path the name of the node. Expressed as a file name with slashes 
+ * separating ancestors of the node.
+ * \param mode ZOO_ADD_WATCH_PERSISTENT or ZOO_ADD_WATCH_PERSISTENT_RECURSIVE.
+ * \param watcher the function to call when the watch fires.
+ * \param watcherCtx user specific data, will be passed to the watcher callback.
+ * \return  return code of the function call.
+ * ZOK operation completed successfully
+ * ZNOAUTH the client does not have permission.
+ * ZBADARGUMENTS - invalid input parameters
+ * ZUNIMPLEMENTED - persistent watches are not enabled on this handle
+ * ZINVALIDSTATE - zhandle state is either ZOO_SESSION_EXPIRED_STATE or ZOO_AUTH_FAILED_STATE
+ * ZMARSHALLINGERROR - failed to marshall a request; possibly, out of memory
+ */
+ZOOAPI int zoo_add_watch(zhandle_t *zh, const char *path, int mode,
+        watcher_fn watcher, void* watcherCtx);
+
 /**
  * \brief checks the existence of a node in zookeeper synchronously.
  * 
@@ -1371,6 +1691,62 @@ ZOOAPI int zoo_wget(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx, 
         char *buffer, int* buffer_len, struct Stat *stat);
 
+/**
+ * \brief enables the cache of \ref zoo_cached_get, or changes its budget.
+ *
+ * Call it before the cache is used. Passing 0 later on empties the cache;
+ * until a budget is set again \ref zoo_cached_get is \ref zoo_get without a
+ * watch.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param max_bytes the most memory the cached nodes may take, data and
+ * bookkeeping together. The least recently read nodes make room for new ones.
+ * \return ZOK, ZBADARGUMENTS or ZSYSTEMERROR
+ */
+ZOOAPI int zoo_enable_cache(zhandle_t *zh, size_t max_bytes);
+
+/**
+ * \brief gets the data of a node, from the cache if it is there.
+ *
+ * A node that is not cached is read with a data watch and cached, once it
+ * was read in full. The cached copy is dropped when a change or the deletion
+ * of the node is notified, or when the session expires; until then it may be
+ * as stale as any other read, e.g. while the client is disconnected.
+ * Without \ref zoo_enable_cache this is \ref zoo_get without a watch.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param path the name of the node. Expressed as a file name with slashes 
+ * separating ancestors of the node.
+ * \param buffer the buffer holding the node data
+ * \param buffer_len is the size of the buffer pointed to by the buffer parameter.
+ * It'll be set to the actual data length upon return. If the data is NULL, length is -1.
+ * \param stat if not NULL, will hold the value of stat for the path on return.
+ * \return the same as \ref zoo_get
+ */
+ZOOAPI int zoo_cached_get(zhandle_t *zh, const char *path, char *buffer,
+        int* buffer_len, struct Stat *stat);
+
+/**
+ * \brief the counters of the cache of \ref zoo_cached_get.
+ */
+struct zoo_cache_stats {
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions; /* nodes dropped to stay within the budget */
+    int64_t invalidations; /* nodes dropped as they changed */
+    int32_t entries; /* nodes cached or being read */
+    int64_t bytes;
+};
+
+/**
+ * \brief gets the counters of the cache of \ref zoo_cached_get.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param stats the counters, all 0 if the cache was never enabled
+ * \return ZOK or ZBADARGUMENTS
+ */
+ZOOAPI int zoo_get_cache_stats(zhandle_t *zh, struct zoo_cache_stats *stats);
+
 /**
  * \brief sets the data associated with a node. See zoo_set2 function if
  * you require access to the stat information associated with the znode.
@@ -1470,6 +1846,56 @@ ZOOAPI int zoo_wget_children(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx,
         struct String_vector *strings);
 
+/**
+ * \brief lists the children of a node synchronously into a single block.
+ * 
+ * This function is similar to \ref zoo_get_children except that the names
+ * and the array pointing at them share one allocation, which saves a malloc
+ * and a free per child on large directories. The result must be released
+ * with deallocate_String_vector_arena() rather than deallocate_String_vector().
+ * 
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param path the name of the node. Expressed as a file name with slashes 
+ * separating ancestors of the node.
+ * \param watch if nonzero, a watch will be set at the server to notify 
+ * the client if the node changes.
+ * \param strings return value of children paths.
+ * \return the return code of the function.
+ * ZOK operation completed successfully
+ * ZNONODE the node does not exist.
+ * ZNOAUTH the client does not have permission.
+ * ZBADARGUMENTS - invalid input parameters
+ * ZINVALIDSTATE - zhandle state is either ZOO_SESSION_EXPIRED_STATE or ZOO_AUTH_FAILED_STATE
+ * ZMARSHALLINGERROR - failed to marshall a request; possibly, out of memory
+ */
+ZOOAPI int zoo_get_children_arena(zhandle_t *zh, const char *path, int watch,
+                            struct String_vector *strings);
+
+/**
+ * \brief lists the children of a node synchronously into a single block.
+ * 
+ * This function is similar to \ref zoo_get_children_arena except it allows
+ * one specify a watcher object rather than a boolean watch flag.
+ * 
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param path the name of the node. Expressed as a file name with slashes 
+ * separating ancestors of the node.
+ * \param watcher if non-null, a watch will be set at the server to notify 
+ * the client if the node changes.
+ * \param watcherCtx user specific data, will be passed to the watcher callback.
+ * \param strings return value of children paths.
+ * \return the return code of the function.
+ * ZOK operation completed successfully
+ * ZNONODE the node does not exist.
+ * ZNOAUTH the client does not have permission.
+ * ZBADARGUMENTS - invalid input parameters
+ * ZINVALIDSTATE - zhandle state is either ZOO_SESSION_EXPIRED_STATE or ZOO_AUTH_FAILED_STATE
+ * ZMARSHALLINGERROR - failed to marshall a request; possibly, out of memory
+ */
+ZOOAPI int zoo_wget_children_arena(zhandle_t *zh, const char *path, 
+        watcher_fn watcher, void* watcherCtx,
+        struct String_vector *strings);
+
 /**
  * \brief lists the children of a node and get its stat synchronously.
  * 
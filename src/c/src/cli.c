@@ -275,6 +275,57 @@ void od_completion(int rc, const struct Stat *stat, const void *data) {
     }
 }
 
+static const char *op2String(int op) {
+    switch (op) {
+    case ZOO_CREATE_OP: return "create";
+    case ZOO_DELETE_OP: return "delete";
+    case ZOO_EXISTS_OP: return "exists";
+    case ZOO_GETDATA_OP: return "get";
+    case ZOO_SETDATA_OP: return "set";
+    case ZOO_GETACL_OP: return "getacl";
+    case ZOO_SETACL_OP: return "setacl";
+    case ZOO_GETCHILDREN_OP: return "ls";
+    case ZOO_GETCHILDREN2_OP: return "ls2";
+    case ZOO_SYNC_OP: return "sync";
+    case ZOO_PING_OP: return "ping";
+    case ZOO_MULTI_OP: return "multi";
+    case ZOO_CLOSE_OP: return "close";
+    case ZOO_ADDWATCH_OP: return "addwatch";
+    }
+    return "unknown";
+}
+
+static void printStats() {
+    struct zoo_stats stats;
+    struct zoo_metrics *metrics;
+    int i;
+    if (zoo_get_stats(zh, &stats) != ZOK)
+        return;
+    printf("to send = %d, sent = %d, to process = %d, completions = %d\n",
+            stats.to_send, stats.sent_requests, stats.to_process,
+            stats.completions);
+    printf("bytes sent = %lld, bytes received = %lld\n",
+            _LL_CAST_ stats.bytes_sent, _LL_CAST_ stats.bytes_received);
+    printf("connects = %d, disconnects = %d\n",
+            stats.connects, stats.disconnects);
+    printf("watched paths = %d, persistent = %d\n",
+            stats.watched_paths, stats.persistent_watched_paths);
+    metrics = malloc(sizeof(*metrics));
+    if (!metrics || zoo_get_metrics(zh, metrics) != ZOK) {
+        free(metrics);
+        return;
+    }
+    for (i = 0; i < metrics->count; i++) {
+        struct zoo_op_latency *l = &metrics->ops[i];
+        printf("%-8s count = %lld, p50 = %lldus, p99 = %lldus, max = %lldus\n",
+                op2String(l->op), _LL_CAST_ l->count,
+                _LL_CAST_ zoo_latency_percentile(l, 50),
+                _LL_CAST_ zoo_latency_percentile(l, 99),
+                _LL_CAST_ l->max_us);
+    }
+    free(metrics);
+}
+
 int startsWith(const char *line, const char *prefix) {
     int len = strlen(prefix);
     return strncmp(line, prefix, len) == 0;
@@ -299,6 +350,7 @@ void processline(char *line) {
       fprintf(stderr, "    sync <path>\n");
       fprintf(stderr, "    exists <path>\n");
       fprintf(stderr, "    myid\n");
+      fprintf(stderr, "    stats\n");
       fprintf(stderr, "    verbose\n");
       fprintf(stderr, "    addauth <id> <scheme>\n");
       fprintf(stderr, "    quit\n");
@@ -447,6 +499,8 @@ void processline(char *line) {
         }
     } else if (strcmp(line, "myid") == 0) {
         printf("session Id = %llx\n", _LL_CAST_ zoo_client_id(zh)->client_id);
+    } else if (strcmp(line, "stats") == 0) {
+        printStats();
     } else if (strcmp(line, "reinit") == 0) {
         zookeeper_close(zh);
         // we can't send myid to the server here -- zookeeper_close() removes 
@@ -28,6 +28,7 @@
 #endif
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 
 static zhandle_t *zh;
 
@@ -223,6 +224,32 @@ int recursiveDelete(const char* root){
     return rc;
 }
 
+static double now_seconds(){
+    struct timeval tv;
+    gettimeofday(&tv,0);
+    return tv.tv_sec+tv.tv_usec/1000000.0;
+}
+
+static void logPhase(const char* phase, int count, double started){
+    double elapsed=now_seconds()-started;
+    LOG_INFO(("%s: %d ops in %.3f sec (%.0f ops/sec)",phase,count,elapsed,
+            elapsed>0?count/elapsed:0));
+}
+
+static double hitRate(const zoo_pool_counters_t* c){
+    int64_t total=c->hits+c->misses;
+    return total==0?0:100.0*c->hits/total;
+}
+
+static void logPoolStats(){
+    zoo_pool_stats_t stats;
+    zoo_get_pool_stats(zh,&stats);
+    LOG_INFO(("Pool hit rates: completions %.1f%%, buffers %.1f%%, "
+            "archives %.1f%%, watchers %.1f%%",hitRate(&stats.completions),
+            hitRate(&stats.buffers),hitRate(&stats.archives),
+            hitRate(&stats.watchers)));
+}
+
 void usage(char *argv[]){
     fprintf(stderr, "USAGE:\t%s zookeeper_host_list path #children\nor", argv[0]);
     fprintf(stderr, "\t%s zookeeper_host_list path clean\n", argv[0]);
@@ -261,21 +288,31 @@ int main(int argc, char **argv) {
     nodeCount=atoi(argv[3]);
     createRoot(argv[2]);
     while(1) {
+        double started;
         ensureConnected();
         LOG_INFO(("Creating children for path %s",argv[2]));
+        started=now_seconds();
         doCreateNodes(argv[2],nodeCount);
         waitCounter();
+        logPhase("create",nodeCount,started);
         
         LOG_INFO(("Starting the write cycle for path %s",argv[2]));
+        started=now_seconds();
         doWrites(argv[2],nodeCount);
         waitCounter();
+        logPhase("write",nodeCount,started);
         LOG_INFO(("Starting the read cycle for path %s",argv[2]));
+        started=now_seconds();
         doReads(argv[2],nodeCount);
         waitCounter();
+        logPhase("read",nodeCount,started);
 
         LOG_INFO(("Starting the delete cycle for path %s",argv[2]));
+        started=now_seconds();
         doDeletes(argv[2],nodeCount);
         waitCounter();
+        logPhase("delete",nodeCount,started);
+        logPoolStats();
     }
     zookeeper_close(zh);
     return 0;
@@ -0,0 +1,907 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of the client internals that do not need a running
+ * server. Usage: micro_bench <benchmark> [args]
+ */
+
+#include "zk_adaptor.h"
+#include "zookeeper_log.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static double now_seconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// *****************************************************************************
+// buffer queue: N producers, one consumer
+
+static buffer_head_t queue;
+static object_pool_t queue_pool;
+static int queue_ops_per_thread;
+
+static void *queue_producer(void *arg)
+{
+    int i;
+    for (i = 0; i < queue_ops_per_thread; i++) {
+        while (queue_buffer_bytes(&queue, 0, 0) != ZOK)
+            sched_yield();
+    }
+    return 0;
+}
+
+static double run_queue_round(int producers)
+{
+    pthread_t *threads = calloc(producers, sizeof(pthread_t));
+    int total = producers * queue_ops_per_thread;
+    int received = 0;
+    double started;
+    int i;
+
+    started = now_seconds();
+    for (i = 0; i < producers; i++)
+        pthread_create(&threads[i], 0, queue_producer, 0);
+    while (received < total) {
+        buffer_list_t *b = dequeue_buffer(&queue);
+        if (b) {
+            free_buffer(b);
+            received++;
+        } else {
+            sched_yield();
+        }
+    }
+    for (i = 0; i < producers; i++)
+        pthread_join(threads[i], 0);
+    free(threads);
+    return total / (now_seconds() - started);
+}
+
+static int bench_queue(int argc, char **argv)
+{
+    int max_threads = argc > 0 ? atoi(argv[0]) : 8;
+    int threads;
+    pthread_mutexattr_t attr;
+
+    queue_ops_per_thread = argc > 1 ? atoi(argv[1]) : 1000000;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&queue.lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&queue_pool.lock, 0);
+    init_object_pool(&queue_pool, sizeof(buffer_list_t), OBJECT_POOL_MAX_FREE);
+    init_buffer_list(&queue, &queue_pool);
+
+    printf("%-10s %15s\n", "producers", "ops/sec");
+    for (threads = 1; threads <= max_threads; threads *= 2)
+        printf("%-10d %15.0f\n", threads, run_queue_round(threads));
+    destroy_object_pool(&queue_pool);
+    pthread_mutex_destroy(&queue_pool.lock);
+    pthread_mutex_destroy(&queue.lock);
+    return 0;
+}
+
+// *****************************************************************************
+// reply matching: pop the head of a list and check its xid, as the client
+// did before requests were indexed, vs. doing the same on the doubly linked
+// list and removing the head from the request table through its slot hint,
+// as zookeeper_process() does now, with a given number of requests
+// outstanding. Only the reply side is timed; the requests are queued up
+// front.
+
+struct pending {
+    struct pending *next;
+    struct pending *prev;
+    int xid;
+    request_hint_t hint;
+};
+
+static double run_list_pop(int outstanding, int ops)
+{
+    struct pending *nodes = calloc(outstanding, sizeof(*nodes));
+    double elapsed = 0;
+    int done, i;
+
+    int xid = 0;
+
+    for (done = 0; done < ops; done += outstanding) {
+        struct pending *head = 0, *last = 0;
+        int first = xid;
+        double started;
+        for (i = 0; i < outstanding; i++) {
+            nodes[i].xid = xid++;
+            nodes[i].next = 0;
+            if (last)
+                last->next = &nodes[i];
+            else
+                head = &nodes[i];
+            last = &nodes[i];
+        }
+        started = now_seconds();
+        for (i = first; i < xid; i++) {
+            if (head->xid != i)
+                fprintf(stderr, "reply out of order\n");
+            head = head->next;
+            if (!head)
+                last = 0;
+        }
+        elapsed += now_seconds() - started;
+    }
+    free(nodes);
+    return elapsed * 1e9 / done;
+}
+
+static double run_table_remove(int outstanding, int ops)
+{
+    struct pending *nodes = calloc(outstanding, sizeof(*nodes));
+    request_table_t table;
+    double elapsed = 0;
+    int xid = 0;
+    int done, i;
+
+    memset(&table, 0, sizeof(table));
+    for (done = 0; done < ops; done += outstanding) {
+        struct pending *head = 0, *last = 0;
+        int first = xid;
+        double started;
+        for (i = 0; i < outstanding; i++) {
+            nodes[i].xid = xid++;
+            request_table_place(&table, nodes[i].xid,
+                    (struct _completion_list*)&nodes[i], &nodes[i].hint);
+            nodes[i].next = 0;
+            nodes[i].prev = last;
+            if (last)
+                last->next = &nodes[i];
+            else
+                head = &nodes[i];
+            last = &nodes[i];
+        }
+        started = now_seconds();
+        for (i = first; i < xid; i++) {
+            struct pending *n = head;
+            if (n->xid != i)
+                fprintf(stderr, "reply out of order\n");
+            request_table_remove_entry(&table, n->xid,
+                    (struct _completion_list*)n, &n->hint);
+            /* the prev of the head is not kept up to date */
+            head = n->next;
+            if (!head)
+                last = 0;
+        }
+        elapsed += now_seconds() - started;
+        if (head || last)
+            fprintf(stderr, "requests left after the replies\n");
+    }
+    request_table_destroy(&table);
+    free(nodes);
+    return elapsed * 1e9 / done;
+}
+
+static int bench_xid(int argc, char **argv)
+{
+    int ops = argc > 0 ? atoi(argv[0]) : 10000000;
+    int outstanding;
+
+    printf("%-12s %15s %15s\n", "outstanding", "list ns/op", "table ns/op");
+    for (outstanding = 1; outstanding <= 65536; outstanding *= 16)
+        printf("%-12d %15.1f %15.1f\n", outstanding,
+                run_list_pop(outstanding, ops),
+                run_table_remove(outstanding, ops));
+    return 0;
+}
+
+// *****************************************************************************
+// A stub server in a child process for the benchmarks below. It grants
+// every session, answers the pings and fails any other request with
+// ZNONODE.
+
+#define IDLE_SESSION_TIMEOUT 3000
+
+struct stub_conn {
+    char buf[256];
+    int len;
+    int primed;
+};
+
+/* Answers the complete frames in the buffer; returns -1 if the peer sent
+ * something the stub does not understand. */
+static int stub_serve(int fd, struct stub_conn *conn, int64_t *session_id)
+{
+    for (;;) {
+        int32_t len;
+        int32_t reply[10];
+        int reply_len;
+        if (conn->len < 4)
+            return 0;
+        memcpy(&len, conn->buf, 4);
+        len = ntohl(len);
+        if (len < 8 || len > (int)sizeof(conn->buf) - 4)
+            return -1;
+        if (conn->len < len + 4)
+            return 0;
+        memset(reply, 0, sizeof(reply));
+        if (!conn->primed) {
+            /* protocolVersion, timeOut, sessionId, a 16 byte passwd */
+            int64_t id = (*session_id)++;
+            reply[0] = htonl(36);
+            reply[2] = htonl(IDLE_SESSION_TIMEOUT);
+            reply[3] = htonl((int32_t)(id >> 32));
+            reply[4] = htonl((int32_t)id);
+            reply[5] = htonl(16);
+            reply_len = 40;
+            conn->primed = 1;
+        } else {
+            /* a reply header echoing the xid: xid, zxid, err */
+            int32_t xid, type;
+            memcpy(&xid, conn->buf + 4, 4);
+            memcpy(&type, conn->buf + 8, 4);
+            reply[0] = htonl(16);
+            reply[1] = xid;
+            reply[3] = htonl(1);
+            if (ntohl(xid) != PING_XID && ntohl(type) != ZOO_CLOSE_OP)
+                reply[4] = htonl(ZNONODE);
+            reply_len = 20;
+        }
+        if (send(fd, reply, reply_len, 0) != reply_len)
+            return -1;
+        conn->len -= len + 4;
+        memmove(conn->buf, conn->buf + len + 4, conn->len);
+    }
+}
+
+static void run_stub_server(int listener, int max_conns)
+{
+    struct pollfd *fds = calloc(max_conns + 1, sizeof(*fds));
+    struct stub_conn *conns = calloc(max_conns + 1, sizeof(*conns));
+    int64_t session_id = 1;
+    int nfds = 1;
+    int i;
+
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    for (;;) {
+        if (poll(fds, nfds, -1) <= 0)
+            continue;
+        if ((fds[0].revents & POLLIN) && nfds <= max_conns) {
+            int fd = accept(listener, 0, 0);
+            if (fd != -1) {
+                fds[nfds].fd = fd;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                memset(&conns[nfds], 0, sizeof(conns[nfds]));
+                nfds++;
+            }
+        }
+        for (i = 1; i < nfds; i++) {
+            struct stub_conn *conn = &conns[i];
+            int n;
+            if (!fds[i].revents)
+                continue;
+            n = recv(fds[i].fd, conn->buf + conn->len,
+                    sizeof(conn->buf) - conn->len, 0);
+            if (n > 0) {
+                conn->len += n;
+                if (stub_serve(fds[i].fd, conn, &session_id) == 0)
+                    continue;
+            }
+            close(fds[i].fd);
+            nfds--;
+            fds[i] = fds[nfds];
+            conns[i] = conns[nfds];
+            i--;
+        }
+    }
+}
+
+static pid_t start_stub_server(int max_conns, char *host, size_t host_len)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    pid_t pid;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener == -1 || bind(listener, (struct sockaddr*)&addr, len) == -1 ||
+            listen(listener, 1024) == -1 ||
+            getsockname(listener, (struct sockaddr*)&addr, &len) == -1) {
+        perror("stub server");
+        return -1;
+    }
+    snprintf(host, host_len, "127.0.0.1:%d", ntohs(addr.sin_port));
+    pid = fork();
+    if (pid == 0) {
+        run_stub_server(listener, max_conns);
+        _exit(0);
+    }
+    close(listener);
+    return pid;
+}
+
+// *****************************************************************************
+// idle sessions: the threads and the CPU time it takes to keep a number of
+// sessions alive, with a pair of threads per handle vs. a shared reactor.
+
+static volatile int32_t idle_connected;
+
+static void idle_watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+    if (type == ZOO_SESSION_EVENT && state == ZOO_CONNECTED_STATE)
+        fetch_and_add(&idle_connected, 1);
+}
+
+static int count_threads()
+{
+    char line[128];
+    int threads = 0;
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Threads: %d", &threads) == 1)
+            break;
+    }
+    fclose(f);
+    return threads;
+}
+
+/* The write() calls of the process so far, the wakeups of the IO thread
+ * among them; sends to the server go through sendmsg() instead. */
+static long count_writes()
+{
+    char line[128];
+    long writes = -1;
+    FILE *f = fopen("/proc/self/io", "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "syscw: %ld", &writes) == 1)
+            break;
+    }
+    fclose(f);
+    return writes;
+}
+
+static double cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+/* Returns 0 if all the sessions connected. */
+static int run_idle_round(const char *host, int sessions, int seconds,
+        int reactor_threads)
+{
+    zhandle_t **handles = calloc(sessions, sizeof(*handles));
+    zoo_reactor_t *reactor = 0;
+    char mode[32];
+    double started, cpu;
+    int threads;
+    int i;
+
+    if (reactor_threads > 0) {
+        reactor = zoo_reactor_create(reactor_threads);
+        if (!reactor) {
+            perror("zoo_reactor_create");
+            free(handles);
+            return -1;
+        }
+        snprintf(mode, sizeof(mode), "reactor(%d)", reactor_threads);
+    } else {
+        snprintf(mode, sizeof(mode), "dedicated");
+    }
+    atomic_set(&idle_connected, 0);
+    for (i = 0; i < sessions; i++) {
+        handles[i] = reactor ?
+            zookeeper_init_reactor(reactor, host, idle_watcher,
+                    IDLE_SESSION_TIMEOUT, 0, 0, 0) :
+            zookeeper_init(host, idle_watcher, IDLE_SESSION_TIMEOUT, 0, 0, 0);
+        if (!handles[i]) {
+            perror("zookeeper_init");
+            sessions = i;
+            break;
+        }
+    }
+    for (i = 0; i < 1000 && atomic_get(&idle_connected) < sessions; i++)
+        usleep(10000);
+
+    threads = count_threads();
+    started = now_seconds();
+    cpu = cpu_seconds();
+    sleep(seconds);
+    cpu = cpu_seconds() - cpu;
+    printf("%-12s %10d %10d %10d %20.1f\n", mode, sessions,
+            atomic_get(&idle_connected), threads,
+            cpu * 1e6 / sessions / (now_seconds() - started));
+
+    for (i = 0; i < sessions; i++)
+        zookeeper_close(handles[i]);
+    if (reactor)
+        zoo_reactor_destroy(reactor);
+    free(handles);
+    return atomic_get(&idle_connected) == sessions ? 0 : -1;
+}
+
+static int bench_idle(int argc, char **argv)
+{
+    int sessions = argc > 0 ? atoi(argv[0]) : 200;
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    int reactor_threads = argc > 2 ? atoi(argv[2]) : 2;
+    struct rlimit limit;
+    char host[64];
+    pid_t server;
+    int rc;
+
+    // a dedicated handle takes a socket and a pipe
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    zoo_set_debug_level(ZOO_LOG_LEVEL_ERROR);
+
+    server = start_stub_server(sessions, host, sizeof(host));
+    if (server == -1)
+        return 1;
+    printf("%-12s %10s %10s %10s %20s\n", "mode", "sessions", "connected",
+            "threads", "cpu us/session/sec");
+    rc = run_idle_round(host, sessions, seconds, 0);
+    rc |= run_idle_round(host, sessions, seconds, reactor_threads);
+    kill(server, SIGTERM);
+    waitpid(server, 0, 0);
+    return rc == 0 ? 0 : 1;
+}
+
+// *****************************************************************************
+// async bursts: a single thread issues a burst of asynchronous requests on
+// one handle and waits for all of them to complete. Each request wakes up
+// the IO thread.
+
+static volatile int32_t async_completed;
+
+static void async_completion(int rc, const struct Stat *stat, const void *data)
+{
+    fetch_and_add(&async_completed, 1);
+}
+
+static int bench_async(int argc, char **argv)
+{
+    int calls = argc > 0 ? atoi(argv[0]) : 10000;
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    double elapsed = 0, cpu = 0;
+    long writes = 0;
+    char host[64];
+    zhandle_t *zh;
+    pid_t server;
+    int round, i;
+
+    zoo_set_debug_level(ZOO_LOG_LEVEL_ERROR);
+    server = start_stub_server(1, host, sizeof(host));
+    if (server == -1)
+        return 1;
+    atomic_set(&idle_connected, 0);
+    zh = zookeeper_init(host, idle_watcher, 10000, 0, 0, 0);
+    for (i = 0; i < 1000 && atomic_get(&idle_connected) == 0; i++)
+        usleep(10000);
+    if (!zh || atomic_get(&idle_connected) == 0) {
+        fprintf(stderr, "could not connect to the stub server\n");
+        kill(server, SIGTERM);
+        waitpid(server, 0, 0);
+        return 1;
+    }
+    for (round = 0; round < rounds; round++) {
+        double started = now_seconds();
+        double cpu_started = cpu_seconds();
+        long writes_started = count_writes();
+        atomic_set(&async_completed, 0);
+        for (i = 0; i < calls; i++)
+            zoo_aexists(zh, "/node", 0, async_completion, 0);
+        while (atomic_get(&async_completed) < calls)
+            sched_yield();
+        elapsed += now_seconds() - started;
+        cpu += cpu_seconds() - cpu_started;
+        writes += count_writes() - writes_started;
+    }
+    printf("%-10s %15s %15s %15s\n", "burst", "calls/sec", "cpu us/call",
+            "writes/burst");
+    printf("%-10d %15.0f %15.2f %15.0f\n", calls,
+            (double)calls * rounds / elapsed,
+            cpu * 1e6 / ((double)calls * rounds), (double)writes / rounds);
+    zookeeper_close(zh);
+    kill(server, SIGTERM);
+    waitpid(server, 0, 0);
+    return 0;
+}
+
+// *****************************************************************************
+// sync completions: N threads go through the life cycle of the sync
+// completion of a synchronous call, without the call itself
+
+static int sync_ops_per_thread;
+
+static void *sync_caller(void *arg)
+{
+    int i;
+    for (i = 0; i < sync_ops_per_thread; i++) {
+        struct sync_completion *sc = alloc_sync_completion();
+        notify_sync_completion(sc);
+        wait_sync_completion(sc);
+        free_sync_completion(sc);
+    }
+    return 0;
+}
+
+static int bench_sync(int argc, char **argv)
+{
+    int max_threads = argc > 0 ? atoi(argv[0]) : 8;
+    int threads;
+    pthread_t tids[64];
+    sync_ops_per_thread = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (max_threads > 64)
+        max_threads = 64;
+
+    printf("%-10s %15s %15s\n", "threads", "calls/sec", "ns/call");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        double started = now_seconds(), elapsed;
+        int i;
+        for (i = 0; i < threads; i++)
+            pthread_create(&tids[i], 0, sync_caller, 0);
+        for (i = 0; i < threads; i++)
+            pthread_join(tids[i], 0);
+        elapsed = now_seconds() - started;
+        printf("%-10d %15.0f %15.1f\n", threads,
+                (double)threads * sync_ops_per_thread / elapsed,
+                elapsed * 1e9 / sync_ops_per_thread);
+    }
+    return 0;
+}
+
+// *****************************************************************************
+// request serialization: growing buffer vs. one pre-sized allocation
+
+static double run_serialize_round(struct SetDataRequest *req, int ops,
+        int presize, void *storage)
+{
+    double started = now_seconds();
+    int i;
+    for (i = 0; i < ops; i++) {
+        struct oarchive *oa;
+        if (presize) {
+            struct oarchive sa;
+            int32_t size = 0;
+            init_size_oarchive(&sa, &size);
+            serialize_SetDataRequest(&sa, "req", req);
+            oa = init_reserved_buffer_oarchive(storage, sizeof(int32_t), size);
+        } else {
+            oa = init_buffer_oarchive(storage);
+        }
+        serialize_SetDataRequest(oa, "req", req);
+        release_buffer_oarchive(oa, 1);
+    }
+    return (now_seconds() - started) * 1e9 / ops;
+}
+
+static int bench_serialize(int argc, char **argv)
+{
+    int max_bytes = argc > 0 ? atoi(argv[0]) : 512 * 1024;
+    int ops = argc > 1 ? atoi(argv[1]) : 2000;
+    void *storage = malloc(buffer_oarchive_size());
+    struct SetDataRequest req;
+    int bytes;
+
+    req.path = "/bench/serialize";
+    req.version = -1;
+    req.data.buff = calloc(1, max_bytes > 0 ? max_bytes : 1);
+    printf("%10s %14s %14s\n", "bytes", "growing ns/op", "presized ns/op");
+    for (bytes = 64; bytes > 0; bytes = bytes < max_bytes ? bytes * 8 : 0) {
+        if (bytes > max_bytes)
+            bytes = max_bytes;
+        req.data.len = bytes;
+        printf("%10d %14.0f %14.0f\n", bytes,
+                run_serialize_round(&req, ops, 0, storage),
+                run_serialize_round(&req, ops, 1, storage));
+    }
+    free(req.data.buff);
+    free(storage);
+    return 0;
+}
+
+// *****************************************************************************
+// reply deserialization: copying vs. borrowing archive
+
+static double run_deserialize_round(char *reply, int len, int ops,
+        int borrowed, int children)
+{
+    char *frame = malloc(len);
+    double started = now_seconds();
+    int i;
+    for (i = 0; i < ops; i++) {
+        struct iarchive *ia;
+        /* the borrowing archive rewrites the frame, so each round gets a
+         * fresh copy as it would from the socket */
+        memcpy(frame, reply, len);
+        ia = borrowed ? create_borrowed_buffer_iarchive(frame, len)
+                : create_buffer_iarchive(frame, len);
+        if (children) {
+            struct GetChildrenResponse res;
+            deserialize_GetChildrenResponse(ia, "reply", &res);
+            if (borrowed)
+                free(res.children.data);
+            else
+                deallocate_GetChildrenResponse(&res);
+        } else {
+            struct GetDataResponse res;
+            deserialize_GetDataResponse(ia, "reply", &res);
+            if (!borrowed)
+                deallocate_GetDataResponse(&res);
+        }
+        close_buffer_iarchive(&ia);
+    }
+    free(frame);
+    return (now_seconds() - started) * 1e6 / ops;
+}
+
+static double run_arena_round(char *reply, int len, int ops)
+{
+    double started = now_seconds();
+    int i;
+    for (i = 0; i < ops; i++) {
+        struct iarchive *ia = create_buffer_iarchive(reply, len);
+        struct String_vector children;
+        deserialize_String_vector_arena(ia, "children", &children);
+        deallocate_String_vector_arena(&children);
+        close_buffer_iarchive(&ia);
+    }
+    return (now_seconds() - started) * 1e6 / ops;
+}
+
+static int bench_deserialize(int argc, char **argv)
+{
+    int children = argc > 0 ? atoi(argv[0]) : 50000;
+    int data_bytes = argc > 1 ? atoi(argv[1]) : 1024 * 1024;
+    int ops = argc > 2 ? atoi(argv[2]) : 200;
+    struct oarchive *oa = create_buffer_oarchive();
+    struct GetChildrenResponse cres;
+    struct GetDataResponse dres;
+    char name[32];
+    int i;
+
+    cres.children.count = children;
+    cres.children.data = calloc(children, sizeof(char *));
+    for (i = 0; i < children; i++) {
+        sprintf(name, "member-%010d", i);
+        cres.children.data[i] = strdup(name);
+    }
+    serialize_GetChildrenResponse(oa, "reply", &cres);
+    printf("%d children: copying %.0f us/op, borrowing %.0f us/op\n",
+            children,
+            run_deserialize_round(get_buffer(oa), get_buffer_len(oa), ops,
+                    0, 1),
+            run_deserialize_round(get_buffer(oa), get_buffer_len(oa), ops,
+                    1, 1));
+    printf("%d children: arena %.0f us/op\n", children,
+            run_arena_round(get_buffer(oa), get_buffer_len(oa), ops));
+    deallocate_GetChildrenResponse(&cres);
+    close_buffer_oarchive(&oa, 1);
+
+    oa = create_buffer_oarchive();
+    memset(&dres, 0, sizeof(dres));
+    dres.data.len = data_bytes;
+    dres.data.buff = calloc(1, data_bytes > 0 ? data_bytes : 1);
+    serialize_GetDataResponse(oa, "reply", &dres);
+    printf("%d data bytes: copying %.0f us/op, borrowing %.0f us/op\n",
+            data_bytes,
+            run_deserialize_round(get_buffer(oa), get_buffer_len(oa), ops,
+                    0, 0),
+            run_deserialize_round(get_buffer(oa), get_buffer_len(oa), ops,
+                    1, 0));
+    free(dres.data.buff);
+    close_buffer_oarchive(&oa, 1);
+    return 0;
+}
+
+// *****************************************************************************
+// watch table: a data and a child watch on each of N paths
+
+static int watch_data_checker(zhandle_t *zh, int rc)
+{
+    return WATCH_DATA;
+}
+
+static int watch_child_checker(zhandle_t *zh, int rc)
+{
+    return WATCH_CHILD;
+}
+
+static void watch_noop(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+}
+
+static int bench_watches(int argc, char **argv)
+{
+    int paths = argc > 0 ? atoi(argv[0]) : 1000000;
+    zhandle_t *zh = calloc(1, sizeof(*zh));
+    watcher_registration_t reg;
+    char path[64];
+    struct rusage usage;
+    long rss;
+    buffer_list_t *b;
+    int requests = 0, largest = 0;
+    double bytes = 0;
+    double started, elapsed;
+    int i;
+
+    zh->active_watchers = create_zk_hashtable();
+    zh->persistent_watchers = create_zk_hashtable();
+    reg.watcher = watch_noop;
+    reg.context = 0;
+    reg.path = path;
+    started = now_seconds();
+    for (i = 0; i < paths; i++) {
+        sprintf(path, "/bench/watches/node-%010d", i);
+        reg.checker = watch_data_checker;
+        activateWatcher(zh, &reg, ZOK);
+        reg.checker = watch_child_checker;
+        activateWatcher(zh, &reg, ZOK);
+    }
+    printf("insert: %.0f ns/watch\n",
+            (now_seconds() - started) * 1e9 / (2.0 * paths));
+
+    /* re-arm as after a reconnect, and take the requests off the queue */
+    zoo_set_debug_level(ZOO_LOG_LEVEL_ERROR);
+    init_object_pool(&zh->buffer_pool, sizeof(buffer_list_t),
+            OBJECT_POOL_MAX_FREE);
+    init_object_pool(&zh->oarchive_pool, buffer_oarchive_size(),
+            OBJECT_POOL_MAX_FREE);
+    init_buffer_list(&zh->to_send, &zh->buffer_pool);
+    getrusage(RUSAGE_SELF, &usage);
+    rss = usage.ru_maxrss;
+    started = now_seconds();
+    send_set_watches(zh);
+    elapsed = now_seconds() - started;
+    getrusage(RUSAGE_SELF, &usage);
+    while ((b = dequeue_buffer(&zh->to_send)) != 0) {
+        requests++;
+        bytes += b->len;
+        if (b->len > largest)
+            largest = b->len;
+        free_buffer(b);
+    }
+    printf("re-arm: %.1f ms, %d requests of up to %d bytes, %.1f MB, "
+            "peak RSS +%ld MB\n", elapsed * 1e3, requests, largest,
+            bytes / 1e6, (usage.ru_maxrss - rss) / 1024);
+
+    started = now_seconds();
+    for (i = 0; i < paths; i++) {
+        watcher_object_list_t *list;
+        sprintf(path, "/bench/watches/node-%010d", i);
+        list = collectWatchers(zh, DELETED_EVENT_DEF, path);
+        deliverWatchers(zh, DELETED_EVENT_DEF, 0, path, &list);
+    }
+    printf("collect: %.0f ns/event\n",
+            (now_seconds() - started) * 1e9 / paths);
+
+    destroy_zk_hashtable(zh->active_watchers);
+    destroy_zk_hashtable(zh->persistent_watchers);
+    destroy_object_pool(&zh->buffer_pool);
+    destroy_object_pool(&zh->oarchive_pool);
+    free(zh);
+    return 0;
+}
+
+// *****************************************************************************
+// logging: the time a caller spends in LOG_INFO, written directly and queued
+// for the writer thread. A flood like this one overruns the queue, and the
+// writer reports the messages dropped
+
+static int log_messages_per_thread;
+
+static void *log_caller(void *arg)
+{
+    int i;
+    for (i = 0; i < log_messages_per_thread; i++)
+        LOG_INFO(("session 0x%llx state %d: %s", 0x1234567890abcdefULL, i,
+                "connection loss"));
+    return 0;
+}
+
+static int bench_log(int argc, char **argv)
+{
+    int threads = argc > 0 ? atoi(argv[0]) : 4;
+    FILE *stream = fopen(argc > 1 ? argv[1] : "/dev/null", "w");
+    pthread_t tids[64];
+    int async, i;
+
+    log_messages_per_thread = argc > 2 ? atoi(argv[2]) : 200000;
+    if (!stream || threads < 1 || threads > 64)
+        return 2;
+    zoo_set_log_stream(stream);
+    zoo_set_debug_level(ZOO_LOG_LEVEL_INFO);
+    for (async = 0; async <= 1; async++) {
+        double started, called;
+        zoo_set_log_async(async);
+        started = now_seconds();
+        for (i = 0; i < threads; i++)
+            pthread_create(&tids[i], 0, log_caller, 0);
+        for (i = 0; i < threads; i++)
+            pthread_join(tids[i], 0);
+        called = now_seconds() - started;
+        zoo_set_log_async(0);
+        printf("%-5s %d threads: %.0f ns/message in the caller\n",
+                async ? "async" : "sync", threads,
+                called * 1e9 / log_messages_per_thread);
+    }
+    zoo_set_log_stream(0);
+    fclose(stream);
+    return 0;
+}
+
+// *****************************************************************************
+
+struct benchmark {
+    const char *name;
+    const char *args;
+    int (*run)(int argc, char **argv);
+};
+
+static struct benchmark benchmarks[] = {
+    {"queue", "[max_producers] [ops_per_producer]", bench_queue},
+    {"xid", "[ops]", bench_xid},
+    {"idle", "[sessions] [seconds] [reactor_threads]", bench_idle},
+    {"async", "[calls_per_burst] [bursts]", bench_async},
+    {"sync", "[max_threads] [calls_per_thread]", bench_sync},
+    {"serialize", "[max_bytes] [ops]", bench_serialize},
+    {"deserialize", "[children] [data_bytes] [ops]", bench_deserialize},
+    {"watches", "[paths]", bench_watches},
+    {"log", "[threads] [file] [messages_per_thread]", bench_log},
+    {0, 0, 0}
+};
+
+int main(int argc, char **argv)
+{
+    struct benchmark *b;
+    if (argc > 1) {
+        for (b = benchmarks; b->name; b++) {
+            if (strcmp(argv[1], b->name) == 0)
+                return b->run(argc - 2, argv + 2);
+        }
+    }
+    fprintf(stderr, "USAGE: %s <benchmark> [args]\n", argv[0]);
+    for (b = benchmarks; b->name; b++)
+        fprintf(stderr, "    %s %s\n", b->name, b->args);
+    return 2;
+}
@@ -36,12 +36,18 @@
 #include <fcntl.h>
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
 
 #ifndef WIN32
 #include <signal.h>
 #include <poll.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
 #endif
 
 void zoo_lock_auth(zhandle_t *zh)
@@ -69,9 +75,61 @@ void unlock_completion_list(completion_head_t *l)
     pthread_cond_broadcast(&l->cond);
     pthread_mutex_unlock(&l->lock);
 }
+void lock_object_pool(object_pool_t *p)
+{
+    pthread_mutex_lock(&p->lock);
+}
+void unlock_object_pool(object_pool_t *p)
+{
+    pthread_mutex_unlock(&p->lock);
+}
+/* Each thread keeps the sync completion of its last synchronous call for
+ * the next one, so that the common case neither allocates memory nor
+ * initializes a mutex and a cond. Calls nested in a callback fall back to
+ * the heap. */
+static pthread_key_t sync_completion_key;
+static volatile int32_t sync_completion_key_state; // 0 none, 1 creating, 2 ready
+
+static void destroy_sync_completion(void *p)
+{
+    struct sync_completion *sc = p;
+    pthread_mutex_destroy(&sc->lock);
+    pthread_cond_destroy(&sc->cond);
+    free(sc);
+}
+
+static int sync_completion_cache_ready(void)
+{
+    int32_t state = atomic_get(&sync_completion_key_state);
+    if (state == 2)
+        return 1;
+    if (state == 0 && compare_and_swap(&sync_completion_key_state, 0, 1) == 0) {
+        if (pthread_key_create(&sync_completion_key,
+                destroy_sync_completion) == 0) {
+            atomic_set(&sync_completion_key_state, 2);
+            return 1;
+        }
+        atomic_set(&sync_completion_key_state, 0);
+    }
+    // another thread is creating the key, do without the cache meanwhile
+    return 0;
+}
+
 struct sync_completion *alloc_sync_completion(void)
 {
-    struct sync_completion *sc = (struct sync_completion*)calloc(1, sizeof(struct sync_completion));
+    struct sync_completion *sc = 0;
+    if (sync_completion_cache_ready()) {
+        sc = pthread_getspecific(sync_completion_key);
+        if (sc) {
+            pthread_setspecific(sync_completion_key, 0);
+            sc->rc = 0;
+            memset(&sc->u, 0, sizeof(sc->u));
+            sc->complete = 0;
+            sc->strings_arena = 0;
+            return sc;
+        }
+    }
+    sc = (struct sync_completion*)calloc(1, sizeof(struct sync_completion));
     if (sc) {
        pthread_cond_init(&sc->cond, 0);
        pthread_mutex_init(&sc->lock, 0);
@@ -90,11 +148,14 @@ int wait_sync_completion(struct sync_completion *sc)
 
 void free_sync_completion(struct sync_completion *sc)
 {
-    if (sc) {
-        pthread_mutex_destroy(&sc->lock);
-        pthread_cond_destroy(&sc->cond);
-        free(sc);
-    }
+    if (!sc)
+        return;
+    // the notifier is done with it once the waiter has seen it complete
+    if (sync_completion_cache_ready() &&
+            pthread_getspecific(sync_completion_key) == 0 &&
+            pthread_setspecific(sync_completion_key, sc) == 0)
+        return;
+    destroy_sync_completion(sc);
 }
 
 void notify_sync_completion(struct sync_completion *sc)
@@ -113,6 +174,7 @@ int process_async(int outstanding_sync)
 #ifdef WIN32
 unsigned __stdcall do_io( void * );
 unsigned __stdcall do_completion( void * );
+unsigned __stdcall do_completion_worker( void * );
 
 int handle_error(SOCKET sock, char* message)
 {
@@ -165,10 +227,13 @@ int create_socket_pair(SOCKET fds[2])
 #else
 void *do_io(void *);
 void *do_completion(void *);
+void *do_completion_worker(void *);
 #endif
 
 
 int wakeup_io_thread(zhandle_t *zh);
+static void stop_completion_workers(struct completion_executor *executor);
+static void free_completion_executor(struct completion_executor *executor);
 
 #ifdef WIN32
 static int set_nonblock(SOCKET fd){
@@ -179,6 +244,7 @@ static int set_nonblock(SOCKET fd){
         return -1;
 }
 #else
+#ifndef HAVE_SYS_EVENTFD_H
 static int set_nonblock(int fd){
     long l = fcntl(fd, F_GETFL);
     if(l & O_NONBLOCK) return 0;
@@ -186,6 +252,55 @@ static int set_nonblock(int fd){
 }
 #endif
 
+/* The IO loops sleep on the read end of a self pipe; waking them up makes it
+ * readable. Where available an eventfd takes the place of the pipe and
+ * serves as both of its ends. */
+int create_wakeup_fd(int fds[2])
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    fds[0]=fds[1]=eventfd(0,EFD_NONBLOCK);
+    return fds[0]==-1?-1:0;
+#else
+    if(pipe(fds)==-1)
+        return -1;
+    set_nonblock(fds[0]);
+    set_nonblock(fds[1]);
+    return 0;
+#endif
+}
+
+void close_wakeup_fd(int fds[2])
+{
+    close(fds[0]);
+    if(fds[1]!=fds[0])
+        close(fds[1]);
+}
+
+int signal_wakeup_fd(int fd)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t one=1;
+    return write(fd,&one,sizeof(one))==sizeof(one)? ZOK: ZSYSTEMERROR;
+#else
+    char c=0;
+    // a full pipe is as good as a successful write
+    return write(fd,&c,1)==1||errno==EAGAIN? ZOK: ZSYSTEMERROR;
+#endif
+}
+
+void drain_wakeup_fd(int fd)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t count;
+    // reading resets the counter
+    while(read(fd,&count,sizeof(count))==sizeof(count)){}
+#else
+    char b[128];
+    while(read(fd,b,sizeof(b))==sizeof(b)){}
+#endif
+}
+#endif
+
 void wait_for_others(zhandle_t* zh)
 {
     struct adaptor_threads* adaptor=zh->adaptor_priv;
@@ -236,19 +351,26 @@ int adaptor_init(zhandle_t *zh)
         return -1;
     }
 
-    /* We use a pipe for interrupting select() in unix/sol and socketpair in windows. */
+    /* We use a pipe for interrupting select() in unix/sol and socketpair in windows.
+     * The handles served by a reactor are woken up through the reactor. */
+    adaptor_threads->self_pipe[0] = adaptor_threads->self_pipe[1] = -1;
+    if (zh->reactor == 0) {
 #ifdef WIN32   
-    if (create_socket_pair(adaptor_threads->self_pipe) == -1){
-       LOG_ERROR(("Can't make a socket."));
+        if (create_socket_pair(adaptor_threads->self_pipe) == -1){
+           LOG_ERROR(("Can't make a socket."));
+           free(adaptor_threads);
+           return -1;
+        }
+        set_nonblock(adaptor_threads->self_pipe[1]);
+        set_nonblock(adaptor_threads->self_pipe[0]);
 #else
-    if(pipe(adaptor_threads->self_pipe)==-1) {
-        LOG_ERROR(("Can't make a pipe %d",errno));
+        if(create_wakeup_fd(adaptor_threads->self_pipe)==-1) {
+            LOG_ERROR(("Can't make a pipe %d",errno));
+            free(adaptor_threads);
+            return -1;
+        }
 #endif
-        free(adaptor_threads);
-        return -1;
     }
-    set_nonblock(adaptor_threads->self_pipe[1]);
-    set_nonblock(adaptor_threads->self_pipe[0]);
 
     pthread_mutex_init(&zh->auth_h.lock,0);
 
@@ -265,6 +387,19 @@ int adaptor_init(zhandle_t *zh)
     pthread_cond_init(&zh->sent_requests.cond,0);
     pthread_mutex_init(&zh->completions_to_process.lock,0);
     pthread_cond_init(&zh->completions_to_process.cond,0);
+    pthread_mutex_init(&zh->completion_pool.lock,0);
+    pthread_mutex_init(&zh->buffer_pool.lock,0);
+    pthread_mutex_init(&zh->oarchive_pool.lock,0);
+    pthread_mutex_init(&zh->watcher_pool.lock,0);
+    if (zh->reactor) {
+        if (reactor_attach(zh) == -1) {
+            int errnosave = errno;
+            adaptor_destroy(zh);
+            errno = errnosave;
+            return -1;
+        }
+        return 0;
+    }
     start_threads(zh);
     return 0;
 }
@@ -279,6 +414,13 @@ void adaptor_finish(zhandle_t *zh)
         api_epilog(zh,0);
         return;
     }
+    if(zh->reactor){
+        reactor_detach(zh);
+        if(adaptor_threads->executor)
+            stop_completion_workers(adaptor_threads->executor);
+        api_epilog(zh,0);
+        return;
+    }
 
     if(!pthread_equal(adaptor_threads->io,pthread_self())){
         wakeup_io_thread(zh);
@@ -293,7 +435,9 @@ void adaptor_finish(zhandle_t *zh)
         pthread_join(adaptor_threads->completion, 0);
     }else
         pthread_detach(adaptor_threads->completion);
-    
+
+    if(adaptor_threads->executor)
+        stop_completion_workers(adaptor_threads->executor);
     api_epilog(zh,0);
 }
 
@@ -302,20 +446,32 @@ void adaptor_destroy(zhandle_t *zh)
     struct adaptor_threads *adaptor = zh->adaptor_priv;
     if(adaptor==0) return;
     
-    pthread_cond_destroy(&adaptor->cond);
-    pthread_mutex_destroy(&adaptor->lock);
+    if(zh->reactor==0){
+        pthread_cond_destroy(&adaptor->cond);
+        pthread_mutex_destroy(&adaptor->lock);
+#ifdef WIN32
+        closesocket(adaptor->self_pipe[0]);
+        closesocket(adaptor->self_pipe[1]);
+#else
+        close_wakeup_fd(adaptor->self_pipe);
+#endif
+    }
     pthread_mutex_destroy(&zh->to_process.lock);
     pthread_mutex_destroy(&zh->to_send.lock);
     pthread_mutex_destroy(&zh->sent_requests.lock);
     pthread_cond_destroy(&zh->sent_requests.cond);
     pthread_mutex_destroy(&zh->completions_to_process.lock);
     pthread_cond_destroy(&zh->completions_to_process.cond);
+    pthread_mutex_destroy(&zh->completion_pool.lock);
+    pthread_mutex_destroy(&zh->buffer_pool.lock);
+    pthread_mutex_destroy(&zh->oarchive_pool.lock);
+    pthread_mutex_destroy(&zh->watcher_pool.lock);
     pthread_mutex_destroy(&adaptor->zh_lock);
 
     pthread_mutex_destroy(&zh->auth_h.lock);
 
-    close(adaptor->self_pipe[0]);
-    close(adaptor->self_pipe[1]);
+    if(adaptor->executor)
+        free_completion_executor(adaptor->executor);
     free(adaptor);
     zh->adaptor_priv=0;
 }
@@ -323,12 +479,23 @@ void adaptor_destroy(zhandle_t *zh)
 int wakeup_io_thread(zhandle_t *zh)
 {
     struct adaptor_threads *adaptor_threads = zh->adaptor_priv;
-    char c=0;
+    int rc;
+    if(zh->reactor)
+        return reactor_wakeup(zh);
+    // a wakeup the IO thread has not consumed yet covers this one as well
+    if(compare_and_swap(&adaptor_threads->wakeup_pending,0,1)!=0)
+        return ZOK;
 #ifndef WIN32
-    return write(adaptor_threads->self_pipe[1],&c,1)==1? ZOK: ZSYSTEMERROR;    
+    rc=signal_wakeup_fd(adaptor_threads->self_pipe[1]);
 #else
-    return send(adaptor_threads->self_pipe[1], &c, 1, 0)==1? ZOK: ZSYSTEMERROR;    
+    {
+        char c=0;
+        rc=send(adaptor_threads->self_pipe[1], &c, 1, 0)==1? ZOK: ZSYSTEMERROR;
+    }
 #endif         
+    if(rc!=ZOK)
+        atomic_set(&adaptor_threads->wakeup_pending,0);
+    return rc;
 }
 
 int adaptor_send_queue(zhandle_t *zh, int timeout)
@@ -390,9 +557,10 @@ void *do_io(void *v)
             interest|=((fds[1].revents&POLLOUT)||(fds[1].revents&POLLHUP))?ZOOKEEPER_WRITE:0;
         }
         if(fds[0].revents&POLLIN){
-            // flush the pipe
-            char b[128];
-            while(read(adaptor_threads->self_pipe[0],b,sizeof(b))==sizeof(b)){}
+            // the requests queued before the wakeups we drain here get sent
+            // below, so only then let the next wakeup through
+            drain_wakeup_fd(adaptor_threads->self_pipe[0]);
+            atomic_set(&adaptor_threads->wakeup_pending,0);
         }        
 #else
     fd_set rfds, wfds, efds;
@@ -433,6 +601,7 @@ void *do_io(void *v)
             // flush the pipe/socket
             char b[128];
            while(recv(adaptor_threads->self_pipe[0],b,sizeof(b), 0)==sizeof(b)){}
+           atomic_set(&adaptor_threads->wakeup_pending,0);
        }
 #endif
         // dispatch zookeeper events
@@ -470,6 +639,152 @@ void *do_completion(void *v)
     return 0;
 }
 
+#define MAX_COMPLETION_THREADS 64
+
+struct completion_worker {
+    zhandle_t *zh;
+    pthread_t thread;
+    completion_head_t queue;
+    int stop; // guarded by queue.lock
+};
+
+/* the completion thread hands the completions over to the workers, picking
+ * the worker by the order key so the callbacks for a path keep their order */
+struct completion_executor {
+    int count;
+    struct completion_worker workers[1];
+};
+
+#ifdef WIN32
+unsigned __stdcall do_completion_worker( void * v)
+#else
+void *do_completion_worker(void *v)
+#endif
+{
+    struct completion_worker *w = v;
+    zhandle_t *zh = w->zh;
+    struct _completion_list *c;
+    LOG_DEBUG(("started completion worker"));
+    for(;;) {
+        pthread_mutex_lock(&w->queue.lock);
+        while(!w->queue.head && !w->stop)
+            pthread_cond_wait(&w->queue.cond, &w->queue.lock);
+        // run whatever was queued before stopping
+        if(!w->queue.head) {
+            pthread_mutex_unlock(&w->queue.lock);
+            break;
+        }
+        pthread_mutex_unlock(&w->queue.lock);
+        while((c = dequeue_completion(&w->queue)) != 0)
+            run_completion(zh, c);
+    }
+    LOG_DEBUG(("completion worker terminated"));
+    // this may release the handle, and the worker with it
+    api_epilog(zh, 0);
+    return 0;
+}
+
+static void stop_completion_workers(struct completion_executor *executor)
+{
+    int i;
+    for(i=0;i<executor->count;i++){
+        struct completion_worker *w=&executor->workers[i];
+        pthread_mutex_lock(&w->queue.lock);
+        w->stop=1;
+        pthread_cond_broadcast(&w->queue.cond);
+        pthread_mutex_unlock(&w->queue.lock);
+    }
+    for(i=0;i<executor->count;i++){
+        struct completion_worker *w=&executor->workers[i];
+        if(!pthread_equal(w->thread,pthread_self()))
+            pthread_join(w->thread, 0);
+        else
+            pthread_detach(w->thread);
+    }
+}
+
+static void free_completion_executor(struct completion_executor *executor)
+{
+    int i;
+    for(i=0;i<executor->count;i++){
+        pthread_mutex_destroy(&executor->workers[i].queue.lock);
+        pthread_cond_destroy(&executor->workers[i].queue.cond);
+    }
+    free(executor);
+}
+
+int zoo_set_completion_threads(zhandle_t *zh, int threads)
+{
+    struct adaptor_threads *adaptor;
+    struct completion_executor *executor;
+    int i;
+    if(zh==0 || zh->adaptor_priv==0 || threads<1 ||
+            threads>MAX_COMPLETION_THREADS)
+        return ZBADARGUMENTS;
+    adaptor=zh->adaptor_priv;
+    if(adaptor->executor || zh->close_requested)
+        return ZINVALIDSTATE;
+    if(threads==1)
+        return ZOK;
+    executor=calloc(1,sizeof(*executor)+
+            (threads-1)*sizeof(executor->workers[0]));
+    if(!executor){
+        LOG_ERROR(("Out of memory"));
+        return ZSYSTEMERROR;
+    }
+    for(i=0;i<threads;i++){
+        struct completion_worker *w=&executor->workers[i];
+        w->zh=zh;
+        pthread_mutex_init(&w->queue.lock,0);
+        pthread_cond_init(&w->queue.cond,0);
+        // the workers keep the handle alive until they have drained
+        api_prolog(zh);
+        if(pthread_create(&w->thread, 0, do_completion_worker, w)!=0){
+            LOG_ERROR(("pthread_create() failed for a completion worker"));
+            api_epilog(zh, 0);
+            pthread_mutex_destroy(&w->queue.lock);
+            pthread_cond_destroy(&w->queue.cond);
+            stop_completion_workers(executor);
+            free_completion_executor(executor);
+            return ZSYSTEMERROR;
+        }
+        executor->count++;
+    }
+    enter_critical(zh);
+    // publish the workers to dispatch_completion(), which does not lock:
+    // the barrier orders their initialization before the pointer
+#ifndef WIN32
+    __sync_synchronize();
+#else
+    MemoryBarrier();
+#endif
+    adaptor->executor=executor;
+    leave_critical(zh);
+    return ZOK;
+}
+
+/* Called by the one thread that runs the completions of the handle. It runs
+ * each completion it does not hand over before it takes the next one, so
+ * the callbacks keep their order when the executor shows up. */
+int dispatch_completion(zhandle_t *zh, struct _completion_list *c,
+        unsigned int order_key)
+{
+    struct adaptor_threads *adaptor=zh->adaptor_priv;
+    struct completion_executor *executor=adaptor? adaptor->executor: 0;
+    // pairs with the barrier in zoo_set_completion_threads()
+#ifndef WIN32
+    __sync_synchronize();
+#else
+    MemoryBarrier();
+#endif
+    // the workers are stopped only once nothing dispatches any more
+    if(executor==0)
+        return 0;
+    queue_completion(&executor->workers[order_key%executor->count].queue,
+            c, 0);
+    return 1;
+}
+
 int32_t inc_ref_counter(zhandle_t* zh,int i)
 {
     int incr=(i<0?-1:(i>0?1:0));
@@ -505,6 +820,50 @@ int32_t fetch_and_add(volatile int32_t* operand, int incr)
 #endif
 }
 
+int64_t fetch_and_add64(volatile int64_t* operand, int64_t incr)
+{
+#ifndef WIN32
+    return __sync_fetch_and_add(operand, incr);
+#else
+    return InterlockedExchangeAdd64((volatile LONGLONG*)operand, incr);
+#endif
+}
+
+int32_t compare_and_swap(volatile int32_t* operand, int32_t oldval, int32_t newval)
+{
+#ifndef WIN32
+    return __sync_val_compare_and_swap(operand, oldval, newval);
+#else
+    return InterlockedCompareExchange((volatile LONG*)operand, newval, oldval);
+#endif
+}
+
+int32_t atomic_get(volatile int32_t* operand)
+{
+    int32_t v;
+#ifndef WIN32
+    __sync_synchronize();
+    v = *operand;
+    __sync_synchronize();
+#else
+    MemoryBarrier();
+    v = *operand;
+    MemoryBarrier();
+#endif
+    return v;
+}
+
+void atomic_set(volatile int32_t* operand, int32_t value)
+{
+#ifndef WIN32
+    __sync_synchronize();
+    *operand = value;
+    __sync_synchronize();
+#else
+    InterlockedExchange((volatile LONG*)operand, value);
+#endif
+}
+
 // make sure the static xid is initialized before any threads started
 __attribute__((constructor)) int32_t get_xid()
 {
@@ -0,0 +1,462 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef THREADED
+#define THREADED
+#endif
+
+#ifndef DLL_EXPORT
+#  define USE_STATIC_LIB
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "zk_adaptor.h"
+#include "zookeeper_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * The shared reactor: a fixed set of threads, each running the IO loop of
+ * many handles over one epoll set. A handle is pinned to a single reactor
+ * thread for its whole life, so zookeeper_interest() and zookeeper_process()
+ * of a handle never run concurrently, just like with the dedicated IO
+ * thread. The same thread dispatches the completions of the handle right
+ * after zookeeper_process() has queued them.
+ */
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+
+/* These two are declared here because we will run the event loop
+ * and not the client */
+int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
+        struct timeval *tv);
+int zookeeper_process(zhandle_t *zh, int events);
+
+#define REACTOR_MAX_THREADS 64
+#define REACTOR_MAX_EVENTS 64
+
+struct reactor_thread;
+
+struct reactor_source {
+    zhandle_t *zh;
+    struct reactor_thread *thread;
+    int fd;                     /* the descriptor in the epoll set, -1 for none */
+    uint32_t events;            /* the epoll events it is registered for */
+    uint32_t ready;             /* the events reported since the last run */
+    struct timeval deadline;    /* when the handle wants to run again */
+    volatile int32_t pending;   /* a wakeup has been requested */
+    volatile int32_t closing;   /* zookeeper_close() wants the handle back */
+    int stopped;                /* closed or unrecoverable, no more IO */
+    struct reactor_source *next;
+    struct reactor_source *prev;
+};
+
+struct reactor_thread {
+    pthread_t thread;
+    int epfd;
+    int wakeup_pipe[2];
+    pthread_mutex_t lock;       /* guards attaching, count, stop and detaching */
+    pthread_cond_t cond;        /* signalled when handles have been detached */
+    struct reactor_source *attaching; /* handed over by zookeeper_init_reactor */
+    struct reactor_source *sources;   /* owned by the thread, no locking */
+    int count;                  /* the handles attached to the thread */
+    int stop;
+};
+
+struct _zoo_reactor {
+    int nthreads;
+    volatile int32_t next;      /* round robin assignment of new handles */
+    struct reactor_thread threads[1];
+};
+
+static int wake_reactor_thread(struct reactor_thread *t)
+{
+    return signal_wakeup_fd(t->wakeup_pipe[1]);
+}
+
+static void unwatch_source(struct reactor_source *s)
+{
+    struct epoll_event ev;
+    if(s->fd==-1)
+        return;
+    // the socket may be closed already, which has removed it from the set
+    memset(&ev,0,sizeof(ev));
+    epoll_ctl(s->thread->epfd,EPOLL_CTL_DEL,s->fd,&ev);
+    s->fd=-1;
+    s->events=0;
+}
+
+static void watch_source(struct reactor_source *s, int fd, int interest)
+{
+    struct epoll_event ev;
+    int rc=0;
+
+    memset(&ev,0,sizeof(ev));
+    ev.events=(interest&ZOOKEEPER_READ)?EPOLLIN:0;
+    ev.events|=(interest&ZOOKEEPER_WRITE)?EPOLLOUT:0;
+    ev.data.ptr=s;
+    if(fd!=s->fd){
+        unwatch_source(s);
+        if(fd!=-1)
+            rc=epoll_ctl(s->thread->epfd,EPOLL_CTL_ADD,fd,&ev);
+    }else if(fd!=-1 && ev.events!=s->events){
+        rc=epoll_ctl(s->thread->epfd,EPOLL_CTL_MOD,fd,&ev);
+    }
+    if(rc==-1){
+        LOG_ERROR(("Can't watch descriptor %d in the reactor %d",fd,errno));
+        fd=-1;
+        ev.events=0;
+    }
+    s->fd=fd;
+    s->events=ev.events;
+}
+
+static void run_source(struct reactor_source *s, const struct timeval *now)
+{
+    zhandle_t *zh=s->zh;
+    struct timeval tv;
+    int fd;
+    int interest;
+
+    atomic_set(&s->pending,0);
+    if(s->fd!=-1){
+        interest=(s->ready&EPOLLIN)?ZOOKEEPER_READ:0;
+        interest|=(s->ready&(EPOLLOUT|EPOLLHUP|EPOLLERR))?ZOOKEEPER_WRITE:0;
+        zookeeper_process(zh,interest);
+    }
+    s->ready=0;
+    process_completions(zh);
+    if(zh->close_requested || is_unrecoverable(zh)){
+        unwatch_source(s);
+        s->stopped=1;
+        return;
+    }
+    // a socket that has been closed left the epoll set with it, even if the
+    // new connection happens to get the same descriptor
+    if(zh->fd==-1)
+        s->fd=-1;
+    zookeeper_interest(zh,&fd,&interest,&tv);
+    watch_source(s,fd,interest);
+    s->deadline.tv_sec=now->tv_sec+tv.tv_sec;
+    s->deadline.tv_usec=now->tv_usec+tv.tv_usec;
+    if(s->deadline.tv_usec>=1000000){
+        s->deadline.tv_sec++;
+        s->deadline.tv_usec-=1000000;
+    }
+}
+
+/* Returns the milliseconds until the deadline of the source, rounded up. */
+static int time_to_deadline(const struct reactor_source *s,
+        const struct timeval *now)
+{
+    long usec=(s->deadline.tv_sec-now->tv_sec)*1000000L+
+        (s->deadline.tv_usec-now->tv_usec);
+    return usec<=0?0:(int)((usec+999)/1000);
+}
+
+/* Called with the thread lock held. Takes over the new handles and unlinks
+ * the ones being closed; returns those whose last reference was held by the
+ * reactor, which the caller must close once the lock is released. */
+static struct reactor_source *sync_sources(struct reactor_thread *t)
+{
+    struct reactor_source *s, *next, *orphans=0;
+    int detached=0;
+
+    while(t->attaching){
+        s=t->attaching;
+        t->attaching=s->next;
+        s->prev=0;
+        s->next=t->sources;
+        if(t->sources)
+            t->sources->prev=s;
+        t->sources=s;
+    }
+    for(s=t->sources;s;s=next){
+        next=s->next;
+        if(!atomic_get(&s->closing))
+            continue;
+        if(s->prev)
+            s->prev->next=s->next;
+        else
+            t->sources=s->next;
+        if(s->next)
+            s->next->prev=s->prev;
+        unwatch_source(s);
+        t->count--;
+        ((struct adaptor_threads*)s->zh->adaptor_priv)->source=0;
+        detached=1;
+        // whoever is waiting in reactor_detach() still holds a reference,
+        // so only a handle closed from one of our own callbacks can drop
+        // to zero here
+        if(inc_ref_counter(s->zh,-1)==0){
+            s->next=orphans;
+            orphans=s;
+        }else{
+            free(s);
+        }
+    }
+    if(detached)
+        pthread_cond_broadcast(&t->cond);
+    return orphans;
+}
+
+static void *reactor_loop(void *v)
+{
+    struct reactor_thread *t=v;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    LOG_DEBUG(("started reactor thread"));
+    for(;;){
+        struct reactor_source *s, *orphans;
+        struct timeval now;
+        int timeout=-1;
+        int n, i;
+
+        pthread_mutex_lock(&t->lock);
+        if(t->stop){
+            pthread_mutex_unlock(&t->lock);
+            break;
+        }
+        orphans=sync_sources(t);
+        pthread_mutex_unlock(&t->lock);
+        while(orphans){
+            s=orphans;
+            orphans=s->next;
+            zookeeper_close(s->zh);
+            free(s);
+        }
+
+        gettimeofday(&now,0);
+        for(s=t->sources;s;s=s->next){
+            int left;
+            if(s->stopped || atomic_get(&s->closing))
+                continue;
+            left=time_to_deadline(s,&now);
+            if(s->ready || left==0 || atomic_get(&s->pending)){
+                run_source(s,&now);
+                if(s->stopped)
+                    continue;
+                left=time_to_deadline(s,&now);
+            }
+            if(timeout==-1 || left<timeout)
+                timeout=left;
+        }
+
+        n=epoll_wait(t->epfd,events,REACTOR_MAX_EVENTS,timeout);
+        for(i=0;i<n;i++){
+            s=events[i].data.ptr;
+            if(s){
+                s->ready|=events[i].events;
+            }else{
+                drain_wakeup_fd(t->wakeup_pipe[0]);
+            }
+        }
+    }
+    LOG_DEBUG(("reactor thread terminated"));
+    return 0;
+}
+
+static int start_reactor_thread(struct reactor_thread *t)
+{
+    struct epoll_event ev;
+    t->epfd=epoll_create(REACTOR_MAX_EVENTS);
+    if(t->epfd==-1)
+        return -1;
+    if(create_wakeup_fd(t->wakeup_pipe)==-1){
+        close(t->epfd);
+        return -1;
+    }
+    memset(&ev,0,sizeof(ev));
+    ev.events=EPOLLIN;
+    ev.data.ptr=0;
+    epoll_ctl(t->epfd,EPOLL_CTL_ADD,t->wakeup_pipe[0],&ev);
+    pthread_mutex_init(&t->lock,0);
+    pthread_cond_init(&t->cond,0);
+    if(pthread_create(&t->thread,0,reactor_loop,t)!=0){
+        pthread_cond_destroy(&t->cond);
+        pthread_mutex_destroy(&t->lock);
+        close_wakeup_fd(t->wakeup_pipe);
+        close(t->epfd);
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_reactor_thread(struct reactor_thread *t)
+{
+    pthread_mutex_lock(&t->lock);
+    t->stop=1;
+    pthread_mutex_unlock(&t->lock);
+    wake_reactor_thread(t);
+    pthread_join(t->thread,0);
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->lock);
+    close_wakeup_fd(t->wakeup_pipe);
+    close(t->epfd);
+}
+
+zoo_reactor_t *zoo_reactor_create(int threads)
+{
+    zoo_reactor_t *reactor;
+    int i;
+
+    if(threads<1 || threads>REACTOR_MAX_THREADS){
+        errno=EINVAL;
+        return 0;
+    }
+    reactor=calloc(1,sizeof(*reactor)+
+            (threads-1)*sizeof(struct reactor_thread));
+    if(!reactor){
+        LOG_ERROR(("Out of memory"));
+        return 0;
+    }
+    for(i=0;i<threads;i++){
+        if(start_reactor_thread(&reactor->threads[i])==-1){
+            int errnosave=errno;
+            LOG_ERROR(("Can't start a reactor thread %d",errno));
+            while(i-->0)
+                stop_reactor_thread(&reactor->threads[i]);
+            free(reactor);
+            errno=errnosave;
+            return 0;
+        }
+        reactor->nthreads++;
+    }
+    return reactor;
+}
+
+int zoo_reactor_destroy(zoo_reactor_t *reactor)
+{
+    int i;
+    if(reactor==0)
+        return ZBADARGUMENTS;
+    for(i=0;i<reactor->nthreads;i++){
+        struct reactor_thread *t=&reactor->threads[i];
+        int count;
+        pthread_mutex_lock(&t->lock);
+        count=t->count;
+        pthread_mutex_unlock(&t->lock);
+        if(count!=0){
+            LOG_ERROR(("Can't destroy a reactor serving %d handles",count));
+            return ZINVALIDSTATE;
+        }
+    }
+    for(i=0;i<reactor->nthreads;i++)
+        stop_reactor_thread(&reactor->threads[i]);
+    free(reactor);
+    return ZOK;
+}
+
+int reactor_attach(zhandle_t *zh)
+{
+    zoo_reactor_t *reactor=zh->reactor;
+    struct adaptor_threads *adaptor=zh->adaptor_priv;
+    struct reactor_source *s=calloc(1,sizeof(*s));
+    struct reactor_thread *t;
+
+    if(!s){
+        LOG_ERROR(("Out of memory"));
+        return -1;
+    }
+    t=&reactor->threads[(uint32_t)fetch_and_add(&reactor->next,1)%
+        reactor->nthreads];
+    s->zh=zh;
+    s->thread=t;
+    s->fd=-1;
+    s->pending=1;
+    // the reactor keeps the handle alive until it is detached
+    api_prolog(zh);
+    adaptor->source=s;
+    pthread_mutex_lock(&t->lock);
+    s->next=t->attaching;
+    t->attaching=s;
+    t->count++;
+    pthread_mutex_unlock(&t->lock);
+    wake_reactor_thread(t);
+    return 0;
+}
+
+void reactor_detach(zhandle_t *zh)
+{
+    struct adaptor_threads *adaptor=zh->adaptor_priv;
+    struct reactor_source *s=adaptor->source;
+    struct reactor_thread *t;
+
+    if(s==0)
+        return;
+    t=s->thread;
+    pthread_mutex_lock(&t->lock);
+    atomic_set(&s->closing,1);
+    wake_reactor_thread(t);
+    // when called from one of our callbacks the reactor thread picks the
+    // handle up as soon as the callback returns
+    if(!pthread_equal(t->thread,pthread_self())){
+        while(adaptor->source)
+            pthread_cond_wait(&t->cond,&t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+int reactor_wakeup(zhandle_t *zh)
+{
+    struct adaptor_threads *adaptor=zh->adaptor_priv;
+    struct reactor_source *s=adaptor->source;
+    if(s==0)
+        return ZOK;
+    // a wakeup that is still pending covers this one as well
+    if(compare_and_swap(&s->pending,0,1)!=0)
+        return ZOK;
+    return wake_reactor_thread(s->thread);
+}
+
+#else /* no epoll */
+
+zoo_reactor_t *zoo_reactor_create(int threads)
+{
+    errno=ENOSYS;
+    return 0;
+}
+
+int zoo_reactor_destroy(zoo_reactor_t *reactor)
+{
+    return ZBADARGUMENTS;
+}
+
+int reactor_attach(zhandle_t *zh)
+{
+    errno=ENOSYS;
+    return -1;
+}
+
+void reactor_detach(zhandle_t *zh)
+{
+}
+
+int reactor_wakeup(zhandle_t *zh)
+{
+    return ZSYSTEMERROR;
+}
+
+#endif
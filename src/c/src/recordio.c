@@ -17,6 +17,7 @@
  */
 
 #include <recordio.h>
+#include <zookeeper.jute.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
@@ -178,6 +179,32 @@ int oa_serialize_string(struct oarchive *oa, const char *name, char **s)
     priv->off += len;
     return 0;
 }
+static int oa_size_int(struct oarchive *oa, const char *tag, const int32_t *d)
+{
+    *(int32_t *)oa->priv += sizeof(*d);
+    return 0;
+}
+static int oa_size_long(struct oarchive *oa, const char *tag, const int64_t *d)
+{
+    *(int32_t *)oa->priv += sizeof(*d);
+    return 0;
+}
+static int oa_size_bool(struct oarchive *oa, const char *name, const int32_t *i)
+{
+    *(int32_t *)oa->priv += 1;
+    return 0;
+}
+static int oa_size_buffer(struct oarchive *oa, const char *name,
+        const struct buffer *b)
+{
+    *(int32_t *)oa->priv += sizeof(b->len) + (b && b->len > 0 ? b->len : 0);
+    return 0;
+}
+static int oa_size_string(struct oarchive *oa, const char *name, char **s)
+{
+    *(int32_t *)oa->priv += sizeof(int32_t) + (*s ? strlen(*s) : 0);
+    return 0;
+}
 int ia_start_record(struct iarchive *ia, const char *tag)
 {
     return 0;
@@ -277,6 +304,103 @@ int ia_deserialize_string(struct iarchive *ia, const char *name, char **s)
     priv->off += len;
     return 0;
 }
+/* like ia_deserialize_buffer(), but points into the archive buffer */
+static int ia_borrow_buffer(struct iarchive *ia, const char *name,
+        struct buffer *b)
+{
+    struct buff_struct *priv = ia->priv;
+    int rc = ia_deserialize_int(ia, "len", &b->len);
+    if (rc < 0)
+        return rc;
+    if ((priv->len - priv->off) < b->len) {
+        return -E2BIG;
+    }
+    if (b->len == -1) {
+       b->buff = NULL;
+       return rc;
+    }
+    b->buff = priv->buffer+priv->off;
+    priv->off += b->len;
+    return 0;
+}
+/* like ia_deserialize_string(), but points into the archive buffer: the
+ * characters move one byte back over the length, which has been read
+ * already, to make room for the terminating '\0' */
+static int ia_borrow_string(struct iarchive *ia, const char *name, char **s)
+{
+    struct buff_struct *priv = ia->priv;
+    int32_t len;
+    int rc = ia_deserialize_int(ia, "len", &len);
+    if (rc < 0)
+        return rc;
+    if ((priv->len - priv->off) < len) {
+        return -E2BIG;
+    }
+    if (len < 0) {
+        return -EINVAL;
+    }
+    *s = priv->buffer+priv->off-1;
+    memmove(*s, priv->buffer+priv->off, len);
+    (*s)[len] = '\0';
+    priv->off += len;
+    return 0;
+}
+
+int deserialize_String_vector_arena(struct iarchive *ia, const char *tag,
+        struct String_vector *v)
+{
+    struct buff_struct *priv = ia->priv;
+    int32_t count, len, i;
+    int off;
+    size_t bytes = 0;
+    char *names;
+    int rc = ia_start_vector(ia, tag, &count);
+    v->count = 0;
+    v->data = 0;
+    if (rc < 0)
+        return rc;
+    if (count <= 0)
+        return 0;
+    /* add up the names before allocating anything */
+    for (i = 0, off = priv->off; i < count; i++) {
+        if ((priv->len - off) < sizeof(len)) {
+            return -E2BIG;
+        }
+        memcpy(&len, priv->buffer+off, sizeof(len));
+        len = ntohl(len);
+        off += sizeof(len);
+        if (len < 0) {
+            return -EINVAL;
+        }
+        if ((priv->len - off) < len) {
+            return -E2BIG;
+        }
+        off += len;
+        bytes += len + 1;
+    }
+    v->data = malloc(count * sizeof(*v->data) + bytes);
+    if (!v->data) {
+        return -ENOMEM;
+    }
+    names = (char *)(v->data + count);
+    for (i = 0; i < count; i++) {
+        ia_deserialize_int(ia, "len", &len);
+        memcpy(names, priv->buffer+priv->off, len);
+        names[len] = '\0';
+        priv->off += len;
+        v->data[i] = names;
+        names += len + 1;
+    }
+    v->count = count;
+    return ia_end_vector(ia, tag);
+}
+
+void deallocate_String_vector_arena(struct String_vector *v)
+{
+    free(v->data);
+    v->data = 0;
+    v->count = 0;
+}
 
 static struct iarchive ia_default = { STRUCT_INITIALIZER (start_record ,ia_start_record),
         STRUCT_INITIALIZER (end_record ,ia_end_record), STRUCT_INITIALIZER (start_vector , ia_start_vector),
@@ -286,6 +410,14 @@ static struct iarchive ia_default = { STRUCT_INITIALIZER (start_record ,ia_start
         STRUCT_INITIALIZER (deserialize_Buffer, ia_deserialize_buffer),
         STRUCT_INITIALIZER (deserialize_String, ia_deserialize_string)   };
 
+static struct iarchive ia_borrowed = { STRUCT_INITIALIZER (start_record ,ia_start_record),
+        STRUCT_INITIALIZER (end_record ,ia_end_record), STRUCT_INITIALIZER (start_vector , ia_start_vector),
+        STRUCT_INITIALIZER (end_vector ,ia_end_vector), STRUCT_INITIALIZER (deserialize_Bool , ia_deserialize_bool),
+        STRUCT_INITIALIZER (deserialize_Int ,ia_deserialize_int),
+        STRUCT_INITIALIZER (deserialize_Long , ia_deserialize_long) ,
+        STRUCT_INITIALIZER (deserialize_Buffer, ia_borrow_buffer),
+        STRUCT_INITIALIZER (deserialize_String, ia_borrow_string)   };
+
 static struct oarchive oa_default = { STRUCT_INITIALIZER (start_record , oa_start_record),
         STRUCT_INITIALIZER (end_record , oa_end_record), STRUCT_INITIALIZER (start_vector , oa_start_vector),
         STRUCT_INITIALIZER (end_vector , oa_end_vector), STRUCT_INITIALIZER (serialize_Bool , oa_serialize_bool),
@@ -294,6 +426,20 @@ static struct oarchive oa_default = { STRUCT_INITIALIZER (start_record , oa_star
         STRUCT_INITIALIZER (serialize_Buffer , oa_serialize_buffer),
         STRUCT_INITIALIZER (serialize_String , oa_serialize_string) };
 
+static struct oarchive oa_size = { STRUCT_INITIALIZER (start_record , oa_start_record),
+        STRUCT_INITIALIZER (end_record , oa_end_record), STRUCT_INITIALIZER (start_vector , oa_size_int),
+        STRUCT_INITIALIZER (end_vector , oa_end_vector), STRUCT_INITIALIZER (serialize_Bool , oa_size_bool),
+        STRUCT_INITIALIZER (serialize_Int , oa_size_int),
+        STRUCT_INITIALIZER (serialize_Long , oa_size_long) ,
+        STRUCT_INITIALIZER (serialize_Buffer , oa_size_buffer),
+        STRUCT_INITIALIZER (serialize_String , oa_size_string) };
+
+void init_size_oarchive(struct oarchive *oa, int32_t *size)
+{
+    *oa = oa_size;
+    oa->priv = size;
+}
+
 struct iarchive *create_buffer_iarchive(char *buffer, int len)
 {
     struct iarchive *ia = malloc(sizeof(*ia));
@@ -311,20 +457,58 @@ struct iarchive *create_buffer_iarchive(char *buffer, int len)
     return ia;
 }
 
+struct iarchive *create_borrowed_buffer_iarchive(char *buffer, int len)
+{
+    struct iarchive *ia = create_buffer_iarchive(buffer, len);
+    if (ia) {
+        struct buff_struct *buff = ia->priv;
+        *ia = ia_borrowed;
+        ia->priv = buff;
+    }
+    return ia;
+}
+
+/* the archive and its state share a single allocation */
+struct buff_oarchive {
+    struct oarchive oa;
+    struct buff_struct buff;
+    int32_t reserve; /* bytes in front of the serialized data */
+};
+
+size_t buffer_oarchive_size(void)
+{
+    return sizeof(struct buff_oarchive);
+}
+
+struct oarchive *init_reserved_buffer_oarchive(void *storage, int32_t reserve,
+        int32_t len)
+{
+    struct buff_oarchive *boa = storage;
+    boa->oa = oa_default;
+    boa->reserve = reserve;
+    boa->buff.off = reserve;
+    boa->buff.len = reserve + (len > 0 ? len : 1);
+    boa->buff.buffer = malloc(boa->buff.len);
+    if (!boa->buff.buffer) return 0;
+    boa->oa.priv = &boa->buff;
+    return &boa->oa;
+}
+
+struct oarchive *init_buffer_oarchive(void *storage)
+{
+    return init_reserved_buffer_oarchive(storage, 0, 128);
+}
+
 struct oarchive *create_buffer_oarchive()
 {
-    struct oarchive *oa = malloc(sizeof(*oa));
-    struct buff_struct *buff = malloc(sizeof(struct buff_struct));
-    if (!oa) return 0;
-    if (!buff) {
-        free(oa);
+    void *storage = malloc(buffer_oarchive_size());
+    struct oarchive *oa;
+    if (!storage) return 0;
+    oa = init_buffer_oarchive(storage);
+    if (!oa) {
+        free(storage);
         return 0;
     }
-    *oa = oa_default;
-    buff->off = 0;
-    buff->buffer = malloc(128);
-    buff->len = 128;
-    oa->priv = buff;
     return oa;
 }
 
@@ -335,26 +519,30 @@ void close_buffer_iarchive(struct iarchive **ia)
     *ia = 0;
 }
 
-void close_buffer_oarchive(struct oarchive **oa, int free_buffer)
+void release_buffer_oarchive(struct oarchive *oa, int free_buffer)
 {
     if (free_buffer) {
-        struct buff_struct *buff = (struct buff_struct *)(*oa)->priv;
+        struct buff_struct *buff = (struct buff_struct *)oa->priv;
         if (buff->buffer) {
             free(buff->buffer);
         }
     }
-    free((*oa)->priv);
+}
+
+void close_buffer_oarchive(struct oarchive **oa, int free_buffer)
+{
+    release_buffer_oarchive(*oa, free_buffer);
     free(*oa);
     *oa = 0;
 }
 
 char *get_buffer(struct oarchive *oa)
 {
-    struct buff_struct *buff = oa->priv;
-    return buff->buffer;
+    struct buff_oarchive *boa = (struct buff_oarchive *)oa;
+    return boa->buff.buffer + boa->reserve;
 }
 int get_buffer_len(struct oarchive *oa)
 {
-    struct buff_struct *buff = oa->priv;
-    return buff->off;
+    struct buff_oarchive *boa = (struct buff_oarchive *)oa;
+    return boa->buff.off - boa->reserve;
 }
@@ -42,6 +42,12 @@ void lock_completion_list(completion_head_t *l)
 void unlock_completion_list(completion_head_t *l)
 {
 }
+void lock_object_pool(object_pool_t *p)
+{
+}
+void unlock_object_pool(object_pool_t *p)
+{
+}
 struct sync_completion *alloc_sync_completion(void)
 {
     return (struct sync_completion*)calloc(1, sizeof(struct sync_completion));
@@ -65,6 +71,12 @@ int process_async(int outstanding_sync)
     return outstanding_sync == 0;
 }
 
+int dispatch_completion(zhandle_t *zh, struct _completion_list *c,
+        unsigned int order_key)
+{
+    return 0;
+}
+
 int adaptor_init(zhandle_t *zh)
 {
     return 0;
@@ -87,6 +99,38 @@ int32_t inc_ref_counter(zhandle_t* zh,int i)
     return zh->ref_counter;
 }
 
+int32_t fetch_and_add(volatile int32_t* operand, int incr)
+{
+    int32_t result = *operand;
+    *operand = result + incr;
+    return result;
+}
+
+int64_t fetch_and_add64(volatile int64_t* operand, int64_t incr)
+{
+    int64_t result = *operand;
+    *operand = result + incr;
+    return result;
+}
+
+int32_t compare_and_swap(volatile int32_t* operand, int32_t oldval, int32_t newval)
+{
+    int32_t v = *operand;
+    if (v == oldval)
+        *operand = newval;
+    return v;
+}
+
+int32_t atomic_get(volatile int32_t* operand)
+{
+    return *operand;
+}
+
+void atomic_set(volatile int32_t* operand, int32_t value)
+{
+    *operand = value;
+}
+
 int32_t get_xid()
 {
     static int32_t xid = -1;
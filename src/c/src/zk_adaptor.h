@@ -35,6 +35,10 @@
 #define AUTH_XID -4
 #define SET_WATCHES_XID -8
 
+/* the most paths a single SetWatches request carries, in serialized bytes;
+ * well below the 1M jute.maxbuffer default of the server */
+#define SET_WATCHES_MAX_LENGTH (128*1024)
+
 /* zookeeper state constants */
 #define EXPIRED_SESSION_STATE_DEF -112
 #define AUTH_FAILED_STATE_DEF -113
@@ -58,9 +62,65 @@ extern "C" {
 struct _buffer_list;
 struct _completion_list;
 
+/* the most free objects a pool keeps around before returning them to malloc */
+#define OBJECT_POOL_MAX_FREE 1024
+
+/**
+ * Every pooled object is preceded by this header. While the object is in
+ * use the header points back to the pool it came from, so it can be
+ * released without the handle; while it sits in the pool it links the
+ * free list.
+ */
+typedef union _pool_header {
+    struct _object_pool *pool;
+    union _pool_header *next;
+    int64_t align;
+} pool_header_t;
+
+/**
+ * A free list of fixed size objects owned by a zhandle.
+ */
+typedef struct _object_pool {
+    size_t size; /* the size of an object, not counting the header */
+    pool_header_t *free_list;
+    int free_count;
+    int max_free;
+    int64_t hits; /* allocations served from the free list */
+    int64_t misses; /* allocations that had to go to malloc */
+#ifdef THREADED
+    pthread_mutex_t lock;
+#endif
+} object_pool_t;
+
+void lock_object_pool(object_pool_t *p);
+void unlock_object_pool(object_pool_t *p);
+
+/* number of slots in the lock-free buffer ring; must be a power of two */
+#define BUFFER_RING_SIZE 256
+
+typedef struct _buffer_ring_slot {
+    volatile int32_t seq;
+    struct _buffer_list *buffer;
+} buffer_ring_slot_t;
+
+/*
+ * A buffer queue with many producers and a single consumer. Producers
+ * publish into a bounded lock-free ring; when the ring is full the buffers
+ * spill into an overflow list protected by the lock. The consumer (which
+ * holds the lock) moves published buffers into the head/last list, which is
+ * also where buffers are pushed to the front of the queue.
+ */
 typedef struct _buffer_head {
     struct _buffer_list *volatile head;
     struct _buffer_list *last;
+    buffer_ring_slot_t ring[BUFFER_RING_SIZE];
+    volatile int32_t enqueue_pos;
+    volatile int32_t dequeue_pos;
+    struct _buffer_list *overflow_head;
+    struct _buffer_list *overflow_last;
+    volatile int32_t overflow_count;
+    volatile int32_t length; /* the number of buffers queued */
+    object_pool_t *pool; /* where the queued buffer_list_t come from */
 #ifdef THREADED
     pthread_mutex_t lock;
 #endif
@@ -69,12 +129,91 @@ typedef struct _buffer_head {
 typedef struct _completion_head {
     struct _completion_list *volatile head;
     struct _completion_list *last;
+    volatile int32_t length; /* changed with the list locked */
 #ifdef THREADED
     pthread_cond_t cond;
     pthread_mutex_t lock;
 #endif
 } completion_head_t;
 
+typedef struct _request_slot {
+    int32_t xid;
+    struct _completion_list *entry; /* 0 if the slot is free */
+} request_slot_t;
+
+/**
+ * Linear probing table of the outstanding requests keyed by xid. Xids are
+ * handed out in increasing order and replies come back in the same order,
+ * so the low bits of the xid pick the slot: the window of outstanding xids
+ * moves around the table like a ring, and the replies go through it one
+ * slot after the other. Duplicate xids are allowed, for pings share one; a
+ * lookup returns any one of the duplicates.
+ *
+ * Removed entries leave a tombstone behind, which the xid that comes home
+ * to it a lap later reuses, so that entries never move but when the table
+ * grows. It grows when an entry would land more than a few slots from its
+ * home, and lookups give up after as many slots as the furthest entry is
+ * from its own. The table does not keep a count of its entries, so that
+ * removing one is a single store.
+ */
+typedef struct _request_table {
+    request_slot_t *slots;
+    int capacity; /* a power of two, 0 until the first insert */
+    int max_probe; /* the furthest an entry went from its home slot */
+    int generation; /* changes whenever the entries move */
+} request_table_t;
+
+/* where request_table_place() put an entry, good until the table changes
+ * generation */
+typedef struct _request_hint {
+    int slot;
+    int generation;
+} request_hint_t;
+
+int request_table_insert(request_table_t *t, int32_t xid,
+        struct _completion_list *entry);
+/* like request_table_insert(), and stores where the entry went in hint */
+int request_table_place(request_table_t *t, int32_t xid,
+        struct _completion_list *entry, request_hint_t *hint);
+struct _completion_list *request_table_lookup(request_table_t *t, int32_t xid);
+struct _completion_list *request_table_remove(request_table_t *t, int32_t xid);
+/* removes entry, which must be in the table, by probing for it */
+void request_table_remove_stale(request_table_t *t, int32_t xid,
+        struct _completion_list *entry);
+
+/* marks the slots of removed entries */
+#define REQUEST_DELETED ((struct _completion_list *)-1)
+
+/**
+ * Removes entry, which must be in the table. While the hint that
+ * request_table_place() gave is current this only marks its slot, which is
+ * what keeps the reply path as cheap as popping a list.
+ */
+static inline void request_table_remove_entry(request_table_t *t,
+        int32_t xid, struct _completion_list *entry,
+        const request_hint_t *hint)
+{
+    if (hint->generation == t->generation) {
+        t->slots[hint->slot].entry = REQUEST_DELETED;
+    } else {
+        request_table_remove_stale(t, xid, entry);
+    }
+}
+/* counts the entries, which takes a pass over the table */
+int request_table_count(const request_table_t *t);
+void request_table_clear(request_table_t *t);
+void request_table_destroy(request_table_t *t);
+
+/**
+ * Binary min-heap of the outstanding requests that have a deadline, ordered
+ * by deadline. Guarded by the sent_requests lock.
+ */
+typedef struct _deadline_heap {
+    struct _completion_list **entries;
+    int count;
+    int capacity;
+} deadline_heap_t;
+
 void lock_buffer_list(buffer_head_t *l);
 void unlock_buffer_list(buffer_head_t *l);
 void lock_completion_list(completion_head_t *l);
@@ -104,6 +243,7 @@ struct sync_completion {
         } strs_stat;
     } u;
     int complete;
+    int strings_arena; /* string lists come back as one block */
 #ifdef THREADED
     pthread_cond_t cond;
     pthread_mutex_t lock;
@@ -119,6 +259,20 @@ typedef struct _auth_info {
     struct _auth_info *next;
 } auth_info;
 
+/* size of the receive block; larger frames get a buffer of their own */
+#define RECV_BLOCK_SIZE (64*1024)
+
+/**
+ * A reference counted block the IO thread reads into. Complete frames are
+ * sliced out of it in place, and each slice holds a reference to the block.
+ */
+typedef struct _recv_block {
+    volatile int32_t ref_count;
+    int start; /* the beginning of the first frame not yet sliced out */
+    int end; /* the end of the data received so far */
+    char data[RECV_BLOCK_SIZE];
+} recv_block_t;
+
 /**
  * This structure represents a packet being read or written.
  */
@@ -127,6 +281,8 @@ typedef struct _buffer_list {
     int len; /* This represents the length of sizeof(header) + length of buffer */
     int curr_offset; /* This is the offset into the header followed by offset into the buffer */
     struct _buffer_list *next;
+    recv_block_t *block; /* set if buffer points into a receive block */
+    int framed; /* buffer is preceded by 4 bytes for the frame length */
 } buffer_list_t;
 
 /* the size of connect request */
@@ -165,7 +321,24 @@ struct adaptor_threads {
 #else
      int self_pipe[2];
 #endif
+     volatile int32_t wakeup_pending; // the self pipe has been signalled
+     struct reactor_source *source; // the reactor's state of the handle
+     struct completion_executor *volatile executor; // see zoo_set_completion_threads
 };
+
+int wakeup_io_thread(zhandle_t *zh);
+#ifndef WIN32
+// the self pipe, or an eventfd where available
+int create_wakeup_fd(int fds[2]);
+void close_wakeup_fd(int fds[2]);
+int signal_wakeup_fd(int fd);
+void drain_wakeup_fd(int fd);
+#endif
+
+// the shared reactor (mt_reactor.c)
+int reactor_attach(zhandle_t *zh);
+void reactor_detach(zhandle_t *zh);
+int reactor_wakeup(zhandle_t *zh);
 #endif
 
 /** the auth list for adding auth */
@@ -176,6 +349,49 @@ typedef struct _auth_list_head {
 #endif
 } auth_list_head_t;
 
+/* the counters behind zoo_get_stats() that the queues do not keep */
+typedef struct _zk_counters {
+    volatile int64_t bytes_sent;
+    volatile int64_t bytes_received;
+    volatile int32_t connects;
+    volatile int32_t disconnects;
+} zk_counters_t;
+
+/* the latencies of one type of request (zk_metrics.c). Only the thread
+ * that processes the responses adds to them */
+typedef struct _latency_histogram {
+    int64_t count;
+    int64_t total_us;
+    int64_t max_us;
+    int64_t buckets[ZOO_LATENCY_BUCKETS];
+} latency_histogram_t;
+
+/* the number of request types tracked, at most ZOO_METRICS_MAX_OPS */
+#define LATENCY_OPS 14
+
+void record_latency(zhandle_t *zh, int op, const struct timeval *sent,
+        const struct timeval *now);
+void destroy_latency_histograms(zhandle_t *zh);
+
+/* the nodes read by zoo_cached_get() (zk_cache.c) */
+typedef struct _read_cache read_cache_t;
+
+read_cache_t *create_read_cache(size_t max_bytes);
+void destroy_read_cache(read_cache_t *cache);
+void set_read_cache_limit(read_cache_t *cache, size_t max_bytes);
+/* copies the node out and returns 1 if it is cached; otherwise returns 0
+ * and sets *generation to pass to cache_fill() or cache_abandon() once the
+ * node has been read with a watch, 0 if there is nothing to fill in.
+ * Returns -1 while the budget is 0: the node is to be read without a watch */
+int cache_lookup(read_cache_t *cache, const char *path, char *buffer,
+        int *buffer_len, struct Stat *stat, int64_t *generation);
+void cache_fill(read_cache_t *cache, const char *path, int64_t generation,
+        const char *data, int data_len, const struct Stat *stat);
+void cache_abandon(read_cache_t *cache, const char *path, int64_t generation);
+void cache_invalidate(read_cache_t *cache, const char *path);
+void cache_clear(read_cache_t *cache);
+void get_read_cache_stats(read_cache_t *cache, struct zoo_cache_stats *stats);
+
 /**
  * This structure represents the connection to zookeeper.
  */
@@ -197,9 +413,15 @@ struct _zhandle {
     int recv_timeout; /* The maximum amount of time that can go by without 
      receiving anything from the zookeeper server */
     buffer_list_t *input_buffer; /* the current buffer being read in */
+    recv_block_t *recv_block; /* the block the responses are read into */
     buffer_head_t to_process; /* The buffers that have been read and are ready to be processed. */
     buffer_head_t to_send; /* The packets queued to send */
     completion_head_t sent_requests; /* The outstanding requests */
+    request_table_t sent_index; /* sent_requests by xid, guarded by its lock */
+    volatile int32_t request_timeout; /* the deadline of new requests in ms, 0 for none */
+    int persistent_watches; /* the servers take AddWatch and SetWatches2 */
+    deadline_heap_t deadlines; /* the sent requests that have a deadline */
+    request_table_t expired_index; /* expired requests awaiting their response */
     completion_head_t completions_to_process; /* completions that are ready to run */
     int connect_index; /* The index of the address to connect to */
     clientid_t client_id;
@@ -217,16 +439,25 @@ struct _zhandle {
     int32_t ref_counter;
     volatile int close_requested;
     void *adaptor_priv;
+    struct _zoo_reactor *reactor; /* runs the IO of the handle, 0 for own threads */
     /* Used for debugging only: non-zero value indicates the time when the zookeeper_process
      * call returned while there was at least one unprocessed server response 
      * available in the socket recv buffer */
     struct timeval socket_readable;
     
-    zk_hashtable* active_node_watchers;   
-    zk_hashtable* active_exist_watchers;
-    zk_hashtable* active_child_watchers;
+    zk_hashtable* active_watchers; /* data, exist and child watches */
+    zk_hashtable* persistent_watchers; /* persistent and recursive watches */
     /** used for chroot path at the client side **/
     char *chroot;
+
+    object_pool_t completion_pool; /* completion_list_t */
+    object_pool_t buffer_pool; /* buffer_list_t */
+    object_pool_t oarchive_pool; /* request oarchives and their state */
+    object_pool_t watcher_pool; /* watcher_registration_t */
+    zk_counters_t counters;
+    read_cache_t *cache; /* 0 unless zoo_enable_cache() was called */
+    /* per request type, allocated when the first response comes in */
+    latency_histogram_t *volatile latencies[LATENCY_OPS];
 };
 
 
@@ -238,9 +469,26 @@ int wait_sync_completion(struct sync_completion *sc);
 void free_sync_completion(struct sync_completion *sc);
 void notify_sync_completion(struct sync_completion *sc);
 int adaptor_send_queue(zhandle_t *zh, int timeout);
+int send_set_watches(zhandle_t *zh);
 int process_async(int outstanding_sync);
 void process_completions(zhandle_t *zh);
+void run_completion(zhandle_t *zh, struct _completion_list *c);
+/* hands a completion over to the adaptor; 0 if the caller has to run it */
+int dispatch_completion(zhandle_t *zh, struct _completion_list *c,
+        unsigned int order_key);
+void queue_completion(completion_head_t *list, struct _completion_list *c,
+        int add_to_front);
+struct _completion_list *dequeue_completion(completion_head_t *list);
 int flush_send_queue(zhandle_t*zh, int timeout);
+void init_object_pool(object_pool_t *pool, size_t size, int max_free);
+void destroy_object_pool(object_pool_t *pool);
+void *pool_alloc(object_pool_t *pool);
+void pool_free(void *p);
+void init_buffer_list(buffer_head_t *list, object_pool_t *pool);
+int queue_buffer_bytes(buffer_head_t *list, char *buff, int len);
+buffer_list_t *dequeue_buffer(buffer_head_t *list);
+void free_buffer(buffer_list_t *b);
+void free_buffers(buffer_head_t *list);
 char* sub_string(zhandle_t *zh, const char* server_path);
 void free_duplicate_path(const char* free_path, const char* path);
 void zoo_lock_auth(zhandle_t *zh);
@@ -256,9 +504,17 @@ int32_t get_xid();
 // returns the new value of the ref counter
 int32_t inc_ref_counter(zhandle_t* zh,int i);
 
-#ifdef THREADED
+// atomic compare-and-swap, returns the value of *operand before the call
+int32_t compare_and_swap(volatile int32_t* operand, int32_t oldval, int32_t newval);
+// atomic load and store with full memory barriers
+int32_t atomic_get(volatile int32_t* operand);
+void atomic_set(volatile int32_t* operand, int32_t value);
+
 // atomic post-increment
 int32_t fetch_and_add(volatile int32_t* operand, int incr);
+int64_t fetch_and_add64(volatile int64_t* operand, int64_t incr);
+
+#ifdef THREADED
 // in mt mode process session event asynchronously by the completion thread
 #define PROCESS_SESSION_EVENT(zh,newstate) queue_session_event(zh,newstate)
 #else
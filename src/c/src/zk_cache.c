@@ -0,0 +1,365 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DLL_EXPORT
+#  define USE_STATIC_LIB
+#endif
+
+#include "zk_adaptor.h"
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * The nodes read by zoo_cached_get(), keyed by server path. An entry is
+ * created, still without data, before the node is read with a data watch;
+ * the data is only filled in if the entry is still there when the response
+ * has been processed. Any CHANGED or DELETED event for the path removes the
+ * entry, so a response that raced with a change never gets cached.
+ */
+typedef struct _cache_entry {
+    char *path;
+    unsigned int hash;
+    int64_t generation; /* tells an entry apart from a later one */
+    int pending; /* the data is being read */
+    char *data;
+    int data_len; /* -1 for null data */
+    struct Stat stat;
+    size_t size; /* what the entry counts against the budget */
+    struct _cache_entry *next; /* in the bucket */
+    struct _cache_entry *lru_prev; /* more recently used */
+    struct _cache_entry *lru_next; /* less recently used */
+} cache_entry_t;
+
+struct _read_cache {
+    cache_entry_t **buckets;
+    unsigned int mask;
+    unsigned int count;
+    cache_entry_t *lru_head;
+    cache_entry_t *lru_tail;
+    size_t max_bytes;
+    size_t bytes;
+    int64_t generation;
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t invalidations;
+#ifdef THREADED
+    pthread_mutex_t lock;
+#endif
+};
+
+#define MIN_BUCKETS 64
+
+static void lock_cache(read_cache_t *cache)
+{
+#ifdef THREADED
+    pthread_mutex_lock(&cache->lock);
+#endif
+}
+
+static void unlock_cache(read_cache_t *cache)
+{
+#ifdef THREADED
+    pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+/* FNV-1a, like the watch table */
+static unsigned int cache_hash(const char *path)
+{
+    unsigned int hash = 2166136261U;
+    while (*path) {
+        hash ^= (unsigned char)*path++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+read_cache_t *create_read_cache(size_t max_bytes)
+{
+    read_cache_t *cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        return 0;
+    cache->buckets = calloc(MIN_BUCKETS, sizeof(cache_entry_t*));
+    if (!cache->buckets) {
+        free(cache);
+        return 0;
+    }
+    cache->mask = MIN_BUCKETS - 1;
+    cache->max_bytes = max_bytes;
+#ifdef THREADED
+    pthread_mutex_init(&cache->lock, 0);
+#endif
+    return cache;
+}
+
+static void free_entry(cache_entry_t *e)
+{
+    free(e->path);
+    free(e->data);
+    free(e);
+}
+
+void destroy_read_cache(read_cache_t *cache)
+{
+    cache_entry_t *e;
+    if (!cache)
+        return;
+    while ((e = cache->lru_head) != 0) {
+        cache->lru_head = e->lru_next;
+        free_entry(e);
+    }
+    free(cache->buckets);
+#ifdef THREADED
+    pthread_mutex_destroy(&cache->lock);
+#endif
+    free(cache);
+}
+
+static cache_entry_t *find_entry(read_cache_t *cache, const char *path,
+        unsigned int hash)
+{
+    cache_entry_t *e = cache->buckets[hash & cache->mask];
+    while (e && (e->hash != hash || strcmp(e->path, path) != 0))
+        e = e->next;
+    return e;
+}
+
+/* doubles the buckets once there are more entries than buckets; the
+ * table just gets longer chains if that fails */
+static void grow_buckets(read_cache_t *cache)
+{
+    unsigned int size = (cache->mask + 1) * 2;
+    cache_entry_t **buckets = calloc(size, sizeof(cache_entry_t*));
+    cache_entry_t *e;
+    if (!buckets)
+        return;
+    for (e = cache->lru_head; e; e = e->lru_next) {
+        e->next = buckets[e->hash & (size - 1)];
+        buckets[e->hash & (size - 1)] = e;
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->mask = size - 1;
+}
+
+static void lru_unlink(read_cache_t *cache, cache_entry_t *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        cache->lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        cache->lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = 0;
+}
+
+static void lru_push(read_cache_t *cache, cache_entry_t *e)
+{
+    e->lru_prev = 0;
+    e->lru_next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->lru_prev = e;
+    else
+        cache->lru_tail = e;
+    cache->lru_head = e;
+}
+
+static void remove_entry(read_cache_t *cache, cache_entry_t *e)
+{
+    cache_entry_t **p = &cache->buckets[e->hash & cache->mask];
+    while (*p != e)
+        p = &(*p)->next;
+    *p = e->next;
+    lru_unlink(cache, e);
+    cache->bytes -= e->size;
+    cache->count--;
+    free_entry(e);
+}
+
+/* evicts the least recently used entries, except keep, until the cache is
+ * within its budget */
+static void evict(read_cache_t *cache, cache_entry_t *keep)
+{
+    cache_entry_t *e = cache->lru_tail;
+    while (cache->bytes > cache->max_bytes && e) {
+        cache_entry_t *prev = e->lru_prev;
+        if (e != keep) {
+            remove_entry(cache, e);
+            cache->evictions++;
+        }
+        e = prev;
+    }
+}
+
+int cache_lookup(read_cache_t *cache, const char *path, char *buffer,
+        int *buffer_len, struct Stat *stat, int64_t *generation)
+{
+    unsigned int hash = cache_hash(path);
+    cache_entry_t *e;
+    lock_cache(cache);
+    if (cache->max_bytes == 0) {
+        unlock_cache(cache);
+        return -1;
+    }
+    e = find_entry(cache, path, hash);
+    if (e && !e->pending) {
+        int len = e->data_len < *buffer_len ? e->data_len : *buffer_len;
+        if (len > 0)
+            memcpy(buffer, e->data, len);
+        *buffer_len = len;
+        if (stat)
+            *stat = e->stat;
+        lru_unlink(cache, e);
+        lru_push(cache, e);
+        cache->hits++;
+        unlock_cache(cache);
+        return 1;
+    }
+    cache->misses++;
+    *generation = 0;
+    if (!e) {
+        size_t len = strlen(path);
+        e = calloc(1, sizeof(*e));
+        if (e && (e->path = malloc(len + 1)) != 0) {
+            memcpy(e->path, path, len + 1);
+            e->hash = hash;
+            e->generation = ++cache->generation;
+            e->pending = 1;
+            e->size = sizeof(*e) + len + 1;
+            e->next = cache->buckets[hash & cache->mask];
+            cache->buckets[hash & cache->mask] = e;
+            lru_push(cache, e);
+            cache->bytes += e->size;
+            if (++cache->count > cache->mask + 1)
+                grow_buckets(cache);
+            evict(cache, e);
+        } else {
+            free(e);
+            e = 0;
+        }
+    }
+    /* the reads started while the entry is pending may all fill it in */
+    if (e)
+        *generation = e->generation;
+    unlock_cache(cache);
+    return 0;
+}
+
+void cache_fill(read_cache_t *cache, const char *path, int64_t generation,
+        const char *data, int data_len, const struct Stat *stat)
+{
+    cache_entry_t *e;
+    lock_cache(cache);
+    e = find_entry(cache, path, cache_hash(path));
+    if (e && e->pending && e->generation == generation) {
+        size_t size = e->size + (data_len > 0 ? data_len : 0);
+        if (size > cache->max_bytes ||
+                (data_len > 0 && (e->data = malloc(data_len)) == 0)) {
+            remove_entry(cache, e);
+        } else {
+            if (data_len > 0)
+                memcpy(e->data, data, data_len);
+            e->data_len = data_len;
+            e->stat = *stat;
+            e->pending = 0;
+            cache->bytes += size - e->size;
+            e->size = size;
+            evict(cache, e);
+        }
+    }
+    unlock_cache(cache);
+}
+
+void cache_abandon(read_cache_t *cache, const char *path, int64_t generation)
+{
+    cache_entry_t *e;
+    lock_cache(cache);
+    e = find_entry(cache, path, cache_hash(path));
+    if (e && e->pending && e->generation == generation)
+        remove_entry(cache, e);
+    unlock_cache(cache);
+}
+
+void cache_invalidate(read_cache_t *cache, const char *path)
+{
+    cache_entry_t *e;
+    lock_cache(cache);
+    e = find_entry(cache, path, cache_hash(path));
+    if (e) {
+        remove_entry(cache, e);
+        cache->invalidations++;
+    }
+    unlock_cache(cache);
+}
+
+void cache_clear(read_cache_t *cache)
+{
+    lock_cache(cache);
+    while (cache->lru_head)
+        remove_entry(cache, cache->lru_head);
+    unlock_cache(cache);
+}
+
+void set_read_cache_limit(read_cache_t *cache, size_t max_bytes)
+{
+    lock_cache(cache);
+    cache->max_bytes = max_bytes;
+    evict(cache, 0);
+    unlock_cache(cache);
+}
+
+void get_read_cache_stats(read_cache_t *cache, struct zoo_cache_stats *stats)
+{
+    lock_cache(cache);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->invalidations = cache->invalidations;
+    stats->entries = cache->count;
+    stats->bytes = cache->bytes;
+    unlock_cache(cache);
+}
+
+int zoo_enable_cache(zhandle_t *zh, size_t max_bytes)
+{
+    if (!zh)
+        return ZBADARGUMENTS;
+    if (zh->cache) {
+        set_read_cache_limit(zh->cache, max_bytes);
+        return ZOK;
+    }
+    if (max_bytes == 0)
+        return ZOK;
+    zh->cache = create_read_cache(max_bytes);
+    return zh->cache ? ZOK : ZSYSTEMERROR;
+}
+
+int zoo_get_cache_stats(zhandle_t *zh, struct zoo_cache_stats *stats)
+{
+    if (!zh || !stats)
+        return ZBADARGUMENTS;
+    if (!zh->cache) {
+        memset(stats, 0, sizeof(*stats));
+        return ZOK;
+    }
+    get_read_cache_stats(zh->cache, stats);
+    return ZOK;
+}
@@ -18,8 +18,6 @@
 
 #include "zk_hashtable.h"
 #include "zk_adaptor.h"
-#include "hashtable/hashtable.h"
-#include "hashtable/hashtable_itr.h"
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -30,30 +28,57 @@ typedef struct _watcher_object {
     struct _watcher_object* next;
 } watcher_object_t;
 
+/* a table holds either the one-shot or the persistent kinds of watch, so
+ * the persistent kinds reuse the list slots of the first one-shot kinds */
+#define LISTS_PER_ENTRY WATCH_TYPE_COUNT
 
+/* all the watches of one path */
+typedef struct _watch_entry {
+    char *path; /* one copy shared by all the lists, 0 for a free slot */
+    unsigned int hash;
+    unsigned int types; /* WATCH_* bits of the non-empty lists */
+    watcher_object_t *lists[LISTS_PER_ENTRY];
+} watch_entry_t;
+
+/**
+ * An open addressing table with linear probing. The number of slots is a
+ * power of two, so a probe starts at hash & mask; the hash is kept in the
+ * entry to skip most string comparisons and to grow without rehashing.
+ */
 struct _zk_hashtable {
-    struct hashtable* ht;
+    watch_entry_t *slots;
+    unsigned int mask;
+    unsigned int count;
 };
 
 struct watcher_object_list {
     watcher_object_t* head;
 };
 
-/* the following functions are for testing only */
-typedef struct hashtable hashtable_impl;
+#define MIN_SLOTS 32
 
-hashtable_impl* getImpl(zk_hashtable* ht){
-    return ht->ht;
+/* the list index of a single WATCH_* bit */
+static int list_index(int type)
+{
+    switch (type) {
+    case WATCH_DATA: return 0;
+    case WATCH_EXIST: return 1;
+    case WATCH_CHILD: return 2;
+    case WATCH_PERSISTENT: return 0;
+    default: assert(type == WATCH_PERSISTENT_RECURSIVE); return 1;
+    }
 }
 
-watcher_object_t* getFirstWatcher(zk_hashtable* ht,const char* path)
+/* FNV-1a of the first len characters of path */
+static unsigned int path_hash(const char *path, size_t len)
 {
-    watcher_object_list_t* wl=hashtable_search(ht->ht,(void*)path);
-    if(wl!=0)
-        return wl->head;
-    return 0;
+    unsigned int hash = 2166136261U;
+    while (len--) {
+        hash ^= (unsigned char)*path++;
+        hash *= 16777619U;
+    }
+    return hash;
 }
-/* end of testing functions */
 
 watcher_object_t* clone_watcher_object(watcher_object_t* wo)
 {
@@ -64,22 +89,6 @@ watcher_object_t* clone_watcher_object(watcher_object_t* wo)
     return res;
 }
 
-static unsigned int string_hash_djb2(void *str) 
-{
-    unsigned int hash = 5381;
-    int c;
-    const char* cstr = (const char*)str;
-    while ((c = *cstr++))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-
-    return hash;
-}
-
-static int string_equal(void *key1,void *key2)
-{
-    return strcmp((const char*)key1,(const char*)key2)==0;
-}
-
 static watcher_object_t* create_watcher_object(watcher_fn watcher,void* ctx)
 {
     watcher_object_t* wo=calloc(1,sizeof(watcher_object_t));
@@ -97,18 +106,20 @@ static watcher_object_list_t* create_watcher_object_list(watcher_object_t* head)
     return wl;
 }
 
-static void destroy_watcher_object_list(watcher_object_list_t* list)
+static void destroy_watcher_objects(watcher_object_t* e)
 {
-    watcher_object_t* e = NULL;
-
-    if(list==0)
-        return;
-    e=list->head;
     while(e!=0){
         watcher_object_t* this=e;
         e=e->next;
         free(this);
     }
+}
+
+static void destroy_watcher_object_list(watcher_object_list_t* list)
+{
+    if(list==0)
+        return;
+    destroy_watcher_objects(list->head);
     free(list);
 }
 
@@ -116,40 +127,90 @@ zk_hashtable* create_zk_hashtable()
 {
     struct _zk_hashtable *ht=calloc(1,sizeof(struct _zk_hashtable));
     assert(ht);
-    ht->ht=create_hashtable(32,string_hash_djb2,string_equal);
+    ht->slots=calloc(MIN_SLOTS,sizeof(watch_entry_t));
+    assert(ht->slots);
+    ht->mask=MIN_SLOTS-1;
     return ht;
 }
 
-static void do_clean_hashtable(zk_hashtable* ht)
-{
-    struct hashtable_itr *it;
-    int hasMore;
-    if(hashtable_count(ht->ht)==0)
-        return;
-    it=hashtable_iterator(ht->ht);
-    do {
-        watcher_object_list_t* w=hashtable_iterator_value(it);
-        destroy_watcher_object_list(w);
-        hasMore=hashtable_iterator_remove(it);
-    } while(hasMore);
-    free(it);
-}
-
 void destroy_zk_hashtable(zk_hashtable* ht)
 {
     if(ht!=0){
-        do_clean_hashtable(ht);
-        hashtable_destroy(ht->ht,0);
+        unsigned int i;
+        int j;
+        for(i=0;i<=ht->mask;i++){
+            watch_entry_t *e=&ht->slots[i];
+            if(!e->path)
+                continue;
+            for(j=0;j<LISTS_PER_ENTRY;j++)
+                destroy_watcher_objects(e->lists[j]);
+            free(e->path);
+        }
+        free(ht->slots);
         free(ht);
     }
 }
 
+/* the slot of the first len characters of path, or the free slot where
+ * they would go */
+static watch_entry_t *find_slot(zk_hashtable *ht, const char *path,
+        size_t len, unsigned int hash)
+{
+    unsigned int i=hash&ht->mask;
+    while(ht->slots[i].path){
+        watch_entry_t *e=&ht->slots[i];
+        if(e->hash==hash && strncmp(e->path,path,len)==0 && !e->path[len])
+            break;
+        i=(i+1)&ht->mask;
+    }
+    return &ht->slots[i];
+}
+
+static void grow_table(zk_hashtable *ht)
+{
+    watch_entry_t *old=ht->slots;
+    unsigned int size=ht->mask+1;
+    unsigned int i;
+    ht->slots=calloc(size*2,sizeof(watch_entry_t));
+    assert(ht->slots);
+    ht->mask=size*2-1;
+    for(i=0;i<size;i++){
+        if(old[i].path)
+            *find_slot(ht,old[i].path,strlen(old[i].path),old[i].hash)=old[i];
+    }
+    free(old);
+}
+
+/* frees the slot of an entry that has no watches left; the entries that
+ * follow it in its probe run move back, so lookups need no tombstones */
+static void remove_entry(zk_hashtable *ht, watch_entry_t *e)
+{
+    unsigned int i=e-ht->slots;
+    unsigned int j=i;
+    free(e->path);
+    for(;;){
+        unsigned int home;
+        j=(j+1)&ht->mask;
+        if(!ht->slots[j].path)
+            break;
+        home=ht->slots[j].hash&ht->mask;
+        /* the entry at j may only move back to i if its home slot is not
+         * in the cyclic range (i, j] */
+        if(i<=j ? (home<=i || home>j) : (home<=i && home>j)){
+            ht->slots[i]=ht->slots[j];
+            i=j;
+        }
+    }
+    memset(&ht->slots[i],0,sizeof(watch_entry_t));
+    ht->count--;
+}
+
 // searches for a watcher object instance in a watcher object list;
 // two watcher objects are equal if their watcher function and context pointers
 // are equal
-static watcher_object_t* search_watcher(watcher_object_list_t** wl,watcher_object_t* wo)
+static watcher_object_t* search_watcher(watcher_object_t* head,watcher_object_t* wo)
 {
-    watcher_object_t* wobj=(*wl)->head;
+    watcher_object_t* wobj=head;
     while(wobj!=0){
         if(wobj->watcher==wo->watcher && wobj->context==wo->context)
             return wobj;
@@ -158,17 +219,17 @@ static watcher_object_t* search_watcher(watcher_object_list_t** wl,watcher_objec
     return 0;
 }
 
-static int add_to_list(watcher_object_list_t **wl, watcher_object_t *wo,
+static int add_to_list(watcher_object_t **head, watcher_object_t *wo,
                        int clone)
 {
-    if (search_watcher(wl, wo)==0) {
+    if (search_watcher(*head, wo)==0) {
         watcher_object_t* cloned=wo;
         if (clone) {
             cloned = clone_watcher_object(wo);
             assert(cloned);
         }
-        cloned->next = (*wl)->head;
-        (*wl)->head = cloned;
+        cloned->next = *head;
+        *head = cloned;
         return 1;
     } else if (!clone) {
         // If it's here and we aren't supposed to clone, we must destroy
@@ -177,91 +238,121 @@ static int add_to_list(watcher_object_list_t **wl, watcher_object_t *wo,
     return 0;
 }
 
-static int do_insert_watcher_object(zk_hashtable *ht, const char *path, watcher_object_t* wo)
+static int insert_watcher_object(zk_hashtable *ht, int type, const char *path,
+                                 watcher_object_t* wo)
 {
-    int res=1;
-    watcher_object_list_t* wl;
-
-    wl=hashtable_search(ht->ht,(void*)path);
-    if(wl==0){
-        int res;
-        /* inserting a new path element */
-        res=hashtable_insert(ht->ht,strdup(path),create_watcher_object_list(wo));
-        assert(res);
-    }else{
-        /* path already exists; check if the watcher already exists */
-        res = add_to_list(&wl, wo, 1);
+    size_t len=strlen(path);
+    unsigned int hash=path_hash(path,len);
+    watch_entry_t *e=find_slot(ht,path,len,hash);
+    if(!e->path){
+        /* keep the load at 3/4 at most */
+        if((ht->count+1)*4>(ht->mask+1)*3){
+            grow_table(ht);
+            e=find_slot(ht,path,len,hash);
+        }
+        e->path=strdup(path);
+        assert(e->path);
+        e->hash=hash;
+        ht->count++;
     }
-    return res;    
+    e->types|=type;
+    return add_to_list(&e->lists[list_index(type)],wo,0);
 }
 
-
-char **collect_keys(zk_hashtable *ht, int *count)
+const char *next_watched_path(zk_hashtable *ht, unsigned int *cursor,
+        int *types)
 {
-    char **list;
-    struct hashtable_itr *it;
-    int i;
-
-    *count = hashtable_count(ht->ht);
-    list = calloc(*count, sizeof(char*));
-    it=hashtable_iterator(ht->ht);
-    for(i = 0; i < *count; i++) {
-        list[i] = strdup(hashtable_iterator_key(it));
-        hashtable_iterator_advance(it);
+    while(*cursor<=ht->mask){
+        watch_entry_t *e=&ht->slots[(*cursor)++];
+        if(e->path){
+            *types=e->types;
+            return e->path;
+        }
     }
-    free(it);
-    return list;
+    return 0;
 }
 
-static int insert_watcher_object(zk_hashtable *ht, const char *path,
-                                 watcher_object_t* wo)
+unsigned int watched_paths(zk_hashtable *ht)
 {
-    int res;
-    res=do_insert_watcher_object(ht,path,wo);
-    return res;
+    return ht->count;
 }
 
-static void copy_watchers(watcher_object_list_t *from, watcher_object_list_t *to, int clone)
+static void copy_watchers(watcher_object_t *from, watcher_object_list_t *to, int clone)
 {
-    watcher_object_t* wo=from->head;
+    watcher_object_t* wo=from;
     while(wo){
         watcher_object_t *next = wo->next;
-        add_to_list(&to, wo, clone);
+        add_to_list(&to->head, wo, clone);
         wo=next;
     }
 }
 
-static void copy_table(zk_hashtable *from, watcher_object_list_t *to) {
-    struct hashtable_itr *it;
-    int hasMore;
-    if(hashtable_count(from->ht)==0)
-        return;
-    it=hashtable_iterator(from->ht);
-    do {
-        watcher_object_list_t *w = hashtable_iterator_value(it);
-        copy_watchers(w, to, 1);
-        hasMore=hashtable_iterator_advance(it);
-    } while(hasMore);
-    free(it);
+static void copy_table(zk_hashtable *ht, watcher_object_list_t *list)
+{
+    unsigned int i;
+    int j;
+    for(i=0;i<=ht->mask;i++){
+        for(j=0;j<LISTS_PER_ENTRY;j++)
+            copy_watchers(ht->slots[i].lists[j], list, 1);
+    }
 }
 
 static void collect_session_watchers(zhandle_t *zh,
                                      watcher_object_list_t **list)
 {
-    copy_table(zh->active_node_watchers, *list);
-    copy_table(zh->active_exist_watchers, *list);
-    copy_table(zh->active_child_watchers, *list);
+    copy_table(zh->active_watchers, *list);
+    copy_table(zh->persistent_watchers, *list);
+}
+
+/* moves the one-shot watches of the given kinds on path to the delivery
+ * list */
+static void add_for_event(zk_hashtable *ht, int types, char *path,
+        watcher_object_list_t **list)
+{
+    size_t len=strlen(path);
+    watch_entry_t *e=find_slot(ht,path,len,path_hash(path,len));
+    int type;
+    if(!e->path || !(e->types&types))
+        return;
+    for(type=WATCH_DATA;type<=WATCH_CHILD;type<<=1){
+        if(!(types&type))
+            continue;
+        copy_watchers(e->lists[list_index(type)], *list, 0);
+        e->lists[list_index(type)]=0;
+    }
+    e->types&=~types;
+    if(!e->types)
+        remove_entry(ht,e);
+}
+
+/* adds the persistent watches of the given kind on the first len characters
+ * of path to the delivery list; they stay in place */
+static void add_persistent(zk_hashtable *ht, int type, const char *path,
+        size_t len, watcher_object_list_t **list)
+{
+    watch_entry_t *e=find_slot(ht,path,len,path_hash(path,len));
+    if(e->path && (e->types&type))
+        copy_watchers(e->lists[list_index(type)], *list, 1);
 }
 
-static void add_for_event(zk_hashtable *ht, char *path, watcher_object_list_t **list)
+/* persistent watches of the node get all its events, the recursive ones of
+ * the node and of its ancestors all but the child events */
+static void add_persistent_for_event(zk_hashtable *ht, int type, char *path,
+        watcher_object_list_t **list)
 {
-    watcher_object_list_t* wl;
-    wl = (watcher_object_list_t*)hashtable_remove(ht->ht, path);
-    if (wl) {
-        copy_watchers(wl, *list, 0);
-        // Since we move, not clone the watch_objects, we just need to free the
-        // head pointer
-        free(wl);
+    size_t len=strlen(path);
+    if(ht->count==0)
+        return;
+    add_persistent(ht,WATCH_PERSISTENT,path,len,list);
+    if(type==CHILD_EVENT_DEF)
+        return;
+    for(;;){
+        add_persistent(ht,WATCH_PERSISTENT_RECURSIVE,path,len,list);
+        if(len<=1)
+            break;
+        /* on to the parent; the parent of "/a" is "/" */
+        while(len>1 && path[--len]!='/')
+            ;
     }
 }
 
@@ -286,28 +377,28 @@ watcher_object_list_t *collectWatchers(zhandle_t *zh,int type, char *path)
         watcher_object_t defWatcher;
         defWatcher.watcher=zh->watcher;
         defWatcher.context=zh->context;
-        add_to_list(&list, &defWatcher, 1);
+        add_to_list(&list->head, &defWatcher, 1);
         collect_session_watchers(zh, &list);
         return list;
     }
+    // the watch of zoo_cached_get() fires with the others
+    if(zh->cache && (type==CHANGED_EVENT_DEF || type==DELETED_EVENT_DEF))
+        cache_invalidate(zh->cache,path);
+    // look up the watchers for the path and move them to a delivery list
     switch(type){
     case CREATED_EVENT_DEF:
     case CHANGED_EVENT_DEF:
-        // look up the watchers for the path and move them to a delivery list
-        add_for_event(zh->active_node_watchers,path,&list);
-        add_for_event(zh->active_exist_watchers,path,&list);
+        add_for_event(zh->active_watchers,WATCH_DATA|WATCH_EXIST,path,&list);
         break;
     case CHILD_EVENT_DEF:
-        // look up the watchers for the path and move them to a delivery list
-        add_for_event(zh->active_child_watchers,path,&list);
+        add_for_event(zh->active_watchers,WATCH_CHILD,path,&list);
         break;
     case DELETED_EVENT_DEF:
-        // look up the watchers for the path and move them to a delivery list
-        add_for_event(zh->active_node_watchers,path,&list);
-        add_for_event(zh->active_exist_watchers,path,&list);
-        add_for_event(zh->active_child_watchers,path,&list);
+        add_for_event(zh->active_watchers,
+                WATCH_DATA|WATCH_EXIST|WATCH_CHILD,path,&list);
         break;
     }
+    add_persistent_for_event(zh->persistent_watchers,type,path,&list);
     return list;
 }
 
@@ -324,9 +415,11 @@ void activateWatcher(zhandle_t *zh, watcher_registration_t* reg, int rc)
     if(reg){
         /* in multithreaded lib, this code is executed 
          * by the IO thread */
-        zk_hashtable *ht = reg->checker(zh, rc);
-        if(ht){
-            insert_watcher_object(ht,reg->path,
+        int type = reg->checker(zh, rc);
+        if(type){
+            zk_hashtable *ht=type&(WATCH_PERSISTENT|WATCH_PERSISTENT_RECURSIVE)?
+                    zh->persistent_watchers:zh->active_watchers;
+            insert_watcher_object(ht,type,reg->path,
                     create_watcher_object(reg->watcher, reg->context));
         }
     }    
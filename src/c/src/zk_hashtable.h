@@ -28,13 +28,23 @@ extern "C" {
     typedef struct watcher_object_list watcher_object_list_t;
 typedef struct _zk_hashtable zk_hashtable;
 
+/* the kinds of watch a path can carry. The one-shot kinds share a table,
+ * the persistent ones, which stay until the session ends, have their own */
+#define WATCH_DATA  0x1 /* zoo_get(), or zoo_exists() of an existing node */
+#define WATCH_EXIST 0x2 /* zoo_exists() of a node that does not exist */
+#define WATCH_CHILD 0x4 /* zoo_get_children() */
+#define WATCH_TYPE_COUNT 3 /* of the one-shot kinds */
+#define WATCH_PERSISTENT 0x8 /* any event of the node */
+#define WATCH_PERSISTENT_RECURSIVE 0x10 /* any but child events of the subtree */
+
 /**
- * The function must return a non-zero value if the watcher object can be activated
- * as a result of the server response. Normally, a watch can only be activated
- * if the server returns a success code (ZOK). However in the case when zoo_exists() 
- * returns a ZNONODE code the watcher should be activated nevertheless.
+ * The function must return the kind of watch (WATCH_DATA etc.) the watcher object
+ * is activated as a result of the server response, or 0 if it isn't. Normally, a
+ * watch can only be activated if the server returns a success code (ZOK). However
+ * in the case when zoo_exists() returns a ZNONODE code the watcher should be
+ * activated nevertheless.
  */
-typedef zk_hashtable *(*result_checker_fn)(zhandle_t *, int rc);
+typedef int (*result_checker_fn)(zhandle_t *, int rc);
 
 /**
  * A watcher object gets temporarily stored with the completion entry until 
@@ -51,7 +61,18 @@ typedef struct _watcher_registration {
 zk_hashtable* create_zk_hashtable();
 void destroy_zk_hashtable(zk_hashtable* ht);
 
-char **collect_keys(zk_hashtable *ht, int *count);
+/**
+ * iterates over the watched paths: returns the first path at or after
+ * *cursor (0 to start with), sets *types to its WATCH_* kinds and moves
+ * *cursor past it. Returns 0 at the end. The path belongs to the table.
+ */
+const char *next_watched_path(zk_hashtable *ht, unsigned int *cursor,
+        int *types);
+
+/**
+ * the number of paths with at least one watch on them.
+ */
+unsigned int watched_paths(zk_hashtable *ht);
 
 /**
  * check if the completion has a watcher object associated
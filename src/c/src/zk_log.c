@@ -21,16 +21,26 @@
 #endif
 
 #include "zookeeper_log.h"
+#include "zk_adaptor.h"
 #ifndef WIN32
 #include <unistd.h>
 #endif
 
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
 
 #define TIME_NOW_BUF_SIZE 1024
 #define FORMAT_LOG_BUF_SIZE 4096
 
+/* the time of the last message. The date and the seconds are formatted
+ * again only when the second changes */
+struct time_cache {
+    time_t sec;
+    int len; /* of the "yyyy-MM-dd HH:mm:ss," part */
+    char str[TIME_NOW_BUF_SIZE];
+};
+
 #ifdef THREADED
 #ifndef WIN32
 #include <pthread.h>
@@ -63,17 +73,18 @@ char* getTSData(pthread_key_t key,int size){
     return p;
 }
 
-char* get_time_buffer(){
-    return getTSData(time_now_buffer,TIME_NOW_BUF_SIZE);
+struct time_cache* get_time_buffer(){
+    return (struct time_cache*)getTSData(time_now_buffer,
+            sizeof(struct time_cache));
 }
 
 char* get_format_log_buffer(){  
     return getTSData(format_log_msg_buffer,FORMAT_LOG_BUF_SIZE);
 }
 #else
-char* get_time_buffer(){
-    static char buf[TIME_NOW_BUF_SIZE];
-    return buf;    
+struct time_cache* get_time_buffer(){
+    static struct time_cache buf;
+    return &buf;
 }
 
 char* get_format_log_buffer(){
@@ -96,52 +107,242 @@ void zoo_set_log_stream(FILE* stream){
     logStream=stream;
 }
 
-static const char* time_now(char* now_str){
+static const char* time_now(struct time_cache* cache,const struct timeval* tv){
+    int ms = (int)(tv->tv_usec/1000);
+
+    if (cache->sec != tv->tv_sec || cache->len == 0) {
+        struct tm lt;
+        time_t now = tv->tv_sec;
+        localtime_r(&now, &lt);
+
+        // clone the format used by log4j ISO8601DateFormat
+        // specifically: "yyyy-MM-dd HH:mm:ss,SSS"
+
+        cache->len = strftime(cache->str, TIME_NOW_BUF_SIZE - 4,
+                              "%Y-%m-%d %H:%M:%S,",
+                              &lt);
+        cache->sec = tv->tv_sec;
+    }
+    cache->str[cache->len] = '0' + ms / 100;
+    cache->str[cache->len + 1] = '0' + ms / 10 % 10;
+    cache->str[cache->len + 2] = '0' + ms % 10;
+    cache->str[cache->len + 3] = 0;
+    return cache->str;
+}
+
+static const char* dbgLevelStr[]={"ZOO_INVALID","ZOO_ERROR","ZOO_WARN",
+        "ZOO_INFO","ZOO_DEBUG"};
+
+static pid_t get_log_pid(){
+    static pid_t pid=0;
+    if(pid==0)pid=getpid();
+    return pid;
+}
+
+#if defined(THREADED) && !defined(WIN32)
+/*
+ * The asynchronous backend. Callers copy their message into a record of a
+ * bounded ring and go on; a writer thread formats the records and writes
+ * them out in batches with one flush per batch. A caller that finds the
+ * ring full drops its message, and the writer reports how many were
+ * dropped, so logging never blocks the IO thread.
+ */
+#define LOG_RING_SIZE 1024 /* records, a power of 2 */
+#define LOG_MESSAGE_SIZE 480
+
+typedef struct _log_record {
+    /* the position the record is free for, or that position + 1 once the
+     * message is in */
+    volatile int32_t seq;
+    ZooLogLevel level;
+    int line;
+    const char* funcName;
+    unsigned long int tid;
     struct timeval tv;
-    struct tm lt;
-    time_t now = 0;
-    size_t len = 0;
-    
-    gettimeofday(&tv,0);
+    char message[LOG_MESSAGE_SIZE];
+} log_record_t;
 
-    now = tv.tv_sec;
-    localtime_r(&now, &lt);
+static log_record_t log_ring[LOG_RING_SIZE];
+static volatile int32_t log_enqueue_pos;
+static int32_t log_dequeue_pos; /* the writer's, or zoo_set_log_async's */
+static volatile int32_t log_dropped;
+static volatile int32_t log_writer_idle;
+static volatile int32_t log_writer_stop;
+static volatile int32_t log_async;
+static int log_ring_ready;
+static pthread_t log_writer;
+static pthread_mutex_t log_writer_lock;
+static pthread_cond_t log_writer_cond;
 
-    // clone the format used by log4j ISO8601DateFormat
-    // specifically: "yyyy-MM-dd HH:mm:ss,SSS"
+#define POS_DIFF(a,b) ((int32_t)((unsigned int)(a)-(unsigned int)(b)))
+#define POS_NEXT(a) ((int32_t)((unsigned int)(a)+1))
 
-    len = strftime(now_str, TIME_NOW_BUF_SIZE,
-                          "%Y-%m-%d %H:%M:%S",
-                          &lt);
+static void queue_log_record(ZooLogLevel curLevel,int line,
+        const char* funcName,const char* message)
+{
+    int32_t pos=atomic_get(&log_enqueue_pos);
+    log_record_t* r;
+    for(;;){
+        int32_t diff;
+        r=&log_ring[pos&(LOG_RING_SIZE-1)];
+        diff=POS_DIFF(atomic_get(&r->seq),pos);
+        if(diff==0){
+            int32_t seen=compare_and_swap(&log_enqueue_pos,pos,POS_NEXT(pos));
+            if(seen==pos)
+                break;
+            pos=seen;
+        }else if(diff<0){
+            fetch_and_add(&log_dropped,1);
+            return;
+        }else{
+            pos=atomic_get(&log_enqueue_pos);
+        }
+    }
+    r->level=curLevel;
+    r->line=line;
+    r->funcName=funcName;
+    r->tid=(unsigned long int)pthread_self();
+    gettimeofday(&r->tv,0);
+    strncpy(r->message,message,LOG_MESSAGE_SIZE-1);
+    r->message[LOG_MESSAGE_SIZE-1]=0;
+    atomic_set(&r->seq,POS_NEXT(pos));
+    /* the writer sets the flag before it checks the ring a last time */
+    if(atomic_get(&log_writer_idle)){
+        pthread_mutex_lock(&log_writer_lock);
+        pthread_cond_signal(&log_writer_cond);
+        pthread_mutex_unlock(&log_writer_lock);
+    }
+}
 
-    len += snprintf(now_str + len,
-                    TIME_NOW_BUF_SIZE - len,
-                    ",%03d",
-                    (int)(tv.tv_usec/1000));
+static int log_record_ready(){
+    log_record_t* r=&log_ring[log_dequeue_pos&(LOG_RING_SIZE-1)];
+    return atomic_get(&r->seq)==POS_NEXT(log_dequeue_pos);
+}
 
-    return now_str;
+/* writes out what is in the ring, returns the number of records */
+static int write_log_records(){
+    static struct time_cache cache;
+    FILE* stream=LOGSTREAM;
+    int32_t dropped;
+    int count=0;
+    while(count<LOG_RING_SIZE && log_record_ready()){
+        log_record_t* r=&log_ring[log_dequeue_pos&(LOG_RING_SIZE-1)];
+        fprintf(stream, "%s:%d(0x%lx):%s@%s@%d: %s\n",
+                time_now(&cache,&r->tv),get_log_pid(),r->tid,
+                dbgLevelStr[r->level],r->funcName,r->line,r->message);
+        atomic_set(&r->seq,log_dequeue_pos+LOG_RING_SIZE);
+        log_dequeue_pos=POS_NEXT(log_dequeue_pos);
+        count++;
+    }
+    dropped=atomic_get(&log_dropped);
+    if(dropped){
+        struct timeval tv;
+        fetch_and_add(&log_dropped,-dropped);
+        gettimeofday(&tv,0);
+        fprintf(stream, "%s:%d(0x%lx):%s@%s@%d: %d log messages dropped\n",
+                time_now(&cache,&tv),get_log_pid(),
+                (unsigned long int)pthread_self(),
+                dbgLevelStr[ZOO_LOG_LEVEL_WARN],__func__,__LINE__,dropped);
+    }
+    if(count||dropped)
+        fflush(stream);
+    return count;
+}
+
+static void* log_writer_loop(void* arg){
+    for(;;){
+        struct timeval now;
+        struct timespec until;
+        if(write_log_records())
+            continue;
+        if(atomic_get(&log_writer_stop))
+            break;
+        pthread_mutex_lock(&log_writer_lock);
+        atomic_set(&log_writer_idle,1);
+        if(!log_record_ready() && !atomic_get(&log_writer_stop)){
+            gettimeofday(&now,0);
+            until.tv_sec=now.tv_sec+1;
+            until.tv_nsec=now.tv_usec*1000;
+            pthread_cond_timedwait(&log_writer_cond,&log_writer_lock,&until);
+        }
+        atomic_set(&log_writer_idle,0);
+        pthread_mutex_unlock(&log_writer_lock);
+    }
+    return 0;
 }
 
+static void stop_log_writer(){
+    zoo_set_log_async(0);
+}
+
+int zoo_set_log_async(int enable){
+    static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+    int rc=ZOK;
+    pthread_mutex_lock(&lock);
+    if(enable && !atomic_get(&log_async)){
+        if(!log_ring_ready){
+            int32_t i;
+            /* the positions carry on from one writer to the next, so that
+             * messages queued while the last one stopped go out with the
+             * next */
+            for(i=0;i<LOG_RING_SIZE;i++)
+                log_ring[i].seq=i;
+            pthread_mutex_init(&log_writer_lock,0);
+            pthread_cond_init(&log_writer_cond,0);
+            atexit(stop_log_writer);
+            log_ring_ready=1;
+        }
+        atomic_set(&log_writer_stop,0);
+        if(pthread_create(&log_writer,0,log_writer_loop,0)==0)
+            atomic_set(&log_async,1);
+        else
+            rc=ZSYSTEMERROR;
+    }else if(!enable && atomic_get(&log_async)){
+        atomic_set(&log_async,0);
+        atomic_set(&log_writer_stop,1);
+        pthread_mutex_lock(&log_writer_lock);
+        pthread_cond_signal(&log_writer_cond);
+        pthread_mutex_unlock(&log_writer_lock);
+        pthread_join(log_writer,0);
+        /* what was queued by threads that saw the flag set before it was
+         * cleared but finished after the writer's last look */
+        write_log_records();
+    }
+    pthread_mutex_unlock(&lock);
+    return rc;
+}
+#elif defined(THREADED)
+int zoo_set_log_async(int enable){
+    return enable?ZUNIMPLEMENTED:ZOK;
+}
+#endif
+
 void log_message(ZooLogLevel curLevel,int line,const char* funcName,
     const char* message)
 {
-    static const char* dbgLevelStr[]={"ZOO_INVALID","ZOO_ERROR","ZOO_WARN",
-            "ZOO_INFO","ZOO_DEBUG"};
-    static pid_t pid=0;
+    struct timeval tv;
 #ifdef WIN32
-    char timebuf [TIME_NOW_BUF_SIZE];
+    struct time_cache timebuf;
+    timebuf.len=0;
 #endif
-    if(pid==0)pid=getpid();
+#if defined(THREADED) && !defined(WIN32)
+    if(atomic_get(&log_async)){
+        queue_log_record(curLevel,line,funcName,message);
+        return;
+    }
+#endif
+    gettimeofday(&tv,0);
 #ifndef THREADED
-    fprintf(LOGSTREAM, "%s:%d:%s@%s@%d: %s\n", time_now(get_time_buffer()),pid,
-            dbgLevelStr[curLevel],funcName,line,message);
+    fprintf(LOGSTREAM, "%s:%d:%s@%s@%d: %s\n", time_now(get_time_buffer(),&tv),
+            get_log_pid(),dbgLevelStr[curLevel],funcName,line,message);
 #else
 #ifdef WIN32
-    fprintf(LOGSTREAM, "%s:%d(0x%lx):%s@%s@%d: %s\n", time_now(timebuf),pid,
-            (unsigned long int)(pthread_self().thread_id),
+    fprintf(LOGSTREAM, "%s:%d(0x%lx):%s@%s@%d: %s\n", time_now(&timebuf,&tv),
+            get_log_pid(),(unsigned long int)(pthread_self().thread_id),
             dbgLevelStr[curLevel],funcName,line,message);      
 #else
-    fprintf(LOGSTREAM, "%s:%d(0x%lx):%s@%s@%d: %s\n", time_now(get_time_buffer()),pid,
+    fprintf(LOGSTREAM, "%s:%d(0x%lx):%s@%s@%d: %s\n",
+            time_now(get_time_buffer(),&tv),get_log_pid(),
             (unsigned long int)pthread_self(),
             dbgLevelStr[curLevel],funcName,line,message);      
 #endif
@@ -0,0 +1,180 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DLL_EXPORT
+#  define USE_STATIC_LIB
+#endif
+
+#include "zk_adaptor.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* each power of 2 above the first 16 microseconds is split in 16 buckets */
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+
+/* the request types that are tracked, in the order of latency_index() */
+static const int tracked_ops[LATENCY_OPS] = {
+    ZOO_CREATE_OP, ZOO_DELETE_OP, ZOO_EXISTS_OP, ZOO_GETDATA_OP,
+    ZOO_SETDATA_OP, ZOO_GETACL_OP, ZOO_SETACL_OP, ZOO_GETCHILDREN_OP,
+    ZOO_SYNC_OP, ZOO_PING_OP, ZOO_GETCHILDREN2_OP, ZOO_MULTI_OP,
+    ZOO_CLOSE_OP, ZOO_ADDWATCH_OP
+};
+
+static int latency_index(int op)
+{
+    switch (op) {
+    case ZOO_CREATE_OP: return 0;
+    case ZOO_DELETE_OP: return 1;
+    case ZOO_EXISTS_OP: return 2;
+    case ZOO_GETDATA_OP: return 3;
+    case ZOO_SETDATA_OP: return 4;
+    case ZOO_GETACL_OP: return 5;
+    case ZOO_SETACL_OP: return 6;
+    case ZOO_GETCHILDREN_OP: return 7;
+    case ZOO_SYNC_OP: return 8;
+    case ZOO_PING_OP: return 9;
+    case ZOO_GETCHILDREN2_OP: return 10;
+    case ZOO_MULTI_OP: return 11;
+    case ZOO_CLOSE_OP: return 12;
+    case ZOO_ADDWATCH_OP: return 13;
+    default: return -1;
+    }
+}
+
+static int latency_bucket(int64_t us)
+{
+    int shift = 0;
+    if (us < SUB_BUCKETS)
+        return us < 0 ? 0 : (int)us;
+    if (us > 0xffffffffLL)
+        return ZOO_LATENCY_BUCKETS - 1;
+    /* the position of the highest bit above the sub bucket bits */
+    while ((us >> shift) >= 2 * SUB_BUCKETS)
+        shift++;
+    return ((shift + 1) << SUB_BUCKET_BITS) +
+            (int)((us >> shift) & (SUB_BUCKETS - 1));
+}
+
+int64_t zoo_latency_bucket_floor(int bucket)
+{
+    int shift;
+    if (bucket < SUB_BUCKETS)
+        return bucket < 0 ? 0 : bucket;
+    shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    return (int64_t)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+}
+
+void record_latency(zhandle_t *zh, int op, const struct timeval *sent,
+        const struct timeval *now)
+{
+    int i = latency_index(op);
+    latency_histogram_t *h;
+    int64_t us;
+    if (i < 0)
+        return;
+    h = zh->latencies[i];
+    if (!h) {
+        h = calloc(1, sizeof(*h));
+        if (!h)
+            return;
+        zh->latencies[i] = h;
+    }
+    us = (int64_t)(now->tv_sec - sent->tv_sec) * 1000000 +
+            (now->tv_usec - sent->tv_usec);
+    if (us < 0)
+        us = 0;
+    h->buckets[latency_bucket(us)]++;
+    h->total_us += us;
+    if (us > h->max_us)
+        h->max_us = us;
+    h->count++;
+}
+
+void destroy_latency_histograms(zhandle_t *zh)
+{
+    int i;
+    for (i = 0; i < LATENCY_OPS; i++) {
+        free(zh->latencies[i]);
+        zh->latencies[i] = 0;
+    }
+}
+
+int zoo_get_metrics(zhandle_t *zh, struct zoo_metrics *metrics)
+{
+    int i;
+    if (!zh || !metrics)
+        return ZBADARGUMENTS;
+    metrics->count = 0;
+    /* the IO thread only adds to the counts, and never frees a histogram
+     * before the handle goes away */
+    for (i = 0; i < LATENCY_OPS; i++) {
+        latency_histogram_t *h = zh->latencies[i];
+        struct zoo_op_latency *l;
+        if (!h)
+            continue;
+        l = &metrics->ops[metrics->count++];
+        l->op = tracked_ops[i];
+        l->count = h->count;
+        l->total_us = h->total_us;
+        l->max_us = h->max_us;
+        memcpy(l->buckets, h->buckets, sizeof(l->buckets));
+    }
+    return ZOK;
+}
+
+int zoo_get_stats(zhandle_t *zh, struct zoo_stats *stats)
+{
+    if (!zh || !stats)
+        return ZBADARGUMENTS;
+    stats->to_send = atomic_get(&zh->to_send.length);
+    stats->sent_requests = atomic_get(&zh->sent_requests.length);
+    stats->to_process = atomic_get(&zh->to_process.length);
+    stats->completions = atomic_get(&zh->completions_to_process.length);
+    stats->bytes_sent = fetch_and_add64(&zh->counters.bytes_sent, 0);
+    stats->bytes_received = fetch_and_add64(&zh->counters.bytes_received, 0);
+    stats->connects = atomic_get(&zh->counters.connects);
+    stats->disconnects = atomic_get(&zh->counters.disconnects);
+    stats->watched_paths = watched_paths(zh->active_watchers);
+    stats->persistent_watched_paths = watched_paths(zh->persistent_watchers);
+    return ZOK;
+}
+
+int64_t zoo_latency_percentile(const struct zoo_op_latency *latency,
+        double percentile)
+{
+    int64_t total = 0;
+    int64_t seen = 0;
+    double wanted;
+    int i;
+    for (i = 0; i < ZOO_LATENCY_BUCKETS; i++)
+        total += latency->buckets[i];
+    if (total == 0)
+        return 0;
+    wanted = total * percentile / 100.0;
+    for (i = 0; i < ZOO_LATENCY_BUCKETS - 1; i++) {
+        seen += latency->buckets[i];
+        if (seen >= wanted && seen > 0)
+            break;
+    }
+    /* the highest latency of the bucket, or the highest one seen */
+    if (i < ZOO_LATENCY_BUCKETS - 1 &&
+            zoo_latency_bucket_floor(i + 1) - 1 < latency->max_us)
+        return zoo_latency_bucket_floor(i + 1) - 1;
+    return latency->max_us;
+}
@@ -44,6 +44,7 @@
 #ifndef WIN32
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <poll.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -69,6 +70,9 @@ const int ZOOKEEPER_READ = 1 << 1;
 const int ZOO_EPHEMERAL = 1 << 0;
 const int ZOO_SEQUENCE = 1 << 1;
 
+const int ZOO_ADD_WATCH_PERSISTENT = 0;
+const int ZOO_ADD_WATCH_PERSISTENT_RECURSIVE = 1;
+
 const int ZOO_EXPIRED_SESSION_STATE = EXPIRED_SESSION_STATE_DEF;
 const int ZOO_AUTH_FAILED_STATE = AUTH_FAILED_STATE_DEF;
 const int ZOO_CONNECTING_STATE = CONNECTING_STATE_DEF;
@@ -170,7 +174,14 @@ typedef struct _completion_list {
     const void *data;
     buffer_list_t *buffer;
     struct _completion_list *next;
+    struct _completion_list *prev; /* in sent_requests, unless at the head */
     watcher_registration_t* watcher;
+    struct timeval deadline; /* when the request expires, if heap_pos != 0 */
+    int heap_pos; /* 1 + the position in zh->deadlines, 0 if not there */
+    request_hint_t index_hint; /* where zh->sent_index put it */
+    uint32_t order_key; /* completions with the same key run in order */
+    int op; /* the type of the request */
+    struct timeval queued; /* when the request was queued */
 } completion_list_t;
 
 const char*err2string(int err);
@@ -183,17 +194,21 @@ static void deserialize_response(int type, int xid, int failed, int rc, completi
 static int deserialize_multi(int xid, completion_list_t *cptr, struct iarchive *ia);
 
 /* completion routine forward declarations */
-static int add_completion(zhandle_t *zh, int xid, int completion_type,
-        const void *dc, const void *data, int add_to_front, 
+static int add_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+        int completion_type, const void *dc, const void *data,
+        int add_to_front, watcher_registration_t* wo, completion_head_t *clist);
+static completion_list_t* create_completion_entry(zhandle_t *zh, int xid,
+        int completion_type, const void *dc, const void *data,
         watcher_registration_t* wo, completion_head_t *clist);
-static completion_list_t* create_completion_entry(int xid, int completion_type,
-        const void *dc, const void *data, watcher_registration_t* wo, 
-        completion_head_t *clist);
 static void destroy_completion_entry(completion_list_t* c);
+static uint32_t path_order_key(const char *path);
+static completion_list_t *take_sent_request(zhandle_t *zh, int xid,
+        int *expected);
+static int forget_expired_request(zhandle_t *zh, int xid);
+static void expire_requests(zhandle_t *zh);
+static int next_request_deadline(zhandle_t *zh, const struct timeval *now);
 static void queue_completion_nolock(completion_head_t *list, completion_list_t *c,
         int add_to_front);
-static void queue_completion(completion_head_t *list, completion_list_t *c,
-        int add_to_front);
 static int handle_socket_error_msg(zhandle_t *zh, int line, int rc,
     const char* format,...);
 static void cleanup_bufs(zhandle_t *zh,int callCompletion,int rc);
@@ -235,6 +250,37 @@ int zoo_recv_timeout(zhandle_t *zh)
     return zh->recv_timeout;
 }
 
+static void get_pool_counters(object_pool_t *pool, zoo_pool_counters_t *c)
+{
+    lock_object_pool(pool);
+    c->hits = pool->hits;
+    c->misses = pool->misses;
+    unlock_object_pool(pool);
+}
+
+void zoo_set_request_timeout(zhandle_t *zh, int timeout)
+{
+    atomic_set(&zh->request_timeout, timeout > 0 ? timeout : 0);
+}
+
+int zoo_get_request_timeout(zhandle_t *zh)
+{
+    return atomic_get(&zh->request_timeout);
+}
+
+void zoo_set_persistent_watches(zhandle_t *zh, int enable)
+{
+    zh->persistent_watches = enable != 0;
+}
+
+void zoo_get_pool_stats(zhandle_t *zh, zoo_pool_stats_t *stats)
+{
+    get_pool_counters(&zh->completion_pool, &stats->completions);
+    get_pool_counters(&zh->buffer_pool, &stats->buffers);
+    get_pool_counters(&zh->oarchive_pool, &stats->archives);
+    get_pool_counters(&zh->watcher_pool, &stats->watchers);
+}
+
 /** these functions are thread unsafe, so make sure that
     zoo_lock_auth is called before you access them **/
 static auth_info* get_last_auth(auth_list_head_t *auth_list) {
@@ -360,24 +406,34 @@ int is_unrecoverable(zhandle_t *zh)
     return (zh->state<0)? ZINVALIDSTATE: ZOK;
 }
 
-zk_hashtable *exists_result_checker(zhandle_t *zh, int rc)
+int exists_result_checker(zhandle_t *zh, int rc)
 {
     if (rc == ZOK) {
-        return zh->active_node_watchers;
+        return WATCH_DATA;
     } else if (rc == ZNONODE) {
-        return zh->active_exist_watchers;
+        return WATCH_EXIST;
     }
     return 0;
 }
 
-zk_hashtable *data_result_checker(zhandle_t *zh, int rc)
+int data_result_checker(zhandle_t *zh, int rc)
+{
+    return rc==ZOK ? WATCH_DATA : 0;
+}
+
+int child_result_checker(zhandle_t *zh, int rc)
 {
-    return rc==ZOK ? zh->active_node_watchers : 0;
+    return rc==ZOK ? WATCH_CHILD : 0;
 }
 
-zk_hashtable *child_result_checker(zhandle_t *zh, int rc)
+int persistent_result_checker(zhandle_t *zh, int rc)
 {
-    return rc==ZOK ? zh->active_child_watchers : 0;
+    return rc==ZOK ? WATCH_PERSISTENT : 0;
+}
+
+int recursive_result_checker(zhandle_t *zh, int rc)
+{
+    return rc==ZOK ? WATCH_PERSISTENT_RECURSIVE : 0;
 }
 
 /**
@@ -411,9 +467,19 @@ static void destroy(zhandle_t *zh)
     }
 
     free_auth_info(&zh->auth_h);
-    destroy_zk_hashtable(zh->active_node_watchers);
-    destroy_zk_hashtable(zh->active_exist_watchers);
-    destroy_zk_hashtable(zh->active_child_watchers);
+    destroy_zk_hashtable(zh->active_watchers);
+    destroy_zk_hashtable(zh->persistent_watchers);
+    destroy_latency_histograms(zh);
+    destroy_read_cache(zh->cache);
+    zh->cache = 0;
+    request_table_destroy(&zh->sent_index);
+    request_table_destroy(&zh->expired_index);
+    free(zh->deadlines.entries);
+    zh->deadlines.entries = 0;
+    destroy_object_pool(&zh->completion_pool);
+    destroy_object_pool(&zh->buffer_pool);
+    destroy_object_pool(&zh->oarchive_pool);
+    destroy_object_pool(&zh->watcher_pool);
 }
 
 static void setup_random()
@@ -762,8 +828,9 @@ static void log_env() {
 /**
  * Create a zookeeper handle associated with the given host and port.
  */
-zhandle_t *zookeeper_init(const char *host, watcher_fn watcher,
-  int recv_timeout, const clientid_t *clientid, void *context, int flags)
+static zhandle_t *init_zhandle(const char *host, watcher_fn watcher,
+  int recv_timeout, const clientid_t *clientid, void *context, int flags,
+  struct _zoo_reactor *reactor)
 {
     int errnosave = 0;
     zhandle_t *zh = NULL;
@@ -794,6 +861,7 @@ zhandle_t *zookeeper_init(const char *host, watcher_fn watcher,
     zh->fd = -1;
     zh->state = NOTCONNECTED_STATE_DEF;
     zh->context = context;
+    zh->reactor = reactor;
     zh->recv_timeout = recv_timeout;
     init_auth_info(&zh->auth_h);
     if (watcher) {
@@ -851,9 +919,18 @@ zhandle_t *zookeeper_init(const char *host, watcher_fn watcher,
     zh->last_zxid = 0;
     zh->next_deadline.tv_sec=zh->next_deadline.tv_usec=0;
     zh->socket_readable.tv_sec=zh->socket_readable.tv_usec=0;
-    zh->active_node_watchers=create_zk_hashtable();
-    zh->active_exist_watchers=create_zk_hashtable();
-    zh->active_child_watchers=create_zk_hashtable();
+    zh->active_watchers=create_zk_hashtable();
+    zh->persistent_watchers=create_zk_hashtable();
+    init_object_pool(&zh->completion_pool, sizeof(completion_list_t),
+            OBJECT_POOL_MAX_FREE);
+    init_object_pool(&zh->buffer_pool, sizeof(buffer_list_t),
+            OBJECT_POOL_MAX_FREE);
+    init_object_pool(&zh->oarchive_pool, buffer_oarchive_size(),
+            OBJECT_POOL_MAX_FREE);
+    init_object_pool(&zh->watcher_pool, sizeof(watcher_registration_t),
+            OBJECT_POOL_MAX_FREE);
+    init_buffer_list(&zh->to_send, &zh->buffer_pool);
+    init_buffer_list(&zh->to_process, &zh->buffer_pool);
 
     if (adaptor_init(zh) == -1) {
         goto abort;
@@ -868,6 +945,27 @@ abort:
     return 0;
 }
 
+zhandle_t *zookeeper_init(const char *host, watcher_fn watcher,
+  int recv_timeout, const clientid_t *clientid, void *context, int flags)
+{
+    return init_zhandle(host, watcher, recv_timeout, clientid, context,
+            flags, 0);
+}
+
+#ifdef THREADED
+zhandle_t *zookeeper_init_reactor(zoo_reactor_t *reactor, const char *host,
+  watcher_fn watcher, int recv_timeout, const clientid_t *clientid,
+  void *context, int flags)
+{
+    if (reactor == 0) {
+        errno=EINVAL;
+        return 0;
+    }
+    return init_zhandle(host, watcher, recv_timeout, clientid, context,
+            flags, reactor);
+}
+#endif
+
 /**
  * deallocated the free_path only its beeen allocated
  * and not equal to path
@@ -917,9 +1015,113 @@ char* sub_string(zhandle_t *zh, const char* server_path) {
     return ret_str;
 }
 
-static buffer_list_t *allocate_buffer(char *buff, int len)
+void init_object_pool(object_pool_t *pool, size_t size, int max_free)
+{
+    pool->size = size;
+    pool->free_list = 0;
+    pool->free_count = 0;
+    pool->max_free = max_free;
+    pool->hits = pool->misses = 0;
+}
+
+/* must only be called once nobody else can use the pool */
+void destroy_object_pool(object_pool_t *pool)
+{
+    while (pool->free_list) {
+        pool_header_t *h = pool->free_list;
+        pool->free_list = h->next;
+        free(h);
+    }
+    pool->free_count = 0;
+}
+
+/**
+ * Returns a zeroed object from the pool, or from calloc if the pool is empty.
+ */
+void *pool_alloc(object_pool_t *pool)
+{
+    pool_header_t *h;
+    lock_object_pool(pool);
+    h = pool->free_list;
+    if (h) {
+        pool->free_list = h->next;
+        pool->free_count--;
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    unlock_object_pool(pool);
+    if (h) {
+        memset(h + 1, 0, pool->size);
+    } else {
+        h = calloc(1, sizeof(*h) + pool->size);
+        if (h == 0)
+            return 0;
+    }
+    h->pool = pool;
+    return h + 1;
+}
+
+/**
+ * Returns an object to the pool it came from, or to free() if the pool
+ * already holds max_free objects.
+ */
+void pool_free(void *p)
+{
+    pool_header_t *h;
+    object_pool_t *pool;
+    if (p == 0)
+        return;
+    h = (pool_header_t*)p - 1;
+    pool = h->pool;
+    lock_object_pool(pool);
+    if (pool->free_count < pool->max_free) {
+        h->next = pool->free_list;
+        pool->free_list = h;
+        pool->free_count++;
+        h = 0;
+    }
+    unlock_object_pool(pool);
+    free(h);
+}
+
+/* adds up in size what the request header h followed by the request record
+ * req of type T take when serialized */
+#define REQUEST_SIZE(size, h, T, req) do { \
+        struct oarchive sa; \
+        init_size_oarchive(&sa, &(size)); \
+        serialize_RequestHeader(&sa, "header", &(h)); \
+        serialize_##T(&sa, "req", &(req)); \
+    } while (0)
+
+/*
+ * Request archives leave room for the frame length in front of the request,
+ * so that request_buffer() can send both in one piece. size is what the
+ * request takes, as added up by a size archive, or 0 if not known.
+ */
+static struct oarchive *create_request_oarchive(zhandle_t *zh, int32_t size)
+{
+    void *storage = pool_alloc(&zh->oarchive_pool);
+    struct oarchive *oa;
+    if (storage == 0)
+        return 0;
+    oa = init_reserved_buffer_oarchive(storage, sizeof(int32_t),
+            size > 0 ? size : 128);
+    if (oa == 0)
+        pool_free(storage);
+    return oa;
+}
+
+static void close_request_oarchive(struct oarchive **oa, int free_buffer)
+{
+    release_buffer_oarchive(*oa, free_buffer);
+    pool_free(*oa);
+    *oa = 0;
+}
+
+static buffer_list_t *allocate_buffer(object_pool_t *pool, char *buff, int len)
 {
-    buffer_list_t *buffer = calloc(1, sizeof(*buffer));
+    buffer_list_t *buffer = pool_alloc(pool);
     if (buffer == 0)
         return 0;
 
@@ -927,31 +1129,160 @@ static buffer_list_t *allocate_buffer(char *buff, int len)
     buffer->curr_offset = 0;
     buffer->buffer = buff;
     buffer->next = 0;
+    buffer->framed = 0;
+    return buffer;
+}
+
+/* takes over the buffer of a request archive */
+static buffer_list_t *request_buffer(zhandle_t *zh, struct oarchive *oa)
+{
+    buffer_list_t *buffer = allocate_buffer(&zh->buffer_pool, get_buffer(oa),
+            get_buffer_len(oa));
+    if (buffer)
+        buffer->framed = 1;
     return buffer;
 }
 
-static void free_buffer(buffer_list_t *b)
+static void release_recv_block(recv_block_t *block)
+{
+    if (fetch_and_add(&block->ref_count, -1) == 1)
+        free(block);
+}
+
+void free_buffer(buffer_list_t *b)
 {
     if (!b) {
         return;
     }
-    if (b->buffer) {
+    if (b->block) {
+        release_recv_block(b->block);
+    } else if (b->framed) {
+        free(b->buffer - sizeof(int32_t));
+    } else if (b->buffer) {
         free(b->buffer);
     }
-    free(b);
+    pool_free(b);
+}
+
+void init_buffer_list(buffer_head_t *list, object_pool_t *pool)
+{
+    int i;
+    list->pool = pool;
+    list->head = list->last = 0;
+    list->overflow_head = list->overflow_last = 0;
+    list->overflow_count = 0;
+    list->length = 0;
+    list->enqueue_pos = list->dequeue_pos = 0;
+    for (i = 0; i < BUFFER_RING_SIZE; i++) {
+        list->ring[i].seq = i;
+        list->ring[i].buffer = 0;
+    }
+}
+
+/* the ring positions wrap around; compare them modulo 2^32 */
+#define RING_POS_DIFF(a,b) ((int32_t)((uint32_t)(a)-(uint32_t)(b)))
+#define RING_POS_ADD(a,n) ((int32_t)((uint32_t)(a)+(uint32_t)(n)))
+
+/* returns 0 if the ring is full */
+static int push_buffer_ring(buffer_head_t *list, buffer_list_t *b)
+{
+    buffer_ring_slot_t *slot;
+    int32_t pos = atomic_get(&list->enqueue_pos);
+    for (;;) {
+        int32_t diff;
+        slot = &list->ring[pos & (BUFFER_RING_SIZE-1)];
+        diff = RING_POS_DIFF(atomic_get(&slot->seq), pos);
+        if (diff == 0) {
+            int32_t prev = compare_and_swap(&list->enqueue_pos, pos,
+                    RING_POS_ADD(pos, 1));
+            if (prev == pos)
+                break;
+            pos = prev;
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_get(&list->enqueue_pos);
+        }
+    }
+    slot->buffer = b;
+    atomic_set(&slot->seq, RING_POS_ADD(pos, 1));
+    return 1;
+}
+
+/* must be called by the consumer with the list locked */
+static buffer_list_t *pop_buffer_ring(buffer_head_t *list)
+{
+    buffer_list_t *b;
+    int32_t pos = list->dequeue_pos;
+    buffer_ring_slot_t *slot = &list->ring[pos & (BUFFER_RING_SIZE-1)];
+    if (atomic_get(&slot->seq) != RING_POS_ADD(pos, 1))
+        return 0;
+    b = slot->buffer;
+    slot->buffer = 0;
+    list->dequeue_pos = RING_POS_ADD(pos, 1);
+    atomic_set(&slot->seq, RING_POS_ADD(pos, BUFFER_RING_SIZE));
+    return b;
+}
+
+/*
+ * Moves everything published by the producers to the head/last list, the ring
+ * first and then the overflow list. A producer only uses the ring again once
+ * the overflow list is empty, so this preserves the order of its buffers.
+ * Must be called with the list locked.
+ */
+static void drain_buffer_ring(buffer_head_t *list)
+{
+    buffer_list_t *b;
+    while ((b = pop_buffer_ring(list)) != 0) {
+        b->next = 0;
+        if (list->last)
+            list->last->next = b;
+        else
+            list->head = b;
+        list->last = b;
+    }
+    if (list->overflow_head) {
+        if (list->last)
+            list->last->next = list->overflow_head;
+        else
+            list->head = list->overflow_head;
+        list->last = list->overflow_last;
+        list->overflow_head = list->overflow_last = 0;
+        atomic_set(&list->overflow_count, 0);
+    }
 }
 
-static buffer_list_t *dequeue_buffer(buffer_head_t *list)
+/* returns the first buffer in the queue without dequeuing it; the caller must
+ * hold the list lock */
+static buffer_list_t *peek_buffer(buffer_head_t *list)
+{
+    if (!list->head)
+        drain_buffer_ring(list);
+    return list->head;
+}
+
+static int is_buffer_list_empty(buffer_head_t *list)
+{
+    int32_t pos;
+    if (list->head || atomic_get(&list->overflow_count))
+        return 0;
+    pos = atomic_get(&list->dequeue_pos);
+    return atomic_get(&list->ring[pos & (BUFFER_RING_SIZE-1)].seq) !=
+        RING_POS_ADD(pos, 1);
+}
+
+buffer_list_t *dequeue_buffer(buffer_head_t *list)
 {
     buffer_list_t *b;
     lock_buffer_list(list);
-    b = list->head;
+    b = peek_buffer(list);
     if (b) {
         list->head = b->next;
         if (!list->head) {
             assert(b == list->last);
             list->last = 0;
         }
+        fetch_and_add(&list->length, -1);
     }
     unlock_buffer_list(list);
     return b;
@@ -970,65 +1301,55 @@ static int remove_buffer(buffer_head_t *list)
 static void queue_buffer(buffer_head_t *list, buffer_list_t *b, int add_to_front)
 {
     b->next = 0;
-    lock_buffer_list(list);
-    if (list->head) {
-        assert(list->last);
-        // The list is not empty
-        if (add_to_front) {
-            b->next = list->head;
-            list->head = b;
-        } else {
-            list->last->next = b;
-            list->last = b;
-        }
-    }else{
-        // The list is empty
-        assert(!list->head);
+    fetch_and_add(&list->length, 1);
+    if (add_to_front) {
+        lock_buffer_list(list);
+        b->next = list->head;
         list->head = b;
-        list->last = b;
+        if (!list->last)
+            list->last = b;
+        unlock_buffer_list(list);
+        return;
     }
+    // the fast path: no locking unless the ring has filled up
+    if (atomic_get(&list->overflow_count) == 0 && push_buffer_ring(list, b))
+        return;
+    lock_buffer_list(list);
+    if (list->overflow_last)
+        list->overflow_last->next = b;
+    else
+        list->overflow_head = b;
+    list->overflow_last = b;
+    atomic_set(&list->overflow_count, list->overflow_count + 1);
     unlock_buffer_list(list);
 }
 
-static int queue_buffer_bytes(buffer_head_t *list, char *buff, int len)
+int queue_buffer_bytes(buffer_head_t *list, char *buff, int len)
 {
-    buffer_list_t *b  = allocate_buffer(buff,len);
+    buffer_list_t *b  = allocate_buffer(list->pool,buff,len);
     if (!b)
         return ZSYSTEMERROR;
     queue_buffer(list, b, 0);
     return ZOK;
 }
 
-static int queue_front_buffer_bytes(buffer_head_t *list, char *buff, int len)
+/* queues the request serialized in a request archive for sending */
+static int queue_request(zhandle_t *zh, struct oarchive *oa, int add_to_front)
 {
-    buffer_list_t *b  = allocate_buffer(buff,len);
+    buffer_list_t *b = request_buffer(zh, oa);
     if (!b)
         return ZSYSTEMERROR;
-    queue_buffer(list, b, 1);
+    queue_buffer(&zh->to_send, b, add_to_front);
     return ZOK;
 }
 
-static __attribute__ ((unused)) int get_queue_len(buffer_head_t *list)
-{
-    int i;
-    buffer_list_t *ptr;
-    lock_buffer_list(list);
-    ptr = list->head;
-    for (i=0; ptr!=0; ptr=ptr->next, i++)
-        ;
-    unlock_buffer_list(list);
-    return i;
-}
+#ifdef WIN32
 /* returns:
  * -1 if send failed,
  * 0 if send would block while sending the buffer (or a send was incomplete),
  * 1 if success
  */
-#ifdef WIN32
 static int send_buffer(SOCKET fd, buffer_list_t *buff)
-#else
-static int send_buffer(int fd, buffer_list_t *buff)
-#endif
 {
     int len = buff->len;
     int off = buff->curr_offset;
@@ -1072,6 +1393,89 @@ static int send_buffer(int fd, buffer_list_t *buff)
     }
     return buff->curr_offset == len + sizeof(buff->len);
 }
+#else
+/* the maximum number of packets gathered into a single sendmsg() call */
+#define SEND_GATHER_MAX 64
+
+/*
+ * Writes as much of the queue as the socket accepts with a single sendmsg(),
+ * length prefixes included. Buffers that went out completely are removed
+ * from the queue, a partially written one keeps its curr_offset. Adds the
+ * bytes written to *sent. Must be called with the list locked.
+ * returns:
+ * -1 if send failed,
+ * 0 if send would block or a buffer was sent incompletely,
+ * 1 if all the gathered buffers were sent
+ */
+static int send_buffer_list(int fd, buffer_head_t *list, int64_t *sent)
+{
+    struct iovec iov[2*SEND_GATHER_MAX];
+    int32_t lens[SEND_GATHER_MAX];
+    struct msghdr msg;
+    buffer_list_t *b;
+    int niov = 0;
+    int n = 0;
+    ssize_t rc;
+
+    drain_buffer_ring(list);
+    for (b = list->head; b != 0 && n < SEND_GATHER_MAX; b = b->next, n++) {
+        int off = b->curr_offset;
+        if (b->framed) {
+            /* the length goes out together with the request */
+            char *frame = b->buffer - sizeof(b->len);
+            if (off == 0) {
+                int32_t len = htonl(b->len);
+                memcpy(frame, &len, sizeof(len));
+            }
+            iov[niov].iov_base = frame + off;
+            iov[niov].iov_len = b->len + sizeof(b->len) - off;
+            niov++;
+            continue;
+        }
+        if (off < 4) {
+            lens[n] = htonl(b->len);
+            iov[niov].iov_base = (char*)&lens[n] + off;
+            iov[niov].iov_len = sizeof(lens[n]) - off;
+            niov++;
+            off = 0;
+        } else {
+            off -= sizeof(b->len);
+        }
+        if (off < b->len) {
+            iov[niov].iov_base = b->buffer + off;
+            iov[niov].iov_len = b->len - off;
+            niov++;
+        }
+    }
+    if (niov == 0)
+        return 1;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = niov;
+#ifdef __linux__
+    rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+#else
+    rc = sendmsg(fd, &msg, 0);
+#endif
+    if (rc == -1)
+        return errno == EAGAIN ? 0 : -1;
+    *sent += rc;
+
+    while (n-- > 0) {
+        int remaining;
+        b = list->head;
+        remaining = b->len + sizeof(b->len) - b->curr_offset;
+        if (rc < remaining) {
+            b->curr_offset += rc;
+            return 0;
+        }
+        rc -= remaining;
+        remove_buffer(list);
+    }
+    return 1;
+}
+#endif
 
 /* returns:
  * -1 if recv call failed,
@@ -1138,17 +1542,161 @@ static int recv_buffer(int fd, buffer_list_t *buff)
     return buff->curr_offset == buff->len + sizeof(buff->len);
 }
 
+/*
+ * Makes room at the end of the receive block. A block no frame refers to
+ * any more is rewound; otherwise the pending partial frame is moved to a
+ * fresh block and the old one is left to the frames sliced out of it.
+ */
+static recv_block_t *reserve_recv_block(zhandle_t *zh)
+{
+    recv_block_t *block = zh->recv_block;
+    int pending = block ? block->end - block->start : 0;
+
+    if (block && atomic_get(&block->ref_count) == 1) {
+        if (block->end < RECV_BLOCK_SIZE && pending != 0)
+            return block;
+        memmove(block->data, block->data + block->start, pending);
+    } else if (!block || block->end == RECV_BLOCK_SIZE) {
+        recv_block_t *fresh = malloc(sizeof(*fresh));
+        if (!fresh)
+            return 0;
+        fresh->ref_count = 1;
+        if (block) {
+            memcpy(fresh->data, block->data + block->start, pending);
+            release_recv_block(block);
+        }
+        zh->recv_block = block = fresh;
+    } else {
+        return block;
+    }
+    block->start = 0;
+    block->end = pending;
+    return block;
+}
+
+/*
+ * Reads as much as the socket has into the receive block and queues every
+ * complete frame on to_process without copying it. A frame too large for
+ * the block continues in a buffer of its own, zh->input_buffer.
+ * returns:
+ * -1 if recv call failed,
+ * 0 if no frame was completed,
+ * 1 if at least one frame was queued
+ */
+static int recv_frames(zhandle_t *zh)
+{
+    recv_block_t *block = reserve_recv_block(zh);
+    int frames = 0;
+    int rc;
+
+    if (!block) {
+        errno = ENOMEM;
+        return -1;
+    }
+    rc = recv(zh->fd, block->data + block->end, RECV_BLOCK_SIZE - block->end, 0);
+    switch(rc) {
+    case 0:
+        errno = EHOSTDOWN;
+    case -1:
+#ifndef _WINDOWS
+        if (errno == EAGAIN) {
+#else
+        if (WSAGetLastError() == WSAEWOULDBLOCK) {
+#endif
+            return 0;
+        }
+        return -1;
+    default:
+        block->end += rc;
+        fetch_and_add64(&zh->counters.bytes_received, rc);
+    }
+
+    while (block->end - block->start >= (int)sizeof(int32_t)) {
+        char *frame = block->data + block->start;
+        int available = block->end - block->start - sizeof(int32_t);
+        buffer_list_t *b;
+        int32_t len;
+
+        memcpy(&len, frame, sizeof(len));
+        len = ntohl(len);
+        if (len < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (len > RECV_BLOCK_SIZE - (int)sizeof(len)) {
+            char *buffer = malloc(len);
+            b = allocate_buffer(&zh->buffer_pool, buffer, len);
+            if (!buffer || !b) {
+                free(buffer);
+                pool_free(b);
+                errno = ENOMEM;
+                return -1;
+            }
+            memcpy(buffer, frame + sizeof(len), available);
+            b->curr_offset = sizeof(len) + available;
+            block->start = block->end;
+            zh->input_buffer = b;
+            break;
+        }
+        if (available < len)
+            break;
+        b = allocate_buffer(&zh->buffer_pool, frame + sizeof(len), len);
+        if (!b) {
+            errno = ENOMEM;
+            return -1;
+        }
+        b->curr_offset = sizeof(len) + len;
+        b->block = block;
+        fetch_and_add(&block->ref_count, 1);
+        block->start += sizeof(len) + len;
+        queue_buffer(&zh->to_process, b, 0);
+        frames++;
+    }
+    return frames > 0;
+}
+
 void free_buffers(buffer_head_t *list)
 {
     while (remove_buffer(list))
         ;
 }
 
+/**
+ * Completes a request that will not get a response with the given error.
+ */
+static void fail_request(zhandle_t *zh, completion_list_t *cptr, int reason)
+{
+    if (cptr->c.data_result == SYNCHRONOUS_MARKER) {
+        struct sync_completion
+                    *sc = (struct sync_completion*)cptr->data;
+        sc->rc = reason;
+        notify_sync_completion(sc);
+        zh->outstanding_sync--;
+        destroy_completion_entry(cptr);
+    } else if(cptr->xid == PING_XID){
+        // Nothing to do with a ping response
+        destroy_completion_entry(cptr);
+    } else {
+        // Fake the response
+        struct oarchive *oa;
+        struct ReplyHeader h;
+        buffer_list_t *bptr;
+        h.xid = cptr->xid;
+        h.zxid = -1;
+        h.err = reason;
+        oa = create_request_oarchive(zh, 0);
+        serialize_ReplyHeader(oa, "header", &h);
+        bptr = request_buffer(zh, oa);
+        assert(bptr);
+        close_request_oarchive(&oa, 0);
+        cptr->buffer = bptr;
+        queue_completion(&zh->completions_to_process, cptr, 0);
+    }
+}
+
 void free_completions(zhandle_t *zh,int callCompletion,int reason)
 {
     completion_head_t tmp_list;
-    struct oarchive *oa;
-    struct ReplyHeader h;
     void_completion_t auth_completion = NULL;
     auth_completion_list_t a_list, *a_tmp;
 
@@ -1156,38 +1704,18 @@ void free_completions(zhandle_t *zh,int callCompletion,int reason)
     tmp_list = zh->sent_requests;
     zh->sent_requests.head = 0;
     zh->sent_requests.last = 0;
+    zh->sent_requests.length = 0;
+    request_table_clear(&zh->sent_index);
+    zh->deadlines.count = 0;
+    /* the responses to the expired requests will not come anymore */
+    request_table_clear(&zh->expired_index);
     unlock_completion_list(&zh->sent_requests);
     while (tmp_list.head) {
         completion_list_t *cptr = tmp_list.head;
 
         tmp_list.head = cptr->next;
-        if (cptr->c.data_result == SYNCHRONOUS_MARKER) {
-            struct sync_completion
-                        *sc = (struct sync_completion*)cptr->data;
-            sc->rc = reason;
-            notify_sync_completion(sc);
-            zh->outstanding_sync--;
-            destroy_completion_entry(cptr);
-        } else if (callCompletion) {
-            if(cptr->xid == PING_XID){
-                // Nothing to do with a ping response
-                destroy_completion_entry(cptr);
-            } else {
-                // Fake the response
-                buffer_list_t *bptr;
-                h.xid = cptr->xid;
-                h.zxid = -1;
-                h.err = reason;
-                oa = create_buffer_oarchive();
-                serialize_ReplyHeader(oa, "header", &h);
-                bptr = calloc(sizeof(*bptr), 1);
-                assert(bptr);
-                bptr->len = get_buffer_len(oa);
-                bptr->buffer = get_buffer(oa);
-                close_buffer_oarchive(&oa, 0);
-                cptr->buffer = bptr;
-                queue_completion(&zh->completions_to_process, cptr, 0);
-            }
+        if (cptr->c.data_result == SYNCHRONOUS_MARKER || callCompletion) {
+            fail_request(zh, cptr, reason);
         }
     }
     a_list.completion = NULL;
@@ -1218,11 +1746,16 @@ static void cleanup_bufs(zhandle_t *zh,int callCompletion,int rc)
         free_buffer(zh->input_buffer);
         zh->input_buffer = 0;
     }
+    if (zh->recv_block) {
+        release_recv_block(zh->recv_block);
+        zh->recv_block = 0;
+    }
 }
 
 static void handle_error(zhandle_t *zh,int rc)
 {
     close(zh->fd);
+    fetch_and_add(&zh->counters.disconnects, 1);
     if (is_unrecoverable(zh)) {
         LOG_DEBUG(("Calling a watcher for a ZOO_SESSION_EVENT and the state=%s",
                 state2String(zh->state)));
@@ -1303,18 +1836,19 @@ static int send_info_packet(zhandle_t *zh, auth_info* auth) {
     struct oarchive *oa;
     struct RequestHeader h = { STRUCT_INITIALIZER(xid , AUTH_XID), STRUCT_INITIALIZER(type , ZOO_SETAUTH_OP)};
     struct AuthPacket req;
+    int32_t size = 0;
     int rc;
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
     req.type=0;   // ignored by the server
     req.scheme = auth->scheme;
     req.auth = auth->auth;
+    REQUEST_SIZE(size, h, AuthPacket, req);
+    oa = create_request_oarchive(zh, size);
+    rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_AuthPacket(oa, "req", &req);
     /* add this buffer to the head of the send queue */
-    rc = rc < 0 ? rc : queue_front_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : queue_request(zh, oa, 1);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     return rc;
 }
@@ -1356,53 +1890,142 @@ static int send_last_auth_info(zhandle_t *zh)
     return (rc < 0)?ZMARSHALLINGERROR:ZOK;
 }
 
-static void free_key_list(char **list, int count)
-{
-    int i;
-
-    for(i = 0; i < count; i++) {
-        free(list[i]);
-    }
-    free(list);
-}
-
-static int send_set_watches(zhandle_t *zh)
+/* queues one batch of the watches collected in req to go out right after
+ * the handshake, and empties its lists for the next batch. The one-shot
+ * watches go out in SetWatches, which every server knows, and the persistent
+ * ones on their own in SetWatches2, so that a server without it loses those
+ * only */
+static int queue_set_watches(zhandle_t *zh, struct SetWatches2 *req,
+        int persistent)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER(xid , SET_WATCHES_XID), STRUCT_INITIALIZER(type , ZOO_SETWATCHES_OP)};
-    struct SetWatches req;
+    struct SetWatches req1;
+    struct SetWatches2 req2;
     int rc;
 
-    req.relativeZxid = zh->last_zxid;
-    req.dataWatches.data = collect_keys(zh->active_node_watchers, (int*)&req.dataWatches.count);
-    req.existWatches.data = collect_keys(zh->active_exist_watchers, (int*)&req.existWatches.count);
-    req.childWatches.data = collect_keys(zh->active_child_watchers, (int*)&req.childWatches.count);
-
-    // return if there are no pending watches
-    if (!req.dataWatches.count && !req.existWatches.count &&
-        !req.childWatches.count) {
-        free_key_list(req.dataWatches.data, req.dataWatches.count);
-        free_key_list(req.existWatches.data, req.existWatches.count);
-        free_key_list(req.childWatches.data, req.childWatches.count);
-        return ZOK;
-    }
-
-
-    oa = create_buffer_oarchive();
+    if (persistent) {
+        memset(&req2, 0, sizeof(req2));
+        req2.relativeZxid = req->relativeZxid;
+        req2.persistentWatches = req->persistentWatches;
+        req2.persistentRecursiveWatches = req->persistentRecursiveWatches;
+        h.type = ZOO_SETWATCHES2_OP;
+        REQUEST_SIZE(size, h, SetWatches2, req2);
+    } else {
+        req1.relativeZxid = req->relativeZxid;
+        req1.dataWatches = req->dataWatches;
+        req1.existWatches = req->existWatches;
+        req1.childWatches = req->childWatches;
+        REQUEST_SIZE(size, h, SetWatches, req1);
+    }
+    oa = create_request_oarchive(zh, size);
+    if (!oa)
+        return ZSYSTEMERROR;
     rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_SetWatches(oa, "req", &req);
+    if (persistent)
+        rc = rc < 0 ? rc : serialize_SetWatches2(oa, "req", &req2);
+    else
+        rc = rc < 0 ? rc : serialize_SetWatches(oa, "req", &req1);
     /* add this buffer to the head of the send queue */
-    rc = rc < 0 ? rc : queue_front_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
-    /* We queued the buffer, so don't free it */   
-    close_buffer_oarchive(&oa, 0);
-    free_key_list(req.dataWatches.data, req.dataWatches.count);
-    free_key_list(req.existWatches.data, req.existWatches.count);
-    free_key_list(req.childWatches.data, req.childWatches.count);
-    LOG_DEBUG(("Sending set watches request to %s",format_current_endpoint_info(zh)));
+    rc = rc < 0 ? rc : queue_request(zh, oa, 1);
+    /* We queued the buffer, so don't free it */
+    close_request_oarchive(&oa, rc < 0);
+    if (persistent) {
+        req->persistentWatches.count = 0;
+        req->persistentRecursiveWatches.count = 0;
+    } else {
+        req->dataWatches.count = 0;
+        req->existWatches.count = 0;
+        req->childWatches.count = 0;
+    }
     return (rc < 0)?ZMARSHALLINGERROR:ZOK;
 }
 
+#define SET_WATCHES_LISTS 5
+/* the lists from this one on go out in SetWatches2 */
+#define SET_WATCHES_PERSISTENT 3
+
+/*
+ * Re-registers the watches after a reconnect, in as many SetWatches
+ * requests as it takes to keep each one under SET_WATCHES_MAX_LENGTH. The
+ * requests refer to the paths in the watch tables rather than copies.
+ */
+int send_set_watches(zhandle_t *zh)
+{
+    static const int types[] = { WATCH_DATA, WATCH_EXIST, WATCH_CHILD,
+        WATCH_PERSISTENT, WATCH_PERSISTENT_RECURSIVE };
+    struct SetWatches2 req;
+    struct String_vector *lists[SET_WATCHES_LISTS];
+    int32_t capacity[SET_WATCHES_LISTS] = { 0, 0, 0, 0, 0 };
+    zk_hashtable *tables[2];
+    /* of the paths in the SetWatches and the SetWatches2 batch */
+    int32_t size[2] = { 0, 0 };
+    unsigned int cursor = 0;
+    int table = 0;
+    int batches = 0;
+    const char *path;
+    int path_types;
+    int rc = ZOK;
+    int j;
+
+    memset(&req, 0, sizeof(req));
+    req.relativeZxid = zh->last_zxid;
+    lists[0] = &req.dataWatches;
+    lists[1] = &req.existWatches;
+    lists[2] = &req.childWatches;
+    lists[3] = &req.persistentWatches;
+    lists[4] = &req.persistentRecursiveWatches;
+    tables[0] = zh->active_watchers;
+    tables[1] = zh->persistent_watchers;
+    while (rc == ZOK && table < 2) {
+        int32_t len;
+        path = next_watched_path(tables[table], &cursor, &path_types);
+        if (!path) {
+            table++;
+            cursor = 0;
+            continue;
+        }
+        len = sizeof(int32_t) + strlen(path);
+        for (j = 0; j < SET_WATCHES_LISTS && rc == ZOK; j++) {
+            struct String_vector *v = lists[j];
+            int persistent = j >= SET_WATCHES_PERSISTENT;
+            if (!(path_types & types[j]))
+                continue;
+            if (size[persistent] > 0 &&
+                    size[persistent] + len > SET_WATCHES_MAX_LENGTH) {
+                rc = queue_set_watches(zh, &req, persistent);
+                size[persistent] = 0;
+                batches++;
+            }
+            if (v->count == capacity[j]) {
+                int32_t grown = capacity[j] ? capacity[j] * 2 : 64;
+                char **data = realloc(v->data, grown * sizeof(*data));
+                if (!data) {
+                    rc = ZSYSTEMERROR;
+                    break;
+                }
+                v->data = data;
+                capacity[j] = grown;
+            }
+            v->data[v->count++] = (char *)path;
+            size[persistent] += len;
+        }
+    }
+    for (j = 0; j < 2; j++) {
+        if (rc == ZOK && size[j] > 0) {
+            rc = queue_set_watches(zh, &req, j);
+            batches++;
+        }
+    }
+    for (j = 0; j < SET_WATCHES_LISTS; j++)
+        free(lists[j]->data);
+    if (batches > 0)
+        LOG_DEBUG(("Sending %d set watches requests to %s", batches,
+                format_current_endpoint_info(zh)));
+    return rc;
+}
+
 static int serialize_prime_connect(struct connect_req *req, char* buffer){
     //this should be the order of serialization
     int offset = 0;
@@ -1481,6 +2104,7 @@ static int prime_connection(zhandle_t *zh)
         return handle_socket_error_msg(zh, __LINE__, ZCONNECTIONLOSS,
                 "failed to send a handshake packet: %s", strerror(errno));
     }
+    fetch_and_add64(&zh->counters.bytes_sent, sizeof(len) + len);
     zh->state = ZOO_ASSOCIATING_STATE;
 
     zh->input_buffer = &zh->primer_buffer;
@@ -1514,25 +2138,24 @@ static struct timeval get_timeval(int interval)
     return tv;
 }
 
- static int add_void_completion(zhandle_t *zh, int xid, void_completion_t dc,
-     const void *data);
- static int add_string_completion(zhandle_t *zh, int xid,
+ static int add_void_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+     void_completion_t dc, const void *data);
+ static int add_string_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
      string_completion_t dc, const void *data);
 
  int send_ping(zhandle_t* zh)
  {
     int rc;
-    struct oarchive *oa = create_buffer_oarchive();
+    struct oarchive *oa = create_request_oarchive(zh, 0);
     struct RequestHeader h = { STRUCT_INITIALIZER(xid ,PING_XID), STRUCT_INITIALIZER (type , ZOO_PING_OP) };
 
     rc = serialize_RequestHeader(oa, "header", &h);
     enter_critical(zh);
     gettimeofday(&zh->last_ping, 0);
-    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, 0, 0);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_void_completion(zh, &h, 0, 0, 0);
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
     return rc<0 ? rc : adaptor_send_queue(zh, 0);
 }
 
@@ -1633,6 +2256,8 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
         int idle_send = calculate_interval(&zh->last_send, &now);
         int recv_to = zh->recv_timeout*2/3 - idle_recv;
         int send_to = zh->recv_timeout/3;
+        int request_to;
+        int timeout;
         // have we exceeded the receive timeout threshold?
         if (recv_to <= 0) {
             // We gotta cut our losses and connect to someone else
@@ -1663,8 +2288,13 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
                 send_to = zh->recv_timeout/3;
             }
         }
-        // choose the lesser value as the timeout
-        *tv = get_timeval(recv_to < send_to? recv_to:send_to);
+        // choose the lesser value as the timeout, waking up in time to
+        // expire the next request that reaches its deadline
+        timeout = recv_to < send_to? recv_to:send_to;
+        request_to = next_request_deadline(zh, &now);
+        if (request_to >= 0 && request_to < timeout)
+            timeout = request_to;
+        *tv = get_timeval(timeout);
         zh->next_deadline.tv_sec = now.tv_sec + tv->tv_sec;
         zh->next_deadline.tv_usec = now.tv_usec + tv->tv_usec;
         if (zh->next_deadline.tv_usec > 1000000) {
@@ -1674,7 +2304,7 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
         *interest = ZOOKEEPER_READ;
         /* we are interested in a write if we are connected and have something
          * to send, or we are waiting for a connect to finish. */
-        if ((zh->to_send.head && (zh->state == ZOO_CONNECTED_STATE))
+        if ((!is_buffer_list_empty(&zh->to_send) && (zh->state == ZOO_CONNECTED_STATE))
         || zh->state == ZOO_CONNECTING_STATE) {
             *interest |= ZOOKEEPER_WRITE;
         }
@@ -1705,7 +2335,7 @@ static int check_events(zhandle_t *zh, int events)
                 format_endpoint_info(&zh->addrs[zh->connect_index])));
         return ZOK;
     }
-    if (zh->to_send.head && (events&ZOOKEEPER_WRITE)) {
+    if (!is_buffer_list_empty(&zh->to_send) && (events&ZOOKEEPER_WRITE)) {
         /* make the flush call non-blocking by specifying a 0 timeout */
         int rc=flush_send_queue(zh,0);
         if (rc < 0)
@@ -1713,16 +2343,30 @@ static int check_events(zhandle_t *zh, int events)
                 "failed while flushing send queue");
     }
     if (events&ZOOKEEPER_READ) {
-        int rc;
+        int rc, received;
         if (zh->input_buffer == 0) {
-            zh->input_buffer = allocate_buffer(0,0);
+            rc = recv_frames(zh);
+            if (rc < 0) {
+                return handle_socket_error_msg(zh, __LINE__,ZCONNECTIONLOSS,
+                    "failed while receiving a server response");
+            }
+            if (rc == 0) {
+                return ZNOTHING;
+            }
+            gettimeofday(&zh->last_recv, 0);
+            return ZOK;
         }
 
+        /* the handshake response, or a frame too large for the receive
+         * block, is read straight into its own buffer */
+        received = zh->input_buffer->curr_offset;
         rc = recv_buffer(zh->fd, zh->input_buffer);
         if (rc < 0) {
             return handle_socket_error_msg(zh, __LINE__,ZCONNECTIONLOSS,
                 "failed while receiving a server response");
         }
+        fetch_and_add64(&zh->counters.bytes_received,
+                zh->input_buffer->curr_offset - received);
         if (rc > 0) {
             gettimeofday(&zh->last_recv, 0);
             if (zh->input_buffer != &zh->primer_buffer) {
@@ -1747,6 +2391,7 @@ static int check_events(zhandle_t *zh, int events)
                     memcpy(zh->client_id.passwd, &zh->primer_storage.passwd,
                            sizeof(zh->client_id.passwd));
                     zh->state = ZOO_CONNECTED_STATE;
+                    fetch_and_add(&zh->counters.connects, 1);
                     LOG_INFO(("session establishment complete on server [%s], sessionId=%#llx, negotiated timeout=%d",
                               format_endpoint_info(&zh->addrs[zh->connect_index]),
                               newid, zh->recv_timeout));
@@ -1812,27 +2457,31 @@ static int queue_session_event(zhandle_t *zh, int state)
     struct oarchive *oa;
     completion_list_t *cptr;
 
-    if ((oa=create_buffer_oarchive())==NULL) {
+    /* the watches of the cached nodes are gone with the session */
+    if (state == ZOO_EXPIRED_SESSION_STATE && zh->cache)
+        cache_clear(zh->cache);
+    if ((oa=create_request_oarchive(zh, 0))==NULL) {
         LOG_ERROR(("out of memory"));
         goto error;
     }
     rc = serialize_ReplyHeader(oa, "hdr", &hdr);
     rc = rc<0?rc: serialize_WatcherEvent(oa, "event", &evt);
     if(rc<0){
-        close_buffer_oarchive(&oa, 1);
+        close_request_oarchive(&oa, 1);
         goto error;
     }
-    cptr = create_completion_entry(WATCHER_EVENT_XID,-1,0,0,0,0);
-    cptr->buffer = allocate_buffer(get_buffer(oa), get_buffer_len(oa));
+    cptr = create_completion_entry(zh,WATCHER_EVENT_XID,-1,0,0,0,0);
+    cptr->buffer = request_buffer(zh, oa);
     cptr->buffer->curr_offset = get_buffer_len(oa);
     if (!cptr->buffer) {
-        free(cptr);
-        close_buffer_oarchive(&oa, 1);
+        destroy_completion_entry(cptr);
+        close_request_oarchive(&oa, 1);
         goto error;
     }
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
     cptr->c.watcher_result = collectWatchers(zh, ZOO_SESSION_EVENT, "");
+    cptr->order_key = path_order_key("");
     queue_completion(&zh->completions_to_process, cptr, 0);
     if (process_async(zh->outstanding_sync)) {
         process_completions(zh);
@@ -1855,6 +2504,7 @@ completion_list_t *dequeue_completion(completion_head_t *list)
             assert(list->last == cptr);
             list->last = 0;
         }
+        list->length--;
     }
     unlock_completion_list(list);
     return cptr;
@@ -1901,7 +2551,9 @@ static void process_sync_completion(
         }
         break;
     case COMPLETION_STRINGLIST:
-        if (sc->rc==0) {
+        if (sc->rc==0 && sc->strings_arena) {
+            deserialize_String_vector_arena(ia, "children", &sc->u.strs2);
+        } else if (sc->rc==0) {
             struct GetChildrenResponse res;
             deserialize_GetChildrenResponse(ia, "reply", &res);
             sc->u.strs2 = res.children;
@@ -1995,11 +2647,11 @@ static void deserialize_response(int type, int xid, int failed, int rc, completi
         if (failed) {
             cptr->c.data_result(rc, 0, 0, 0, cptr->data);
         } else {
+            /* the data is borrowed from the reply, see run_completion() */
             struct GetDataResponse res;
             deserialize_GetDataResponse(ia, "reply", &res);
             cptr->c.data_result(rc, res.data.buff, res.data.len,
                     &res.stat, cptr->data);
-            deallocate_GetDataResponse(&res);
         }
         break;
     case COMPLETION_STAT:
@@ -2020,10 +2672,11 @@ static void deserialize_response(int type, int xid, int failed, int rc, completi
         if (failed) {
             cptr->c.strings_result(rc, 0, cptr->data);
         } else {
+            /* the names are borrowed from the reply, the array is not */
             struct GetChildrenResponse res;
             deserialize_GetChildrenResponse(ia, "reply", &res);
             cptr->c.strings_result(rc, &res.children, cptr->data);
-            deallocate_GetChildrenResponse(&res);
+            free(res.children.data);
         }
         break;
     case COMPLETION_STRINGLIST_STAT:
@@ -2032,10 +2685,11 @@ static void deserialize_response(int type, int xid, int failed, int rc, completi
         if (failed) {
             cptr->c.strings_stat_result(rc, 0, 0, cptr->data);
         } else {
+            /* the names are borrowed from the reply, the array is not */
             struct GetChildren2Response res;
             deserialize_GetChildren2Response(ia, "reply", &res);
             cptr->c.strings_stat_result(rc, &res.children, &res.stat, cptr->data);
-            deallocate_GetChildren2Response(&res);
+            free(res.children.data);
         }
         break;
     case COMPLETION_STRING:
@@ -2085,35 +2739,52 @@ static void deserialize_response(int type, int xid, int failed, int rc, completi
 }
 
 
-/* handles async completion (both single- and multithreaded) */
-void process_completions(zhandle_t *zh)
+/* calls the callbacks of an async completion and disposes of it */
+void run_completion(zhandle_t *zh, completion_list_t *cptr)
 {
-    completion_list_t *cptr;
-    while ((cptr = dequeue_completion(&zh->completions_to_process)) != 0) {
-        struct ReplyHeader hdr;
-        buffer_list_t *bptr = cptr->buffer;
-        struct iarchive *ia = create_buffer_iarchive(bptr->buffer,
-                bptr->len);
-        deserialize_ReplyHeader(ia, "hdr", &hdr);
-
-        if (hdr.xid == WATCHER_EVENT_XID) {
-            int type, state;
-            struct WatcherEvent evt;
-            deserialize_WatcherEvent(ia, "event", &evt);
-            /* We are doing a notification, so there is no pending request */
-            type = evt.type;
-            state = evt.state;
-            /* This is a notification so there aren't any pending requests */
-            LOG_DEBUG(("Calling a watcher for node [%s], type = %d event=%s",
-                       (evt.path==NULL?"NULL":evt.path), cptr->c.type,
-                       watcherEvent2String(type)));
-            deliverWatchers(zh,type,state,evt.path, &cptr->c.watcher_result);
-            deallocate_WatcherEvent(&evt);
-        } else {
-            deserialize_response(cptr->c.type, hdr.xid, hdr.err != 0, hdr.err, cptr, ia);
-        }
-        destroy_completion_entry(cptr);
-        close_buffer_iarchive(&ia);
+    struct ReplyHeader hdr;
+    buffer_list_t *bptr = cptr->buffer;
+    struct iarchive *ia;
+    /* the reply outlives the callback, so the data and the children it
+     * gets can point into the reply rather than be copied out of it */
+    switch (cptr->c.type) {
+    case COMPLETION_DATA:
+    case COMPLETION_STRINGLIST:
+    case COMPLETION_STRINGLIST_STAT:
+        ia = create_borrowed_buffer_iarchive(bptr->buffer, bptr->len);
+        break;
+    default:
+        ia = create_buffer_iarchive(bptr->buffer, bptr->len);
+    }
+    deserialize_ReplyHeader(ia, "hdr", &hdr);
+
+    if (hdr.xid == WATCHER_EVENT_XID) {
+        int type, state;
+        struct WatcherEvent evt;
+        deserialize_WatcherEvent(ia, "event", &evt);
+        /* We are doing a notification, so there is no pending request */
+        type = evt.type;
+        state = evt.state;
+        /* This is a notification so there aren't any pending requests */
+        LOG_DEBUG(("Calling a watcher for node [%s], type = %d event=%s",
+                   (evt.path==NULL?"NULL":evt.path), cptr->c.type,
+                   watcherEvent2String(type)));
+        deliverWatchers(zh,type,state,evt.path, &cptr->c.watcher_result);
+        deallocate_WatcherEvent(&evt);
+    } else {
+        deserialize_response(cptr->c.type, hdr.xid, hdr.err != 0, hdr.err, cptr, ia);
+    }
+    destroy_completion_entry(cptr);
+    close_buffer_iarchive(&ia);
+}
+
+/* handles async completion (both single- and multithreaded) */
+void process_completions(zhandle_t *zh)
+{
+    completion_list_t *cptr;
+    while ((cptr = dequeue_completion(&zh->completions_to_process)) != 0) {
+        if (!dispatch_completion(zh, cptr, cptr->order_key))
+            run_completion(zh, cptr);
     }
 }
 
@@ -2169,6 +2840,7 @@ int zookeeper_process(zhandle_t *zh, int events)
         return ZINVALIDSTATE;
     api_prolog(zh);
     IF_DEBUG(checkResponseLatency(zh));
+    expire_requests(zh);
     rc = check_events(zh, events);
     if (rc!=ZOK)
         return api_epilog(zh, rc);
@@ -2198,9 +2870,10 @@ int zookeeper_process(zhandle_t *zh, int events)
             type = evt.type;
             path = evt.path;
             /* We are doing a notification, so there is no pending request */
-            c = create_completion_entry(WATCHER_EVENT_XID,-1,0,0,0,0);
+            c = create_completion_entry(zh,WATCHER_EVENT_XID,-1,0,0,0,0);
             c->buffer = bptr;
             c->c.watcher_result = collectWatchers(zh, type, path);
+            c->order_key = path_order_key(path);
 
             // We cannot free until now, otherwise path will become invalid
             deallocate_WatcherEvent(&evt);
@@ -2224,8 +2897,11 @@ int zookeeper_process(zhandle_t *zh, int events)
             }
         } else {
             int rc = hdr.err;
+            int expected = -1;
+            struct timeval now;
             /* Find the request corresponding to the response */
-            completion_list_t *cptr = dequeue_completion(&zh->sent_requests);
+            completion_list_t *cptr = take_sent_request(zh, hdr.xid,
+                    &expected);
 
             /* [ZOOKEEPER-804] Don't assert if zookeeper_close has been called. */
             if (zh->close_requested == 1) {
@@ -2236,30 +2912,33 @@ int zookeeper_process(zhandle_t *zh, int events)
                 close_buffer_iarchive(&ia);
                 return api_epilog(zh,ZINVALIDSTATE);
             }
-            assert(cptr);
-            /* The requests are going to come back in order */
-            if (cptr->xid != hdr.xid) {
+            if (cptr == 0 && forget_expired_request(zh, hdr.xid)) {
+                LOG_DEBUG(("Discarding the late response to xid=%#x",
+                        hdr.xid));
+                close_buffer_iarchive(&ia);
+                free_buffer(bptr);
+                continue;
+            }
+            if (cptr == 0) {
                 LOG_DEBUG(("Processing unexpected or out-of-order response!"));
 
-                // received unexpected (or out-of-order) response
+                // received unexpected (or out-of-order) response; the
+                // outstanding requests stay queued, so they get properly
+                // signaled and deallocated when we disconnect
                 close_buffer_iarchive(&ia);
                 free_buffer(bptr);
-                // put the completion back on the queue (so it gets properly
-                // signaled and deallocated) and disconnect from the server
-                queue_completion(&zh->sent_requests,cptr,1);
                 return handle_socket_error_msg(zh, __LINE__,ZRUNTIMEINCONSISTENCY,
                         "unexpected server response: expected %#x, but received %#x",
-                        hdr.xid,cptr->xid);
+                        expected, hdr.xid);
             }
 
+            gettimeofday(&now, 0);
+            record_latency(zh, cptr->op, &cptr->queued, &now);
             activateWatcher(zh, cptr->watcher, rc);
 
             if (cptr->c.void_result != SYNCHRONOUS_MARKER) {
                 if(hdr.xid == PING_XID){
-                    int elapsed = 0;
-                    struct timeval now;
-                    gettimeofday(&now, 0);
-                    elapsed = calculate_interval(&zh->last_ping, &now);
+                    int elapsed = calculate_interval(&zh->last_ping, &now);
                     LOG_DEBUG(("Got ping response in %d ms", elapsed));
 
                     // Nothing to do with a ping response
@@ -2300,12 +2979,12 @@ int zoo_state(zhandle_t *zh)
     return 0;
 }
 
-static watcher_registration_t* create_watcher_registration(const char* path,
-        result_checker_fn checker,watcher_fn watcher,void* ctx){
+static watcher_registration_t* create_watcher_registration(zhandle_t *zh,
+        const char* path,result_checker_fn checker,watcher_fn watcher,void* ctx){
     watcher_registration_t* wo;
     if(watcher==0)
         return 0;
-    wo=calloc(1,sizeof(watcher_registration_t));
+    wo=pool_alloc(&zh->watcher_pool);
     wo->path=strdup(path);
     wo->watcher=watcher;
     wo->context=ctx;
@@ -2316,14 +2995,15 @@ static watcher_registration_t* create_watcher_registration(const char* path,
 static void destroy_watcher_registration(watcher_registration_t* wo){
     if(wo!=0){
         free((void*)wo->path);
-        free(wo);
+        pool_free(wo);
     }
 }
 
-static completion_list_t* create_completion_entry(int xid, int completion_type,
-        const void *dc, const void *data,watcher_registration_t* wo, completion_head_t *clist)
+static completion_list_t* create_completion_entry(zhandle_t *zh, int xid,
+        int completion_type, const void *dc, const void *data,
+        watcher_registration_t* wo, completion_head_t *clist)
 {
-    completion_list_t *c = calloc(1,sizeof(completion_list_t));
+    completion_list_t *c = pool_alloc(&zh->completion_pool);
     if (!c) {
         LOG_ERROR(("out of memory"));
         return 0;
@@ -2364,12 +3044,24 @@ static completion_list_t* create_completion_entry(int xid, int completion_type,
     return c;
 }
 
+/* FNV-1a of the server path; requests without a path share the key of the
+ * session events so they stay in order with them */
+static uint32_t path_order_key(const char *path)
+{
+    uint32_t h = 2166136261u;
+    if (path) {
+        for (; *path; path++)
+            h = (h ^ (unsigned char)*path) * 16777619u;
+    }
+    return h;
+}
+
 static void destroy_completion_entry(completion_list_t* c){
     if(c!=0){
         destroy_watcher_registration(c->watcher);
         if(c->buffer!=0)
             free_buffer(c->buffer);
-        free(c);
+        pool_free(c);
     }
 }
 
@@ -2395,9 +3087,10 @@ static void queue_completion_nolock(completion_head_t *list,
         list->head = c;
         list->last = c;
     }
+    list->length++;
 }
 
-static void queue_completion(completion_head_t *list, completion_list_t *c,
+void queue_completion(completion_head_t *list, completion_list_t *c,
         int add_to_front)
 {
 
@@ -2406,76 +3099,481 @@ static void queue_completion(completion_head_t *list, completion_list_t *c,
     unlock_completion_list(list);
 }
 
-static int add_completion(zhandle_t *zh, int xid, int completion_type,
-        const void *dc, const void *data, int add_to_front,
-        watcher_registration_t* wo, completion_head_t *clist)
+#define REQUEST_TABLE_MIN_CAPACITY 64
+/* an insert that would have to probe further than this grows the table */
+#define REQUEST_TABLE_MAX_PROBE 8
+#define REQUEST_HOME_SLOT(t,xid) ((int)((uint32_t)(xid) & ((t)->capacity - 1)))
+#define REQUEST_SLOT_LIVE(s) ((s)->entry && (s)->entry != REQUEST_DELETED)
+
+int request_table_count(const request_table_t *t)
+{
+    int count = 0;
+    int i;
+    for (i = 0; i < t->capacity; i++) {
+        if (REQUEST_SLOT_LIVE(&t->slots[i]))
+            count++;
+    }
+    return count;
+}
+
+/* puts the entry into the first slot from its home on that is not live;
+ * returns the slot, or -1 if that is more than limit slots away */
+static int put_request_slot(request_table_t *t, int32_t xid,
+        struct _completion_list *entry, int limit)
+{
+    int i = REQUEST_HOME_SLOT(t, xid);
+    int probe;
+    for (probe = 0; REQUEST_SLOT_LIVE(&t->slots[i]); probe++) {
+        if (probe == limit)
+            return -1;
+        i = (i + 1) & (t->capacity - 1);
+    }
+    if (probe > t->max_probe)
+        t->max_probe = probe;
+    t->slots[i].xid = xid;
+    t->slots[i].entry = entry;
+    return i;
+}
+
+/* rehashes the entries without the tombstones into a table twice as big */
+static int grow_request_table(request_table_t *t)
+{
+    request_slot_t *old_slots = t->slots;
+    int old_capacity = t->capacity;
+    int capacity = old_capacity ? 2 * old_capacity : REQUEST_TABLE_MIN_CAPACITY;
+    request_slot_t *slots;
+    int i;
+
+    if (capacity <= 0)
+        return ZSYSTEMERROR;
+    slots = calloc(capacity, sizeof(*slots));
+    if (slots == 0)
+        return ZSYSTEMERROR;
+    t->slots = slots;
+    t->capacity = capacity;
+    t->max_probe = 0;
+    t->generation++;
+    for (i = 0; i < old_capacity; i++) {
+        if (REQUEST_SLOT_LIVE(&old_slots[i]))
+            put_request_slot(t, old_slots[i].xid, old_slots[i].entry,
+                    capacity);
+    }
+    free(old_slots);
+    return ZOK;
+}
+
+int request_table_place(request_table_t *t, int32_t xid,
+        struct _completion_list *entry, request_hint_t *hint)
+{
+    int i = -1;
+    if (t->capacity > 0)
+        i = put_request_slot(t, xid, entry, REQUEST_TABLE_MAX_PROBE);
+    if (i < 0) {
+        int rc = grow_request_table(t);
+        if (rc != ZOK)
+            return rc;
+        /* entries that share an xid stay together however big the table
+         * gets, so past growing once just take the next free slot */
+        i = put_request_slot(t, xid, entry, t->capacity);
+    }
+    if (hint) {
+        hint->slot = i;
+        hint->generation = t->generation;
+    }
+    return ZOK;
+}
+
+int request_table_insert(request_table_t *t, int32_t xid,
+        struct _completion_list *entry)
+{
+    return request_table_place(t, xid, entry, 0);
+}
+
+static int find_request_slot(request_table_t *t, int32_t xid)
+{
+    int i;
+    int probe;
+    if (t->capacity == 0)
+        return -1;
+    i = REQUEST_HOME_SLOT(t, xid);
+    for (probe = 0; probe <= t->max_probe && t->slots[i].entry; probe++) {
+        if (t->slots[i].xid == xid && t->slots[i].entry != REQUEST_DELETED)
+            return i;
+        i = (i + 1) & (t->capacity - 1);
+    }
+    return -1;
+}
+
+struct _completion_list *request_table_lookup(request_table_t *t, int32_t xid)
+{
+    int i = find_request_slot(t, xid);
+    return i < 0 ? 0 : t->slots[i].entry;
+}
+
+struct _completion_list *request_table_remove(request_table_t *t, int32_t xid)
+{
+    struct _completion_list *entry;
+    int i = find_request_slot(t, xid);
+    if (i < 0)
+        return 0;
+    entry = t->slots[i].entry;
+    t->slots[i].entry = REQUEST_DELETED;
+    return entry;
+}
+
+void request_table_remove_stale(request_table_t *t, int32_t xid,
+        struct _completion_list *entry)
+{
+    int i;
+    int probe;
+    if (t->capacity == 0)
+        return;
+    /* duplicate xids are all within reach of the home slot, so look for
+     * the entry itself */
+    i = REQUEST_HOME_SLOT(t, xid);
+    for (probe = 0; probe <= t->max_probe && t->slots[i].entry; probe++) {
+        if (t->slots[i].entry == entry) {
+            t->slots[i].entry = REQUEST_DELETED;
+            return;
+        }
+        i = (i + 1) & (t->capacity - 1);
+    }
+}
+
+void request_table_clear(request_table_t *t)
+{
+    if (t->slots)
+        memset(t->slots, 0, t->capacity * sizeof(*t->slots));
+    t->max_probe = 0;
+    t->generation++;
+}
+
+void request_table_destroy(request_table_t *t)
+{
+    free(t->slots);
+    t->slots = 0;
+    t->capacity = t->max_probe = 0;
+    t->generation++;
+}
+
+static int deadline_before(const struct timeval *a, const struct timeval *b)
+{
+    return a->tv_sec < b->tv_sec ||
+        (a->tv_sec == b->tv_sec && a->tv_usec < b->tv_usec);
+}
+
+static void place_deadline(deadline_heap_t *h, int i, completion_list_t *c)
+{
+    h->entries[i] = c;
+    c->heap_pos = i + 1;
+}
+
+static void sift_deadline_up(deadline_heap_t *h, int i)
+{
+    completion_list_t *c = h->entries[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!deadline_before(&c->deadline, &h->entries[parent]->deadline))
+            break;
+        place_deadline(h, i, h->entries[parent]);
+        i = parent;
+    }
+    place_deadline(h, i, c);
+}
+
+static void sift_deadline_down(deadline_heap_t *h, int i)
+{
+    completion_list_t *c = h->entries[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= h->count)
+            break;
+        if (child + 1 < h->count && deadline_before(
+                &h->entries[child + 1]->deadline, &h->entries[child]->deadline))
+            child++;
+        if (!deadline_before(&h->entries[child]->deadline, &c->deadline))
+            break;
+        place_deadline(h, i, h->entries[child]);
+        i = child;
+    }
+    place_deadline(h, i, c);
+}
+
+static int push_deadline(deadline_heap_t *h, completion_list_t *c)
+{
+    if (h->count == h->capacity) {
+        int capacity = h->capacity ? 2 * h->capacity : 64;
+        completion_list_t **entries =
+            realloc(h->entries, capacity * sizeof(*entries));
+        if (entries == 0)
+            return ZSYSTEMERROR;
+        h->entries = entries;
+        h->capacity = capacity;
+    }
+    h->entries[h->count++] = c;
+    sift_deadline_up(h, h->count - 1);
+    return ZOK;
+}
+
+static void remove_deadline(deadline_heap_t *h, completion_list_t *c)
+{
+    int i = c->heap_pos - 1;
+    completion_list_t *last = h->entries[--h->count];
+    c->heap_pos = 0;
+    if (last == c)
+        return;
+    place_deadline(h, i, last);
+    sift_deadline_up(h, i);
+    sift_deadline_down(h, last->heap_pos - 1);
+}
+
+/* the caller must hold the sent_requests lock */
+static int queue_sent_request(zhandle_t *zh, completion_list_t *c,
+        int add_to_front)
+{
+    completion_head_t *list = &zh->sent_requests;
+    int rc = request_table_place(&zh->sent_index, c->xid, c, &c->index_hint);
+    if (rc != ZOK)
+        return rc;
+    if (c->deadline.tv_sec != 0) {
+        rc = push_deadline(&zh->deadlines, c);
+        if (rc != ZOK) {
+            request_table_remove_entry(&zh->sent_index, c->xid, c,
+                    &c->index_hint);
+            return rc;
+        }
+    }
+    if (add_to_front) {
+        c->prev = 0;
+        c->next = list->head;
+        if (list->head)
+            list->head->prev = c;
+        else
+            list->last = c;
+        list->head = c;
+    } else {
+        c->next = 0;
+        c->prev = list->last;
+        if (list->last)
+            list->last->next = c;
+        else
+            list->head = c;
+        list->last = c;
+    }
+    list->length++;
+    return ZOK;
+}
+
+/* the caller must hold the sent_requests lock */
+static void unlink_sent_request(zhandle_t *zh, completion_list_t *c)
+{
+    completion_head_t *list = &zh->sent_requests;
+    if (c->heap_pos)
+        remove_deadline(&zh->deadlines, c);
+    /* replies take the head, so that case leaves the next prev alone */
+    if (c == list->head) {
+        list->head = c->next;
+        if (!list->head)
+            list->last = 0;
+    } else {
+        c->prev->next = c->next;
+        if (c->next)
+            c->next->prev = c->prev;
+        else
+            list->last = c->prev;
+    }
+    c->next = 0;
+    list->length--;
+}
+
+/**
+ * Takes the oldest outstanding request off sent_requests if the response
+ * with the given xid is its own. The server answers in order, and expired
+ * requests have already been taken out, so anything else is a broken
+ * stream. Returns 0 then, with the xid of the oldest request in expected,
+ * or -1 in it if there is none.
+ */
+static completion_list_t *take_sent_request(zhandle_t *zh, int xid,
+        int *expected)
+{
+    completion_list_t *c;
+    lock_completion_list(&zh->sent_requests);
+    c = zh->sent_requests.head;
+    if (c && c->xid == xid) {
+        request_table_remove_entry(&zh->sent_index, xid, c, &c->index_hint);
+        unlink_sent_request(zh, c);
+    } else {
+        *expected = c ? c->xid : -1;
+        c = 0;
+    }
+    unlock_completion_list(&zh->sent_requests);
+    return c;
+}
+
+/* stands in for the requests in zh->expired_index, which only needs keys */
+static completion_list_t expired_request;
+
+/**
+ * Returns 1 if a response with the given xid belongs to a request that has
+ * expired, which is then forgotten.
+ */
+static int forget_expired_request(zhandle_t *zh, int xid)
+{
+    completion_list_t *c;
+    lock_completion_list(&zh->sent_requests);
+    c = request_table_remove(&zh->expired_index, xid);
+    unlock_completion_list(&zh->sent_requests);
+    return c != 0;
+}
+
+/**
+ * Fails the requests that have reached their deadline with ZOPERATIONTIMEOUT.
+ * Their responses are discarded when they arrive.
+ */
+static void expire_requests(zhandle_t *zh)
+{
+    completion_list_t *expired = 0;
+    completion_list_t **last = &expired;
+    struct timeval now;
+
+    if (zh->deadlines.count == 0)
+        return;
+    gettimeofday(&now, 0);
+    lock_completion_list(&zh->sent_requests);
+    while (zh->deadlines.count > 0 &&
+            !deadline_before(&now, &zh->deadlines.entries[0]->deadline)) {
+        completion_list_t *c = zh->deadlines.entries[0];
+        request_table_remove_entry(&zh->sent_index, c->xid, c,
+                &c->index_hint);
+        unlink_sent_request(zh, c);
+        if (request_table_insert(&zh->expired_index, c->xid,
+                &expired_request) != ZOK) {
+            LOG_WARN(("Out of memory, the response to xid=%#x will be "
+                    "treated as unexpected", c->xid));
+        }
+        *last = c;
+        last = &c->next;
+    }
+    unlock_completion_list(&zh->sent_requests);
+    while (expired) {
+        completion_list_t *c = expired;
+        expired = c->next;
+        c->next = 0;
+        LOG_DEBUG(("Request xid=%#x has reached its deadline", c->xid));
+        fail_request(zh, c, ZOPERATIONTIMEOUT);
+    }
+}
+
+/**
+ * Returns the milliseconds left until the next request deadline, rounded
+ * up, or -1 if no request has a deadline.
+ */
+static int next_request_deadline(zhandle_t *zh, const struct timeval *now)
+{
+    int64_t left = -1;
+    if (zh->deadlines.count == 0)
+        return -1;
+    lock_completion_list(&zh->sent_requests);
+    if (zh->deadlines.count > 0) {
+        const struct timeval *d = &zh->deadlines.entries[0]->deadline;
+        left = (int64_t)(d->tv_sec - now->tv_sec) * 1000000 +
+            (d->tv_usec - now->tv_usec);
+        left = left <= 0 ? 0 : (left + 999) / 1000;
+    }
+    unlock_completion_list(&zh->sent_requests);
+    return (int)left;
+}
+
+static int add_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+        int completion_type, const void *dc, const void *data,
+        int add_to_front, watcher_registration_t* wo, completion_head_t *clist)
 {
-    completion_list_t *c =create_completion_entry(xid, completion_type, dc,
-            data, wo, clist);
+    completion_list_t *c =create_completion_entry(zh, h->xid, completion_type,
+            dc, data, wo, clist);
+    int32_t timeout = atomic_get(&zh->request_timeout);
     int rc = 0;
     if (!c)
         return ZSYSTEMERROR;
+    c->order_key = path_order_key(path);
+    c->op = h->type;
+    gettimeofday(&c->queued, 0);
+    if (timeout > 0 && h->xid != PING_XID) {
+        c->deadline = c->queued;
+        c->deadline.tv_sec += timeout / 1000;
+        c->deadline.tv_usec += (timeout % 1000) * 1000;
+        if (c->deadline.tv_usec >= 1000000) {
+            c->deadline.tv_sec++;
+            c->deadline.tv_usec -= 1000000;
+        }
+    }
     lock_completion_list(&zh->sent_requests);
     if (zh->close_requested != 1) {
-        queue_completion_nolock(&zh->sent_requests, c, add_to_front);
-        if (dc == SYNCHRONOUS_MARKER) {
+        rc = queue_sent_request(zh, c, add_to_front);
+        if (rc != ZOK) {
+            pool_free(c);
+        } else if (dc == SYNCHRONOUS_MARKER) {
             zh->outstanding_sync++;
         }
-        rc = ZOK;
     } else {
-        free(c);
+        pool_free(c);
         rc = ZINVALIDSTATE;
     }
     unlock_completion_list(&zh->sent_requests);
     return rc;
 }
 
-static int add_data_completion(zhandle_t *zh, int xid, data_completion_t dc,
-        const void *data,watcher_registration_t* wo)
+static int add_data_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+        data_completion_t dc, const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_DATA, dc, data, 0, wo, 0);
+    return add_completion(zh, h, path, COMPLETION_DATA, dc, data, 0, wo, 0);
 }
 
-static int add_stat_completion(zhandle_t *zh, int xid, stat_completion_t dc,
-        const void *data,watcher_registration_t* wo)
+static int add_stat_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+        stat_completion_t dc, const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_STAT, dc, data, 0, wo, 0);
+    return add_completion(zh, h, path, COMPLETION_STAT, dc, data, 0, wo, 0);
 }
 
-static int add_strings_completion(zhandle_t *zh, int xid,
+static int add_strings_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
         strings_completion_t dc, const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_STRINGLIST, dc, data, 0, wo, 0);
+    return add_completion(zh, h, path, COMPLETION_STRINGLIST, dc, data, 0, wo, 0);
 }
 
-static int add_strings_stat_completion(zhandle_t *zh, int xid,
+static int add_strings_stat_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
         strings_stat_completion_t dc, const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_STRINGLIST_STAT, dc, data, 0, wo, 0);
+    return add_completion(zh, h, path, COMPLETION_STRINGLIST_STAT, dc, data, 0, wo, 0);
 }
 
-static int add_acl_completion(zhandle_t *zh, int xid, acl_completion_t dc,
-        const void *data)
+static int add_acl_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+        acl_completion_t dc, const void *data)
 {
-    return add_completion(zh, xid, COMPLETION_ACLLIST, dc, data, 0, 0, 0);
+    return add_completion(zh, h, path, COMPLETION_ACLLIST, dc, data, 0, 0, 0);
 }
 
-static int add_void_completion(zhandle_t *zh, int xid, void_completion_t dc,
-        const void *data)
+static int add_void_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+        void_completion_t dc, const void *data)
+{
+    return add_completion(zh, h, path, COMPLETION_VOID, dc, data, 0, 0, 0);
+}
+
+static int add_watch_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+        void_completion_t dc, const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_VOID, dc, data, 0, 0, 0);
+    return add_completion(zh, h, path, COMPLETION_VOID, dc, data, 0, wo, 0);
 }
 
-static int add_string_completion(zhandle_t *zh, int xid,
+static int add_string_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
         string_completion_t dc, const void *data)
 {
-    return add_completion(zh, xid, COMPLETION_STRING, dc, data, 0, 0, 0);
+    return add_completion(zh, h, path, COMPLETION_STRING, dc, data, 0, 0, 0);
 }
 
-static int add_multi_completion(zhandle_t *zh, int xid, void_completion_t dc,
-        const void *data, completion_head_t *clist)
+static int add_multi_completion(zhandle_t *zh, const struct RequestHeader *h, const char *path,
+        void_completion_t dc, const void *data, completion_head_t *clist)
 {
-    return add_completion(zh, xid, COMPLETION_MULTI, dc, data, 0,0, clist);
+    return add_completion(zh, h, path, COMPLETION_MULTI, dc, data, 0,0, clist);
 }
 
 int zookeeper_close(zhandle_t *zh)
@@ -2508,12 +3606,11 @@ int zookeeper_close(zhandle_t *zh)
         struct RequestHeader h = { STRUCT_INITIALIZER (xid , get_xid()), STRUCT_INITIALIZER (type , ZOO_CLOSE_OP)};
         LOG_INFO(("Closing zookeeper sessionId=%#llx to [%s]\n",
                 zh->client_id.client_id,format_current_endpoint_info(zh)));
-        oa = create_buffer_oarchive();
+        oa = create_request_oarchive(zh, 0);
         rc = serialize_RequestHeader(oa, "header", &h);
-        rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-                get_buffer_len(oa));
+        rc = rc < 0 ? rc : queue_request(zh, oa, 0);
         /* We queued the buffer, so don't free it */
-        close_buffer_oarchive(&oa, 0);
+        close_request_oarchive(&oa, 0);
         if (rc < 0) {
             rc = ZMARSHALLINGERROR;
             goto finish;
@@ -2630,6 +3727,7 @@ int zoo_awget(zhandle_t *zh, const char *path,
         data_completion_t dc, const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     char *server_path = prepend_string(zh, path);
     struct RequestHeader h = { STRUCT_INITIALIZER (xid , get_xid()), STRUCT_INITIALIZER (type ,ZOO_GETDATA_OP)};
     struct GetDataRequest req =  { (char*)server_path, watcher!=0 };
@@ -2643,18 +3741,18 @@ int zoo_awget(zhandle_t *zh, const char *path,
         free_duplicate_path(server_path, path);
         return ZINVALIDSTATE;
     }
-    oa=create_buffer_oarchive();
+    REQUEST_SIZE(size, h, GetDataRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_GetDataRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_data_completion(zh, h.xid, dc, data,
-        create_watcher_registration(server_path,data_result_checker,watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_data_completion(zh, &h, server_path, dc, data,
+        create_watcher_registration(zh,server_path,data_result_checker,watcher,watcherCtx));
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(server_path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -2683,23 +3781,24 @@ int zoo_aset(zhandle_t *zh, const char *path, const char *buffer, int buflen,
         int version, stat_completion_t dc, const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER(xid , get_xid()), STRUCT_INITIALIZER (type , ZOO_SETDATA_OP)};
     struct SetDataRequest req;
     int rc = SetDataRequest_init(zh, &req, path, buffer, buflen, version);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
+    REQUEST_SIZE(size, h, SetDataRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_SetDataRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_stat_completion(zh, h.xid, dc, data,0);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_stat_completion(zh, &h, req.path, dc, data,0);
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -2737,6 +3836,7 @@ int zoo_acreate(zhandle_t *zh, const char *path, const char *value,
         string_completion_t completion, const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER (xid , get_xid()), STRUCT_INITIALIZER (type ,ZOO_CREATE_OP) };
     struct CreateRequest req;
 
@@ -2745,17 +3845,17 @@ int zoo_acreate(zhandle_t *zh, const char *path, const char *value,
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
+    REQUEST_SIZE(size, h, CreateRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_CreateRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_string_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_string_completion(zh, &h, req.path, completion, data);
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -2779,23 +3879,68 @@ int zoo_adelete(zhandle_t *zh, const char *path, int version,
         void_completion_t completion, const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER (xid , get_xid()), STRUCT_INITIALIZER (type , ZOO_DELETE_OP)};
     struct DeleteRequest req;
     int rc = DeleteRequest_init(zh, &req, path, version);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
+    REQUEST_SIZE(size, h, DeleteRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_DeleteRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_void_completion(zh, &h, req.path, completion, data);
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
+    leave_critical(zh);
+    free_duplicate_path(req.path, path);
+    /* We queued the buffer, so don't free it */
+    close_request_oarchive(&oa, 0);
+
+    LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
+            format_current_endpoint_info(zh)));
+    /* make a best (non-blocking) effort to send the requests asap */
+    adaptor_send_queue(zh, 0);
+    return (rc < 0)?ZMARSHALLINGERROR:ZOK;
+}
+
+int zoo_aadd_watch(zhandle_t *zh, const char *path, int mode,
+        watcher_fn watcher, void* watcherCtx,
+        void_completion_t completion, const void *data)
+{
+    struct oarchive *oa;
+    int32_t size = 0;
+    struct RequestHeader h = { STRUCT_INITIALIZER (xid , get_xid()), STRUCT_INITIALIZER (type , ZOO_ADDWATCH_OP)};
+    struct AddWatchRequest req;
+    int rc;
+    if ((mode != ZOO_ADD_WATCH_PERSISTENT &&
+            mode != ZOO_ADD_WATCH_PERSISTENT_RECURSIVE) || watcher == NULL) {
+        return ZBADARGUMENTS;
+    }
+    /* a server without AddWatch drops the request without an answer */
+    if (zh != NULL && !zh->persistent_watches) {
+        return ZUNIMPLEMENTED;
+    }
+    rc = Request_path_init(zh, 0, &req.path, path);
+    if (rc != ZOK) {
+        return rc;
+    }
+    req.mode = mode;
+    REQUEST_SIZE(size, h, AddWatchRequest, req);
+    oa = create_request_oarchive(zh, size);
+    rc = serialize_RequestHeader(oa, "header", &h);
+    rc = rc < 0 ? rc : serialize_AddWatchRequest(oa, "req", &req);
+    enter_critical(zh);
+    rc = rc < 0 ? rc : add_watch_completion(zh, &h, req.path, completion, data,
+        create_watcher_registration(zh, req.path,
+                mode == ZOO_ADD_WATCH_PERSISTENT ? persistent_result_checker :
+                recursive_result_checker, watcher, watcherCtx));
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -2815,6 +3960,7 @@ int zoo_awexists(zhandle_t *zh, const char *path,
         stat_completion_t completion, const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER (xid ,get_xid()), STRUCT_INITIALIZER (type , ZOO_EXISTS_OP) };
     struct ExistsRequest req;
     int rc = Request_path_watch_init(zh, 0, &req.path, path, 
@@ -2822,19 +3968,19 @@ int zoo_awexists(zhandle_t *zh, const char *path,
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
+    REQUEST_SIZE(size, h, ExistsRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_ExistsRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_stat_completion(zh, h.xid, completion, data,
-        create_watcher_registration(req.path,exists_result_checker,
+    rc = rc < 0 ? rc : add_stat_completion(zh, &h, req.path, completion, data,
+        create_watcher_registration(zh,req.path,exists_result_checker,
                 watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -2849,6 +3995,7 @@ static int zoo_awget_children_(zhandle_t *zh, const char *path,
          const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER (xid , get_xid()), STRUCT_INITIALIZER (type , ZOO_GETCHILDREN_OP)};
     struct GetChildrenRequest req ;
     int rc = Request_path_watch_init(zh, 0, &req.path, path, 
@@ -2856,18 +4003,18 @@ static int zoo_awget_children_(zhandle_t *zh, const char *path,
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
+    REQUEST_SIZE(size, h, GetChildrenRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_GetChildrenRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_strings_completion(zh, h.xid, sc, data,
-            create_watcher_registration(req.path,child_result_checker,watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_strings_completion(zh, &h, req.path, sc, data,
+            create_watcher_registration(zh,req.path,child_result_checker,watcher,watcherCtx));
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -2897,6 +4044,7 @@ static int zoo_awget_children2_(zhandle_t *zh, const char *path,
 {
     /* invariant: (sc == NULL) != (sc == NULL) */
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER( xid, get_xid()), STRUCT_INITIALIZER (type ,ZOO_GETCHILDREN2_OP)};
     struct GetChildren2Request req ;
     int rc = Request_path_watch_init(zh, 0, &req.path, path, 
@@ -2904,18 +4052,18 @@ static int zoo_awget_children2_(zhandle_t *zh, const char *path,
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
+    REQUEST_SIZE(size, h, GetChildren2Request, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_GetChildren2Request(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_strings_stat_completion(zh, h.xid, ssc, data,
-            create_watcher_registration(req.path,child_result_checker,watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_strings_stat_completion(zh, &h, req.path, ssc, data,
+            create_watcher_registration(zh,req.path,child_result_checker,watcher,watcherCtx));
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -2942,23 +4090,24 @@ int zoo_async(zhandle_t *zh, const char *path,
         string_completion_t completion, const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER (xid , get_xid()), STRUCT_INITIALIZER (type , ZOO_SYNC_OP)};
     struct SyncRequest req;
     int rc = Request_path_init(zh, 0, &req.path, path);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
+    REQUEST_SIZE(size, h, SyncRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_SyncRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_string_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_string_completion(zh, &h, req.path, completion, data);
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -2972,23 +4121,24 @@ int zoo_aget_acl(zhandle_t *zh, const char *path, acl_completion_t completion,
         const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER (xid , get_xid()), STRUCT_INITIALIZER(type ,ZOO_GETACL_OP)};
     struct GetACLRequest req;
     int rc = Request_path_init(zh, 0, &req.path, path) ;
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
+    REQUEST_SIZE(size, h, GetACLRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_GetACLRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_acl_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_acl_completion(zh, &h, req.path, completion, data);
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -3001,25 +4151,26 @@ int zoo_aset_acl(zhandle_t *zh, const char *path, int version,
         struct ACL_vector *acl, void_completion_t completion, const void *data)
 {
     struct oarchive *oa;
+    int32_t size = 0;
     struct RequestHeader h = { STRUCT_INITIALIZER(xid ,get_xid()), STRUCT_INITIALIZER (type , ZOO_SETACL_OP)};
     struct SetACLRequest req;
     int rc = Request_path_init(zh, 0, &req.path, path);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
     req.acl = *acl;
     req.version = version;
+    REQUEST_SIZE(size, h, SetACLRequest, req);
+    oa = create_request_oarchive(zh, size);
     rc = serialize_RequestHeader(oa, "header", &h);
     rc = rc < 0 ? rc : serialize_SetACLRequest(oa, "req", &req);
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_void_completion(zh, &h, req.path, completion, data);
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     free_duplicate_path(req.path, path);
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             format_current_endpoint_info(zh)));
@@ -3083,103 +4234,153 @@ static int CheckVersionRequest_init(zhandle_t *zh, struct CheckVersionRequest *r
     return ZOK;
 }
 
+/* the request of one op of a multi; zoo_amulti() sets them all up before it
+ * serializes any, so that it knows what the multi request takes */
+union multi_op_request {
+    struct CreateRequest create;
+    struct DeleteRequest del;
+    struct SetDataRequest set;
+    struct CheckVersionRequest check;
+};
+
+static int multi_op_request_init(zhandle_t *zh, const zoo_op_t *op,
+        union multi_op_request *req)
+{
+    switch(op->type) {
+        case ZOO_CREATE_OP:
+            return CreateRequest_init(zh, &req->create, op->create_op.path,
+                    op->create_op.data, op->create_op.datalen,
+                    op->create_op.acl, op->create_op.flags);
+        case ZOO_DELETE_OP:
+            return DeleteRequest_init(zh, &req->del, op->delete_op.path,
+                    op->delete_op.version);
+        case ZOO_SETDATA_OP:
+            return SetDataRequest_init(zh, &req->set, op->set_op.path,
+                    op->set_op.data, op->set_op.datalen, op->set_op.version);
+        case ZOO_CHECK_OP:
+            return CheckVersionRequest_init(zh, &req->check,
+                    op->check_op.path, op->check_op.version);
+        default:
+            LOG_ERROR(("Unimplemented sub-op type=%d in multi-op", op->type));
+            return ZUNIMPLEMENTED;
+    }
+}
+
+/* serializes an op set up by multi_op_request_init(), to a size archive as
+ * well as to the request */
+static int serialize_multi_op(struct oarchive *oa, const zoo_op_t *op,
+        union multi_op_request *req)
+{
+    struct MultiHeader mh = { STRUCT_INITIALIZER(type, op->type), STRUCT_INITIALIZER(done, 0), STRUCT_INITIALIZER(err, -1) };
+    int rc = serialize_MultiHeader(oa, "multiheader", &mh);
+    if (rc < 0)
+        return rc;
+    switch(op->type) {
+        case ZOO_CREATE_OP:
+            return serialize_CreateRequest(oa, "req", &req->create);
+        case ZOO_DELETE_OP:
+            return serialize_DeleteRequest(oa, "req", &req->del);
+        case ZOO_SETDATA_OP:
+            return serialize_SetDataRequest(oa, "req", &req->set);
+        default:
+            return serialize_CheckVersionRequest(oa, "req", &req->check);
+    }
+}
+
+static void free_multi_op_request(const zoo_op_t *op,
+        union multi_op_request *req)
+{
+    switch(op->type) {
+        case ZOO_CREATE_OP:
+            free_duplicate_path(req->create.path, op->create_op.path);
+            break;
+        case ZOO_DELETE_OP:
+            free_duplicate_path(req->del.path, op->delete_op.path);
+            break;
+        case ZOO_SETDATA_OP:
+            free_duplicate_path(req->set.path, op->set_op.path);
+            break;
+        default:
+            free_duplicate_path(req->check.path, op->check_op.path);
+            break;
+    }
+}
+
 int zoo_amulti(zhandle_t *zh, int count, const zoo_op_t *ops,
         zoo_op_result_t *results, void_completion_t completion, const void *data)
 {
     struct RequestHeader h = { STRUCT_INITIALIZER(xid, get_xid()), STRUCT_INITIALIZER(type, ZOO_MULTI_OP) };
     struct MultiHeader mh = { STRUCT_INITIALIZER(type, -1), STRUCT_INITIALIZER(done, 1), STRUCT_INITIALIZER(err, -1) };
-    struct oarchive *oa = create_buffer_oarchive();
+    struct oarchive *oa;
+    struct oarchive sa;
+    int32_t size = 0;
+    union multi_op_request *reqs;
     completion_head_t clist = { 0 };
+    int rc = ZOK;
+    int index = 0;
 
-    int rc = serialize_RequestHeader(oa, "header", &h);
+    reqs = calloc(count > 0 ? count : 1, sizeof(*reqs));
+    if (!reqs)
+        return ZSYSTEMERROR;
+
+    init_size_oarchive(&sa, &size);
+    serialize_RequestHeader(&sa, "header", &h);
+    for (index=0; index < count; index++) {
+        rc = multi_op_request_init(zh, ops+index, reqs+index);
+        if (rc != ZOK)
+            break;
+        serialize_multi_op(&sa, ops+index, reqs+index);
+    }
+    serialize_MultiHeader(&sa, "multiheader", &mh);
+    if (rc != ZOK) {
+        while (index-- > 0)
+            free_multi_op_request(ops+index, reqs+index);
+        free(reqs);
+        return rc == ZUNIMPLEMENTED ? rc : ZMARSHALLINGERROR;
+    }
+
+    oa = create_request_oarchive(zh, size);
+    rc = serialize_RequestHeader(oa, "header", &h);
 
-    int index = 0;
     for (index=0; index < count; index++) {
         const zoo_op_t *op = ops+index;
         zoo_op_result_t *result = results+index;
         completion_list_t *entry = NULL;
 
-        struct MultiHeader mh = { STRUCT_INITIALIZER(type, op->type), STRUCT_INITIALIZER(done, 0), STRUCT_INITIALIZER(err, -1) };
-        rc = rc < 0 ? rc : serialize_MultiHeader(oa, "multiheader", &mh);
-     
+        rc = rc < 0 ? rc : serialize_multi_op(oa, op, reqs+index);
+        free_multi_op_request(op, reqs+index);
+
+        enter_critical(zh);
         switch(op->type) {
-            case ZOO_CREATE_OP: {
-                struct CreateRequest req;
-
-                rc = rc < 0 ? rc : CreateRequest_init(zh, &req, 
-                                        op->create_op.path, op->create_op.data, 
-                                        op->create_op.datalen, op->create_op.acl, 
-                                        op->create_op.flags);
-                rc = rc < 0 ? rc : serialize_CreateRequest(oa, "req", &req);
+            case ZOO_CREATE_OP:
                 result->value = op->create_op.buf;
-				result->valuelen = op->create_op.buflen;
-
-                enter_critical(zh);
-                entry = create_completion_entry(h.xid, COMPLETION_STRING, op_result_string_completion, result, 0, 0); 
-                leave_critical(zh);
-                free_duplicate_path(req.path, op->create_op.path);
-                break;
-            }
-
-            case ZOO_DELETE_OP: {
-                struct DeleteRequest req;
-                rc = rc < 0 ? rc : DeleteRequest_init(zh, &req, op->delete_op.path, op->delete_op.version);
-                rc = rc < 0 ? rc : serialize_DeleteRequest(oa, "req", &req);
-
-                enter_critical(zh);
-                entry = create_completion_entry(h.xid, COMPLETION_VOID, op_result_void_completion, result, 0, 0); 
-                leave_critical(zh);
-                free_duplicate_path(req.path, op->delete_op.path);
+                result->valuelen = op->create_op.buflen;
+                entry = create_completion_entry(zh, h.xid, COMPLETION_STRING, op_result_string_completion, result, 0, 0); 
                 break;
-            }
-
-            case ZOO_SETDATA_OP: {
-                struct SetDataRequest req;
-                rc = rc < 0 ? rc : SetDataRequest_init(zh, &req,
-                                        op->set_op.path, op->set_op.data, 
-                                        op->set_op.datalen, op->set_op.version);
-                rc = rc < 0 ? rc : serialize_SetDataRequest(oa, "req", &req);
+            case ZOO_SETDATA_OP:
                 result->stat = op->set_op.stat;
-
-                enter_critical(zh);
-                entry = create_completion_entry(h.xid, COMPLETION_STAT, op_result_stat_completion, result, 0, 0); 
-                leave_critical(zh);
-                free_duplicate_path(req.path, op->set_op.path);
-                break;
-            }
-
-            case ZOO_CHECK_OP: {
-                struct CheckVersionRequest req;
-                rc = rc < 0 ? rc : CheckVersionRequest_init(zh, &req,
-                                        op->check_op.path, op->check_op.version);
-                rc = rc < 0 ? rc : serialize_CheckVersionRequest(oa, "req", &req);
-
-                enter_critical(zh);
-                entry = create_completion_entry(h.xid, COMPLETION_VOID, op_result_void_completion, result, 0, 0); 
-                leave_critical(zh);
-                free_duplicate_path(req.path, op->check_op.path);
+                entry = create_completion_entry(zh, h.xid, COMPLETION_STAT, op_result_stat_completion, result, 0, 0); 
                 break;
-            } 
-
             default:
-                LOG_ERROR(("Unimplemented sub-op type=%d in multi-op", op->type));
-                return ZUNIMPLEMENTED; 
+                entry = create_completion_entry(zh, h.xid, COMPLETION_VOID, op_result_void_completion, result, 0, 0); 
+                break;
         }
+        leave_critical(zh);
 
         queue_completion(&clist, entry, 0);
     }
+    free(reqs);
 
     rc = rc < 0 ? rc : serialize_MultiHeader(oa, "multiheader", &mh);
   
     /* BEGIN: CRTICIAL SECTION */
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_multi_completion(zh, h.xid, completion, data, &clist);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_multi_completion(zh, &h, 0, completion, data, &clist);
+    rc = rc < 0 ? rc : queue_request(zh, oa, 0);
     leave_critical(zh);
     
     /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    close_request_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending multi request xid=%#x with %d subrequests to %s",
             h.xid, index, format_current_endpoint_info(zh)));
@@ -3257,9 +4458,11 @@ int flush_send_queue(zhandle_t*zh, int timeout)
 {
     int rc= ZOK;
     struct timeval started;
+    int64_t sent = 0;
 #ifdef WIN32
     fd_set pollSet; 
     struct timeval wait;
+    int off;
 #endif
     gettimeofday(&started,0);
     // we can't use dequeue_buffer() here because if (non-blocking) send_buffer()
@@ -3267,7 +4470,7 @@ int flush_send_queue(zhandle_t*zh, int timeout)
     // we use a recursive lock instead and only dequeue the buffer if a send was
     // successful
     lock_buffer_list(&zh->to_send);
-    while (zh->to_send.head != 0&& zh->state == ZOO_CONNECTED_STATE) {
+    while (peek_buffer(&zh->to_send) != 0&& zh->state == ZOO_CONNECTED_STATE) {
         if(timeout!=0){
             int elapsed;
             struct timeval now;
@@ -3298,7 +4501,13 @@ int flush_send_queue(zhandle_t*zh, int timeout)
             }
         }
 
+#ifdef WIN32
+        off = zh->to_send.head->curr_offset;
         rc = send_buffer(zh->fd, zh->to_send.head);
+        sent += zh->to_send.head->curr_offset - off;
+#else
+        rc = send_buffer_list(zh->fd, &zh->to_send, &sent);
+#endif
         if(rc==0 && timeout==0){
             /* send_buffer would block while sending this buffer */
             rc = ZOK;
@@ -3308,13 +4517,17 @@ int flush_send_queue(zhandle_t*zh, int timeout)
             rc = ZCONNECTIONLOSS;
             break;
         }
+#ifdef WIN32
         // if the buffer has been sent successfully, remove it from the queue
         if (rc > 0)
             remove_buffer(&zh->to_send);
+#endif
         gettimeofday(&zh->last_send, 0);
         rc = ZOK;
     }
     unlock_buffer_list(&zh->to_send);
+    if (sent)
+        fetch_and_add64(&zh->counters.bytes_sent, sent);
     return rc;
 }
 
@@ -3503,6 +4716,24 @@ int zoo_delete(zhandle_t *zh, const char *path, int version)
     return rc;
 }
 
+int zoo_add_watch(zhandle_t *zh, const char *path, int mode,
+        watcher_fn watcher, void* watcherCtx)
+{
+    struct sync_completion *sc = alloc_sync_completion();
+    int rc;
+    if (!sc) {
+        return ZSYSTEMERROR;
+    }
+    rc=zoo_aadd_watch(zh, path, mode, watcher, watcherCtx,
+            SYNCHRONOUS_MARKER, sc);
+    if(rc==ZOK){
+        wait_sync_completion(sc);
+        rc = sc->rc;
+    }
+    free_sync_completion(sc);
+    return rc;
+}
+
 int zoo_exists(zhandle_t *zh, const char *path, int watch, struct Stat *stat)
 {
     return zoo_wexists(zh,path,watch?zh->watcher:0,zh->context,stat);
@@ -3563,6 +4794,55 @@ int zoo_wget(zhandle_t *zh, const char *path,
     return rc;
 }
 
+/* the watch that keeps a cached node, see collectWatchers() */
+static void cache_watcher(zhandle_t *zh, int type, int state,
+        const char *path, void *ctx)
+{
+}
+
+int zoo_cached_get(zhandle_t *zh, const char *path, char *buffer,
+        int* buffer_len, struct Stat *stat)
+{
+    struct Stat node_stat;
+    char *server_path;
+    int64_t generation;
+    int len;
+    int rc;
+
+    if (zh==0 || buffer_len==NULL)
+        return ZBADARGUMENTS;
+    if (!zh->cache)
+        return zoo_get(zh, path, 0, buffer, buffer_len, stat);
+    server_path = prepend_string(zh, path);
+    if (!isValidPath(server_path, 0)) {
+        free_duplicate_path(server_path, path);
+        return ZBADARGUMENTS;
+    }
+    rc = cache_lookup(zh->cache, server_path, buffer, buffer_len, stat,
+            &generation);
+    if (rc != 0) {
+        free_duplicate_path(server_path, path);
+        return rc > 0 ? ZOK : zoo_get(zh, path, 0, buffer, buffer_len, stat);
+    }
+    len = *buffer_len;
+    rc = zoo_wget(zh, path, cache_watcher, 0, buffer, &len, &node_stat);
+    if (generation) {
+        /* a node larger than the buffer was not read in full */
+        if (rc == ZOK && (len == -1 || len == node_stat.dataLength))
+            cache_fill(zh->cache, server_path, generation, buffer, len,
+                    &node_stat);
+        else
+            cache_abandon(zh->cache, server_path, generation);
+    }
+    free_duplicate_path(server_path, path);
+    if (rc == ZOK) {
+        *buffer_len = len;
+        if (stat)
+            *stat = node_stat;
+    }
+    return rc;
+}
+
 int zoo_set(zhandle_t *zh, const char *path, const char *buffer, int buflen,
         int version)
 {
@@ -3591,13 +4871,14 @@ int zoo_set2(zhandle_t *zh, const char *path, const char *buffer, int buflen,
 
 static int zoo_wget_children_(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx,
-        struct String_vector *strings)
+        struct String_vector *strings, int arena)
 {
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
         return ZSYSTEMERROR;
     }
+    sc->strings_arena = arena;
     rc= zoo_awget_children (zh, path, watcher, watcherCtx, SYNCHRONOUS_MARKER, sc);
     if(rc==ZOK){
         wait_sync_completion(sc);
@@ -3605,6 +4886,8 @@ static int zoo_wget_children_(zhandle_t *zh, const char *path,
         if (rc == 0) {
             if (strings) {
                 *strings = sc->u.strs2;
+            } else if (arena) {
+                deallocate_String_vector_arena(&sc->u.strs2);
             } else {
                 deallocate_String_vector(&sc->u.strs2);
             }
@@ -3644,14 +4927,27 @@ static int zoo_wget_children2_(zhandle_t *zh, const char *path,
 int zoo_get_children(zhandle_t *zh, const char *path, int watch,
         struct String_vector *strings)
 {
-    return zoo_wget_children_(zh,path,watch?zh->watcher:0,zh->context,strings);
+    return zoo_wget_children_(zh,path,watch?zh->watcher:0,zh->context,strings,0);
 }
 
 int zoo_wget_children(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx,
         struct String_vector *strings)
 {
-    return zoo_wget_children_(zh,path,watcher,watcherCtx,strings);
+    return zoo_wget_children_(zh,path,watcher,watcherCtx,strings,0);
+}
+
+int zoo_get_children_arena(zhandle_t *zh, const char *path, int watch,
+        struct String_vector *strings)
+{
+    return zoo_wget_children_(zh,path,watch?zh->watcher:0,zh->context,strings,1);
+}
+
+int zoo_wget_children_arena(zhandle_t *zh, const char *path,
+        watcher_fn watcher, void* watcherCtx,
+        struct String_vector *strings)
+{
+    return zoo_wget_children_(zh,path,watcher,watcherCtx,strings,1);
 }
 
 int zoo_get_children2(zhandle_t *zh, const char *path, int watch,
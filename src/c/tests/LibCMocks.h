@@ -202,16 +202,35 @@ public:
             errno=sendErrno;
             return -1;
         }
-        // first call to send() is always the length of the buffer to follow
-        bool sendingLength=sendBuffer.size()==0;
-        // overwrite the length bytes
-        sendBuffer.assign((const char*)buf,len);
-        if(!sendingLength){
-            notifyBufferSent(sendBuffer);
-            sendBuffer.erase();
+        // the client writes length-prefixed frames; the prefix may arrive
+        // on its own or together with the payload
+        sendBuffer.append((const char*)buf,len);
+        while(sendBuffer.size()>=sizeof(int32_t)){
+            int32_t flen;
+            memcpy(&flen,sendBuffer.data(),sizeof(flen));
+            flen=ntohl(flen);
+            if(sendBuffer.size()<sizeof(flen)+flen)
+                break;
+            notifyBufferSent(sendBuffer.substr(sizeof(flen),flen));
+            sendBuffer.erase(0,sizeof(flen)+flen);
         }
         return len;
     }
+    // by default a gathered write is delivered to callSend() one iovec
+    // element at a time
+    virtual ssize_t callSendMsg(int s,const struct msghdr *msg,int flags){
+        ssize_t total=0;
+        for(size_t i=0;i<(size_t)msg->msg_iovlen;i++){
+            const struct iovec& v=msg->msg_iov[i];
+            ssize_t rc=callSend(s,v.iov_base,v.iov_len,flags);
+            if(rc<0)
+                return total==0?rc:total;
+            total+=rc;
+            if((size_t)rc<v.iov_len)
+                break;
+        }
+        return total;
+    }
 
     int recvErrno;
     std::string recvReturnBuffer;
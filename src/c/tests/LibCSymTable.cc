@@ -47,6 +47,7 @@ LibCSymTable::LibCSymTable()
     LOAD_SYM(fcntl);
     LOAD_SYM(connect);
     LOAD_SYM(send);
+    LOAD_SYM(sendmsg);
     LOAD_SYM(recv);
     LOAD_SYM(select);
     LOAD_SYM(poll);
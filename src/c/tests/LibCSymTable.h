@@ -76,6 +76,7 @@ struct LibCSymTable
     DECLARE_SYM(int,fcntl,(int,int,...));
     DECLARE_SYM(int,connect,(int,const struct sockaddr*,socklen_t));
     DECLARE_SYM(ssize_t,send,(int,const void*,size_t,int));
+    DECLARE_SYM(ssize_t,sendmsg,(int,const struct msghdr*,int));
     DECLARE_SYM(ssize_t,recv,(int,const void*,size_t,int));
     DECLARE_SYM(int,select,(int,fd_set*,fd_set*,fd_set*,struct timeval*));
     DECLARE_SYM(int,poll,(struct pollfd*,POLL_NFDS_TYPE,int));
@@ -0,0 +1,146 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "CppAssertHelper.h"
+
+#include <stdlib.h>
+#include "src/zk_adaptor.h"
+
+#ifdef THREADED
+#include <pthread.h>
+#endif
+
+class Zookeeper_bufferQueue : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_bufferQueue);
+    CPPUNIT_TEST(testFifoOrder);
+    CPPUNIT_TEST(testOverflowKeepsOrder);
+#ifdef THREADED
+    CPPUNIT_TEST(testConcurrentProducers);
+#endif
+    CPPUNIT_TEST_SUITE_END();
+
+    buffer_head_t queue;
+    object_pool_t pool;
+
+    // the length field tags each buffer with its sequence number
+    void enqueue(int tag){
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,queue_buffer_bytes(&queue,0,tag));
+    }
+    int dequeue(){
+        buffer_list_t* b=dequeue_buffer(&queue);
+        if(b==0)
+            return -1;
+        int tag=b->len;
+        free_buffer(b);
+        return tag;
+    }
+
+public:
+    void setUp()
+    {
+        init_object_pool(&pool,sizeof(buffer_list_t),OBJECT_POOL_MAX_FREE);
+        init_buffer_list(&queue,&pool);
+#ifdef THREADED
+        pthread_mutex_init(&queue.lock,0);
+        pthread_mutex_init(&pool.lock,0);
+#endif
+    }
+
+    void tearDown()
+    {
+        free_buffers(&queue);
+        destroy_object_pool(&pool);
+#ifdef THREADED
+        pthread_mutex_destroy(&queue.lock);
+        pthread_mutex_destroy(&pool.lock);
+#endif
+    }
+
+    void testFifoOrder()
+    {
+        for(int i=1;i<=10;i++)
+            enqueue(i);
+        for(int i=1;i<=10;i++)
+            CPPUNIT_ASSERT_EQUAL(i,dequeue());
+        CPPUNIT_ASSERT_EQUAL(-1,dequeue());
+    }
+
+    void testOverflowKeepsOrder()
+    {
+        const int count=3*BUFFER_RING_SIZE;
+        int next=1;
+        // fill the ring past its capacity, then drain and refill it while
+        // the overflow list is still populated
+        for(int i=1;i<=count;i++)
+            enqueue(i);
+        for(int i=0;i<BUFFER_RING_SIZE/2;i++)
+            CPPUNIT_ASSERT_EQUAL(next++,dequeue());
+        for(int i=count+1;i<=2*count;i++)
+            enqueue(i);
+        while(next<=2*count)
+            CPPUNIT_ASSERT_EQUAL(next++,dequeue());
+        CPPUNIT_ASSERT_EQUAL(-1,dequeue());
+    }
+
+#ifdef THREADED
+    static const int PRODUCERS=4;
+    static const int PER_PRODUCER=10000;
+    struct Producer{
+        buffer_head_t* queue;
+        int id;
+    };
+    static void* produce(void* arg){
+        Producer* p=(Producer*)arg;
+        for(int i=0;i<PER_PRODUCER;i++)
+            queue_buffer_bytes(p->queue,0,p->id*PER_PRODUCER+i+1);
+        return 0;
+    }
+
+    void testConcurrentProducers()
+    {
+        pthread_t threads[PRODUCERS];
+        Producer producers[PRODUCERS];
+        int last[PRODUCERS];
+        for(int i=0;i<PRODUCERS;i++){
+            producers[i].queue=&queue;
+            producers[i].id=i;
+            last[i]=0;
+            pthread_create(&threads[i],0,produce,&producers[i]);
+        }
+        int received=0;
+        while(received<PRODUCERS*PER_PRODUCER){
+            int tag=dequeue();
+            if(tag==-1)
+                continue;
+            int id=(tag-1)/PER_PRODUCER;
+            int seq=(tag-1)%PER_PRODUCER+1;
+            // buffers of a single producer come out in order
+            CPPUNIT_ASSERT_EQUAL(last[id]+1,seq);
+            last[id]=seq;
+            received++;
+        }
+        for(int i=0;i<PRODUCERS;i++)
+            pthread_join(threads[i],0);
+        CPPUNIT_ASSERT_EQUAL(-1,dequeue());
+    }
+#endif
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_bufferQueue);
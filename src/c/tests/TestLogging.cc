@@ -0,0 +1,141 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "CppAssertHelper.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "zookeeper_log.h"
+
+#ifdef THREADED
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+class Zookeeper_logging : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_logging);
+    CPPUNIT_TEST(testLineFormat);
+#ifdef THREADED
+    CPPUNIT_TEST(testAsyncKeepsOrder);
+#endif
+    CPPUNIT_TEST_SUITE_END();
+
+    FILE *stream;
+    ZooLogLevel savedLevel;
+
+    vector<string> readLines(){
+        vector<string> lines;
+        char line[1024];
+        fflush(stream);
+        rewind(stream);
+        while(fgets(line,sizeof(line),stream))
+            lines.push_back(line);
+        return lines;
+    }
+
+public:
+    void setUp()
+    {
+        stream=tmpfile();
+        savedLevel=logLevel;
+        zoo_set_log_stream(stream);
+        zoo_set_debug_level(ZOO_LOG_LEVEL_INFO);
+    }
+
+    void tearDown()
+    {
+        zoo_set_log_stream(0);
+        logLevel=savedLevel;
+        fclose(stream);
+    }
+
+    // "yyyy-MM-dd HH:mm:ss,SSS" as log4j writes it, however the time comes
+    // from the cache
+    void testLineFormat()
+    {
+        LOG_INFO(("first %d",1));
+        LOG_INFO(("second %d",2));
+        vector<string> lines=readLines();
+        CPPUNIT_ASSERT_EQUAL(2,(int)lines.size());
+        for(int i=0;i<2;i++){
+            int y,mo,d,h,mi,s,ms,n=0;
+            CPPUNIT_ASSERT_EQUAL(7,sscanf(lines[i].c_str(),
+                    "%4d-%2d-%2d %2d:%2d:%2d,%3d:%n",&y,&mo,&d,&h,&mi,&s,&ms,&n));
+            CPPUNIT_ASSERT_EQUAL(24,n);
+            CPPUNIT_ASSERT(ms>=0 && ms<1000);
+        }
+        CPPUNIT_ASSERT(lines[0].find("@testLineFormat@")!=string::npos);
+        CPPUNIT_ASSERT(lines[0].find(": first 1\n")!=string::npos);
+        CPPUNIT_ASSERT(lines[1].find(": second 2\n")!=string::npos);
+    }
+
+#ifdef THREADED
+    static const int THREADS=4;
+    static const int MESSAGES=5000;
+
+    static void* logMessages(void* arg){
+        long thread=(long)arg;
+        for(int i=0;i<MESSAGES;i++)
+            LOG_INFO(("thread %ld message %d",thread,i));
+        return 0;
+    }
+
+    // every message is either written, in the order each thread logged
+    // it, or counted as dropped
+    void testAsyncKeepsOrder()
+    {
+        pthread_t threads[THREADS];
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_set_log_async(1));
+        for(long i=0;i<THREADS;i++)
+            pthread_create(&threads[i],0,logMessages,(void*)i);
+        for(int i=0;i<THREADS;i++)
+            pthread_join(threads[i],0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_set_log_async(0));
+
+        vector<string> lines=readLines();
+        int last[THREADS];
+        int written=0,dropped=0;
+        for(int i=0;i<THREADS;i++)
+            last[i]=-1;
+        for(size_t i=0;i<lines.size();i++){
+            long thread;
+            int message,count;
+            size_t at;
+            if((at=lines[i].find(": thread "))!=string::npos){
+                CPPUNIT_ASSERT_EQUAL(2,sscanf(lines[i].c_str()+at,
+                        ": thread %ld message %d",&thread,&message));
+                CPPUNIT_ASSERT(message>last[thread]);
+                last[thread]=message;
+                written++;
+            }else if((at=lines[i].find(": "))!=string::npos &&
+                    sscanf(lines[i].c_str()+at,": %d log messages dropped",
+                            &count)==1){
+                dropped+=count;
+            }
+        }
+        CPPUNIT_ASSERT_EQUAL(THREADS*MESSAGES,written+dropped);
+    }
+#endif
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_logging);
@@ -31,9 +31,20 @@ class Zookeeper_operations : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testPing);
     CPPUNIT_TEST(testTimeoutCausedByWatches1);
     CPPUNIT_TEST(testTimeoutCausedByWatches2);
+    CPPUNIT_TEST(testPartialGatheredSend);
+    CPPUNIT_TEST(testBulkReceive);
+    CPPUNIT_TEST(testObjectPoolReuse);
+    CPPUNIT_TEST(testLargeRequestSingleWrite);
+    CPPUNIT_TEST(testBorrowedReplies);
+    CPPUNIT_TEST(testRequestDeadline);
+    CPPUNIT_TEST(testLatencyMetrics);
+    CPPUNIT_TEST(testLatencyBuckets);
+    CPPUNIT_TEST(testStats);
 #else    
     CPPUNIT_TEST(testAsyncWatcher1);
     CPPUNIT_TEST(testAsyncGetOperation);
+    CPPUNIT_TEST(testGetChildrenArena);
+    CPPUNIT_TEST(testCachedGet);
 #endif
     CPPUNIT_TEST(testOperationsAndDisconnectConcurrently1);
     CPPUNIT_TEST(testOperationsAndDisconnectConcurrently2);
@@ -215,6 +226,466 @@ public:
         CPPUNIT_ASSERT_EQUAL((int)ZOPERATIONTIMEOUT,res2.rc_);
     }
 
+    // accepts only a few bytes per sendmsg() call and reassembles the
+    // request frames from the resulting byte stream
+    class TricklingServer: public ZookeeperServer{
+    public:
+        TricklingServer(size_t chunk):chunk_(chunk),sendCount_(0){}
+        virtual ssize_t callSendMsg(int s,const struct msghdr *msg,int flags){
+            size_t total=0;
+            sendCount_++;
+            for(size_t i=0;i<(size_t)msg->msg_iovlen && total<chunk_;i++){
+                const struct iovec& v=msg->msg_iov[i];
+                size_t k=std::min(v.iov_len,chunk_-total);
+                stream_.append((const char*)v.iov_base,k);
+                total+=k;
+            }
+            while(stream_.size()>=sizeof(int32_t)){
+                int32_t len;
+                memcpy(&len,stream_.data(),sizeof(len));
+                len=ntohl(len);
+                if(stream_.size()<sizeof(len)+len)
+                    break;
+                notifyBufferSent(stream_.substr(sizeof(len),len));
+                stream_.erase(0,sizeof(len)+len);
+            }
+            return total;
+        }
+        virtual void onMessageReceived(const RequestHeader& rh, iarchive* ia){
+            xids_.push_back(rh.xid);
+        }
+        size_t chunk_;
+        int sendCount_;
+        string stream_;
+        vector<int32_t> xids_;
+    };
+
+    // queue a batch of requests and let the socket accept only a few bytes
+    // at a time; verify every request arrives intact and in order
+    void testPartialGatheredSend()
+    {
+        const size_t COUNT=10;
+        Mock_gettimeofday timeMock;
+        TricklingServer zkServer(7);
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        AsyncCompletion res;
+        for(size_t i=0;i<COUNT;i++){
+            int rc=zoo_aexists(zh,"/x/y",0,asyncCompletion,&res);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        }
+        int fd=0;
+        int interest=0;
+        timeval tv;
+        for(int i=0;i<1000 && zkServer.xids_.size()<COUNT;i++){
+            int rc=zookeeper_interest(zh,&fd,&interest,&tv);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+            CPPUNIT_ASSERT(interest&ZOOKEEPER_WRITE);
+            zookeeper_process(zh,ZOOKEEPER_WRITE);
+        }
+        CPPUNIT_ASSERT_EQUAL(COUNT,zkServer.xids_.size());
+        for(size_t i=1;i<COUNT;i++)
+            CPPUNIT_ASSERT(zkServer.xids_[i-1]<zkServer.xids_[i]);
+        CPPUNIT_ASSERT(zkServer.sendCount_>(int)COUNT);
+        CPPUNIT_ASSERT_EQUAL(string(""),zkServer.stream_);
+    }
+
+    // hands out all the queued responses as a single byte stream
+    class BulkServer: public ZookeeperServer{
+    public:
+        virtual ssize_t callRecv(int s,void *buf,size_t len,int flags){
+            {
+                synchronized(recvQMx);
+                while(!recvQueue.empty()){
+                    Element& el=recvQueue.front();
+                    if(el.first!=0){
+                        recvReturnBuffer+=el.first->toString();
+                        delete el.first;
+                    }
+                    --recvHasMore;
+                    recvQueue.pop_front();
+                }
+            }
+            recvErrno=recvReturnBuffer.empty()?EAGAIN:0;
+            return Mock_socket::callRecv(s,buf,len,flags);
+        }
+    };
+
+    // several responses arrive back to back, one of them too large for the
+    // receive block; verify each completion gets its own response
+    void testBulkReceive()
+    {
+        const int COUNT=5;
+        Mock_gettimeofday timeMock;
+        BulkServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        string large(2*RECV_BLOCK_SIZE,'x');
+        AsyncGetOperationCompletion res[COUNT];
+        for(int i=0;i<COUNT;i++){
+            string value=(i==2)?large:string(1,'0'+i);
+            zkServer.addOperationResponse(
+                    new ZooGetResponse(value.data(),value.size()));
+            int rc=zoo_aget(zh,"/x/y",0,asyncCompletion,&res[i]);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        }
+        // send the requests, the responses pile up on the server side
+        int rc=zookeeper_process(zh,ZOOKEEPER_WRITE);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        for(int i=0;i<100 && !res[COUNT-1].called_;i++)
+            zookeeper_process(zh,ZOOKEEPER_READ);
+        for(int i=0;i<COUNT;i++){
+            CPPUNIT_ASSERT(res[i].called_);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,res[i].rc_);
+            if(i!=2)
+                CPPUNIT_ASSERT_EQUAL(string(1,'0'+i),res[i].value_);
+        }
+        CPPUNIT_ASSERT_EQUAL(large,res[2].value_);
+    }
+
+    // issue requests one at a time; after the first round trip the per-request
+    // objects should come out of the handle's pools
+    void testObjectPoolReuse()
+    {
+        const int COUNT=10;
+        Mock_gettimeofday timeMock;
+        ZookeeperServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        for(int i=0;i<COUNT;i++){
+            AsyncGetOperationCompletion res;
+            zkServer.addOperationResponse(new ZooGetResponse("1",1));
+            int rc=zoo_aget(zh,"/x/y",0,asyncCompletion,&res);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+            rc=zookeeper_process(zh,ZOOKEEPER_WRITE);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+            for(int j=0;j<10 && !res.called_;j++)
+                zookeeper_process(zh,ZOOKEEPER_READ);
+            CPPUNIT_ASSERT(res.called_);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,res.rc_);
+        }
+        zoo_pool_stats_t stats;
+        zoo_get_pool_stats(zh,&stats);
+        CPPUNIT_ASSERT_EQUAL((int64_t)COUNT,
+                stats.completions.hits+stats.completions.misses);
+        CPPUNIT_ASSERT(stats.completions.hits>=COUNT-1);
+        CPPUNIT_ASSERT(stats.archives.hits>=COUNT-1);
+        CPPUNIT_ASSERT(stats.buffers.hits>=COUNT-1);
+    }
+
+    // counts the writes and keeps the data of the last set request
+    class SetDataRecordingServer: public ZookeeperServer{
+    public:
+        SetDataRecordingServer():sendCount_(0){}
+        virtual ssize_t callSend(int s,const void *buf,size_t len,int flags){
+            sendCount_++;
+            return ZookeeperServer::callSend(s,buf,len,flags);
+        }
+        virtual void onMessageReceived(const RequestHeader& rh, iarchive* ia){
+            if(rh.type!=ZOO_SETDATA_OP)
+                return;
+            SetDataRequest req;
+            deserialize_SetDataRequest(ia,"req",&req);
+            path_=req.path;
+            data_.assign(req.data.buff,req.data.len);
+            deallocate_SetDataRequest(&req);
+        }
+        int sendCount_;
+        string path_;
+        string data_;
+    };
+
+    // a large request is serialized into a buffer sized up front and goes
+    // out together with its frame length in a single write
+    void testLargeRequestSingleWrite()
+    {
+        const int SIZE=512*1024;
+        Mock_gettimeofday timeMock;
+        SetDataRecordingServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        string data(SIZE,'x');
+        for(int i=0;i<SIZE;i++)
+            data[i]=(char)(i*31);
+        AsyncCompletion res;
+        zkServer.sendCount_=0;
+        int rc=zoo_aset(zh,"/x/y",data.data(),SIZE,-1,asyncCompletion,&res);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        rc=zookeeper_process(zh,ZOOKEEPER_WRITE);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL(1,zkServer.sendCount_);
+        CPPUNIT_ASSERT_EQUAL(string("/x/y"),zkServer.path_);
+        CPPUNIT_ASSERT(data==zkServer.data_);
+    }
+
+    class AsyncGetChildrenCompletion: public AsyncCompletion{
+    public:
+        AsyncGetChildrenCompletion():called_(false),rc_(ZAPIERROR){}
+        virtual void stringsCompl(int rc,const String_vector *strings){
+            called_=true;
+            rc_=rc;
+            if(rc!=ZOK) return;
+            for(int i=0;i<strings->count;i++)
+                children_.push_back(strings->data[i]);
+        }
+        bool called_;
+        int rc_;
+        vector<string> children_;
+    };
+
+    // the async data and children callbacks get views into the reply;
+    // check they see every byte and every name intact
+    void testBorrowedReplies()
+    {
+        Mock_gettimeofday timeMock;
+        ZookeeperServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        string data("a\0b\0c",5);
+        AsyncGetOperationCompletion res1;
+        zkServer.addOperationResponse(new ZooGetResponse(data.data(),
+                data.size()));
+        int rc=zoo_aget(zh,"/x/y",0,asyncCompletion,&res1);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+
+        ZooGetChildrenResponse::StringVector names;
+        names.push_back("");
+        names.push_back("a");
+        names.push_back("node-0000000001");
+        names.push_back(string(1000,'n'));
+        AsyncGetChildrenCompletion res2;
+        zkServer.addOperationResponse(new ZooGetChildrenResponse(names));
+        rc=zoo_aget_children(zh,"/x",0,asyncCompletion,&res2);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+
+        for(int j=0;j<10 && !(res1.called_ && res2.called_);j++)
+            zookeeper_process(zh,ZOOKEEPER_READ|ZOOKEEPER_WRITE);
+        CPPUNIT_ASSERT(res1.called_);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,res1.rc_);
+        CPPUNIT_ASSERT(data==res1.value_);
+        CPPUNIT_ASSERT(res2.called_);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,res2.rc_);
+        CPPUNIT_ASSERT(names==res2.children_);
+    }
+
+    // the time from queueing a request to reading its response lands in
+    // the histogram of its type
+    void testLatencyMetrics()
+    {
+        Mock_gettimeofday timeMock;
+        // millitick() works in whole milliseconds
+        timeMock.millitick(0);
+        ZookeeperServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        struct zoo_metrics metrics;
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_metrics(zh,&metrics));
+        CPPUNIT_ASSERT_EQUAL(0,metrics.count);
+
+        for(int i=0;i<3;i++){
+            AsyncGetOperationCompletion res;
+            zkServer.addOperationResponse(new ZooGetResponse("1",1));
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_aget(zh,"/x",0,asyncCompletion,&res));
+            timeMock.millitick(i==2?250:25);
+            for(int j=0;j<10 && !res.called_;j++)
+                zookeeper_process(zh,ZOOKEEPER_READ|ZOOKEEPER_WRITE);
+            CPPUNIT_ASSERT(res.called_);
+        }
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_metrics(zh,&metrics));
+        CPPUNIT_ASSERT_EQUAL(1,metrics.count);
+        struct zoo_op_latency& l=metrics.ops[0];
+        CPPUNIT_ASSERT_EQUAL((int)ZOO_GETDATA_OP,l.op);
+        CPPUNIT_ASSERT_EQUAL((int64_t)3,l.count);
+        CPPUNIT_ASSERT_EQUAL((int64_t)300000,l.total_us);
+        CPPUNIT_ASSERT_EQUAL((int64_t)250000,l.max_us);
+        int64_t p50=zoo_latency_percentile(&l,50);
+        CPPUNIT_ASSERT(p50>=25000 && p50<25000+25000/16);
+        CPPUNIT_ASSERT_EQUAL((int64_t)250000,zoo_latency_percentile(&l,99));
+    }
+
+    // the buckets cover the latencies in order, each one within 1/16
+    void testLatencyBuckets()
+    {
+        for(int i=1;i<ZOO_LATENCY_BUCKETS;i++){
+            int64_t floor=zoo_latency_bucket_floor(i);
+            int64_t width=floor-zoo_latency_bucket_floor(i-1);
+            CPPUNIT_ASSERT(width>0);
+            CPPUNIT_ASSERT(width<=1 || width*16<=floor);
+        }
+        CPPUNIT_ASSERT(zoo_latency_bucket_floor(ZOO_LATENCY_BUCKETS-1)
+                >=(int64_t)1<<31);
+
+        struct zoo_op_latency l;
+        memset(&l,0,sizeof(l));
+        CPPUNIT_ASSERT_EQUAL((int64_t)0,zoo_latency_percentile(&l,99));
+        l.buckets[5]=90;
+        l.buckets[100]=9;
+        l.buckets[200]=1;
+        l.count=100;
+        l.max_us=zoo_latency_bucket_floor(200);
+        CPPUNIT_ASSERT_EQUAL((int64_t)5,zoo_latency_percentile(&l,50));
+        CPPUNIT_ASSERT_EQUAL((int64_t)5,zoo_latency_percentile(&l,90));
+        CPPUNIT_ASSERT_EQUAL(zoo_latency_bucket_floor(101)-1,
+                zoo_latency_percentile(&l,99));
+        CPPUNIT_ASSERT_EQUAL(l.max_us,zoo_latency_percentile(&l,99.9));
+    }
+
+    void testStats()
+    {
+        Mock_gettimeofday timeMock;
+        ZookeeperServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        struct zoo_stats stats;
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_stats(zh,&stats));
+        CPPUNIT_ASSERT_EQUAL(0,stats.to_send);
+        CPPUNIT_ASSERT_EQUAL(0,stats.sent_requests);
+        CPPUNIT_ASSERT_EQUAL((int64_t)0,stats.bytes_sent);
+        CPPUNIT_ASSERT_EQUAL(0,stats.watched_paths);
+
+        AsyncGetOperationCompletion res;
+        zkServer.addOperationResponse(new ZooGetResponse("1",1));
+        // the request goes out right away in the single threaded mode
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_aget(zh,"/x",1,asyncCompletion,&res));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_stats(zh,&stats));
+        CPPUNIT_ASSERT_EQUAL(0,stats.to_send);
+        CPPUNIT_ASSERT_EQUAL(1,stats.sent_requests);
+        CPPUNIT_ASSERT(stats.bytes_sent>0);
+        CPPUNIT_ASSERT_EQUAL((int64_t)0,stats.bytes_received);
+
+        for(int i=0;i<10 && !res.called_;i++)
+            zookeeper_process(zh,ZOOKEEPER_READ);
+        CPPUNIT_ASSERT(res.called_);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_stats(zh,&stats));
+        CPPUNIT_ASSERT_EQUAL(0,stats.sent_requests);
+        CPPUNIT_ASSERT_EQUAL(0,stats.to_process);
+        CPPUNIT_ASSERT_EQUAL(0,stats.completions);
+        CPPUNIT_ASSERT(stats.bytes_received>0);
+        CPPUNIT_ASSERT_EQUAL(1,stats.watched_paths);
+        CPPUNIT_ASSERT_EQUAL(0,stats.persistent_watched_paths);
+        CPPUNIT_ASSERT_EQUAL(0,stats.disconnects);
+
+        zkServer.setConnectionLost();
+        CPPUNIT_ASSERT_EQUAL((int)ZCONNECTIONLOSS,
+                zookeeper_process(zh,ZOOKEEPER_READ));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_stats(zh,&stats));
+        CPPUNIT_ASSERT_EQUAL(1,stats.disconnects);
+        // the watch is kept for the next connection
+        CPPUNIT_ASSERT_EQUAL(1,stats.watched_paths);
+    }
+
+    class XidRecordingServer: public ZookeeperServer{
+    public:
+        virtual void onMessageReceived(const RequestHeader& rh, iarchive* ia){
+            xids_.push_back(rh.xid);
+        }
+        vector<int32_t> xids_;
+    };
+
+    // a request the server sits on completes with ZOPERATIONTIMEOUT once
+    // its deadline passes; the late response is dropped quietly
+    void testRequestDeadline()
+    {
+        Mock_gettimeofday timeMock;
+        XidRecordingServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+        zoo_set_request_timeout(zh,500);
+        CPPUNIT_ASSERT_EQUAL(500,zoo_get_request_timeout(zh));
+
+        AsyncGetOperationCompletion res1;
+        int rc=zoo_aget(zh,"/x/y/1",0,asyncCompletion,&res1);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        int fd=0;
+        int interest=0;
+        timeval tv;
+        rc=zookeeper_interest(zh,&fd,&interest,&tv);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        // the client asks to be woken up in time for the deadline
+        CPPUNIT_ASSERT_EQUAL(0,(int)tv.tv_sec);
+        CPPUNIT_ASSERT_EQUAL(500000,(int)tv.tv_usec);
+        rc=zookeeper_process(zh,ZOOKEEPER_WRITE);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL(1,(int)zkServer.xids_.size());
+        CPPUNIT_ASSERT(!res1.called_);
+
+        timeMock.millitick(499);
+        zookeeper_process(zh,0);
+        CPPUNIT_ASSERT(!res1.called_);
+        timeMock.tick(1);
+        zookeeper_process(zh,0);
+        CPPUNIT_ASSERT(res1.called_);
+        CPPUNIT_ASSERT_EQUAL((int)ZOPERATIONTIMEOUT,res1.rc_);
+
+        Response* late=new ZooGetResponse("1",1);
+        late->setXID(zkServer.xids_[0]);
+        zkServer.addRecvResponse(late);
+        rc=zookeeper_process(zh,ZOOKEEPER_READ);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL(ZOO_CONNECTED_STATE,zoo_state(zh));
+
+        // the session carries on
+        AsyncGetOperationCompletion res2;
+        zkServer.addOperationResponse(new ZooGetResponse("2",1));
+        rc=zoo_aget(zh,"/x/y/2",0,asyncCompletion,&res2);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        rc=zookeeper_process(zh,ZOOKEEPER_WRITE);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        for(int i=0;i<10 && !res2.called_;i++)
+            zookeeper_process(zh,ZOOKEEPER_READ);
+        CPPUNIT_ASSERT(res2.called_);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,res2.rc_);
+        CPPUNIT_ASSERT_EQUAL(string("2"),res2.value_);
+    }
+
     class PingCountingServer: public ZookeeperServer{
     public:
         PingCountingServer():pingCount_(0){}
@@ -615,6 +1086,128 @@ public:
         CPPUNIT_ASSERT_EQUAL((int)ZOK,res1.rc_);
         CPPUNIT_ASSERT_EQUAL(string("1"),res1.value_);        
     }
+    static Stat nodeStat(int version,int dataLength){
+        NodeStat stat;
+        stat.version=version;
+        stat.dataLength=dataLength;
+        return stat;
+    }
+    struct CacheInvalidated{
+        CacheInvalidated(zhandle_t* zh,int count):zh_(zh),count_(count){}
+        bool operator()() const{
+            struct zoo_cache_stats stats;
+            zoo_get_cache_stats(zh_,&stats);
+            return stats.invalidations==count_;
+        }
+        zhandle_t* zh_;
+        int count_;
+    };
+    // a node is read once, and again after it changed
+    void testCachedGet()
+    {
+        Mock_gettimeofday timeMock;
+
+        ZookeeperServer zkServer;
+        Mock_poll pollMock(&zkServer,ZookeeperServer::FD);
+        // must call zookeeper_close() while all the mocks are in the scope!
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // make sure the client has connected
+        CPPUNIT_ASSERT(ensureCondition(ClientConnected(zh),1000)<1000);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_enable_cache(zh,1024*1024));
+
+        char buf[16];
+        int len=sizeof(buf);
+        struct Stat stat;
+        zkServer.addOperationResponse(new ZooGetResponse("1",1,0,ZOK,nodeStat(2,1)));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_cached_get(zh,"/x",buf,&len,&stat));
+        CPPUNIT_ASSERT_EQUAL(string("1"),string(buf,len));
+        // no response queued: this one has to come from the cache
+        len=sizeof(buf);
+        memset(&stat,0,sizeof(stat));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_cached_get(zh,"/x",buf,&len,&stat));
+        CPPUNIT_ASSERT_EQUAL(string("1"),string(buf,len));
+        CPPUNIT_ASSERT_EQUAL(2,stat.version);
+
+        struct zoo_cache_stats stats;
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_cache_stats(zh,&stats));
+        CPPUNIT_ASSERT_EQUAL((int64_t)1,stats.hits);
+        CPPUNIT_ASSERT_EQUAL((int64_t)1,stats.misses);
+        CPPUNIT_ASSERT_EQUAL(1,stats.entries);
+
+        zkServer.addRecvResponse(new ZNodeEvent(ZOO_CHANGED_EVENT,"/x"));
+        CPPUNIT_ASSERT(ensureCondition(CacheInvalidated(zh,1),1000)<1000);
+        zkServer.addOperationResponse(new ZooGetResponse("22",2,0,ZOK,nodeStat(3,2)));
+        len=sizeof(buf);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_cached_get(zh,"/x",buf,&len,&stat));
+        CPPUNIT_ASSERT_EQUAL(string("22"),string(buf,len));
+        CPPUNIT_ASSERT_EQUAL(3,stat.version);
+
+        // a node larger than the buffer is not cached
+        zkServer.addOperationResponse(new ZooGetResponse("333",3,0,ZOK,nodeStat(1,3)));
+        len=2;
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_cached_get(zh,"/y",buf,&len,0));
+        CPPUNIT_ASSERT_EQUAL(2,len);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_cache_stats(zh,&stats));
+        CPPUNIT_ASSERT_EQUAL(1,stats.entries);
+        CPPUNIT_ASSERT_EQUAL((int64_t)3,stats.misses);
+
+        // no room left
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_enable_cache(zh,0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_cache_stats(zh,&stats));
+        CPPUNIT_ASSERT_EQUAL(0,stats.entries);
+        CPPUNIT_ASSERT_EQUAL((int64_t)0,stats.bytes);
+        CPPUNIT_ASSERT_EQUAL((int64_t)1,stats.evictions);
+        // ...so the node is read from the server, and neither counted nor kept
+        zkServer.addOperationResponse(new ZooGetResponse("4",1,0,ZOK,nodeStat(4,1)));
+        len=sizeof(buf);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_cached_get(zh,"/x",buf,&len,&stat));
+        CPPUNIT_ASSERT_EQUAL(string("4"),string(buf,len));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get_cache_stats(zh,&stats));
+        CPPUNIT_ASSERT_EQUAL(0,stats.entries);
+        CPPUNIT_ASSERT_EQUAL((int64_t)3,stats.misses);
+    }
+    // the names come back in one block that a single free releases
+    void testGetChildrenArena()
+    {
+        Mock_gettimeofday timeMock;
+
+        ZookeeperServer zkServer;
+        Mock_poll pollMock(&zkServer,ZookeeperServer::FD);
+        // must call zookeeper_close() while all the mocks are in the scope!
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // make sure the client has connected
+        CPPUNIT_ASSERT(ensureCondition(ClientConnected(zh),1000)<1000);
+
+        ZooGetChildrenResponse::StringVector names;
+        names.push_back("a");
+        names.push_back("");
+        names.push_back("lock-0000000042");
+        zkServer.addOperationResponse(new ZooGetChildrenResponse(names));
+        String_vector strings;
+        int rc=zoo_get_children_arena(zh,"/x",0,&strings);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL((int)names.size(),strings.count);
+        for(int i=0;i<strings.count;i++){
+            CPPUNIT_ASSERT_EQUAL(names[i],string(strings.data[i]));
+            // the names live right after the array
+            CPPUNIT_ASSERT((char*)strings.data[i]>=(char*)(strings.data+strings.count));
+        }
+        deallocate_String_vector_arena(&strings);
+        CPPUNIT_ASSERT(strings.data==0);
+
+        zkServer.addOperationResponse(
+                new ZooGetChildrenResponse(ZooGetChildrenResponse::StringVector()));
+        rc=zoo_get_children_arena(zh,"/x",0,&strings);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL(0,strings.count);
+        deallocate_String_vector_arena(&strings);
+    }
     class ChangeNodeWatcher: public WatcherAction{
     public:
         ChangeNodeWatcher():changed_(false){}
@@ -0,0 +1,471 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "CppAssertHelper.h"
+
+#include "ZKMocks.h"
+
+#if defined(THREADED) && defined(__linux__)
+
+#include <map>
+#include <vector>
+#include <sstream>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// A loopback server that accepts every session, answers the pings and fails
+// any other request with ZNONODE. Unlike ZookeeperServer it talks over real
+// sockets, which is what the epoll based reactor needs.
+class LoopbackServer{
+public:
+    LoopbackServer():sessionId_(1){
+        sockaddr_in addr;
+        socklen_t len=sizeof(addr);
+        memset(&addr,0,sizeof(addr));
+        addr.sin_family=AF_INET;
+        addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+        listen_=socket(AF_INET,SOCK_STREAM,0);
+        bind(listen_,(sockaddr*)&addr,sizeof(addr));
+        listen(listen_,128);
+        getsockname(listen_,(sockaddr*)&addr,&len);
+        port_=ntohs(addr.sin_port);
+        pipe(stop_);
+        pthread_create(&thread_,0,run,this);
+    }
+    ~LoopbackServer(){
+        write(stop_[1],"",1);
+        pthread_join(thread_,0);
+        close(stop_[0]);
+        close(stop_[1]);
+        close(listen_);
+    }
+    std::string host() const{
+        std::ostringstream os;
+        os<<"127.0.0.1:"<<port_;
+        return os.str();
+    }
+
+private:
+    struct Connection{
+        Connection():primed(false){}
+        std::string input;
+        bool primed;
+    };
+    typedef std::map<int,Connection> Connections;
+
+    static void* run(void* p){
+        ((LoopbackServer*)p)->loop();
+        return 0;
+    }
+    void loop(){
+        Connections conns;
+        for(;;){
+            std::vector<pollfd> fds;
+            pollfd pfd;
+            pfd.events=POLLIN;
+            pfd.fd=stop_[0];
+            fds.push_back(pfd);
+            pfd.fd=listen_;
+            fds.push_back(pfd);
+            for(Connections::iterator it=conns.begin();it!=conns.end();++it){
+                pfd.fd=it->first;
+                fds.push_back(pfd);
+            }
+            poll(&fds[0],fds.size(),-1);
+            if(fds[0].revents)
+                break;
+            if(fds[1].revents&POLLIN){
+                int fd=accept(listen_,0,0);
+                if(fd!=-1)
+                    conns[fd];
+            }
+            for(size_t i=2;i<fds.size();i++){
+                char buf[4096];
+                if(!fds[i].revents)
+                    continue;
+                ssize_t n=recv(fds[i].fd,buf,sizeof(buf),0);
+                if(n<=0){
+                    close(fds[i].fd);
+                    conns.erase(fds[i].fd);
+                    continue;
+                }
+                conns[fds[i].fd].input.append(buf,n);
+                serve(fds[i].fd,conns[fds[i].fd]);
+            }
+        }
+        for(Connections::iterator it=conns.begin();it!=conns.end();++it)
+            close(it->first);
+    }
+    void serve(int fd,Connection& conn){
+        for(;;){
+            int32_t len;
+            if(conn.input.size()<sizeof(len))
+                return;
+            memcpy(&len,conn.input.data(),sizeof(len));
+            len=ntohl(len);
+            if(conn.input.size()<sizeof(len)+len)
+                return;
+            std::string frame=conn.input.substr(sizeof(len),len);
+            conn.input.erase(0,sizeof(len)+len);
+            std::string reply;
+            if(!conn.primed){
+                conn.primed=true;
+                reply=HandshakeResponse(sessionId_++).toString();
+            }else{
+                int32_t hdr[2];
+                memcpy(hdr,frame.data(),sizeof(hdr));
+                int32_t xid=ntohl(hdr[0]);
+                int32_t type=ntohl(hdr[1]);
+                int rc=(xid==PING_XID||type==ZOO_CLOSE_OP)?ZOK:ZNONODE;
+                int32_t body[5]={htonl(16),htonl(xid),0,htonl(1),htonl(rc)};
+                reply.assign((char*)body,sizeof(body));
+            }
+            send(fd,reply.data(),reply.size(),0);
+        }
+    }
+
+    int listen_;
+    int port_;
+    int stop_[2];
+    int64_t sessionId_;
+    pthread_t thread_;
+};
+
+class Zookeeper_reactor : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_reactor);
+    CPPUNIT_TEST(testCreateDestroy);
+    CPPUNIT_TEST(testSessions);
+    CPPUNIT_TEST(testCloseFromCallback);
+    CPPUNIT_TEST_SUITE_END();
+
+    static const int COUNT=8;
+
+    struct Counter{
+        Counter():value(0),rc(ZOK){}
+        volatile int32_t value;
+        int rc;
+    };
+    static void countCompletion(int rc,const Stat*,const void* data){
+        Counter* c=(Counter*)data;
+        c->rc=rc;
+        fetch_and_add(&c->value,1);
+    }
+    struct CounterReached{
+        CounterReached(Counter& c,int value):c_(c),value_(value){}
+        bool operator()() const{ return atomic_get(&c_.value)==value_; }
+        Counter& c_;
+        int value_;
+    };
+
+    struct CloseAction{
+        zhandle_t* zh;
+        volatile int32_t closed;
+        int rc;
+    };
+    static void closeCompletion(int rc,const Stat*,const void* data){
+        CloseAction* action=(CloseAction*)data;
+        action->rc=zookeeper_close(action->zh);
+        atomic_set(&action->closed,1);
+    }
+
+    // the reactor gives the handles up asynchronously when they are closed
+    // from a callback
+    static bool destroyReactor(zoo_reactor_t* reactor){
+        for(int elapsed=0;elapsed<1000;elapsed+=2){
+            if(zoo_reactor_destroy(reactor)==ZOK)
+                return true;
+            millisleep(2);
+        }
+        return false;
+    }
+
+public:
+    void testCreateDestroy()
+    {
+        errno=0;
+        CPPUNIT_ASSERT(zoo_reactor_create(0)==0);
+        CPPUNIT_ASSERT_EQUAL(EINVAL,errno);
+        CPPUNIT_ASSERT(zookeeper_init_reactor(0,"127.0.0.1:2121",0,10000,
+                0,0,0)==0);
+        zoo_reactor_t* reactor=zoo_reactor_create(4);
+        CPPUNIT_ASSERT(reactor!=0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_reactor_destroy(reactor));
+    }
+
+    void testSessions()
+    {
+        LoopbackServer server;
+        zoo_reactor_t* reactor=zoo_reactor_create(2);
+        CPPUNIT_ASSERT(reactor!=0);
+        zhandle_t* handles[COUNT];
+        for(int i=0;i<COUNT;i++){
+            handles[i]=zookeeper_init_reactor(reactor,server.host().c_str(),
+                    0,10000,0,0,0);
+            CPPUNIT_ASSERT(handles[i]!=0);
+        }
+        for(int i=0;i<COUNT;i++)
+            CPPUNIT_ASSERT(ensureCondition(ClientConnected(handles[i]),5000)<5000);
+
+        // the completions run on the reactor threads...
+        Counter counter;
+        for(int i=0;i<COUNT;i++)
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,
+                    zoo_aexists(handles[i],"/node",0,countCompletion,&counter));
+        CPPUNIT_ASSERT(ensureCondition(CounterReached(counter,COUNT),5000)<5000);
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE,counter.rc);
+        // ...and the synchronous API works from any other thread
+        Stat stat;
+        for(int i=0;i<COUNT;i++)
+            CPPUNIT_ASSERT_EQUAL((int)ZNONODE,
+                    zoo_exists(handles[i],"/node",0,&stat));
+
+        CPPUNIT_ASSERT_EQUAL((int)ZINVALIDSTATE,zoo_reactor_destroy(reactor));
+        for(int i=0;i<COUNT;i++)
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,zookeeper_close(handles[i]));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_reactor_destroy(reactor));
+    }
+
+    void testCloseFromCallback()
+    {
+        LoopbackServer server;
+        zoo_reactor_t* reactor=zoo_reactor_create(1);
+        CPPUNIT_ASSERT(reactor!=0);
+        CloseAction actions[COUNT];
+        for(int i=0;i<COUNT;i++){
+            actions[i].zh=zookeeper_init_reactor(reactor,
+                    server.host().c_str(),0,10000,0,0,0);
+            actions[i].closed=0;
+            CPPUNIT_ASSERT(actions[i].zh!=0);
+        }
+        for(int i=0;i<COUNT;i++){
+            CPPUNIT_ASSERT(ensureCondition(ClientConnected(actions[i].zh),5000)<5000);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_aexists(actions[i].zh,"/node",0,
+                    closeCompletion,&actions[i]));
+        }
+        for(int i=0;i<COUNT;i++){
+            for(int elapsed=0;!atomic_get(&actions[i].closed)&&elapsed<5000;
+                    elapsed+=2)
+                millisleep(2);
+            CPPUNIT_ASSERT(atomic_get(&actions[i].closed));
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,actions[i].rc);
+        }
+        CPPUNIT_ASSERT(destroyReactor(reactor));
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_reactor);
+
+class Zookeeper_completionThreads : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_completionThreads);
+    CPPUNIT_TEST(testArguments);
+    CPPUNIT_TEST(testOrderPerPath);
+    CPPUNIT_TEST(testSlowCallback);
+    CPPUNIT_TEST(testBlockingCallbacksOnReactor);
+    CPPUNIT_TEST(testCloseFromCallback);
+    CPPUNIT_TEST_SUITE_END();
+
+    static const int PATHS=8;
+    static const int ROUNDS=100;
+
+    static std::string path(int i){
+        std::ostringstream os;
+        os<<"/node"<<i;
+        return os.str();
+    }
+
+    // the completions for a path run one at a time, so the per path counters
+    // need no lock
+    struct Sequence{
+        Sequence():done(0),outOfOrder(0){
+            memset(next,0,sizeof(next));
+        }
+        int next[PATHS];
+        volatile int32_t done;
+        volatile int32_t outOfOrder;
+    };
+    struct Step{
+        Sequence* seq;
+        int path;
+        int round;
+    };
+    static void stepCompletion(int rc,const Stat*,const void* data){
+        const Step* step=(const Step*)data;
+        Sequence* seq=step->seq;
+        if(seq->next[step->path]!=step->round)
+            fetch_and_add(&seq->outOfOrder,1);
+        seq->next[step->path]=step->round+1;
+        fetch_and_add(&seq->done,1);
+    }
+    struct Done{
+        Done(volatile int32_t& v,int value):v_(v),value_(value){}
+        bool operator()() const{ return atomic_get(&v_)==value_; }
+        volatile int32_t& v_;
+        int value_;
+    };
+
+    struct Gate{
+        volatile int32_t open;
+        volatile int32_t entered;
+        volatile int32_t others;
+    };
+    static void slowCompletion(int rc,const Stat*,const void* data){
+        Gate* gate=(Gate*)data;
+        atomic_set(&gate->entered,1);
+        while(!atomic_get(&gate->open))
+            millisleep(2);
+    }
+    static void otherCompletion(int rc,const Stat*,const void* data){
+        fetch_and_add(&((Gate*)data)->others,1);
+    }
+
+    struct SyncCall{
+        zhandle_t* zh;
+        volatile int32_t done;
+        int rc;
+    };
+    static void syncCallCompletion(int rc,const Stat*,const void* data){
+        SyncCall* call=(SyncCall*)data;
+        Stat stat;
+        call->rc=zoo_exists(call->zh,"/other",0,&stat);
+        atomic_set(&call->done,1);
+    }
+
+    struct CloseAction{
+        zhandle_t* zh;
+        volatile int32_t closed;
+        int rc;
+    };
+    static void closeCompletion(int rc,const Stat*,const void* data){
+        CloseAction* action=(CloseAction*)data;
+        action->rc=zookeeper_close(action->zh);
+        atomic_set(&action->closed,1);
+    }
+
+public:
+    void testArguments()
+    {
+        LoopbackServer server;
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS,zoo_set_completion_threads(0,2));
+        zhandle_t* zh=zookeeper_init(server.host().c_str(),0,10000,0,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS,zoo_set_completion_threads(zh,0));
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS,zoo_set_completion_threads(zh,65));
+        // one thread is the default and leaves the handle as it is
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_set_completion_threads(zh,1));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_set_completion_threads(zh,4));
+        CPPUNIT_ASSERT_EQUAL((int)ZINVALIDSTATE,zoo_set_completion_threads(zh,4));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zookeeper_close(zh));
+    }
+
+    void testOrderPerPath()
+    {
+        LoopbackServer server;
+        zhandle_t* zh=zookeeper_init(server.host().c_str(),0,10000,0,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_set_completion_threads(zh,4));
+        CPPUNIT_ASSERT(ensureCondition(ClientConnected(zh),5000)<5000);
+
+        Sequence seq;
+        std::vector<Step> steps(PATHS*ROUNDS);
+        for(int round=0;round<ROUNDS;round++){
+            for(int i=0;i<PATHS;i++){
+                Step& step=steps[round*PATHS+i];
+                step.seq=&seq;
+                step.path=i;
+                step.round=round;
+                CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_aexists(zh,path(i).c_str(),0,
+                        stepCompletion,&step));
+            }
+        }
+        CPPUNIT_ASSERT(ensureCondition(Done(seq.done,PATHS*ROUNDS),5000)<5000);
+        CPPUNIT_ASSERT_EQUAL(0,(int)seq.outOfOrder);
+        for(int i=0;i<PATHS;i++)
+            CPPUNIT_ASSERT_EQUAL((int)ROUNDS,seq.next[i]);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zookeeper_close(zh));
+    }
+
+    void testSlowCallback()
+    {
+        LoopbackServer server;
+        zhandle_t* zh=zookeeper_init(server.host().c_str(),0,10000,0,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_set_completion_threads(zh,4));
+        CPPUNIT_ASSERT(ensureCondition(ClientConnected(zh),5000)<5000);
+
+        Gate gate={0,0,0};
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_aexists(zh,"/slow",0,
+                slowCompletion,&gate));
+        CPPUNIT_ASSERT(ensureCondition(Done(gate.entered,1),5000)<5000);
+        // the paths that map to the other workers are not held up
+        for(int i=0;i<PATHS;i++)
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_aexists(zh,path(i).c_str(),0,
+                    otherCompletion,&gate));
+        for(int elapsed=0;atomic_get(&gate.others)==0&&elapsed<5000;elapsed+=2)
+            millisleep(2);
+        CPPUNIT_ASSERT(atomic_get(&gate.others)>0);
+        atomic_set(&gate.open,1);
+        CPPUNIT_ASSERT(ensureCondition(Done(gate.others,PATHS),5000)<5000);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zookeeper_close(zh));
+    }
+
+    void testBlockingCallbacksOnReactor()
+    {
+        LoopbackServer server;
+        zoo_reactor_t* reactor=zoo_reactor_create(1);
+        CPPUNIT_ASSERT(reactor!=0);
+        zhandle_t* zh=zookeeper_init_reactor(reactor,server.host().c_str(),
+                0,10000,0,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_set_completion_threads(zh,2));
+        CPPUNIT_ASSERT(ensureCondition(ClientConnected(zh),5000)<5000);
+
+        // off the reactor thread the callbacks may use the synchronous API
+        SyncCall call={zh,0,ZOK};
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_aexists(zh,"/node",0,
+                syncCallCompletion,&call));
+        CPPUNIT_ASSERT(ensureCondition(Done(call.done,1),5000)<5000);
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE,call.rc);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zookeeper_close(zh));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_reactor_destroy(reactor));
+    }
+
+    void testCloseFromCallback()
+    {
+        LoopbackServer server;
+        CloseAction action={0,0,ZOK};
+        action.zh=zookeeper_init(server.host().c_str(),0,10000,0,0,0);
+        CPPUNIT_ASSERT(action.zh!=0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_set_completion_threads(action.zh,4));
+        CPPUNIT_ASSERT(ensureCondition(ClientConnected(action.zh),5000)<5000);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_aexists(action.zh,"/node",0,
+                closeCompletion,&action));
+        CPPUNIT_ASSERT(ensureCondition(Done(action.closed,1),5000)<5000);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,action.rc);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_completionThreads);
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "CppAssertHelper.h"
+
+#include <string.h>
+#include "src/zk_adaptor.h"
+
+class Zookeeper_requestTable : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_requestTable);
+    CPPUNIT_TEST(testInsertRemove);
+    CPPUNIT_TEST(testGrowth);
+    CPPUNIT_TEST(testRemoveKeepsOthersReachable);
+    CPPUNIT_TEST(testDuplicateXids);
+    CPPUNIT_TEST(testRemoveEntryHint);
+    CPPUNIT_TEST(testChurn);
+    CPPUNIT_TEST_SUITE_END();
+
+    request_table_t table;
+
+    // the table never dereferences its entries, so tag them with the xid
+    static struct _completion_list* entry(int xid){
+        return (struct _completion_list*)(intptr_t)(xid*2+1);
+    }
+
+public:
+    void setUp()
+    {
+        memset(&table,0,sizeof(table));
+    }
+
+    void tearDown()
+    {
+        request_table_destroy(&table);
+    }
+
+    void testInsertRemove()
+    {
+        CPPUNIT_ASSERT(request_table_lookup(&table,1)==0);
+        CPPUNIT_ASSERT(request_table_remove(&table,1)==0);
+        for(int xid=1;xid<=10;xid++)
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,
+                    request_table_insert(&table,xid,entry(xid)));
+        CPPUNIT_ASSERT_EQUAL(10,request_table_count(&table));
+        // replies may arrive in any order
+        for(int xid=10;xid>=1;xid-=2){
+            CPPUNIT_ASSERT(request_table_lookup(&table,xid)==entry(xid));
+            CPPUNIT_ASSERT(request_table_remove(&table,xid)==entry(xid));
+            CPPUNIT_ASSERT(request_table_lookup(&table,xid)==0);
+        }
+        for(int xid=1;xid<=9;xid+=2)
+            CPPUNIT_ASSERT(request_table_remove(&table,xid)==entry(xid));
+        CPPUNIT_ASSERT_EQUAL(0,request_table_count(&table));
+    }
+
+    void testGrowth()
+    {
+        const int COUNT=10000;
+        for(int xid=0;xid<COUNT;xid++)
+            request_table_insert(&table,xid,entry(xid));
+        CPPUNIT_ASSERT_EQUAL(COUNT,request_table_count(&table));
+        CPPUNIT_ASSERT(table.capacity>=COUNT);
+        for(int xid=0;xid<COUNT;xid++)
+            CPPUNIT_ASSERT(request_table_remove(&table,xid)==entry(xid));
+        CPPUNIT_ASSERT_EQUAL(0,request_table_count(&table));
+    }
+
+    void testRemoveKeepsOthersReachable()
+    {
+        // insert xids that share their home slots, so that they form
+        // clusters as long as the table allows, then remove the entries in
+        // a scrambled order and make sure nothing gets lost
+        request_table_insert(&table,0,entry(0));
+        const int n=3*table.capacity/4;
+        const int stride=table.capacity;
+        for(int xid=1;xid<n;xid++)
+            request_table_insert(&table,xid*stride,entry(xid));
+        CPPUNIT_ASSERT_EQUAL(n,request_table_count(&table));
+        for(int i=0;i<n;i++){
+            int xid=(i*7)%n;
+            CPPUNIT_ASSERT(request_table_remove(&table,xid*stride)==entry(xid));
+            for(int j=i+1;j<n;j++){
+                int other=(j*7)%n;
+                CPPUNIT_ASSERT(request_table_lookup(&table,other*stride)==
+                        entry(other));
+            }
+        }
+        CPPUNIT_ASSERT_EQUAL(0,request_table_count(&table));
+    }
+
+    void testDuplicateXids()
+    {
+        request_table_insert(&table,PING_XID,entry(PING_XID));
+        request_table_insert(&table,PING_XID,entry(PING_XID));
+        CPPUNIT_ASSERT(request_table_remove(&table,PING_XID)==entry(PING_XID));
+        CPPUNIT_ASSERT(request_table_remove(&table,PING_XID)==entry(PING_XID));
+        CPPUNIT_ASSERT(request_table_remove(&table,PING_XID)==0);
+    }
+
+    // a hint taken before the table was rebuilt falls back to probing, and
+    // of duplicate xids the given entry is the one removed
+    void testRemoveEntryHint()
+    {
+        const int COUNT=1000;
+        request_hint_t hints[COUNT];
+        for(int xid=0;xid<COUNT;xid++){
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,
+                    request_table_place(&table,xid,entry(xid),&hints[xid]));
+            CPPUNIT_ASSERT(table.slots[hints[xid].slot].entry==entry(xid));
+        }
+        CPPUNIT_ASSERT(hints[0].generation!=hints[COUNT-1].generation);
+        for(int xid=0;xid<COUNT;xid++){
+            request_table_remove_entry(&table,xid,entry(xid),&hints[xid]);
+            CPPUNIT_ASSERT(request_table_lookup(&table,xid)==0);
+            CPPUNIT_ASSERT_EQUAL(COUNT-xid-1,request_table_count(&table));
+        }
+
+        request_hint_t first,second;
+        request_table_place(&table,PING_XID,entry(1),&first);
+        request_table_place(&table,PING_XID,entry(2),&second);
+        second.generation--;
+        request_table_remove_entry(&table,PING_XID,entry(2),&second);
+        CPPUNIT_ASSERT(request_table_lookup(&table,PING_XID)==entry(1));
+        request_table_remove_entry(&table,PING_XID,entry(1),&first);
+        CPPUNIT_ASSERT_EQUAL(0,request_table_count(&table));
+    }
+
+    // tombstones are reused, so a table that sees a steady stream of
+    // requests does not grow past what it holds at once, and its entries
+    // stay where they are
+    void testChurn()
+    {
+        request_table_insert(&table,0,entry(0));
+        const int generation=table.generation;
+        for(int xid=1;xid<100000;xid++){
+            request_table_insert(&table,xid,entry(xid));
+            if(xid>=20)
+                CPPUNIT_ASSERT(request_table_remove(&table,xid-20)==entry(xid-20));
+        }
+        CPPUNIT_ASSERT_EQUAL(20,request_table_count(&table));
+        CPPUNIT_ASSERT_EQUAL(generation,table.generation);
+        CPPUNIT_ASSERT(table.capacity<=128);
+        for(int xid=100000-20;xid<100000;xid++)
+            CPPUNIT_ASSERT(request_table_lookup(&table,xid)==entry(xid));
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_requestTable);
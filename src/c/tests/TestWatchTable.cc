@@ -0,0 +1,340 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "CppAssertHelper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <set>
+#include <string>
+#include "src/zk_adaptor.h"
+
+using namespace std;
+
+class Zookeeper_watchTable : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_watchTable);
+    CPPUNIT_TEST(testOneEntryForAllTypes);
+    CPPUNIT_TEST(testDuplicateWatcher);
+    CPPUNIT_TEST(testRemoveKeepsOthersReachable);
+    CPPUNIT_TEST(testSessionEvent);
+    CPPUNIT_TEST(testSetWatchesBatches);
+    CPPUNIT_TEST(testRecursiveMatchesSubtree);
+    CPPUNIT_TEST(testPersistentStays);
+    CPPUNIT_TEST(testSetWatchesPersistent);
+    CPPUNIT_TEST_SUITE_END();
+
+    zhandle_t *zh;
+
+    // counts the deliveries per path; session events have none
+    typedef map<string,int> Deliveries;
+
+    static void countingWatcher(zhandle_t*,int type,int state,
+            const char* path,void* ctx){
+        (*(Deliveries*)ctx)[path?path:"session"]++;
+    }
+
+    static int dataChecker(zhandle_t*,int rc){ return WATCH_DATA; }
+    static int existChecker(zhandle_t*,int rc){ return WATCH_EXIST; }
+    static int childChecker(zhandle_t*,int rc){ return WATCH_CHILD; }
+    static int persistentChecker(zhandle_t*,int rc){ return WATCH_PERSISTENT; }
+    static int recursiveChecker(zhandle_t*,int rc){
+        return WATCH_PERSISTENT_RECURSIVE;
+    }
+
+    void watch(const char* path,result_checker_fn checker,void* ctx){
+        watcher_registration_t reg;
+        reg.watcher=countingWatcher;
+        reg.context=ctx;
+        reg.checker=checker;
+        reg.path=path;
+        activateWatcher(zh,&reg,ZOK);
+    }
+
+    void trigger(int type,const char* path){
+        watcher_object_list_t* list=collectWatchers(zh,type,(char*)path);
+        deliverWatchers(zh,type,ZOO_CONNECTED_STATE,(char*)path,&list);
+    }
+
+    // the number of paths with a watch of one of the given kinds
+    int keyCount(int type){
+        unsigned int cursor=0;
+        int types;
+        int count=0;
+        while(next_watched_path(zh->active_watchers,&cursor,&types))
+            if(types&type)
+                count++;
+        return count;
+    }
+
+public:
+    void setUp()
+    {
+        zh=(zhandle_t*)calloc(1,sizeof(zhandle_t));
+        zh->active_watchers=create_zk_hashtable();
+        zh->persistent_watchers=create_zk_hashtable();
+    }
+
+    void tearDown()
+    {
+        destroy_zk_hashtable(zh->active_watchers);
+        destroy_zk_hashtable(zh->persistent_watchers);
+        free(zh);
+    }
+
+    // a change takes the data and exist watches of the path and leaves its
+    // child watch alone until the node goes away
+    void testOneEntryForAllTypes()
+    {
+        Deliveries data,exist,child;
+        watch("/a",dataChecker,&data);
+        watch("/a",existChecker,&exist);
+        watch("/a",childChecker,&child);
+        CPPUNIT_ASSERT_EQUAL(1,keyCount(WATCH_DATA));
+        CPPUNIT_ASSERT_EQUAL(1,keyCount(WATCH_EXIST));
+        CPPUNIT_ASSERT_EQUAL(1,keyCount(WATCH_CHILD));
+
+        trigger(CHANGED_EVENT_DEF,"/a");
+        CPPUNIT_ASSERT_EQUAL(1,data["/a"]);
+        CPPUNIT_ASSERT_EQUAL(1,exist["/a"]);
+        CPPUNIT_ASSERT_EQUAL(0,child["/a"]);
+        CPPUNIT_ASSERT_EQUAL(0,keyCount(WATCH_DATA|WATCH_EXIST));
+        CPPUNIT_ASSERT_EQUAL(1,keyCount(WATCH_CHILD));
+
+        trigger(DELETED_EVENT_DEF,"/a");
+        CPPUNIT_ASSERT_EQUAL(1,data["/a"]);
+        CPPUNIT_ASSERT_EQUAL(1,child["/a"]);
+        CPPUNIT_ASSERT_EQUAL(0,keyCount(WATCH_DATA|WATCH_EXIST|WATCH_CHILD));
+    }
+
+    // the same watcher and context is delivered once per event, however
+    // many times and kinds it was set
+    void testDuplicateWatcher()
+    {
+        Deliveries d;
+        watch("/a",dataChecker,&d);
+        watch("/a",dataChecker,&d);
+        watch("/a",existChecker,&d);
+        watch("/a",childChecker,&d);
+        trigger(DELETED_EVENT_DEF,"/a");
+        CPPUNIT_ASSERT_EQUAL(1,d["/a"]);
+    }
+
+    // removing entries from the middle of probe runs must not hide the
+    // entries behind them, across several growths of the table
+    void testRemoveKeepsOthersReachable()
+    {
+        const int COUNT=5000;
+        Deliveries d;
+        char path[32];
+        for(int i=0;i<COUNT;i++){
+            sprintf(path,"/n%d",i);
+            watch(path,i%3==0?childChecker:dataChecker,&d);
+        }
+        for(int i=0;i<COUNT;i+=2){
+            sprintf(path,"/n%d",i);
+            trigger(DELETED_EVENT_DEF,path);
+        }
+        CPPUNIT_ASSERT_EQUAL(COUNT/2,keyCount(WATCH_DATA|WATCH_CHILD));
+        for(int i=0;i<COUNT;i++){
+            sprintf(path,"/n%d",i);
+            trigger(DELETED_EVENT_DEF,path);
+            CPPUNIT_ASSERT_EQUAL(1,d[path]);
+        }
+        CPPUNIT_ASSERT_EQUAL(0,keyCount(WATCH_DATA|WATCH_CHILD));
+    }
+
+    // session events go to every watcher and leave the watches in place
+    void testSessionEvent()
+    {
+        Deliveries d,other;
+        zh->watcher=countingWatcher;
+        zh->context=&d;
+        watch("/a",dataChecker,&other);
+        watch("/b",childChecker,&other);
+        watcher_object_list_t* list=collectWatchers(zh,ZOO_SESSION_EVENT,0);
+        deliverWatchers(zh,ZOO_SESSION_EVENT,ZOO_CONNECTING_STATE,0,&list);
+        CPPUNIT_ASSERT_EQUAL(1,d["session"]);
+        // both watches have the same watcher and context: one delivery
+        CPPUNIT_ASSERT_EQUAL(1,other["session"]);
+        CPPUNIT_ASSERT_EQUAL(2,keyCount(WATCH_DATA|WATCH_CHILD));
+    }
+
+    // re-registering many watches takes several requests, each under the
+    // limit, that together name every watch once with its kind
+    void testSetWatchesBatches()
+    {
+        const int COUNT=20000;
+        Deliveries d;
+        char path[64];
+        set<string> expected[WATCH_TYPE_COUNT],sent[WATCH_TYPE_COUNT];
+        for(int i=0;i<COUNT;i++){
+            sprintf(path,"/a/rather/long/path/to/node-%010d",i);
+            watch(path,i%4==0?existChecker:dataChecker,&d);
+            expected[i%4==0?1:0].insert(path);
+            if(i%3==0){
+                watch(path,childChecker,&d);
+                expected[2].insert(path);
+            }
+        }
+        zh->last_zxid=42;
+        init_object_pool(&zh->buffer_pool,sizeof(buffer_list_t),
+                OBJECT_POOL_MAX_FREE);
+        init_object_pool(&zh->oarchive_pool,buffer_oarchive_size(),
+                OBJECT_POOL_MAX_FREE);
+        init_buffer_list(&zh->to_send,&zh->buffer_pool);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,send_set_watches(zh));
+
+        int requests=0;
+        buffer_list_t* b;
+        while((b=dequeue_buffer(&zh->to_send))!=0){
+            requests++;
+            CPPUNIT_ASSERT(b->len<SET_WATCHES_MAX_LENGTH+64);
+            iarchive* ia=create_buffer_iarchive(b->buffer,b->len);
+            RequestHeader h;
+            SetWatches req;
+            deserialize_RequestHeader(ia,"header",&h);
+            CPPUNIT_ASSERT_EQUAL(SET_WATCHES_XID,h.xid);
+            CPPUNIT_ASSERT_EQUAL((int)ZOO_SETWATCHES_OP,h.type);
+            CPPUNIT_ASSERT_EQUAL(0,deserialize_SetWatches(ia,"req",&req));
+            CPPUNIT_ASSERT_EQUAL((int64_t)42,req.relativeZxid);
+            String_vector* lists[]={&req.dataWatches,&req.existWatches,
+                    &req.childWatches};
+            for(int j=0;j<WATCH_TYPE_COUNT;j++)
+                for(int i=0;i<lists[j]->count;i++)
+                    CPPUNIT_ASSERT(sent[j].insert(lists[j]->data[i]).second);
+            deallocate_SetWatches(&req);
+            close_buffer_iarchive(&ia);
+            free_buffer(b);
+        }
+        CPPUNIT_ASSERT(requests>1);
+        for(int j=0;j<WATCH_TYPE_COUNT;j++)
+            CPPUNIT_ASSERT(expected[j]==sent[j]);
+        destroy_object_pool(&zh->buffer_pool);
+        destroy_object_pool(&zh->oarchive_pool);
+    }
+
+    // a recursive watch gets the node and data events of its subtree, and
+    // nothing of the nodes that merely share its prefix
+    void testRecursiveMatchesSubtree()
+    {
+        Deliveries root,a;
+        watch("/",recursiveChecker,&root);
+        watch("/a",recursiveChecker,&a);
+        trigger(CREATED_EVENT_DEF,"/a/b");
+        trigger(CHANGED_EVENT_DEF,"/a/b/c");
+        trigger(DELETED_EVENT_DEF,"/a");
+        trigger(CHANGED_EVENT_DEF,"/ab");
+        trigger(CHANGED_EVENT_DEF,"/");
+        trigger(CHILD_EVENT_DEF,"/a");
+        CPPUNIT_ASSERT_EQUAL(1,a["/a/b"]);
+        CPPUNIT_ASSERT_EQUAL(1,a["/a/b/c"]);
+        CPPUNIT_ASSERT_EQUAL(1,a["/a"]);
+        CPPUNIT_ASSERT_EQUAL(0,a["/ab"]);
+        CPPUNIT_ASSERT_EQUAL(0,a["/"]);
+        CPPUNIT_ASSERT_EQUAL(1,root["/a/b"]);
+        CPPUNIT_ASSERT_EQUAL(1,root["/a"]);
+        CPPUNIT_ASSERT_EQUAL(1,root["/ab"]);
+        CPPUNIT_ASSERT_EQUAL(1,root["/"]);
+    }
+
+    // persistent watches fire on every event of their node, child events
+    // too, and live alongside the one-shot ones
+    void testPersistentStays()
+    {
+        Deliveries d,once;
+        watch("/a",persistentChecker,&d);
+        watch("/a",dataChecker,&once);
+        trigger(CHANGED_EVENT_DEF,"/a");
+        trigger(CHILD_EVENT_DEF,"/a");
+        trigger(DELETED_EVENT_DEF,"/a/b");
+        trigger(DELETED_EVENT_DEF,"/a");
+        CPPUNIT_ASSERT_EQUAL(3,d["/a"]);
+        CPPUNIT_ASSERT_EQUAL(0,d["/a/b"]);
+        CPPUNIT_ASSERT_EQUAL(1,once["/a"]);
+        CPPUNIT_ASSERT_EQUAL(0,keyCount(WATCH_DATA));
+
+        Deliveries session;
+        zh->watcher=countingWatcher;
+        zh->context=&session;
+        watcher_object_list_t* list=collectWatchers(zh,ZOO_SESSION_EVENT,0);
+        deliverWatchers(zh,ZOO_SESSION_EVENT,ZOO_CONNECTING_STATE,0,&list);
+        CPPUNIT_ASSERT_EQUAL(1,d["session"]);
+    }
+
+    // persistent watches go out in SetWatches2 on their own, the one-shot
+    // ones in SetWatches, so a server without SetWatches2 keeps the latter
+    void testSetWatchesPersistent()
+    {
+        Deliveries d;
+        watch("/a",dataChecker,&d);
+        watch("/b",persistentChecker,&d);
+        watch("/c",recursiveChecker,&d);
+        watch("/c",persistentChecker,&d);
+        init_object_pool(&zh->buffer_pool,sizeof(buffer_list_t),
+                OBJECT_POOL_MAX_FREE);
+        init_object_pool(&zh->oarchive_pool,buffer_oarchive_size(),
+                OBJECT_POOL_MAX_FREE);
+        init_buffer_list(&zh->to_send,&zh->buffer_pool);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,send_set_watches(zh));
+
+        int setWatches=0,setWatches2=0;
+        buffer_list_t* b;
+        while((b=dequeue_buffer(&zh->to_send))!=0){
+            iarchive* ia=create_buffer_iarchive(b->buffer,b->len);
+            RequestHeader h;
+            deserialize_RequestHeader(ia,"header",&h);
+            if(h.type==ZOO_SETWATCHES_OP){
+                SetWatches req;
+                setWatches++;
+                CPPUNIT_ASSERT_EQUAL(0,deserialize_SetWatches(ia,"req",&req));
+                CPPUNIT_ASSERT_EQUAL(1,req.dataWatches.count);
+                CPPUNIT_ASSERT_EQUAL(string("/a"),
+                        string(req.dataWatches.data[0]));
+                CPPUNIT_ASSERT_EQUAL(0,
+                        req.existWatches.count+req.childWatches.count);
+                deallocate_SetWatches(&req);
+            }else{
+                SetWatches2 req;
+                setWatches2++;
+                CPPUNIT_ASSERT_EQUAL((int)ZOO_SETWATCHES2_OP,h.type);
+                CPPUNIT_ASSERT_EQUAL(0,deserialize_SetWatches2(ia,"req",&req));
+                CPPUNIT_ASSERT_EQUAL(0,req.dataWatches.count+
+                        req.existWatches.count+req.childWatches.count);
+                set<string> persistent(req.persistentWatches.data,
+                        req.persistentWatches.data+req.persistentWatches.count);
+                CPPUNIT_ASSERT_EQUAL(2,(int)persistent.size());
+                CPPUNIT_ASSERT(persistent.count("/b") && persistent.count("/c"));
+                CPPUNIT_ASSERT_EQUAL(1,req.persistentRecursiveWatches.count);
+                CPPUNIT_ASSERT_EQUAL(string("/c"),
+                        string(req.persistentRecursiveWatches.data[0]));
+                deallocate_SetWatches2(&req);
+            }
+            close_buffer_iarchive(&ia);
+            free_buffer(b);
+        }
+        CPPUNIT_ASSERT_EQUAL(1,setWatches);
+        CPPUNIT_ASSERT_EQUAL(1,setWatches2);
+        destroy_object_pool(&zh->buffer_pool);
+        destroy_object_pool(&zh->oarchive_pool);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_watchTable);
@@ -33,6 +33,9 @@ class Zookeeper_watchers : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testNodeWatcher1);
     CPPUNIT_TEST(testChildWatcher1);
     CPPUNIT_TEST(testChildWatcher2);
+#ifndef THREADED
+    CPPUNIT_TEST(testPersistentWatchers);
+#endif
     CPPUNIT_TEST_SUITE_END();
 
     static void watcher(zhandle_t *, int, int, const char *,void*){}
@@ -122,6 +125,26 @@ public:
         int counter_;
     };
 
+    class NodeEventCountingWatcher: public WatcherAction{
+    public:
+        NodeEventCountingWatcher():changed_(0),deleted_(0),child_(0){}
+        virtual void onNodeValueChanged(zhandle_t*,const char* path){
+            synchronized(mx_);
+            changed_++;
+        }
+        virtual void onNodeDeleted(zhandle_t*,const char* path){
+            synchronized(mx_);
+            deleted_++;
+        }
+        virtual void onChildChanged(zhandle_t*,const char* path){
+            synchronized(mx_);
+            child_++;
+        }
+        int changed_;
+        int deleted_;
+        int child_;
+    };
+
     class ChildEventCountingWatcher: public WatcherAction{
     public:
         ChildEventCountingWatcher():counter_(0){}
@@ -440,6 +463,72 @@ public:
         CPPUNIT_ASSERT_EQUAL(0,defWatcher.counter_);
     }
 
+    // testcase: set a persistent watch and a recursive one on /a, then send
+    //           events on /a, below it and next to it, twice
+    // verify: the persistent watch gets all events of /a, the recursive one
+    //         all but the child events of /a and the nodes below it, and
+    //         both stay set
+    void testPersistentWatchers(){
+        Mock_gettimeofday timeMock;
+        ZookeeperServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        NodeEventCountingWatcher defWatcher;
+        zh=zookeeper_init("localhost:2121",activeWatcher,10000,TEST_CLIENT_ID,
+                &defWatcher,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        AsyncCompletion ignored;
+        NodeEventCountingWatcher persistent;
+        // the server may not know AddWatch until the handle is told it does
+        CPPUNIT_ASSERT_EQUAL((int)ZUNIMPLEMENTED,zoo_aadd_watch(zh,"/a",
+                ZOO_ADD_WATCH_PERSISTENT,activeWatcher,&persistent,
+                asyncCompletion,&ignored));
+        zoo_set_persistent_watches(zh,1);
+        zkServer.addOperationResponse(new ZooStatResponse);
+        int rc=zoo_aadd_watch(zh,"/a",ZOO_ADD_WATCH_PERSISTENT,activeWatcher,
+                &persistent,asyncCompletion,&ignored);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        NodeEventCountingWatcher recursive;
+        zkServer.addOperationResponse(new ZooStatResponse);
+        rc=zoo_aadd_watch(zh,"/a",ZOO_ADD_WATCH_PERSISTENT_RECURSIVE,
+                activeWatcher,&recursive,asyncCompletion,&ignored);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS,zoo_aadd_watch(zh,"/a",2,
+                activeWatcher,&recursive,asyncCompletion,&ignored));
+
+        // this will process the responses and activate the watchers
+        while((rc=zookeeper_process(zh,ZOOKEEPER_READ))==ZOK) {
+          millisleep(100);
+        }
+        CPPUNIT_ASSERT_EQUAL((int)ZNOTHING,rc);
+
+        for(int i=0;i<2;i++){
+            zkServer.addRecvResponse(new ZNodeEvent(ZOO_CHANGED_EVENT,"/a"));
+            zkServer.addRecvResponse(new ZNodeEvent(ZOO_CHILD_EVENT,"/a"));
+            zkServer.addRecvResponse(new ZNodeEvent(ZOO_CHANGED_EVENT,"/a/b/c"));
+            zkServer.addRecvResponse(new ZNodeEvent(ZOO_DELETED_EVENT,"/a/b"));
+            zkServer.addRecvResponse(new ZNodeEvent(ZOO_CHANGED_EVENT,"/ab"));
+            zkServer.addRecvResponse(new ZNodeEvent(ZOO_CHANGED_EVENT,"/"));
+            while((rc=zookeeper_process(zh,ZOOKEEPER_READ))==ZOK) {
+              millisleep(100);
+            }
+            CPPUNIT_ASSERT_EQUAL((int)ZNOTHING,rc);
+        }
+
+        CPPUNIT_ASSERT_EQUAL(2,persistent.changed_);
+        CPPUNIT_ASSERT_EQUAL(2,persistent.child_);
+        CPPUNIT_ASSERT_EQUAL(0,persistent.deleted_);
+        CPPUNIT_ASSERT_EQUAL(4,recursive.changed_);
+        CPPUNIT_ASSERT_EQUAL(0,recursive.child_);
+        CPPUNIT_ASSERT_EQUAL(2,recursive.deleted_);
+        CPPUNIT_ASSERT_EQUAL(0,defWatcher.changed_+defWatcher.child_+
+                defWatcher.deleted_);
+    }
+
 #else
     // verify: the default watcher is called once for a session event
     void testDefaultSessionWatcher1(){
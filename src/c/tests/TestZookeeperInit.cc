@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include "Util.h"
 #include "LibCMocks.h"
@@ -52,6 +53,10 @@ class Zookeeper_init : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testOutOfMemory_getaddrs2);
 #endif
     CPPUNIT_TEST(testPermuteAddrsList);
+#ifdef THREADED
+    CPPUNIT_TEST(testWakeupsCoalesce);
+    CPPUNIT_TEST(testSyncCompletionReuse);
+#endif
     CPPUNIT_TEST_SUITE_END();
     zhandle_t *zh;
     MockPthreadsNull* pthreadMock;
@@ -296,6 +301,52 @@ public:
         }
         CPPUNIT_ASSERT_EQUAL(EXPECTED_SEQ,string(ACTUAL_SEQ));
     }
+#ifdef THREADED
+    void testWakeupsCoalesce()
+    {
+        zh=zookeeper_init("localhost:2121",watcher,10000,0,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        adaptor_threads* adaptor=(adaptor_threads*)zh->adaptor_priv;
+        char buf[64];
+
+        for(int i=0;i<1000;i++)
+            CPPUNIT_ASSERT_EQUAL((int)ZOK,wakeup_io_thread(zh));
+        // a burst of wakeups signals the IO thread only once...
+        CPPUNIT_ASSERT(read(adaptor->self_pipe[0],buf,sizeof(buf))>0);
+        CPPUNIT_ASSERT_EQUAL(-1,(int)read(adaptor->self_pipe[0],buf,sizeof(buf)));
+        CPPUNIT_ASSERT_EQUAL(1,(int)adaptor->wakeup_pending);
+        // ...and the next one gets through once the IO thread has seen it
+        adaptor->wakeup_pending=0;
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,wakeup_io_thread(zh));
+        CPPUNIT_ASSERT(read(adaptor->self_pipe[0],buf,sizeof(buf))>0);
+    }
+
+    void testSyncCompletionReuse()
+    {
+        struct sync_completion* sc=alloc_sync_completion();
+        CPPUNIT_ASSERT(sc!=0);
+        sc->rc=ZNONODE;
+        sc->u.str.str_len=10;
+        sc->strings_arena=1;
+        notify_sync_completion(sc);
+        wait_sync_completion(sc);
+        free_sync_completion(sc);
+        // the next call of the thread gets the same one back, as good as new
+        struct sync_completion* again=alloc_sync_completion();
+        CPPUNIT_ASSERT(again==sc);
+        CPPUNIT_ASSERT_EQUAL(0,again->rc);
+        CPPUNIT_ASSERT_EQUAL(0,again->u.str.str_len);
+        CPPUNIT_ASSERT_EQUAL(0,again->complete);
+        CPPUNIT_ASSERT_EQUAL(0,again->strings_arena);
+        // nested calls get one of their own
+        struct sync_completion* nested=alloc_sync_completion();
+        CPPUNIT_ASSERT(nested!=0 && nested!=again);
+        free_sync_completion(nested);
+        free_sync_completion(again);
+        CPPUNIT_ASSERT(alloc_sync_completion()==nested);
+        free_sync_completion(nested);
+    }
+#endif
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_init);
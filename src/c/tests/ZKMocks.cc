@@ -340,11 +340,8 @@ string ZooGetResponse::toString() const{
     serialize_ReplyHeader(oa, "hdr", &h);
     
     GetDataResponse resp;
-	char buf[1024];
-    assert("GetDataResponse is too long"&&data_.size()<=sizeof(buf));
     resp.data.len=data_.size();
-    resp.data.buff=buf;
-    data_.copy(resp.data.buff, data_.size());
+    resp.data.buff=const_cast<char*>(data_.data());
     resp.stat=stat_;
     serialize_GetDataResponse(oa, "reply", &resp);
     int32_t len=htonl(get_buffer_len(oa));
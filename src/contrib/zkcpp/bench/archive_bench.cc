@@ -0,0 +1,134 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Times encoding and decoding a GetChildren2Response, as the server sends
+ * it for getChildren() on a znode with many children, with OBinArchive and
+ * IBinArchive against ODirectBinArchive and IDirectBinArchive.
+ *
+ * Usage: zk_archive_bench [children] [rounds]
+ */
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <binarchive.hh>
+#include <memory_in_stream.hh>
+#include <string_out_stream.hh>
+#include <zookeeper.jute.hh>
+
+using namespace org::apache::zookeeper;
+
+static double
+elapsedMs(const boost::posix_time::ptime& start) {
+  return (boost::posix_time::microsec_clock::universal_time() - start)
+    .total_microseconds() / 1000.0;
+}
+
+static void
+report(const char* name, int rounds, size_t bytes, double ms) {
+  std::cout << name << ": " << ms / rounds << " ms, " <<
+    (ms > 0 ? bytes * rounds / ms / 1000 : 0) << " MB/s" << std::endl;
+}
+
+static void
+makeResponse(int children, proto::GetChildren2Response& response) {
+  for (int i = 0; i < children; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "member-%010d", i);
+    response.getchildren().push_back(name);
+  }
+  data::Stat& stat = response.getstat();
+  stat.setczxid(1);
+  stat.setmzxid(2);
+  stat.setctime(3);
+  stat.setmtime(4);
+  stat.setversion(5);
+  stat.setcversion(children);
+  stat.setaversion(0);
+  stat.setephemeralOwner(0);
+  stat.setdataLength(0);
+  stat.setnumChildren(children);
+  stat.setpzxid(6);
+}
+
+template <typename Archive>
+static void
+encode(const char* name, int children, int rounds) {
+  // A record can only be serialized once after its fields have been set.
+  std::vector<proto::GetChildren2Response> responses(rounds);
+  for (int i = 0; i < rounds; i++) {
+    makeResponse(children, responses[i]);
+  }
+  size_t bytes = 0;
+  boost::posix_time::ptime start =
+    boost::posix_time::microsec_clock::universal_time();
+  for (int i = 0; i < rounds; i++) {
+    std::string serialized;
+    StringOutStream stream(serialized);
+    Archive oarchive(stream);
+    responses[i].serialize(oarchive, "response");
+    bytes = serialized.size();
+  }
+  report(name, rounds, bytes, elapsedMs(start));
+}
+
+template <typename Archive>
+static bool
+decode(const char* name, const std::string& serialized,
+       const proto::GetChildren2Response& expected, int rounds) {
+  proto::GetChildren2Response response;
+  boost::posix_time::ptime start =
+    boost::posix_time::microsec_clock::universal_time();
+  for (int i = 0; i < rounds; i++) {
+    response = proto::GetChildren2Response();
+    MemoryInStream stream(serialized.data(), serialized.size());
+    Archive iarchive(stream);
+    response.deserialize(iarchive, "response");
+  }
+  report(name, rounds, serialized.size(), elapsedMs(start));
+  return response == expected;
+}
+
+int main(int argc, char** argv) {
+  int children = argc > 1 ? atoi(argv[1]) : 100000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 10;
+  proto::GetChildren2Response response;
+  makeResponse(children, response);
+
+  std::string serialized;
+  StringOutStream stream(serialized);
+  hadoop::OBinArchive oarchive(stream);
+  response.serialize(oarchive, "response");
+  std::cout << children << " children, " << serialized.size() <<
+    " bytes" << std::endl;
+
+  encode<hadoop::OBinArchive>("encode, OBinArchive", children, rounds);
+  encode<hadoop::ODirectBinArchive<StringOutStream> >(
+      "encode, ODirectBinArchive", children, rounds);
+  bool ok = decode<hadoop::IBinArchive>("decode, IBinArchive", serialized,
+                                        response, rounds);
+  ok = decode<hadoop::IDirectBinArchive<MemoryInStream> >(
+      "decode, IDirectBinArchive", serialized, response, rounds) && ok;
+  if (!ok) {
+    std::cerr << "Decoded response differs" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Compares reading a znode N times with the synchronous get() against
+ * issuing N future get() requests and joining them.
+ *
+ * Usage: zk_future_bench [host:port] [reads] [rounds]
+ */
+#include <zookeeper/zookeeper.hh>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdlib>
+#include <iostream>
+
+using namespace org::apache::zookeeper;
+
+static double
+elapsedMs(const boost::posix_time::ptime& start) {
+  return (boost::posix_time::microsec_clock::universal_time() - start)
+    .total_microseconds() / 1000.0;
+}
+
+static void
+report(const char* name, int reads, double ms) {
+  std::cout << name << ": " << reads << " reads in " << ms << " ms, "
+            << (ms > 0 ? reads * 1000.0 / ms : 0) << " reads/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  std::string hosts = argc > 1 ? argv[1] : "localhost:2181";
+  int reads = argc > 2 ? atoi(argv[2]) : 1000;
+  int rounds = argc > 3 ? atoi(argv[3]) : 5;
+  std::string path = "/zk_future_bench";
+  std::vector<data::ACL> acl;
+  data::ACL temp;
+  temp.getid().getscheme() = "world";
+  temp.getid().getid() = "anyone";
+  temp.setperms(Permission::All);
+  acl.push_back(temp);
+
+  ZooKeeper zk;
+  if (zk.init(hosts, 30000, boost::shared_ptr<Watch>()) != ReturnCode::Ok) {
+    std::cerr << "Failed to initialize the session to " << hosts << std::endl;
+    return 1;
+  }
+  for (int i = 0; i < 100 && zk.getState() != SessionState::Connected; i++) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+  }
+  if (zk.getState() != SessionState::Connected) {
+    std::cerr << "Failed to connect to " << hosts << std::endl;
+    return 1;
+  }
+  ReturnCode::type rc = zk.create(path, std::string(100, 'x'), acl,
+                                  CreateMode::Ephemeral).get().rc;
+  if (rc != ReturnCode::Ok && rc != ReturnCode::NodeExists) {
+    std::cerr << "Failed to create " << path << ": " <<
+      ReturnCode::toString(rc) << std::endl;
+    return 1;
+  }
+
+  for (int round = 0; round < rounds; round++) {
+    std::string data;
+    data::Stat stat;
+    boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < reads; i++) {
+      zk.get(path, boost::shared_ptr<Watch>(), data, stat);
+    }
+    report("sync  ", reads, elapsedMs(start));
+
+    std::vector<Future<GetResult> > futures;
+    futures.reserve(reads);
+    start = boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < reads; i++) {
+      futures.push_back(zk.get(path));
+    }
+    waitAll(futures.begin(), futures.end());
+    report("future", reads, elapsedMs(start));
+  }
+  zk.close();
+  return 0;
+}
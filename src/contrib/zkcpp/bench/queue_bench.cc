@@ -0,0 +1,160 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures the throughput of the queues of a zhandle_t, with producer
+ * threads pushing elements and one consumer taking them off, against the
+ * queues they replaced:
+ *
+ *  - buffers: a boost::ptr_list guarded by a recursive mutex, polled by the
+ *    consumer as the IO thread does, against an MpscQueue whose consumer
+ *    holds a mutex of its own.
+ *  - completions: a std::queue guarded by a mutex whose condition variable
+ *    is notified on every push, against a ParkingMpscQueue.
+ *
+ * Usage: zk_queue_bench [producers] [elements per producer]
+ */
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/ptr_container/ptr_list.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <vector>
+#include "mpsc_queue.hh"
+
+using namespace org::apache::zookeeper;
+
+struct Element : public MpscNode {
+  int value;
+};
+
+class PtrListQueue {
+  public:
+    void push(Element* e) {
+      boost::lock_guard<boost::recursive_mutex> lock(mutex_);
+      list_.push_back(e);
+    }
+    Element* pop() {
+      boost::lock_guard<boost::recursive_mutex> lock(mutex_);
+      if (list_.empty()) {
+        return NULL;
+      }
+      return list_.release(list_.begin()).release();
+    }
+    void wait() {
+      boost::this_thread::yield();
+    }
+  private:
+    boost::ptr_list<Element> list_;
+    boost::recursive_mutex mutex_;
+};
+
+class BufferQueue {
+  public:
+    void push(Element* e) {
+      queue_.push(e);
+    }
+    Element* pop() {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return queue_.pop();
+    }
+    void wait() {
+      boost::this_thread::yield();
+    }
+  private:
+    MpscQueue<Element> queue_;
+    boost::mutex mutex_;
+};
+
+class ConditionQueue {
+  public:
+    void push(Element* e) {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      queue_.push(e);
+      cond_.notify_all();
+    }
+    Element* pop() {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (queue_.empty()) {
+        return NULL;
+      }
+      Element* e = queue_.front();
+      queue_.pop();
+      return e;
+    }
+    void wait() {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (queue_.empty()) {
+        cond_.wait(lock);
+      }
+    }
+  private:
+    std::queue<Element*> queue_;
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+};
+
+template <typename Queue>
+static void
+produce(Queue* queue, Element* elements, int count) {
+  for (int i = 0; i < count; i++) {
+    queue->push(&elements[i]);
+  }
+}
+
+template <typename Queue>
+static void
+run(const char* name, int producers, int count) {
+  Queue queue;
+  std::vector<Element> elements(producers * count);
+  boost::posix_time::ptime start =
+    boost::posix_time::microsec_clock::universal_time();
+  boost::thread_group threads;
+  for (int p = 0; p < producers; p++) {
+    threads.create_thread(boost::bind(produce<Queue>, &queue,
+                                      &elements[p * count], count));
+  }
+  for (int received = 0; received < producers * count; received++) {
+    while (queue.pop() == NULL) {
+      queue.wait();
+    }
+  }
+  threads.join_all();
+  double us = (boost::posix_time::microsec_clock::universal_time() - start)
+    .total_microseconds();
+  std::cout << name << ": " << (us > 0 ? producers * count / us : 0) <<
+    " million elements/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  int producers = argc > 1 ? atoi(argv[1]) : 4;
+  int count = argc > 2 ? atoi(argv[2]) : 1000000;
+  std::cout << producers << " producers, " << count << " elements each" <<
+    std::endl;
+  run<PtrListQueue>("buffers, ptr_list and recursive mutex", producers, count);
+  run<BufferQueue>("buffers, MpscQueue", producers, count);
+  run<ConditionQueue>("completions, std::queue and condition", producers,
+                      count);
+  run<ParkingMpscQueue<Element> >("completions, ParkingMpscQueue", producers,
+                                  count);
+  return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Counts the heap allocations, and the bytes allocated, by the calling
+ * thread for each get() and set() request, and times them.
+ *
+ * The requests are queued on a session that never connects, so this needs
+ * no server and measures the client side of the request path only: building
+ * and queueing the request and its completion. The results are written into
+ * Completions allocated up front, so no callback is allocated either.
+ *
+ * Usage: zk_request_bench [requests] [set size in bytes]
+ */
+#include <zookeeper/zookeeper.hh>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+using namespace org::apache::zookeeper;
+
+static __thread bool counting = false;
+static __thread int64_t allocations = 0;
+static __thread int64_t allocatedBytes = 0;
+
+void* operator new(size_t size) {
+  if (counting) {
+    allocations++;
+    allocatedBytes += size;
+  }
+  void* p = malloc(size ? size : 1);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) throw() {
+  free(p);
+}
+
+template <typename T>
+static void
+ignore(Completion<T>* completion) {
+}
+
+static void
+report(const char* name, int requests, int64_t count, int64_t bytes,
+       const boost::posix_time::ptime& start) {
+  double us = (boost::posix_time::microsec_clock::universal_time() - start)
+    .total_microseconds();
+  std::cout << name << ": " << (double)count / requests << " allocations, " <<
+    (double)bytes / requests << " bytes, " << us / requests << " us per request"
+    << std::endl;
+}
+
+int main(int argc, char** argv) {
+  int requests = argc > 1 ? atoi(argv[1]) : 10000;
+  int size = argc > 2 ? atoi(argv[2]) : 4096;
+  std::string path = "/zk_request_bench/node";
+  std::string data(size, 'x');
+  boost::shared_ptr<Watch> noWatch;
+  std::vector<Completion<GetResult> > gets(requests);
+  std::vector<Completion<StatResult> > sets(requests);
+  for (int i = 0; i < requests; i++) {
+    gets[i].done = &ignore<GetResult>;
+    sets[i].done = &ignore<StatResult>;
+  }
+
+  ZooKeeper zk;
+  // Nothing listens on port 1: the requests stay queued.
+  if (zk.init("127.0.0.1:1", 30000, noWatch) != ReturnCode::Ok) {
+    std::cerr << "Failed to initialize the session" << std::endl;
+    return 1;
+  }
+
+  boost::posix_time::ptime start =
+    boost::posix_time::microsec_clock::universal_time();
+  allocations = allocatedBytes = 0;
+  counting = true;
+  for (int i = 0; i < requests; i++) {
+    zk.get(path, noWatch, gets[i]);
+  }
+  counting = false;
+  report("get", requests, allocations, allocatedBytes, start);
+
+  start = boost::posix_time::microsec_clock::universal_time();
+  allocations = allocatedBytes = 0;
+  counting = true;
+  for (int i = 0; i < requests; i++) {
+    zk.set(path, data, -1, sets[i]);
+  }
+  counting = false;
+  std::cout << "set of " << size << " bytes:" << std::endl;
+  report("set", requests, allocations, allocatedBytes, start);
+  zk.close();
+  return 0;
+}
@@ -52,9 +52,9 @@ public:
   void deserialize(std::vector<T>& v, const char* tag) {
     Index* idx = startVector(tag);
     while (!idx->done()) {
-      T t;
-      deserialize(t, tag);
-      v.push_back(t);
+      // Deserialize each element in place rather than copying it in.
+      v.push_back(T());
+      deserialize(v.back(), tag);
       idx->incr();
     }
     endVector(idx, tag);
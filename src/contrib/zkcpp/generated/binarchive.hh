@@ -19,6 +19,7 @@
 #ifndef BINARCHIVE_HH_
 #define BINARCHIVE_HH_
 
+#include <arpa/inet.h>
 #include "recordio.hh"
 
 namespace hadoop {
@@ -77,5 +78,141 @@ public:
   virtual ~OBinArchive();
 };
 
+/**
+ * Like IBinArchive, but reads fields in place from a stream of type Stream
+ * instead of copying each of them out through the virtual InStream::read().
+ * Stream provides const char* consume(size_t len), which returns the next
+ * len bytes and skips them, or NULL if fewer are left; MemoryInStream does.
+ */
+template <typename Stream>
+class IDirectBinArchive : public IArchive {
+private:
+  Stream& stream;
+
+  const char* next(size_t len) {
+    const char* data = stream.consume(len);
+    if (data == NULL) {
+      throw new IOException("Error deserializing data.");
+    }
+    return data;
+  }
+
+  static int32_t decodeInt(const char* data) {
+    uint32_t num;
+    memcpy(&num, data, sizeof(num));
+    return ntohl(num);
+  }
+public:
+  IDirectBinArchive(Stream& _stream) : stream(_stream) {}
+  virtual void deserialize(int8_t& t, const char* tag) {
+    t = *next(sizeof(t));
+  }
+  virtual void deserialize(bool& t, const char* tag) {
+    t = *next(sizeof(t)) != 0;
+  }
+  virtual void deserialize(int32_t& t, const char* tag) {
+    t = decodeInt(next(sizeof(t)));
+  }
+  virtual void deserialize(int64_t& t, const char* tag) {
+    const char* data = next(sizeof(t));
+    t = ((int64_t) decodeInt(data) << 32) | (uint32_t) decodeInt(data + 4);
+  }
+  virtual void deserialize(float& t, const char* tag) {
+    throw new IOException("Deserializing float is not supported.");
+  }
+  virtual void deserialize(double& t, const char* tag) {
+    throw new IOException("Deserializing double is not supported.");
+  }
+  virtual void deserialize(std::string& t, const char* tag) {
+    int32_t len;
+    deserialize(len, tag);
+    if (len > 0) {
+      t.assign(next(len), len);
+    } else {
+      t.clear();
+    }
+  }
+  virtual void deserialize(std::string& t, size_t& len, const char* tag) {
+    deserialize(t, tag);
+    len = t.length();
+  }
+  virtual void startRecord(Record& s, const char* tag) {}
+  virtual void endRecord(Record& s, const char* tag) {}
+  virtual Index* startVector(const char* tag) {
+    int32_t len;
+    deserialize(len, tag);
+    return new BinIndex((size_t) len);
+  }
+  virtual void endVector(Index* idx, const char* tag) {
+    delete idx;
+  }
+  virtual Index* startMap(const char* tag) {
+    return startVector(tag);
+  }
+  virtual void endMap(Index* idx, const char* tag) {
+    delete idx;
+  }
+  virtual ~IDirectBinArchive() {}
+};
+
+/**
+ * Like OBinArchive, but writes to a stream of type Stream, whose write()
+ * is called directly rather than through the virtual OutStream::write();
+ * StringOutStream is such a stream.
+ */
+template <typename Stream>
+class ODirectBinArchive : public OArchive {
+private:
+  Stream& stream;
+
+  void write(const void* buf, size_t len) {
+    if ((ssize_t) len != stream.Stream::write(buf, len)) {
+      throw new IOException("Error serializing data.");
+    }
+  }
+public:
+  ODirectBinArchive(Stream& _stream) : stream(_stream) {}
+  virtual void serialize(int8_t t, const char* tag) {
+    write(&t, sizeof(t));
+  }
+  virtual void serialize(bool t, const char* tag) {
+    write(&t, sizeof(t));
+  }
+  virtual void serialize(int32_t t, const char* tag) {
+    const uint32_t num = htonl(t);
+    write(&num, sizeof(num));
+  }
+  virtual void serialize(int64_t t, const char* tag) {
+    const uint32_t num[2] = { htonl((uint64_t) t >> 32), htonl(t) };
+    write(num, sizeof(num));
+  }
+  virtual void serialize(float t, const char* tag) {
+    throw new IOException("Serializing float is not supported.");
+  }
+  virtual void serialize(double t, const char* tag) {
+    throw new IOException("Serializing double is not supported.");
+  }
+  virtual void serialize(const std::string& t, const char* tag) {
+    serialize((int32_t) t.length(), tag);
+    if (t.length() > 0) {
+      write(t.data(), t.length());
+    }
+  }
+  virtual void serialize(const std::string& t, size_t len, const char* tag) {
+    serialize(t, tag);
+  }
+  virtual void startRecord(const Record& s, const char* tag) {}
+  virtual void endRecord(const Record& s, const char* tag) {}
+  virtual void startVector(size_t len, const char* tag) {
+    serialize((int32_t) len, tag);
+  }
+  virtual void endVector(size_t len, const char* tag) {}
+  virtual void startMap(size_t len, const char* tag) {
+    serialize((int32_t) len, tag);
+  }
+  virtual void endMap(size_t len, const char* tag) {}
+  virtual ~ODirectBinArchive() {}
+};
+
 }
 #endif /*BINARCHIVE_HH_*/
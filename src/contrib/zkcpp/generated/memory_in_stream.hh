@@ -45,6 +45,21 @@ class MemoryInStream : public hadoop::InStream, boost::noncopyable {
       return numBytes;
     }
 
+    /**
+     * Skips the next len bytes without copying them.
+     *
+     * @return the bytes skipped, or NULL if fewer than len bytes are left,
+     *         in which case nothing is skipped.
+     */
+    const char* consume(size_t len) {
+      if (len > buflen_ - offset_) {
+        return NULL;
+      }
+      const char* data = (const char*)buf_ + offset_;
+      offset_ += len;
+      return data;
+    }
+
   private:
     MemoryInStream() {}
     const void* buf_;
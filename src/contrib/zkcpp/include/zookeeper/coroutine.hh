@@ -0,0 +1,211 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * C++20 coroutine support.
+ *
+ * The library itself is built as C++03; this header only builds on the
+ * Completion interface of ZooKeeper, so it can be used by code compiled
+ * with coroutines enabled:
+ *
+ *   AwaitableZooKeeper azk(zk);
+ *   GetResult result = co_await azk.get("/path");
+ *
+ * An awaitable sends its request as soon as it is created and is completed
+ * in place, so awaiting one allocates nothing beyond the coroutine frame.
+ */
+#ifndef SRC_CONTRIB_ZKCPP_INCLUDE_COROUTINE_H_
+#define SRC_CONTRIB_ZKCPP_INCLUDE_COROUTINE_H_
+
+#if !defined(__cpp_impl_coroutine)
+#error "zookeeper/coroutine.hh requires C++20 coroutines"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <utility>
+#include "zookeeper.hh"
+
+namespace org { namespace apache { namespace zookeeper {
+
+/**
+ * Resumes coroutines on behalf of an AwaitableZooKeeper, for instance on
+ * the threads of an event loop.
+ */
+class Executor {
+  public:
+    /**
+     * Called from the completion thread to have a coroutine resumed.
+     */
+    virtual void execute(std::coroutine_handle<> handle) = 0;
+    virtual ~Executor() {}
+};
+
+/**
+ * A request that can be awaited by one coroutine.
+ *
+ * The request is sent when the awaitable is constructed, so several of them
+ * can be outstanding before the first one is awaited. An awaitable cannot
+ * be copied or moved, and must be awaited before it goes away.
+ */
+template <typename T>
+class Awaitable : private Completion<T> {
+  public:
+    /**
+     * Sends a request by calling start with the completion to write the
+     * result into, which is what ZooKeeper::get() and the other Completion
+     * overloads take. start returns whether the request was sent.
+     *
+     * @param executor Resumes the awaiting coroutine. If null, it is resumed
+     *                 directly on the completion thread.
+     */
+    template <typename Start>
+    Awaitable(Executor* executor, Start start) :
+      executor_(executor), state_(Pending) {
+      this->done = &requestDone;
+      ReturnCode::type rc = start(static_cast<Completion<T>&>(*this));
+      if (rc != ReturnCode::Ok) {
+        this->result.rc = rc;
+        state_.store(Done, std::memory_order_relaxed);
+      }
+    }
+
+    Awaitable(const Awaitable&) = delete;
+    Awaitable& operator=(const Awaitable&) = delete;
+
+    bool await_ready() const noexcept {
+      return state_.load(std::memory_order_acquire) == Done;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+      handle_ = handle;
+      int expected = Pending;
+      // Fails if the request has completed since await_ready().
+      return state_.compare_exchange_strong(expected, Suspended,
+                                            std::memory_order_acq_rel);
+    }
+
+    T await_resume() {
+      return std::move(this->result);
+    }
+
+  private:
+    enum { Pending, Suspended, Done };
+
+    static void requestDone(Completion<T>* completion) {
+      Awaitable* self = static_cast<Awaitable*>(completion);
+      // Unless the coroutine is suspended already, it may go ahead and
+      // destroy the awaitable as soon as the state is Done.
+      if (self->state_.exchange(Done, std::memory_order_acq_rel) ==
+          Suspended) {
+        if (self->executor_) {
+          self->executor_->execute(self->handle_);
+        } else {
+          self->handle_.resume();
+        }
+      }
+    }
+
+    Executor* executor_;
+    std::coroutine_handle<> handle_;
+    std::atomic<int> state_;
+};
+
+/**
+ * The ZooKeeper operations as awaitables.
+ *
+ * Coroutines resumed on the completion thread hold up the completion of
+ * every other request until they suspend again, so they should hand long
+ * running work off; otherwise, pass an Executor.
+ */
+class AwaitableZooKeeper {
+  public:
+    explicit AwaitableZooKeeper(ZooKeeper& zk, Executor* executor = nullptr) :
+      zk_(zk), executor_(executor) {}
+
+    Awaitable<GetResult> get(const std::string& path,
+        boost::shared_ptr<Watch> watch = boost::shared_ptr<Watch>()) {
+      return Awaitable<GetResult>(executor_,
+          [&](Completion<GetResult>& completion) {
+            return zk_.get(path, watch, completion);
+          });
+    }
+
+    Awaitable<StatResult> exists(const std::string& path,
+        boost::shared_ptr<Watch> watch = boost::shared_ptr<Watch>()) {
+      return Awaitable<StatResult>(executor_,
+          [&](Completion<StatResult>& completion) {
+            return zk_.exists(path, watch, completion);
+          });
+    }
+
+    Awaitable<StatResult> set(const std::string& path,
+                              const std::string& data, int32_t version) {
+      return Awaitable<StatResult>(executor_,
+          [&](Completion<StatResult>& completion) {
+            return zk_.set(path, data, version, completion);
+          });
+    }
+
+    Awaitable<CreateResult> create(const std::string& path,
+                                   const std::string& data,
+                                   const std::vector<data::ACL>& acl,
+                                   CreateMode::type mode) {
+      return Awaitable<CreateResult>(executor_,
+          [&](Completion<CreateResult>& completion) {
+            return zk_.create(path, data, acl, mode, completion);
+          });
+    }
+
+    Awaitable<RemoveResult> remove(const std::string& path, int32_t version) {
+      return Awaitable<RemoveResult>(executor_,
+          [&](Completion<RemoveResult>& completion) {
+            return zk_.remove(path, version, completion);
+          });
+    }
+
+    Awaitable<GetChildrenResult> getChildren(const std::string& path,
+        boost::shared_ptr<Watch> watch = boost::shared_ptr<Watch>()) {
+      return Awaitable<GetChildrenResult>(executor_,
+          [&](Completion<GetChildrenResult>& completion) {
+            return zk_.getChildren(path, watch, completion);
+          });
+    }
+
+    Awaitable<GetAclResult> getAcl(const std::string& path) {
+      return Awaitable<GetAclResult>(executor_,
+          [&](Completion<GetAclResult>& completion) {
+            return zk_.getAcl(path, completion);
+          });
+    }
+
+    Awaitable<MultiResult> multi(const boost::ptr_vector<Op>& ops) {
+      return Awaitable<MultiResult>(executor_,
+          [&](Completion<MultiResult>& completion) {
+            return zk_.multi(ops, completion);
+          });
+    }
+
+  private:
+    ZooKeeper& zk_;
+    Executor* executor_;
+};
+
+}}}  // namespace org::apache::zookeeper
+
+#endif  // SRC_CONTRIB_ZKCPP_INCLUDE_COROUTINE_H_
@@ -0,0 +1,297 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_CONTRIB_ZKCPP_INCLUDE_FUTURE_H_
+#define SRC_CONTRIB_ZKCPP_INCLUDE_FUTURE_H_
+
+#include <boost/intrusive_ptr.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+#include <string>
+#include <vector>
+#include "zookeeper.jute.hh"
+#include "zookeeper_const.hh"
+#include "zookeeper_multi.hh"
+
+namespace org { namespace apache { namespace zookeeper {
+
+/**
+ * Result of ZooKeeper::get().
+ */
+struct GetResult {
+  ReturnCode::type rc;
+  std::string data;  // Valid iff rc == ReturnCode::Ok.
+  data::Stat stat;   // Valid iff rc == ReturnCode::Ok.
+};
+
+/**
+ * Result of ZooKeeper::exists() and ZooKeeper::set().
+ */
+struct StatResult {
+  ReturnCode::type rc;
+  data::Stat stat;  // Valid iff rc == ReturnCode::Ok.
+};
+
+/**
+ * Result of ZooKeeper::create().
+ */
+struct CreateResult {
+  ReturnCode::type rc;
+  std::string pathCreated;  // Valid iff rc == ReturnCode::Ok.
+};
+
+/**
+ * Result of ZooKeeper::remove().
+ */
+struct RemoveResult {
+  ReturnCode::type rc;
+};
+
+/**
+ * Result of ZooKeeper::getChildren().
+ */
+struct GetChildrenResult {
+  ReturnCode::type rc;
+  std::vector<std::string> children;  // Valid iff rc == ReturnCode::Ok.
+  data::Stat stat;                    // Valid iff rc == ReturnCode::Ok.
+};
+
+/**
+ * Result of ZooKeeper::getAcl().
+ */
+struct GetAclResult {
+  ReturnCode::type rc;
+  std::vector<data::ACL> acl;  // Valid iff rc == ReturnCode::Ok.
+  data::Stat stat;             // Valid iff rc == ReturnCode::Ok.
+};
+
+/**
+ * Result of ZooKeeper::multi().
+ */
+struct MultiResult {
+  MultiResult() : rc(ReturnCode::Ok) {}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+  // boost::ptr_vector can neither be moved nor, as OpResult cannot be
+  // cloned, copied; swapping the results lets a MultiResult be moved.
+  MultiResult(MultiResult&& other) : rc(other.rc) {
+    results.swap(other.results);
+  }
+
+  MultiResult& operator=(MultiResult&& other) {
+    rc = other.rc;
+    results.swap(other.results);
+    return *this;
+  }
+#endif
+
+  ReturnCode::type rc;
+  boost::ptr_vector<OpResult> results;
+};
+
+/**
+ * A request whose result is written in place, in memory owned by the caller.
+ *
+ * Once the request has completed, result is set and done is called with
+ * this completion; the completion must stay valid until then. This is what
+ * futures and coroutine awaitables are built on, and it lets them issue
+ * requests without allocating anything themselves.
+ */
+template <typename T>
+struct Completion {
+  T result;
+  void (*done)(Completion<T>* completion);
+};
+
+namespace internal {
+
+/**
+ * The mutex and the condition that all the futures of one ZooKeeper object
+ * wait on. Completing a request only signals the condition when a thread is
+ * waiting, so requests nobody blocks on cost one uncontended lock.
+ */
+class FutureWaiter : boost::noncopyable {
+  public:
+    FutureWaiter() : waiters_(0), refs_(0) {}
+
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    int waiters_;
+    boost::detail::atomic_count refs_;
+};
+
+inline void intrusive_ptr_add_ref(FutureWaiter* waiter) {
+  ++waiter->refs_;
+}
+
+inline void intrusive_ptr_release(FutureWaiter* waiter) {
+  if (--waiter->refs_ == 0) {
+    delete waiter;
+  }
+}
+
+template <typename T>
+class SharedState;
+
+template <typename T>
+void intrusive_ptr_add_ref(SharedState<T>* state);
+
+template <typename T>
+void intrusive_ptr_release(SharedState<T>* state);
+
+/**
+ * The state a Future shares with the completion of its request: the result
+ * and whether it has been set. It is allocated once per request and
+ * reference counted by the futures and by the pending request, whose
+ * reference is released when the request is done.
+ */
+template <typename T>
+class SharedState : public Completion<T>, boost::noncopyable {
+  public:
+    explicit SharedState(const boost::intrusive_ptr<FutureWaiter>& waiter) :
+      waiter_(waiter), ready_(false), refs_(0) {
+      this->result.rc = ReturnCode::Ok;
+      this->done = &requestDone;
+    }
+
+    /**
+     * Publishes the result, which must not be changed afterwards.
+     */
+    void setReady() {
+      boost::lock_guard<boost::mutex> lock(waiter_->mutex_);
+      ready_ = true;
+      if (waiter_->waiters_ > 0) {
+        waiter_->cond_.notify_all();
+      }
+    }
+
+    bool isReady() {
+      boost::lock_guard<boost::mutex> lock(waiter_->mutex_);
+      return ready_;
+    }
+
+    void wait() {
+      boost::unique_lock<boost::mutex> lock(waiter_->mutex_);
+      if (ready_) {
+        return;
+      }
+      waiter_->waiters_++;
+      while (!ready_) {
+        waiter_->cond_.wait(lock);
+      }
+      waiter_->waiters_--;
+    }
+
+  private:
+    friend void intrusive_ptr_add_ref<T>(SharedState<T>* state);
+    friend void intrusive_ptr_release<T>(SharedState<T>* state);
+
+    static void requestDone(Completion<T>* completion) {
+      SharedState<T>* state = static_cast<SharedState<T>*>(completion);
+      state->setReady();
+      intrusive_ptr_release(state);
+    }
+
+    boost::intrusive_ptr<FutureWaiter> waiter_;
+    bool ready_;
+    boost::detail::atomic_count refs_;
+};
+
+template <typename T>
+inline void intrusive_ptr_add_ref(SharedState<T>* state) {
+  ++state->refs_;
+}
+
+template <typename T>
+inline void intrusive_ptr_release(SharedState<T>* state) {
+  if (--state->refs_ == 0) {
+    delete state;
+  }
+}
+}  // namespace internal
+
+/**
+ * The result of an asynchronous request, available once the request has
+ * completed.
+ *
+ * Futures are cheap to copy; all the copies refer to the same result. Like
+ * the result of a synchronous call, it is set by the ZooKeeper IO thread, so
+ * a future may be waited on from a Watch or a callback too; the completion
+ * thread then runs nothing else until the result is in.
+ */
+template <typename T>
+class Future {
+  public:
+    /**
+     * Constructs a future that does not refer to any request.
+     */
+    Future() {}
+
+    explicit Future(internal::SharedState<T>* state) : state_(state) {}
+
+    /**
+     * @return true if this future refers to a request.
+     */
+    bool valid() const {
+      return state_.get() != NULL;
+    }
+
+    /**
+     * @return true if the request has completed, without waiting for it.
+     */
+    bool isReady() const {
+      return state_->isReady();
+    }
+
+    /**
+     * Blocks until the request has completed.
+     */
+    void wait() const {
+      state_->wait();
+    }
+
+    /**
+     * Blocks until the request has completed and returns its result. The
+     * rc field of the result is either the error that kept the request from
+     * being sent or the result code of the request.
+     */
+    const T& get() const {
+      state_->wait();
+      return state_->result;
+    }
+
+  private:
+    boost::intrusive_ptr<internal::SharedState<T> > state_;
+};
+
+/**
+ * Blocks until all the futures in [begin, end) have completed.
+ */
+template <typename Iterator>
+void waitAll(Iterator begin, Iterator end) {
+  for (; begin != end; ++begin) {
+    begin->wait();
+  }
+}
+
+}}}  // namespace org::apache::zookeeper
+
+#endif  // SRC_CONTRIB_ZKCPP_INCLUDE_FUTURE_H_
@@ -26,6 +26,7 @@
 #include <string>
 #include <vector>
 #include "zookeeper.jute.hh"
+#include "future.hh"
 #include "zookeeper_const.hh"
 #include "zookeeper_multi.hh"
 
@@ -528,6 +529,166 @@ class ZooKeeper : boost::noncopyable {
     ReturnCode::type multi(const boost::ptr_vector<Op>& ops,
                            boost::ptr_vector<OpResult>& results);
 
+    /**
+     * Gets the data associated with a znode, returning a future.
+     *
+     * Unlike the synchronous version, any number of these requests can be
+     * outstanding; the caller only blocks when it calls Future::get(). This
+     * makes it cheap to issue many reads and wait for all of them with
+     * waitAll(). The future is ready immediately if the request could not
+     * be sent, with the error in GetResult::rc.
+     *
+     * @param path The name of the znode.
+     * @param watch If non-null, a watch will be set at the server to notify
+     * the client if the znode changes.
+     */
+    Future<GetResult> get(const std::string& path,
+        boost::shared_ptr<Watch> watch = boost::shared_ptr<Watch>());
+
+    /**
+     * Checks the existence of a znode, returning a future.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>)
+     */
+    Future<StatResult> exists(const std::string& path,
+        boost::shared_ptr<Watch> watch = boost::shared_ptr<Watch>());
+
+    /**
+     * Sets the data associated with a znode, returning a future.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>)
+     */
+    Future<StatResult> set(const std::string& path, const std::string& data,
+                           int32_t version);
+
+    /**
+     * Creates a znode, returning a future.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>)
+     */
+    Future<CreateResult> create(const std::string& path,
+                                const std::string& data,
+                                const std::vector<data::ACL>& acl,
+                                CreateMode::type mode);
+
+    /**
+     * Gets the children and the stat of a znode, returning a future.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>)
+     */
+    Future<GetChildrenResult> getChildren(const std::string& path,
+        boost::shared_ptr<Watch> watch = boost::shared_ptr<Watch>());
+
+    /**
+     * Gets the acl associated with a znode, returning a future.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>)
+     */
+    Future<GetAclResult> getAcl(const std::string& path);
+
+    /**
+     * Atomically executes multiple operations, returning a future.
+     *
+     * remove() and setAcl() have no future version, as it would only differ
+     * from the synchronous one in its return type; use multi() with a single
+     * operation instead.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>)
+     */
+    Future<MultiResult> multi(const boost::ptr_vector<Op>& ops);
+
+    /**
+     * Gets the data associated with a znode, writing the result into a
+     * Completion owned by the caller.
+     *
+     * Nothing is allocated for the completion, which makes this the building
+     * block for other asynchronous interfaces, like the coroutine awaitables
+     * in zookeeper/coroutine.hh. Completion::done is called from the
+     * completion thread, and the completion must stay valid until then. It
+     * is not called if the request could not be sent.
+     *
+     * @param path The name of the znode.
+     * @param watch If non-null, a watch will be set at the server to notify
+     * the client if the znode changes.
+     * @param completion Receives the result.
+     *
+     * @return ReturnCode::Ok if the request has been enqueued successfully.
+     */
+    ReturnCode::type get(const std::string& path,
+                         boost::shared_ptr<Watch> watch,
+                         Completion<GetResult>& completion);
+
+    /**
+     * Checks the existence of a znode, writing the result into a Completion.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>,
+     *          Completion<GetResult>&)
+     */
+    ReturnCode::type exists(const std::string& path,
+                            boost::shared_ptr<Watch> watch,
+                            Completion<StatResult>& completion);
+
+    /**
+     * Sets the data associated with a znode, writing the result into a
+     * Completion.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>,
+     *          Completion<GetResult>&)
+     */
+    ReturnCode::type set(const std::string& path, const std::string& data,
+                         int32_t version, Completion<StatResult>& completion);
+
+    /**
+     * Creates a znode, writing the result into a Completion.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>,
+     *          Completion<GetResult>&)
+     */
+    ReturnCode::type create(const std::string& path, const std::string& data,
+                            const std::vector<data::ACL>& acl,
+                            CreateMode::type mode,
+                            Completion<CreateResult>& completion);
+
+    /**
+     * Removes a znode, writing the result into a Completion.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>,
+     *          Completion<GetResult>&)
+     */
+    ReturnCode::type remove(const std::string& path, int32_t version,
+                            Completion<RemoveResult>& completion);
+
+    /**
+     * Gets the children and the stat of a znode, writing the result into a
+     * Completion.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>,
+     *          Completion<GetResult>&)
+     */
+    ReturnCode::type getChildren(const std::string& path,
+                                 boost::shared_ptr<Watch> watch,
+                                 Completion<GetChildrenResult>& completion);
+
+    /**
+     * Gets the acl associated with a znode, writing the result into a
+     * Completion.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>,
+     *          Completion<GetResult>&)
+     */
+    ReturnCode::type getAcl(const std::string& path,
+                            Completion<GetAclResult>& completion);
+
+    /**
+     * Atomically executes multiple operations, writing the result into a
+     * Completion.
+     *
+     * @see get(const std::string&, boost::shared_ptr<Watch>,
+     *          Completion<GetResult>&)
+     */
+    ReturnCode::type multi(const boost::ptr_vector<Op>& ops,
+                           Completion<MultiResult>& completion);
+
     /**
      * Closes this ZooKeeper session.
      *
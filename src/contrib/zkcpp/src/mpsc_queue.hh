@@ -0,0 +1,180 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SRC_CONTRIB_ZKCPP_SRC_MPSC_QUEUE_HH_
+#define SRC_CONTRIB_ZKCPP_SRC_MPSC_QUEUE_HH_
+
+#include <boost/atomic.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+namespace org {
+namespace apache {
+namespace zookeeper {
+
+/**
+ * The link of an element of an MpscQueue. Elements derive from it, so that
+ * queueing them allocates nothing; an element can be in one queue at a time.
+ */
+class MpscNode {
+  public:
+    MpscNode() : next_(NULL) {}
+    MpscNode(const MpscNode&) : next_(NULL) {}
+    MpscNode& operator=(const MpscNode&) {
+      return *this;
+    }
+
+  private:
+    template <typename T> friend class MpscQueue;
+    boost::atomic<MpscNode*> next_;
+};
+
+/**
+ * An intrusive, unbounded multiple producer single consumer queue, after
+ * Dmitry Vyukov's.
+ *
+ * push() never blocks and can be called from any thread. The other methods
+ * take elements off the queue and must be called by one thread at a time,
+ * the consumer; empty() can also be called by other threads, which get a
+ * snapshot.
+ */
+template <typename T>
+class MpscQueue : boost::noncopyable {
+  public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+
+    void push(T* element) {
+      link(element);
+    }
+
+    /**
+     * @return the oldest element, or NULL if there is none. The element is
+     *         left in the queue.
+     */
+    T* front() {
+      MpscNode* tail = tail_.load(boost::memory_order_relaxed);
+      if (tail == &stub_) {
+        tail = stub_.next_.load(boost::memory_order_acquire);
+        if (tail == NULL) {
+          return NULL;
+        }
+        tail_.store(tail, boost::memory_order_relaxed);
+      }
+      return static_cast<T*>(tail);
+    }
+
+    /**
+     * Removes the oldest element.
+     *
+     * @return the element removed, or NULL if the queue was empty.
+     */
+    T* pop() {
+      T* element = front();
+      if (element == NULL) {
+        return NULL;
+      }
+      if (element == head_.load(boost::memory_order_acquire)) {
+        // Put the stub back behind the last element, so that it can be
+        // taken off without leaving the queue without a node.
+        link(&stub_);
+      }
+      MpscNode* next;
+      // A producer that has taken the place of the head links it to its
+      // element right away; wait for it to do so.
+      while ((next = element->next_.load(boost::memory_order_acquire)) ==
+             NULL) {
+        boost::this_thread::yield();
+      }
+      tail_.store(next, boost::memory_order_relaxed);
+      return element;
+    }
+
+    /**
+     * @return true if there is no element in the queue. An element whose
+     *         push() is still in progress counts, though front() may not
+     *         return it yet.
+     */
+    bool empty() const {
+      return tail_.load(boost::memory_order_relaxed) == &stub_ &&
+             head_.load(boost::memory_order_seq_cst) == &stub_;
+    }
+
+  private:
+    void link(MpscNode* node) {
+      node->next_.store(NULL, boost::memory_order_relaxed);
+      MpscNode* prev = head_.exchange(node, boost::memory_order_seq_cst);
+      prev->next_.store(node, boost::memory_order_release);
+    }
+
+    boost::atomic<MpscNode*> head_;  // The last element pushed.
+    boost::atomic<MpscNode*> tail_;  // The next element to pop.
+    MpscNode stub_;
+};
+
+/**
+ * An MpscQueue whose consumer can wait for elements.
+ *
+ * A waiting consumer spins briefly and then parks on a condition variable.
+ * Producers only take the mutex to wake the consumer up once it has parked,
+ * so pushing onto a busy queue costs no more than onto an MpscQueue.
+ */
+template <typename T>
+class ParkingMpscQueue : public MpscQueue<T> {
+  public:
+    ParkingMpscQueue() : parked_(false) {}
+
+    void push(T* element) {
+      MpscQueue<T>::push(element);
+      // Either this sees the consumer parked or the consumer sees the
+      // element: both the push and the load are sequentially consistent.
+      if (parked_.load(boost::memory_order_seq_cst)) {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        cond_.notify_one();
+      }
+    }
+
+    /**
+     * Blocks the consumer until the queue is not empty.
+     */
+    void wait() {
+      for (int i = 0; i < SPIN_COUNT; i++) {
+        if (!this->empty()) {
+          return;
+        }
+      }
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      parked_.store(true, boost::memory_order_seq_cst);
+      while (this->empty()) {
+        cond_.wait(lock);
+      }
+      parked_.store(false, boost::memory_order_relaxed);
+    }
+
+  private:
+    // The number of times wait() checks the queue before parking.
+    static const int SPIN_COUNT = 100;
+
+    boost::atomic<bool> parked_;
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+};
+
+}}}  // namespace org::apache::zookeeper
+
+#endif  // SRC_CONTRIB_ZKCPP_SRC_MPSC_QUEUE_HH_
@@ -163,12 +163,9 @@ do_completion(zhandle_t* zh) {
   LOG_DEBUG("started completion thread");
   ReturnCode::type rc = ReturnCode::Ok;
   while(rc != ReturnCode::InvalidState) {
-    boost::unique_lock<boost::mutex> lock(*(zh->completions_to_process.lock));
-    while(zh->completions_to_process.completions.empty() &&
-          !zh->close_requested) {
-      (*(zh->completions_to_process.cond)).wait(lock);
-    }
-    lock.unlock();
+    // zookeeper_close() queues the completion of death, so this wakes up
+    // when the handle is closed too.
+    zh->completions_to_process.wait();
     rc = process_completions(zh);
   }
   zh->threads.io.join();
@@ -20,11 +20,10 @@
 #define ZK_ADAPTOR_H_
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
-#include <boost/thread/recursive_mutex.hpp>
 #include <boost/thread/condition.hpp>
 #include <boost/ptr_container/ptr_list.hpp>
-#include <queue>
 #include <zookeeper/zookeeper_const.hh>
+#include "mpsc_queue.hh"
 #include "zookeeper.h"
 #include "watch_manager.hh"
 
@@ -45,7 +44,7 @@ class completion_list_t;
 /**
  * This structure represents a packet being read or written.
  */
-class buffer_t {
+class buffer_t : public MpscNode {
   public:
     buffer_t() : buffer(""), length(0), offset(0) {
     }
@@ -54,10 +53,14 @@ class buffer_t {
     int32_t offset;
 };
 
+/**
+ * A queue of buffers. Any thread can queue a buffer without locking; the
+ * threads taking buffers off hold the mutex.
+ */
 class buffer_list_t {
   public:
-    boost::ptr_list<buffer_t> bufferList_;
-    boost::recursive_mutex mutex_;
+    MpscQueue<buffer_t> buffers_;
+    boost::mutex mutex_;
 };
 
 class completion_t {
@@ -78,7 +81,7 @@ class completion_t {
     bool isSynchronous;
 };
 
-class completion_list_t {
+class completion_list_t : public MpscNode {
   public:
     int xid;
     completion_t c;
@@ -87,12 +90,12 @@ class completion_list_t {
     boost::scoped_ptr<WatchRegistration> watch;
 };
 
-class completion_head_t {
-  public:
-    std::queue<completion_list_t*> completions;
-    boost::shared_ptr<boost::condition_variable> cond;
-    boost::shared_ptr<boost::mutex> lock;
-};
+/**
+ * A queue of completions. Any thread can queue a completion; only one
+ * thread takes them off: the IO thread for sent_requests, and the
+ * completion thread, which waits for them, for completions_to_process.
+ */
+typedef ParkingMpscQueue<completion_list_t> completion_head_t;
 
 class auth_info {
   public:
@@ -147,7 +150,7 @@ class zhandle_t {
     /** used for chroot path at the client side **/
     std::string chroot;
     boost::mutex mutex; // critical section lock
-    static completion_list_t completionOfDeath;
+    completion_list_t completionOfDeath; /* queued to stop the completion thread */
 };
 
 int adaptor_init(zhandle_t *zh);
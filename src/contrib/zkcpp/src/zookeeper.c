@@ -68,7 +68,6 @@ ENABLE_LOGGING;
 #endif
 
 using namespace org::apache::zookeeper;
-completion_list_t zhandle_t::completionOfDeath;
 const int ZOOKEEPER_WRITE = 1 << 0;
 const int ZOOKEEPER_READ = 1 << 1;
 
@@ -89,10 +88,10 @@ static const char* format_current_endpoint_info(zhandle_t* zh);
 
 /* deserialize forward declarations */
 static void deserialize_response(int type, int xid, ReturnCode::type rc,
-    completion_list_t *cptr, hadoop::IBinArchive& iarchive,
+    completion_list_t *cptr, hadoop::IArchive& iarchive,
      const std::string& chroot);
 static int deserialize_multi(int xid, completion_list_t *cptr,
-                             hadoop::IBinArchive& iarchive,
+                             hadoop::IArchive& iarchive,
                              boost::ptr_vector<OpResult>& results);
 
 /* completion routine forward declarations */
@@ -104,6 +103,7 @@ static completion_list_t* create_completion_entry(int xid, int completion_type,
         boost::ptr_vector<OpResult>* results, bool isSynchronous);
 static void destroy_completion_entry(completion_list_t* c);
 static void queue_completion(completion_head_t *list, completion_list_t *c);
+completion_list_t* dequeue_completion(completion_head_t* list);
 static ReturnCode::type handle_socket_error_msg(zhandle_t *zh, int line, ReturnCode::type rc,
                                   const std::string& message);
 static void cleanup_bufs(zhandle_t *zh, int rc);
@@ -376,10 +376,6 @@ zhandle_t *zookeeper_init(const char *host, boost::shared_ptr<Watch> watch,
                     host % recv_timeout % watch % flags);
 
     zh = new zhandle_t();
-    zh->sent_requests.lock.reset(new boost::mutex());
-    zh->sent_requests.cond.reset(new boost::condition_variable());
-    zh->completions_to_process.lock.reset(new boost::mutex());
-    zh->completions_to_process.cond.reset(new boost::condition_variable());
 
     zh->fd = -1;
     zh->state = SessionState::Connecting;
@@ -436,11 +432,8 @@ abort:
 }
 
 static buffer_t *dequeue_buffer(buffer_list_t *list) {
-  boost::lock_guard<boost::recursive_mutex> lock(list->mutex_);
-  if (list->bufferList_.empty()) {
-    return NULL;
-  }
-  return list->bufferList_.release(list->bufferList_.begin()).release();
+  boost::lock_guard<boost::mutex> lock(list->mutex_);
+  return list->buffers_.pop();
 }
 
 static int remove_buffer(buffer_list_t *list)
@@ -455,8 +448,7 @@ static int remove_buffer(buffer_list_t *list)
 
 static void
 queue_buffer(buffer_list_t *list, buffer_t* b) {
-  boost::lock_guard<boost::recursive_mutex> lock(list->mutex_);
-  list->bufferList_.push_back(b);
+  list->buffers_.push(b);
 }
 
 /* returns:
@@ -560,19 +552,16 @@ void free_buffers(buffer_list_t *list)
 
 void free_completions(zhandle_t *zh, int reason) {
   {
-    boost::lock_guard<boost::mutex> lock(*(zh->sent_requests.lock));
-    while (!zh->sent_requests.completions.empty()) {
-      completion_list_t *cptr = zh->sent_requests.completions.front();
-      zh->sent_requests.completions.pop();
-
-      if (cptr == &zhandle_t::completionOfDeath) {
+    completion_list_t *cptr;
+    while ((cptr = dequeue_completion(&zh->sent_requests)) != NULL) {
+      if (cptr == &zh->completionOfDeath) {
         LOG_DEBUG("Packet of death! do somethign");
       } else if(cptr->xid == PING_XID){
         // Nothing to do with a ping response
         destroy_completion_entry(cptr);
       } else if (cptr->c.isSynchronous) {
         MemoryInStream stream(NULL, 0);
-        hadoop::IBinArchive iarchive(stream);
+        hadoop::IDirectBinArchive<MemoryInStream> iarchive(stream);
         deserialize_response(cptr->c.type, cptr->xid,
             (ReturnCode::type)reason, cptr, iarchive, zh->chroot);
         destroy_completion_entry(cptr);
@@ -582,7 +571,7 @@ void free_completions(zhandle_t *zh, int reason) {
             cptr->xid);
         buffer_t *bptr = new buffer_t();
         StringOutStream stream(bptr->buffer);
-        hadoop::OBinArchive oarchive(stream);
+        hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
         proto::ReplyHeader header;
         header.setxid(cptr->xid);
         header.setzxid(-1);
@@ -592,7 +581,6 @@ void free_completions(zhandle_t *zh, int reason) {
         queue_completion(&zh->completions_to_process, cptr);
       }
     }
-    (*(zh->sent_requests.cond)).notify_all();
   }
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
@@ -675,7 +663,7 @@ static int send_info_packet(zhandle_t *zh, auth_info* auth) {
   int rc = 0;
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(AUTH_XID);
@@ -734,7 +722,7 @@ send_set_watches(zhandle_t *zh) {
 
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(SET_WATCHES_XID);
@@ -759,7 +747,7 @@ sendConnectRequest(zhandle_t *zh) {
   int rc;
   std::string serialized;
   StringOutStream stream(serialized);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::ConnectRequest request;
   request.setprotocolVersion(0);
@@ -811,7 +799,7 @@ send_ping(zhandle_t* zh) {
   std::string serialized;
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(PING_XID);
@@ -914,7 +902,7 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
         // a PING
         if (zh->state==SessionState::Connected) {
             send_to = zh->recv_timeout/3 - idle_send;
-            if (send_to <= 0 && zh->sent_requests.completions.empty()) {
+            if (send_to <= 0 && zh->sent_requests.empty()) {
 //                LOG_DEBUG(("Sending PING to %s (exceeded idle by %dms)",
 //                                format_current_endpoint_info(zh),-send_to));
                 int rc=send_ping(zh);
@@ -936,7 +924,7 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
         *interest = ZOOKEEPER_READ;
         /* we are interested in a write if we are connected and have something
          * to send, or we are waiting for a connect to finish. */
-        if ((!zh->to_send.bufferList_.empty() &&
+        if ((!zh->to_send.buffers_.empty() &&
             zh->state == SessionState::Connected) ||
             zh->state == SessionState::Connecting) {
             *interest |= ZOOKEEPER_WRITE;
@@ -970,7 +958,7 @@ check_events(zhandle_t *zh, int events)
                 format_endpoint_info(&zh->addrs[zh->connect_index]));
         return ReturnCode::Ok;
     }
-    if (!(zh->to_send.bufferList_.empty()) && (events&ZOOKEEPER_WRITE)) {
+    if (!(zh->to_send.buffers_.empty()) && (events&ZOOKEEPER_WRITE)) {
         /* make the flush call non-blocking by specifying a 0 timeout */
         ReturnCode::type returnCode = flush_send_queue(zh,0);
         if (returnCode == ReturnCode::InvalidState) {
@@ -997,14 +985,13 @@ check_events(zhandle_t *zh, int events)
         if (rc > 0) {
             gettimeofday(&zh->last_recv, 0);
             if (zh->state != SessionState::Associating) {
-                boost::lock_guard<boost::recursive_mutex> lock(zh->to_process.mutex_);
-                zh->to_process.bufferList_.push_back(zh->input_buffer);
+                queue_buffer(&zh->to_process, zh->input_buffer);
             } else  {
                 // Process connect response.
                 int64_t oldid,newid;
                 MemoryInStream istream(zh->input_buffer->buffer.data(),
                                        zh->input_buffer->length);
-                hadoop::IBinArchive iarchive(istream);
+                hadoop::IDirectBinArchive<MemoryInStream> iarchive(istream);
                 zh->connectResponse.deserialize(iarchive,"connect");
 
                 /* We are processing the connect response , so we need to finish
@@ -1046,7 +1033,7 @@ static int queue_session_event(zhandle_t *zh, SessionState::type state) {
             SessionState::toString(state));
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
   completion_list_t *cptr;
   proto::ReplyHeader header;
   header.setxid(WATCHER_EVENT_XID);
@@ -1071,19 +1058,12 @@ static int queue_session_event(zhandle_t *zh, SessionState::type state) {
 
 completion_list_t*
 dequeue_completion(completion_head_t* list) {
-  boost::lock_guard<boost::mutex> lock(*(list->lock));
-  completion_list_t *cptr = NULL;
-  if (!list->completions.empty()) {
-    cptr = list->completions.front();
-    list->completions.pop();
-  }
-  list->cond->notify_all();
-  return cptr;
+  return list->pop();
 }
 
 static int
 deserialize_multi(int xid, completion_list_t *cptr,
-                  hadoop::IBinArchive& iarchive,
+                  hadoop::IArchive& iarchive,
                   boost::ptr_vector<OpResult>& results) {
 
   boost::ptr_vector<OpResult> temp;
@@ -1152,7 +1132,7 @@ deserialize_multi(int xid, completion_list_t *cptr,
 }
 
 static void deserialize_response(int type, int xid, ReturnCode::type rc,
-    completion_list_t *cptr, hadoop::IBinArchive& iarchive,
+    completion_list_t *cptr, hadoop::IArchive& iarchive,
     const std::string& chroot) {
   switch (type) {
     case COMPLETION_DATA:
@@ -1263,13 +1243,13 @@ static void deserialize_response(int type, int xid, ReturnCode::type rc,
 ReturnCode::type process_completions(zhandle_t *zh) {
   completion_list_t *cptr;
   while ((cptr = dequeue_completion(&zh->completions_to_process)) != 0) {
-    if (cptr == &zhandle_t::completionOfDeath) {
+    if (cptr == &zh->completionOfDeath) {
       LOG_DEBUG("Received the completion of death");
       return ReturnCode::InvalidState;
     }
     buffer_t *bptr = cptr->buffer;
     MemoryInStream stream(bptr->buffer.data(), bptr->buffer.size());
-    hadoop::IBinArchive iarchive(stream);
+    hadoop::IDirectBinArchive<MemoryInStream> iarchive(stream);
     proto::ReplyHeader header;
     header.deserialize(iarchive, "header");
 
@@ -1308,7 +1288,7 @@ zookeeper_process(zhandle_t *zh, int events) {
   }
   while (rc >= 0 && (bptr=dequeue_buffer(&zh->to_process))) {
     MemoryInStream stream(bptr->buffer.data(), bptr->length);
-    hadoop::IBinArchive iarchive(stream);
+    hadoop::IDirectBinArchive<MemoryInStream> iarchive(stream);
     proto::ReplyHeader header;
     header.deserialize(iarchive, "header");
 
@@ -1451,9 +1431,7 @@ static void destroy_completion_entry(completion_list_t* c) {
 
 static void
 queue_completion(completion_head_t *list, completion_list_t *c) {
-  boost::lock_guard<boost::mutex> lock(*(list->lock));
-  list->completions.push(c);
-  list->cond->notify_all();
+  list->push(c);
 }
 
 static int add_completion(zhandle_t *zh, int xid, int completion_type,
@@ -1527,7 +1505,7 @@ zookeeper_close(zhandle_t *zh) {
   }
   zh->close_requested = 1;
   LOG_DEBUG("Enqueueing the completion of death");
-  queue_completion(&zh->completions_to_process, &zhandle_t::completionOfDeath);
+  queue_completion(&zh->completions_to_process, &zh->completionOfDeath);
   if (boost::this_thread::get_id() == zh->threads.completion.get_id()) {
     // completion thread
     wakeup_io_thread(zh);
@@ -1547,7 +1525,7 @@ zookeeper_close(zhandle_t *zh) {
   if(zh->state==SessionState::Connected){
     buffer_t* buffer = new buffer_t();
     StringOutStream stream(buffer->buffer);
-    hadoop::OBinArchive oarchive(stream);
+    hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
     proto::RequestHeader header;
     header.setxid(get_xid());
@@ -1577,6 +1555,38 @@ static ReturnCode::type getRealString(zhandle_t *zh, int flags, const std::strin
   return ReturnCode::Ok;
 }
 
+/* Like getRealString(), but only copies the path if there is a chroot. */
+static const std::string&
+getRealPath(zhandle_t *zh, const std::string& path, std::string& pathStr) {
+  if (zh->chroot.empty()) {
+    return path;
+  }
+  pathStr = PathUtils::prependChroot(path, zh->chroot);
+  return pathStr;
+}
+
+/* The serialized lengths of the fields of a request */
+#define REQUEST_HEADER_LENGTH (2 * sizeof(int32_t))
+#define STRING_LENGTH(s) (sizeof(int32_t) + (s).size())
+
+/*
+ * Creates the buffer of a request of the given length, without the header,
+ * and serializes the header into it. As the buffer is allocated at its
+ * final size, serializing the fields copies each of them exactly once.
+ */
+static buffer_t*
+create_request_buffer(int32_t xid, OpCode::type type, size_t length) {
+  buffer_t* buffer = new buffer_t();
+  buffer->buffer.reserve(REQUEST_HEADER_LENGTH + length);
+  StringOutStream stream(buffer->buffer);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
+  proto::RequestHeader header;
+  header.setxid(xid);
+  header.settype(type);
+  header.serialize(oarchive, "header");
+  return buffer;
+}
+
 /*---------------------------------------------------------------------------*
  * ASYNC API
  *---------------------------------------------------------------------------*/
@@ -1584,25 +1594,22 @@ int zoo_awget(zhandle_t *zh, const std::string& path,
         boost::shared_ptr<Watch> watch,
         data_completion_t dc, const void *data, bool isSynchronous)
 {
-  std::string pathStr;
-  int rc = getRealString(zh, 0, path, pathStr);
-  if (rc != ReturnCode::Ok) {
-    return rc;
+  if (zh == NULL) {
+    return ReturnCode::BadArguments;
   }
+  std::string chrootPath;
+  const std::string& pathStr = getRealPath(zh, path, chrootPath);
+  int32_t xid = get_xid();
+  int rc = 0;
 
-  buffer_t* buffer = new buffer_t();
+  /* the fields of a proto::GetDataRequest, written without copying them
+   * into one first */
+  buffer_t* buffer = create_request_buffer(xid, OpCode::GetData,
+      STRING_LENGTH(pathStr) + sizeof(bool));
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
-
-  proto::RequestHeader header;
-  header.setxid(get_xid());
-  header.settype(OpCode::GetData);
-  header.serialize(oarchive, "header");
-
-  proto::GetDataRequest req;
-  req.getpath() = pathStr;
-  req.setwatch(watch.get() != NULL);
-  req.serialize(oarchive, "req");
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
+  oarchive.serialize(pathStr, "path");
+  oarchive.serialize(watch.get() != NULL, "watch");
 
   WatchRegistration* reg = NULL;
   if (watch.get() != NULL) {
@@ -1610,55 +1617,46 @@ int zoo_awget(zhandle_t *zh, const std::string& path,
   }
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
-    rc = rc < 0 ? rc : add_data_completion(zh, header.getxid(), dc, data,
-        reg, isSynchronous);
+    rc = add_data_completion(zh, xid, dc, data, reg, isSynchronous);
     queue_buffer(&zh->to_send, buffer);
   }
 
   LOG_DEBUG(boost::format("Sending a get request xid=%#08x for path [%s] to %s") %
-      header.getxid() % pathStr % format_current_endpoint_info(zh));
+      xid % pathStr % format_current_endpoint_info(zh));
   /* make a best (non-blocking) effort to send the requests asap */
   adaptor_send_queue(zh, 0);
   return (rc < 0)?ReturnCode::MarshallingError:ReturnCode::Ok;
 }
 
-int zoo_aset(zhandle_t *zh, const std::string& path, const char *buf, int buflen,
+int zoo_aset(zhandle_t *zh, const std::string& path, const std::string& buf,
         int version, stat_completion_t dc, const void *data, bool isSynchronous)
 {
-  std::string pathStr;
-  int rc = getRealString(zh, 0, path, pathStr);
-  if (rc != ReturnCode::Ok) {
-    return rc;
+  if (zh == NULL) {
+    return ReturnCode::BadArguments;
   }
+  std::string chrootPath;
+  const std::string& pathStr = getRealPath(zh, path, chrootPath);
+  int32_t xid = get_xid();
+  int rc = 0;
 
-  buffer_t* buffer = new buffer_t();
+  /* the fields of a proto::SetDataRequest: the data is only copied into
+   * the request buffer */
+  buffer_t* buffer = create_request_buffer(xid, OpCode::SetData,
+      STRING_LENGTH(pathStr) + STRING_LENGTH(buf) + sizeof(int32_t));
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
-
-  proto::RequestHeader header;
-  header.setxid(get_xid());
-  header.settype(OpCode::SetData);
-  header.serialize(oarchive, "header");
-
-  proto::SetDataRequest req;
-  req.getpath() = pathStr;
-  if (buf != NULL && buflen >= 0) {
-    req.getdata() = std::string(buf, buflen);
-  } else {
-    req.getdata() = "";
-  }
-  req.setversion(version);
-  req.serialize(oarchive, "req");
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
+  oarchive.serialize(pathStr, "path");
+  oarchive.serialize(buf, buf.size(), "data");
+  oarchive.serialize((int32_t)version, "version");
 
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
-    rc = rc < 0 ? rc : add_stat_completion(zh, header.getxid(), dc, data,0,
-        isSynchronous);
+    rc = add_stat_completion(zh, xid, dc, data, 0, isSynchronous);
     queue_buffer(&zh->to_send, buffer);
   }
 
   LOG_DEBUG(boost::format("Sending set request xid=%#08x for path [%s] to %s") %
-      header.getxid() % path % format_current_endpoint_info(zh));
+      xid % path % format_current_endpoint_info(zh));
   /* make a best (non-blocking) effort to send the requests asap */
   adaptor_send_queue(zh, 0);
   return (rc < 0)?ReturnCode::MarshallingError:ReturnCode::Ok;
@@ -1677,7 +1675,7 @@ ReturnCode::type zoo_acreate(zhandle_t *zh, const std::string& path, const char
 
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
@@ -1718,7 +1716,7 @@ int zoo_adelete(zhandle_t *zh, const std::string& path, int version,
 
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
@@ -1756,7 +1754,7 @@ int zoo_awexists(zhandle_t *zh, const std::string& path,
 
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
@@ -1799,7 +1797,7 @@ int zoo_awget_children2(zhandle_t *zh, const std::string& path,
 
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
@@ -1840,7 +1838,7 @@ int zoo_async(zhandle_t *zh, const std::string& path,
 
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
@@ -1875,7 +1873,7 @@ int zoo_aget_acl(zhandle_t *zh, const std::string& path, acl_completion_t comple
 
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
@@ -1911,7 +1909,7 @@ int zoo_aset_acl(zhandle_t *zh, const std::string& path, int version,
 
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
@@ -1943,7 +1941,7 @@ int zoo_amulti(zhandle_t *zh,
     multi_completion_t completion, const void *data, bool isSynchronous) {
   buffer_t* buffer = new buffer_t();
   StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::ODirectBinArchive<StringOutStream> oarchive(stream);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
@@ -2046,11 +2044,11 @@ flush_send_queue(zhandle_t*zh, int timeout) {
   gettimeofday(&started,0);
   // we can't use dequeue_buffer() here because if (non-blocking) send_buffer()
   // returns EWOULDBLOCK we'd have to put the buffer back on the queue.
-  // we use a recursive lock instead and only dequeue the buffer if a send was
-  // successful
+  // we only dequeue the buffer at the front once it has been sent instead.
   {
-    boost::lock_guard<boost::recursive_mutex> lock(zh->to_send.mutex_);
-    while (!(zh->to_send.bufferList_.empty()) &&
+    boost::lock_guard<boost::mutex> lock(zh->to_send.mutex_);
+    buffer_t *bptr;
+    while ((bptr = zh->to_send.buffers_.front()) != NULL &&
            zh->state == SessionState::Connected) {
       if(timeout != 0){
         int elapsed;
@@ -2072,7 +2070,7 @@ flush_send_queue(zhandle_t*zh, int timeout) {
         }
       }
 
-      rc = send_buffer(zh->fd, &(zh->to_send.bufferList_.front()));
+      rc = send_buffer(zh->fd, bptr);
       if(rc == 0 && timeout == 0){
         /* send_buffer would block while sending this buffer */
         return ReturnCode::Ok;
@@ -2082,7 +2080,7 @@ flush_send_queue(zhandle_t*zh, int timeout) {
       }
       // if the buffer has been sent successfully, remove it from the queue
       if (rc > 0) {
-        remove_buffer(&zh->to_send);
+        delete zh->to_send.buffers_.pop();
       }
       gettimeofday(&zh->last_send, 0);
     }
@@ -164,6 +164,89 @@ multi(const boost::ptr_vector<Op>& ops,
   return impl_->multi(ops, results);
 }
 
+Future<GetResult> ZooKeeper::
+get(const std::string& path, boost::shared_ptr<Watch> watch) {
+  return impl_->get(path, watch);
+}
+
+Future<StatResult> ZooKeeper::
+exists(const std::string& path, boost::shared_ptr<Watch> watch) {
+  return impl_->exists(path, watch);
+}
+
+Future<StatResult> ZooKeeper::
+set(const std::string& path, const std::string& data, int32_t version) {
+  return impl_->set(path, data, version);
+}
+
+Future<CreateResult> ZooKeeper::
+create(const std::string& path, const std::string& data,
+       const std::vector<data::ACL>& acl, CreateMode::type mode) {
+  return impl_->create(path, data, acl, mode);
+}
+
+Future<GetChildrenResult> ZooKeeper::
+getChildren(const std::string& path, boost::shared_ptr<Watch> watch) {
+  return impl_->getChildren(path, watch);
+}
+
+Future<GetAclResult> ZooKeeper::
+getAcl(const std::string& path) {
+  return impl_->getAcl(path);
+}
+
+Future<MultiResult> ZooKeeper::
+multi(const boost::ptr_vector<Op>& ops) {
+  return impl_->multi(ops);
+}
+
+ReturnCode::type ZooKeeper::
+get(const std::string& path, boost::shared_ptr<Watch> watch,
+    Completion<GetResult>& completion) {
+  return impl_->get(path, watch, completion, false);
+}
+
+ReturnCode::type ZooKeeper::
+exists(const std::string& path, boost::shared_ptr<Watch> watch,
+       Completion<StatResult>& completion) {
+  return impl_->exists(path, watch, completion, false);
+}
+
+ReturnCode::type ZooKeeper::
+set(const std::string& path, const std::string& data, int32_t version,
+    Completion<StatResult>& completion) {
+  return impl_->set(path, data, version, completion, false);
+}
+
+ReturnCode::type ZooKeeper::
+create(const std::string& path, const std::string& data,
+       const std::vector<data::ACL>& acl, CreateMode::type mode,
+       Completion<CreateResult>& completion) {
+  return impl_->create(path, data, acl, mode, completion, false);
+}
+
+ReturnCode::type ZooKeeper::
+remove(const std::string& path, int32_t version,
+       Completion<RemoveResult>& completion) {
+  return impl_->remove(path, version, completion, false);
+}
+
+ReturnCode::type ZooKeeper::
+getChildren(const std::string& path, boost::shared_ptr<Watch> watch,
+            Completion<GetChildrenResult>& completion) {
+  return impl_->getChildren(path, watch, completion, false);
+}
+
+ReturnCode::type ZooKeeper::
+getAcl(const std::string& path, Completion<GetAclResult>& completion) {
+  return impl_->getAcl(path, completion, false);
+}
+
+ReturnCode::type ZooKeeper::
+multi(const boost::ptr_vector<Op>& ops, Completion<MultiResult>& completion) {
+  return impl_->multi(ops, completion, false);
+}
+
 SessionState::type ZooKeeper::
 getState() {
   return impl_->getState();
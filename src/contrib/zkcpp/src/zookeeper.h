@@ -81,7 +81,7 @@ int zoo_aget(zhandle_t *zh, const std::string& path, int watch,
 int zoo_awget(zhandle_t *zh, const std::string& path,
         boost::shared_ptr<Watch> watch,
         data_completion_t completion, const void *data, bool isSynchronous);
-int zoo_aset(zhandle_t *zh, const std::string& path, const char *buffer, int buflen, 
+int zoo_aset(zhandle_t *zh, const std::string& path, const std::string& buffer,
         int version, stat_completion_t completion, const void *data,
         bool isSynchronous);
 int zoo_awget_children2(zhandle_t *zh, const std::string& path,
@@ -402,8 +402,85 @@ multiCompletion(int rc, const boost::ptr_vector<OpResult>& results,
   delete context;
 }
 
+template <typename T>
+void ZooKeeperImpl::
+complete(Completion<T>* completion, int rc) {
+  completion->result.rc = (ReturnCode::type)rc;
+  completion->done(completion);
+}
+
+void ZooKeeperImpl::
+getResultCompletion(int rc, const std::string& value,
+                    const data::Stat& stat, const void* data) {
+  Completion<GetResult>* completion = (Completion<GetResult>*)data;
+  completion->result.data = value;
+  completion->result.stat = stat;
+  complete(completion, rc);
+}
+
+void ZooKeeperImpl::
+statResultCompletion(int rc, const data::Stat& stat, const void* data) {
+  Completion<StatResult>* completion = (Completion<StatResult>*)data;
+  completion->result.stat = stat;
+  complete(completion, rc);
+}
+
+void ZooKeeperImpl::
+createResultCompletion(int rc, const std::string& value, const void* data) {
+  Completion<CreateResult>* completion = (Completion<CreateResult>*)data;
+  completion->result.pathCreated = value;
+  complete(completion, rc);
+}
+
+void ZooKeeperImpl::
+removeResultCompletion(int rc, const void* data) {
+  Completion<RemoveResult>* completion = (Completion<RemoveResult>*)data;
+  complete(completion, rc);
+}
+
+void ZooKeeperImpl::
+getChildrenResultCompletion(int rc, const std::vector<std::string>& children,
+                            const data::Stat& stat, const void* data) {
+  Completion<GetChildrenResult>* completion =
+    (Completion<GetChildrenResult>*)data;
+  completion->result.children = children;
+  completion->result.stat = stat;
+  complete(completion, rc);
+}
+
+void ZooKeeperImpl::
+getAclResultCompletion(int rc, const std::vector<data::ACL>& acl,
+                       const data::Stat& stat, const void* data) {
+  Completion<GetAclResult>* completion = (Completion<GetAclResult>*)data;
+  completion->result.acl = acl;
+  completion->result.stat = stat;
+  complete(completion, rc);
+}
+
+void ZooKeeperImpl::
+multiResultCompletion(int rc, const boost::ptr_vector<OpResult>& results,
+                      const void* data) {
+  Completion<MultiResult>* completion = (Completion<MultiResult>*)data;
+  boost::ptr_vector<OpResult>& res = (boost::ptr_vector<OpResult>&)results;
+  completion->result.results.clear();
+  while (res.begin() != res.end()) {
+    completion->result.results.push_back(res.release(res.begin()).release());
+  }
+  complete(completion, rc);
+}
+
+template <typename T>
+internal::SharedState<T>* ZooKeeperImpl::
+newFutureState() {
+  internal::SharedState<T>* state = new internal::SharedState<T>(waiter_);
+  // Released when the request is done.
+  intrusive_ptr_add_ref(state);
+  return state;
+}
+
 ZooKeeperImpl::
-ZooKeeperImpl() : handle_(NULL), inited_(false), state_(SessionState::Expired) {
+ZooKeeperImpl() : handle_(NULL), inited_(false), state_(SessionState::Expired),
+                  waiter_(new internal::FutureWaiter()) {
 }
 
 ZooKeeperImpl::
@@ -462,7 +539,7 @@ create(const std::string& path, const std::string& data,
     completion = &stringCompletion;
     context = new CompletionContext(callback, path);
   }
-  ReturnCode::type rc = zoo_acreate(handle_, path.c_str(), data.c_str(), data.size(),
+  ReturnCode::type rc = zoo_acreate(handle_, path, data.c_str(), data.size(),
                        acl, mode, completion, (void*)context, isSynchronous);
   if (rc != ReturnCode::Ok) {
     delete context;
@@ -496,7 +573,7 @@ remove(const std::string& path, int32_t version,
     completion = &removeCompletion;
     context = new CompletionContext(callback, path);
   }
-  int rc = zoo_adelete(handle_, path.c_str(), version,
+  int rc = zoo_adelete(handle_, path, version,
          completion, (void*)context, isSynchronous);
   return (ReturnCode::type)rc;
 }
@@ -523,7 +600,7 @@ exists(const std::string& path, boost::shared_ptr<Watch> watch,
     completion = &existsCompletion;
     completionContext = new CompletionContext(cb, path);
   }
-  int rc = zoo_awexists(handle_, path.c_str(), watch,
+  int rc = zoo_awexists(handle_, path, watch,
                         completion,  (void*)completionContext, isSynchronous);
   return (ReturnCode::type)rc;
 }
@@ -552,7 +629,7 @@ get(const std::string& path, boost::shared_ptr<Watch> watch,
     context = new CompletionContext(cb, path);
   }
 
-  int rc = zoo_awget(handle_, path.c_str(), watch,
+  int rc = zoo_awget(handle_, path, watch,
                     completion, (void*)context, isSynchronous);
   return (ReturnCode::type)rc;
 }
@@ -580,7 +657,7 @@ set(const std::string& path, const std::string& data,
     context = new CompletionContext(cb, path);
   }
 
-  int rc = zoo_aset(handle_, path.c_str(), data.c_str(), data.size(), version,
+  int rc = zoo_aset(handle_, path, data, version,
                     completion, (void*)context, isSynchronous);
   return (ReturnCode::type)rc;
 }
@@ -611,7 +688,7 @@ getChildren(const std::string& path, boost::shared_ptr<Watch> watch,
     context = new CompletionContext(cb, path);
   }
 
-  int rc = zoo_awget_children2(handle_, path.c_str(), watch,
+  int rc = zoo_awget_children2(handle_, path, watch,
                                completion, (void*)context,
                                isSynchronous);
   return (ReturnCode::type)rc;
@@ -640,7 +717,7 @@ getAcl(const std::string& path, boost::shared_ptr<GetAclCallback> cb,
     completion = &aclCompletion;
     context = new CompletionContext(cb, path);
   }
-  int rc = zoo_aget_acl(handle_, path.c_str(), completion, (void*)context,
+  int rc = zoo_aget_acl(handle_, path, completion, (void*)context,
                         isSynchronous);
   return (ReturnCode::type)rc;
 }
@@ -671,7 +748,7 @@ setAcl(const std::string& path, int32_t version,
     context = new CompletionContext(cb, path);
   }
 
-  int rc = zoo_aset_acl(handle_, path.c_str(), version, acl, completion,
+  int rc = zoo_aset_acl(handle_, path, version, acl, completion,
                          (void*)context, isSynchronous);
   return (ReturnCode::type)rc;
 }
@@ -697,7 +774,7 @@ sync(const std::string& path, boost::shared_ptr<SyncCallback> cb) {
     completion = &syncCompletion;
     context = new CompletionContext(cb, path);
   }
-  return (ReturnCode::type)zoo_async(handle_, path.c_str(),
+  return (ReturnCode::type)zoo_async(handle_, path,
          completion, context);
 }
 
@@ -727,6 +804,144 @@ multi(const boost::ptr_vector<Op>& ops,
   return callback->rc_;
 }
 
+ReturnCode::type ZooKeeperImpl::
+get(const std::string& path, boost::shared_ptr<Watch> watch,
+    Completion<GetResult>& completion, bool isSynchronous) {
+  return (ReturnCode::type)zoo_awget(handle_, path, watch,
+      &getResultCompletion, &completion, isSynchronous);
+}
+
+ReturnCode::type ZooKeeperImpl::
+exists(const std::string& path, boost::shared_ptr<Watch> watch,
+       Completion<StatResult>& completion, bool isSynchronous) {
+  return (ReturnCode::type)zoo_awexists(handle_, path, watch,
+      &statResultCompletion, &completion, isSynchronous);
+}
+
+ReturnCode::type ZooKeeperImpl::
+set(const std::string& path, const std::string& data, int32_t version,
+    Completion<StatResult>& completion, bool isSynchronous) {
+  return (ReturnCode::type)zoo_aset(handle_, path, data, version,
+      &statResultCompletion, &completion, isSynchronous);
+}
+
+ReturnCode::type ZooKeeperImpl::
+create(const std::string& path, const std::string& data,
+       const std::vector<data::ACL>& acl, CreateMode::type mode,
+       Completion<CreateResult>& completion, bool isSynchronous) {
+  return zoo_acreate(handle_, path, data.c_str(), data.size(),
+      acl, mode, &createResultCompletion, &completion, isSynchronous);
+}
+
+ReturnCode::type ZooKeeperImpl::
+remove(const std::string& path, int32_t version,
+       Completion<RemoveResult>& completion, bool isSynchronous) {
+  return (ReturnCode::type)zoo_adelete(handle_, path, version,
+      &removeResultCompletion, &completion, isSynchronous);
+}
+
+ReturnCode::type ZooKeeperImpl::
+getChildren(const std::string& path, boost::shared_ptr<Watch> watch,
+            Completion<GetChildrenResult>& completion, bool isSynchronous) {
+  return (ReturnCode::type)zoo_awget_children2(handle_, path, watch,
+      &getChildrenResultCompletion, &completion, isSynchronous);
+}
+
+ReturnCode::type ZooKeeperImpl::
+getAcl(const std::string& path, Completion<GetAclResult>& completion,
+       bool isSynchronous) {
+  return (ReturnCode::type)zoo_aget_acl(handle_, path,
+      &getAclResultCompletion, &completion, isSynchronous);
+}
+
+ReturnCode::type ZooKeeperImpl::
+multi(const boost::ptr_vector<Op>& ops, Completion<MultiResult>& completion,
+      bool isSynchronous) {
+  return (ReturnCode::type)zoo_amulti(handle_, ops, &multiResultCompletion,
+      &completion, isSynchronous);
+}
+
+// The future requests complete in the IO thread like the synchronous ones,
+// since the result is only moved into the shared state.
+Future<GetResult> ZooKeeperImpl::
+get(const std::string& path, boost::shared_ptr<Watch> watch) {
+  internal::SharedState<GetResult>* state = newFutureState<GetResult>();
+  Future<GetResult> future(state);
+  ReturnCode::type rc = get(path, watch, *state, true);
+  if (rc != ReturnCode::Ok) {
+    complete(state, rc);
+  }
+  return future;
+}
+
+Future<StatResult> ZooKeeperImpl::
+exists(const std::string& path, boost::shared_ptr<Watch> watch) {
+  internal::SharedState<StatResult>* state = newFutureState<StatResult>();
+  Future<StatResult> future(state);
+  ReturnCode::type rc = exists(path, watch, *state, true);
+  if (rc != ReturnCode::Ok) {
+    complete(state, rc);
+  }
+  return future;
+}
+
+Future<StatResult> ZooKeeperImpl::
+set(const std::string& path, const std::string& data, int32_t version) {
+  internal::SharedState<StatResult>* state = newFutureState<StatResult>();
+  Future<StatResult> future(state);
+  ReturnCode::type rc = set(path, data, version, *state, true);
+  if (rc != ReturnCode::Ok) {
+    complete(state, rc);
+  }
+  return future;
+}
+
+Future<CreateResult> ZooKeeperImpl::
+create(const std::string& path, const std::string& data,
+       const std::vector<data::ACL>& acl, CreateMode::type mode) {
+  internal::SharedState<CreateResult>* state = newFutureState<CreateResult>();
+  Future<CreateResult> future(state);
+  ReturnCode::type rc = create(path, data, acl, mode, *state, true);
+  if (rc != ReturnCode::Ok) {
+    complete(state, rc);
+  }
+  return future;
+}
+
+Future<GetChildrenResult> ZooKeeperImpl::
+getChildren(const std::string& path, boost::shared_ptr<Watch> watch) {
+  internal::SharedState<GetChildrenResult>* state =
+    newFutureState<GetChildrenResult>();
+  Future<GetChildrenResult> future(state);
+  ReturnCode::type rc = getChildren(path, watch, *state, true);
+  if (rc != ReturnCode::Ok) {
+    complete(state, rc);
+  }
+  return future;
+}
+
+Future<GetAclResult> ZooKeeperImpl::
+getAcl(const std::string& path) {
+  internal::SharedState<GetAclResult>* state = newFutureState<GetAclResult>();
+  Future<GetAclResult> future(state);
+  ReturnCode::type rc = getAcl(path, *state, true);
+  if (rc != ReturnCode::Ok) {
+    complete(state, rc);
+  }
+  return future;
+}
+
+Future<MultiResult> ZooKeeperImpl::
+multi(const boost::ptr_vector<Op>& ops) {
+  internal::SharedState<MultiResult>* state = newFutureState<MultiResult>();
+  Future<MultiResult> future(state);
+  ReturnCode::type rc = multi(ops, *state, true);
+  if (rc != ReturnCode::Ok) {
+    complete(state, rc);
+  }
+  return future;
+}
+
 ReturnCode::type ZooKeeperImpl::
 close() {
   if (!inited_) {
@@ -91,6 +91,49 @@ class ZooKeeperImpl {
                            bool isSynchronous);
     ReturnCode::type multi(const boost::ptr_vector<Op>& ops,
                            boost::ptr_vector<OpResult>& results);
+    ReturnCode::type get(const std::string& path,
+                         boost::shared_ptr<Watch> watch,
+                         Completion<GetResult>& completion,
+                         bool isSynchronous);
+    ReturnCode::type exists(const std::string& path,
+                            boost::shared_ptr<Watch> watch,
+                            Completion<StatResult>& completion,
+                            bool isSynchronous);
+    ReturnCode::type set(const std::string& path, const std::string& data,
+                         int32_t version, Completion<StatResult>& completion,
+                         bool isSynchronous);
+    ReturnCode::type create(const std::string& path, const std::string& data,
+                            const std::vector<data::ACL>& acl,
+                            CreateMode::type mode,
+                            Completion<CreateResult>& completion,
+                            bool isSynchronous);
+    ReturnCode::type remove(const std::string& path, int32_t version,
+                            Completion<RemoveResult>& completion,
+                            bool isSynchronous);
+    ReturnCode::type getChildren(const std::string& path,
+                                 boost::shared_ptr<Watch> watch,
+                                 Completion<GetChildrenResult>& completion,
+                                 bool isSynchronous);
+    ReturnCode::type getAcl(const std::string& path,
+                            Completion<GetAclResult>& completion,
+                            bool isSynchronous);
+    ReturnCode::type multi(const boost::ptr_vector<Op>& ops,
+                           Completion<MultiResult>& completion,
+                           bool isSynchronous);
+    Future<GetResult> get(const std::string& path,
+                          boost::shared_ptr<Watch> watch);
+    Future<StatResult> exists(const std::string& path,
+                              boost::shared_ptr<Watch> watch);
+    Future<StatResult> set(const std::string& path, const std::string& data,
+                           int32_t version);
+    Future<CreateResult> create(const std::string& path,
+                                const std::string& data,
+                                const std::vector<data::ACL>& acl,
+                                CreateMode::type mode);
+    Future<GetChildrenResult> getChildren(const std::string& path,
+                                          boost::shared_ptr<Watch> watch);
+    Future<GetAclResult> getAcl(const std::string& path);
+    Future<MultiResult> multi(const boost::ptr_vector<Op>& ops);
     ReturnCode::type close();
     SessionState::type getState();
     void setState(SessionState::type state);
@@ -117,9 +160,33 @@ class ZooKeeperImpl {
     static void syncCompletion(int rc, const char *value, const void *data);
     static void multiCompletion(int rc,
       const boost::ptr_vector<OpResult>& results, const void* data);
+
+    // Completions of the requests that write their result in place. The
+    // data is the Completion.
+    template <typename T>
+    static void complete(Completion<T>* completion, int rc);
+    static void getResultCompletion(int rc, const std::string& value,
+                                    const data::Stat& stat, const void *data);
+    static void statResultCompletion(int rc, const data::Stat& stat,
+                                     const void* data);
+    static void createResultCompletion(int rc, const std::string& value,
+                                       const void *data);
+    static void removeResultCompletion(int rc, const void *data);
+    static void getChildrenResultCompletion(int rc,
+        const std::vector<std::string>& children, const data::Stat& stat,
+        const void *data);
+    static void getAclResultCompletion(int rc,
+        const std::vector<data::ACL>& acl, const data::Stat& stat,
+        const void *data);
+    static void multiResultCompletion(int rc,
+      const boost::ptr_vector<OpResult>& results, const void* data);
+    template <typename T>
+    internal::SharedState<T>* newFutureState();
+
     zhandle_t* handle_;
     bool inited_;
     SessionState::type state_;
+    boost::intrusive_ptr<internal::FutureWaiter> waiter_;
 };
 }}}
 
@@ -0,0 +1,235 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Built with -std=c++20 when the compiler supports it; see CMakeLists.txt.
+#ifdef __cpp_impl_coroutine
+
+#include <gtest/gtest.h>
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <zookeeper/coroutine.hh>
+#include <zookeeper/logging.hh>
+ENABLE_LOGGING;
+
+#include "zk_server.hh"
+
+using namespace boost;
+using namespace org::apache::zookeeper;
+
+// Runs until its first suspension when called, and frees its frame when it
+// returns.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return Detached(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Holds on to the completion of a request instead of sending it.
+template <typename T>
+struct HeldRequest {
+  HeldRequest() : completion(NULL) {}
+  ReturnCode::type operator()(Completion<T>& c) {
+    completion = &c;
+    return ReturnCode::Ok;
+  }
+  void complete(ReturnCode::type rc) {
+    completion->result.rc = rc;
+    completion->done(completion);
+  }
+  Completion<T>* completion;
+};
+
+class QueueExecutor : public Executor {
+  public:
+    void execute(std::coroutine_handle<> handle) {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      handles.push_back(handle);
+    }
+
+    // Resumes the queued coroutines on the calling thread.
+    int run() {
+      int count = 0;
+      while (true) {
+        std::coroutine_handle<> handle;
+        {
+          boost::lock_guard<boost::mutex> lock(mutex);
+          if (handles.empty()) {
+            return count;
+          }
+          handle = handles.front();
+          handles.pop_front();
+        }
+        handle.resume();
+        count++;
+      }
+    }
+
+    boost::mutex mutex;
+    std::deque<std::coroutine_handle<> > handles;
+};
+
+static Detached awaitHeld(HeldRequest<StatResult>& request,
+                          Executor* executor, StatResult& result,
+                          bool& resumed) {
+  result = co_await Awaitable<StatResult>(executor, std::ref(request));
+  resumed = true;
+}
+
+TEST(Awaitable, completedBeforeAwait) {
+  StatResult result;
+  bool resumed = false;
+  // Completes as soon as it is sent, without suspending the coroutine.
+  auto complete = [&](Completion<StatResult>& completion) {
+    completion.result.rc = ReturnCode::Ok;
+    completion.result.stat.setversion(3);
+    completion.done(&completion);
+    return ReturnCode::Ok;
+  };
+  [&]() -> Detached {
+    result = co_await Awaitable<StatResult>(NULL, complete);
+    resumed = true;
+  }();
+  EXPECT_TRUE(resumed);
+  EXPECT_EQ(ReturnCode::Ok, result.rc);
+  EXPECT_EQ(3, result.stat.getversion());
+}
+
+TEST(Awaitable, resumedByCompletion) {
+  StatResult result;
+  bool resumed = false;
+  HeldRequest<StatResult> request;
+  awaitHeld(request, NULL, result, resumed);
+  EXPECT_FALSE(resumed);
+  ASSERT_TRUE(request.completion != NULL);
+
+  boost::thread completer(&HeldRequest<StatResult>::complete, &request,
+                          ReturnCode::NoNode);
+  completer.join();
+  EXPECT_TRUE(resumed);
+  EXPECT_EQ(ReturnCode::NoNode, result.rc);
+}
+
+TEST(Awaitable, resumedByExecutor) {
+  StatResult result;
+  bool resumed = false;
+  HeldRequest<StatResult> request;
+  QueueExecutor executor;
+  awaitHeld(request, &executor, result, resumed);
+  request.complete(ReturnCode::Ok);
+  EXPECT_FALSE(resumed);
+  EXPECT_EQ(1, executor.run());
+  EXPECT_TRUE(resumed);
+  EXPECT_EQ(ReturnCode::Ok, result.rc);
+}
+
+TEST(Awaitable, notSent) {
+  ZooKeeper zk;
+  AwaitableZooKeeper azk(zk);
+  GetResult result;
+  bool resumed = false;
+  [&]() -> Detached {
+    result = co_await azk.get("/path");
+    resumed = true;
+  }();
+  EXPECT_TRUE(resumed);
+  EXPECT_EQ(ReturnCode::BadArguments, result.rc);
+}
+
+class ConnectWatch : public Watch {
+  public:
+    ConnectWatch() : connected(false) {}
+    void process(WatchEvent::type event, SessionState::type state,
+        const std::string& path) {
+      if (event == WatchEvent::SessionStateChanged &&
+          state == SessionState::Connected) {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        connected = true;
+        cond.notify_all();
+      }
+    }
+    void waitForConnected() {
+      boost::unique_lock<boost::mutex> lock(mutex);
+      while (!connected) {
+        cond.wait(lock);
+      }
+    }
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool connected;
+};
+
+static Detached useZooKeeper(AwaitableZooKeeper& azk, const std::string& path,
+                             bool& finished) {
+  std::vector<data::ACL> acl;
+  data::ACL temp;
+  temp.getid().getscheme() = "world";
+  temp.getid().getid() = "anyone";
+  temp.setperms(Permission::All);
+  acl.push_back(temp);
+
+  EXPECT_EQ(ReturnCode::NoNode, (co_await azk.get(path)).rc);
+  CreateResult created = co_await azk.create(path, "hello", acl,
+                                             CreateMode::Persistent);
+  EXPECT_EQ(ReturnCode::Ok, created.rc);
+  EXPECT_EQ(path, created.pathCreated);
+
+  // Both requests are outstanding before the first is awaited.
+  Awaitable<GetResult> get = azk.get(path);
+  Awaitable<StatResult> exists = azk.exists(path);
+  GetResult data = co_await get;
+  EXPECT_EQ(ReturnCode::Ok, data.rc);
+  EXPECT_EQ("hello", data.data);
+  EXPECT_EQ(ReturnCode::Ok, (co_await exists).rc);
+
+  StatResult set = co_await azk.set(path, "goodbye", 0);
+  EXPECT_EQ(ReturnCode::Ok, set.rc);
+  EXPECT_EQ(1, set.stat.getversion());
+
+  boost::ptr_vector<Op> ops;
+  ops.push_back(new Op::Check(path, 1));
+  ops.push_back(new Op::Remove(path, 1));
+  MultiResult multi = co_await azk.multi(ops);
+  EXPECT_EQ(ReturnCode::Ok, multi.rc);
+  EXPECT_EQ(2, (int)multi.results.size());
+  EXPECT_EQ(ReturnCode::NoNode, (co_await azk.remove(path, -1)).rc);
+  finished = true;
+}
+
+TEST(CppClient, testCoroutine) {
+  ZooKeeper zk;
+  shared_ptr<ConnectWatch> watch(new ConnectWatch());
+  EXPECT_EQ(ReturnCode::Ok, zk.init(ZkServer::HOST_PORT, 30000, watch));
+  watch->waitForConnected();
+
+  QueueExecutor executor;
+  AwaitableZooKeeper azk(zk, &executor);
+  bool finished = false;
+  useZooKeeper(azk, "/testCoroutine", finished);
+  // Resume the coroutine on this thread.
+  while (!finished) {
+    if (executor.run() == 0) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+  }
+}
+
+#endif  // __cpp_impl_coroutine
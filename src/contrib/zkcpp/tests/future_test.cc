@@ -0,0 +1,88 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <zookeeper/zookeeper.hh>
+#include <zookeeper/logging.hh>
+ENABLE_LOGGING;
+
+using namespace boost;
+using namespace org::apache::zookeeper;
+
+static void completeAll(std::vector<internal::SharedState<GetResult>*>* states) {
+  for (size_t i = 0; i < states->size(); i++) {
+    internal::SharedState<GetResult>* state = (*states)[i];
+    state->result.data = "data";
+    state->result.stat.setversion(i);
+    state->done(state);
+  }
+}
+
+TEST(Future, waitAll) {
+  intrusive_ptr<internal::FutureWaiter> waiter(new internal::FutureWaiter());
+  std::vector<internal::SharedState<GetResult>*> states;
+  std::vector<Future<GetResult> > futures;
+  for (int i = 0; i < 500; i++) {
+    internal::SharedState<GetResult>* state =
+      new internal::SharedState<GetResult>(waiter);
+    // The reference of the pending request, released by done.
+    intrusive_ptr_add_ref(state);
+    states.push_back(state);
+    futures.push_back(Future<GetResult>(state));
+  }
+  EXPECT_TRUE(futures[0].valid());
+  EXPECT_FALSE(futures[0].isReady());
+
+  boost::thread completer(boost::bind(&completeAll, &states));
+  waitAll(futures.begin(), futures.end());
+  for (size_t i = 0; i < futures.size(); i++) {
+    EXPECT_TRUE(futures[i].isReady());
+    EXPECT_EQ(ReturnCode::Ok, futures[i].get().rc);
+    EXPECT_EQ("data", futures[i].get().data);
+    EXPECT_EQ((int32_t)i, futures[i].get().stat.getversion());
+  }
+  completer.join();
+}
+
+TEST(Future, copies) {
+  intrusive_ptr<internal::FutureWaiter> waiter(new internal::FutureWaiter());
+  Future<CreateResult> empty;
+  EXPECT_FALSE(empty.valid());
+
+  internal::SharedState<CreateResult>* state =
+    new internal::SharedState<CreateResult>(waiter);
+  Future<CreateResult> future(state);
+  Future<CreateResult> copy = future;
+  state->result.rc = ReturnCode::NodeExists;
+  state->setReady();
+  EXPECT_TRUE(copy.isReady());
+  EXPECT_EQ(ReturnCode::NodeExists, copy.get().rc);
+
+  // The waiter outlives the ZooKeeper object if a future does.
+  waiter.reset();
+  future = Future<CreateResult>();
+  EXPECT_EQ(ReturnCode::NodeExists, copy.get().rc);
+}
+
+TEST(Future, notSent) {
+  ZooKeeper zk;
+  Future<GetResult> future = zk.get("/path");
+  EXPECT_TRUE(future.isReady());
+  EXPECT_EQ(ReturnCode::BadArguments, future.get().rc);
+}
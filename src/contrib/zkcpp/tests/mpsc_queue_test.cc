@@ -0,0 +1,107 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/thread.hpp>
+#include "mpsc_queue.hh"
+
+using namespace org::apache::zookeeper;
+
+struct Item : public MpscNode {
+  Item(int producer, int seq) : producer(producer), seq(seq) {}
+  int producer;
+  int seq;
+};
+
+TEST(MpscQueue, fifo) {
+  MpscQueue<Item> queue;
+  Item a(0, 0), b(0, 1), c(0, 2);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(queue.front() == NULL);
+  EXPECT_TRUE(queue.pop() == NULL);
+
+  queue.push(&a);
+  queue.push(&b);
+  EXPECT_FALSE(queue.empty());
+  EXPECT_EQ(&a, queue.front());
+  EXPECT_EQ(&a, queue.front());
+  EXPECT_EQ(&a, queue.pop());
+  queue.push(&c);
+  EXPECT_EQ(&b, queue.pop());
+  EXPECT_EQ(&c, queue.front());
+  EXPECT_EQ(&c, queue.pop());
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(queue.pop() == NULL);
+
+  // An element can be queued again once it has been taken off.
+  queue.push(&a);
+  EXPECT_EQ(&a, queue.pop());
+  EXPECT_TRUE(queue.empty());
+}
+
+static void produce(ParkingMpscQueue<Item>* queue, boost::ptr_vector<Item>* items) {
+  for (size_t i = 0; i < items->size(); i++) {
+    queue->push(&(*items)[i]);
+  }
+}
+
+TEST(MpscQueue, producers) {
+  const int producers = 4;
+  const int count = 20000;
+  ParkingMpscQueue<Item> queue;
+  boost::ptr_vector<boost::ptr_vector<Item> > items(producers);
+  for (int p = 0; p < producers; p++) {
+    items.push_back(new boost::ptr_vector<Item>());
+    for (int i = 0; i < count; i++) {
+      items[p].push_back(new Item(p, i));
+    }
+  }
+  boost::thread_group threads;
+  for (int p = 0; p < producers; p++) {
+    threads.create_thread(boost::bind(produce, &queue, &items[p]));
+  }
+
+  // Each producer's elements come out in the order it pushed them.
+  std::vector<int> next(producers, 0);
+  for (int received = 0; received < producers * count; received++) {
+    Item* item;
+    while ((item = queue.pop()) == NULL) {
+      queue.wait();
+    }
+    ASSERT_EQ(next[item->producer], item->seq);
+    next[item->producer]++;
+  }
+  threads.join_all();
+  EXPECT_TRUE(queue.empty());
+}
+
+static void pushLater(ParkingMpscQueue<Item>* queue, Item* item) {
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  queue->push(item);
+}
+
+TEST(ParkingMpscQueue, wait) {
+  ParkingMpscQueue<Item> queue;
+  Item item(0, 0);
+  boost::thread producer(pushLater, &queue, &item);
+  // Parks until the item has been pushed.
+  queue.wait();
+  EXPECT_EQ(&item, queue.pop());
+  producer.join();
+}
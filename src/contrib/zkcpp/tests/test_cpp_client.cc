@@ -346,6 +346,74 @@ TEST(CppClient, testBasic) {
   EXPECT_EQ(ReturnCode::NoNode, rc);
 }
 
+TEST(CppClient, testFuture) {
+  ZooKeeper zk;
+  std::string znodeName = "/testFuture";
+  std::vector<data::ACL> acl;
+  data::ACL temp;
+  temp.getid().getscheme() = "world";
+  temp.getid().getid() = "anyone";
+  temp.setperms(Permission::All);
+  acl.push_back(temp);
+
+  shared_ptr<TestInitWatch> watch(new TestInitWatch());
+  EXPECT_EQ(ReturnCode::Ok, zk.init(ZkServer::HOST_PORT, 30000, watch));
+
+  EXPECT_EQ(ReturnCode::NoNode, zk.get(znodeName).get().rc);
+  EXPECT_EQ(ReturnCode::NoNode, zk.exists(znodeName).get().rc);
+
+  Future<CreateResult> created = zk.create(znodeName, "hello", acl,
+                                           CreateMode::Persistent);
+  EXPECT_EQ(ReturnCode::Ok, created.get().rc);
+  EXPECT_EQ(znodeName, created.get().pathCreated);
+
+  // Fan out creates and reads, then join them.
+  const int numChildren = 200;
+  std::vector<Future<CreateResult> > creates;
+  for (int i = 0; i < numChildren; i++) {
+    creates.push_back(zk.create(str(boost::format("%s/child%d") %
+                                    znodeName % i),
+                                str(boost::format("data%d") % i), acl,
+                                CreateMode::Persistent));
+  }
+  waitAll(creates.begin(), creates.end());
+  std::vector<Future<GetResult> > gets;
+  for (int i = 0; i < numChildren; i++) {
+    EXPECT_EQ(ReturnCode::Ok, creates[i].get().rc);
+    gets.push_back(zk.get(str(boost::format("%s/child%d") % znodeName % i)));
+  }
+  waitAll(gets.begin(), gets.end());
+  for (int i = 0; i < numChildren; i++) {
+    EXPECT_EQ(ReturnCode::Ok, gets[i].get().rc);
+    EXPECT_EQ(str(boost::format("data%d") % i), gets[i].get().data);
+  }
+
+  Future<GetChildrenResult> children = zk.getChildren(znodeName);
+  EXPECT_EQ(ReturnCode::Ok, children.get().rc);
+  EXPECT_EQ(numChildren, (int)children.get().children.size());
+  EXPECT_EQ(numChildren, children.get().stat.getnumChildren());
+
+  Future<StatResult> set = zk.set(znodeName, "goodbye", 0);
+  EXPECT_EQ(ReturnCode::Ok, set.get().rc);
+  EXPECT_EQ(1, set.get().stat.getversion());
+  EXPECT_EQ(ReturnCode::BadVersion, zk.set(znodeName, "hello", 0).get().rc);
+
+  Future<GetAclResult> getAcl = zk.getAcl(znodeName);
+  EXPECT_EQ(ReturnCode::Ok, getAcl.get().rc);
+  EXPECT_EQ(1, (int)getAcl.get().acl.size());
+
+  boost::ptr_vector<Op> ops;
+  for (int i = 0; i < numChildren; i++) {
+    ops.push_back(new Op::Remove(str(boost::format("%s/child%d") %
+                                     znodeName % i), -1));
+  }
+  ops.push_back(new Op::Remove(znodeName, 1));
+  Future<MultiResult> multi = zk.multi(ops);
+  EXPECT_EQ(ReturnCode::Ok, multi.get().rc);
+  EXPECT_EQ(numChildren + 1, (int)multi.get().results.size());
+  EXPECT_EQ(ReturnCode::NoNode, zk.exists(znodeName).get().rc);
+}
+
 TEST(CppClient, testAcl) {
   ZooKeeper zk;
   data::Stat stat;
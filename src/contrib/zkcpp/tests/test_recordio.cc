@@ -118,3 +118,83 @@ TEST(TestRecordIo, testConnectResponse) {
   res2.deserialize(iarchive, "something else?");
   EXPECT_TRUE(res1 == res2);
 }
+
+static void makeGetChildren2Response(proto::GetChildren2Response& res) {
+  res.getchildren().push_back("child");
+  res.getchildren().push_back("");
+  res.getchildren().push_back(std::string(1000, 'x'));
+  res.getstat().setczxid(0x123456789abcdefLL);
+  res.getstat().setmzxid(-2);
+  res.getstat().setctime(3);
+  res.getstat().setmtime(4);
+  res.getstat().setversion(-5);
+  res.getstat().setcversion(6);
+  res.getstat().setaversion(7);
+  res.getstat().setephemeralOwner(8);
+  res.getstat().setdataLength(9);
+  res.getstat().setnumChildren(3);
+  res.getstat().setpzxid(10);
+}
+
+TEST(TestRecordIo, testDirectBinArchive) {
+  proto::GetChildren2Response res1, res2, res3, res4;
+  makeGetChildren2Response(res1);
+  makeGetChildren2Response(res2);
+
+  // The direct archives use the same encoding as the others.
+  std::string serialized, directSerialized;
+  StringOutStream stream(serialized);
+  hadoop::OBinArchive oarchive(stream);
+  res1.serialize(oarchive, "mytag");
+  StringOutStream directStream(directSerialized);
+  hadoop::ODirectBinArchive<StringOutStream> directOarchive(directStream);
+  res2.serialize(directOarchive, "mytag");
+  EXPECT_EQ(serialized, directSerialized);
+
+  MemoryInStream istream(serialized.data(), serialized.size());
+  hadoop::IDirectBinArchive<MemoryInStream> iarchive(istream);
+  res3.deserialize(iarchive, "mytag");
+  EXPECT_TRUE(res1 == res3);
+  EXPECT_EQ(0x123456789abcdefLL, res3.getstat().getczxid());
+  EXPECT_EQ(-2, res3.getstat().getmzxid());
+  EXPECT_EQ(-5, res3.getstat().getversion());
+
+  MemoryInStream istream2(serialized.data(), serialized.size());
+  hadoop::IBinArchive iarchive2(istream2);
+  res4.deserialize(iarchive2, "mytag");
+  EXPECT_TRUE(res1 == res4);
+}
+
+// The archives throw the IOExceptions they allocate.
+template <typename Archive>
+static bool deserializeFails(hadoop::Record& record,
+                             const std::string& serialized) {
+  MemoryInStream istream(serialized.data(), serialized.size());
+  Archive iarchive(istream);
+  try {
+    record.deserialize(iarchive, "mytag");
+  } catch (hadoop::IOException* e) {
+    delete e;
+    return true;
+  }
+  return false;
+}
+
+TEST(TestRecordIo, testTruncated) {
+  proto::GetChildren2Response res1;
+  makeGetChildren2Response(res1);
+  std::string serialized;
+  StringOutStream stream(serialized);
+  hadoop::OBinArchive oarchive(stream);
+  res1.serialize(oarchive, "mytag");
+
+  // Cut off in the middle of a string, of an int and of a long.
+  size_t lengths[] = { 10, serialized.size() - 34, serialized.size() - 1 };
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    std::string truncated = serialized.substr(0, lengths[i]);
+    proto::GetChildren2Response res2, res3;
+    EXPECT_TRUE(deserializeFails<hadoop::IBinArchive>(res2, truncated));
+    EXPECT_TRUE(deserializeFails<
+        hadoop::IDirectBinArchive<MemoryInStream> >(res3, truncated));
+  }
+}